@@ -0,0 +1,1875 @@
+//---------------------------------------------------------------------------
+//
+// Headless benchmarks
+//
+//----------------------------------------------------------------------------
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+#include "comp308.hpp"
+#include "bench.hpp"
+#include "bvh.hpp"
+#include "dualContouring.hpp"
+#include "marchingCubes.hpp"
+#include "mcTable.hpp"
+#include "meshCache.hpp"
+#include "octreeMesher.hpp"
+#include "perlin.hpp"
+#include "school.hpp"
+#include "schoolRules.hpp"
+#include "separation.hpp"
+#include "simplex.hpp"
+#include "simplify.hpp"
+#include "streamTerrain.hpp"
+#include "surfaceNets.hpp"
+#include "terrain.hpp"
+#include "threadPool.hpp"
+
+#ifdef __linux__
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+using namespace std;
+using namespace comp308;
+
+namespace {
+
+	// Best of a few runs, in seconds
+	double timeBest(int repeats, const function<void()> &fn) {
+		double best = 1e30;
+		for (int r = 0; r < repeats; ++r) {
+			auto start = chrono::steady_clock::now();
+			fn();
+			best = min(best, chrono::duration<double>(chrono::steady_clock::now() - start).count());
+		}
+		return best;
+	}
+
+	// FNV-1a over raw bytes, to compare large outputs without keeping copies
+	unsigned long long hashBytes(const void *data, size_t bytes) {
+		const unsigned char *c = static_cast<const unsigned char *>(data);
+		unsigned long long h = 14695981039346656037ull;
+		for (size_t i = 0; i < bytes; ++i) {
+			h = (h ^ c[i]) * 1099511628211ull;
+		}
+		return h;
+	}
+
+	// Distance from p to triangle abc in double precision, the nearest of
+	// the corners, the nearest points on the edges and the projection onto
+	// the face if it falls inside. For checking faster answers.
+	double triangleDistance(vec3 p, vec3 a, vec3 b, vec3 c) {
+		struct Point {
+			double x, y, z;
+			Point(vec3 v) : x(v.x), y(v.y), z(v.z) { }
+			Point(double _x, double _y, double _z) : x(_x), y(_y), z(_z) { }
+			Point operator-(const Point &o) const { return Point(x - o.x, y - o.y, z - o.z); }
+			Point operator+(const Point &o) const { return Point(x + o.x, y + o.y, z + o.z); }
+			Point operator*(double f) const { return Point(x * f, y * f, z * f); }
+			double dot(const Point &o) const { return x * o.x + y * o.y + z * o.z; }
+		};
+		Point q(p), corners[3] = { Point(a), Point(b), Point(c) };
+		double best = 1e300;
+		for (int e = 0; e < 3; ++e) {
+			Point from = corners[e], edge = corners[(e + 1) % 3] - from;
+			double ee = edge.dot(edge);
+			double f = (ee > 0) ? max(0.0, min(1.0, (q - from).dot(edge) / ee)) : 0;
+			Point to = from + edge * f - q;
+			best = min(best, to.dot(to));
+		}
+		Point ab = corners[1] - corners[0], ac = corners[2] - corners[0], ap = q - corners[0];
+		double d00 = ab.dot(ab), d01 = ab.dot(ac), d11 = ac.dot(ac);
+		double d20 = ap.dot(ab), d21 = ap.dot(ac), den = d00 * d11 - d01 * d01;
+		if (den > 0) {
+			double v = (d11 * d20 - d01 * d21) / den, w = (d00 * d21 - d01 * d20) / den;
+			if (v >= 0 && w >= 0 && v + w <= 1) {
+				Point to = corners[0] + ab * v + ac * w - q;
+				best = min(best, to.dot(to));
+			}
+		}
+		return sqrt(best);
+	}
+
+	vector<int> sizeArgs(int argc, char **argv, vector<int> defaults) {
+		vector<int> sizes;
+		for (int a = 1; a < argc; ++a) sizes.push_back(atoi(argv[a]));
+		return sizes.empty() ? defaults : sizes;
+	}
+
+	// 1, 2, 4, ... up to and including the number of cores
+	vector<unsigned> threadCounts() {
+		unsigned cores = max(1u, thread::hardware_concurrency());
+		vector<unsigned> counts;
+		for (unsigned t = 1; t < cores; t *= 2) counts.push_back(t);
+		counts.push_back(cores);
+		return counts;
+	}
+
+	float maxDifference(const vector<Fish> &a, const vector<Fish> &b) {
+		float diff = 0;
+		for (size_t i = 0; i < a.size(); ++i) {
+			diff = max(diff, length(a[i].getPosition() - b[i].getPosition()));
+		}
+		return diff;
+	}
+
+	template <typename Rules>
+	void benchRuleSet(const char *name, const vector<Fish> &start, int steps, double tunedSeconds) {
+		double seconds = timeBest(3, [&] {
+			Rules rules(start);
+			for (int s = 0; s < steps; ++s) rules.moveAllFishToNewPositions();
+		});
+		cout << "  " << left << setw(24) << name << right << setw(10) << seconds * 1000 / steps
+		     << " ms/step  " << setw(6) << tunedSeconds / seconds << "x" << endl;
+	}
+
+	/*
+		School's runtime weighted rules against compile time rule sets
+	*/
+	int benchRules(int argc, char **argv) {
+		int steps = (argc > 1) ? atoi(argv[1]) : 100;
+
+		for (int fishAmount : {300, 1000}) {
+			SchoolParams params;
+			params.fishAmount = fishAmount;
+			// schools with the same seed start out identical
+			const vector<Fish> start = School(params, 1).getFish();
+
+			vector<Fish> tunedEnd;
+			double tunedSeconds = timeBest(3, [&] {
+				School tuned(params, 1);
+				for (int s = 0; s < steps; ++s) tuned.moveAllFishToNewPositions();
+				tunedEnd = tuned.getFish();
+			});
+
+			// the default set must follow the same trajectory as School
+			DefaultRules check(start);
+			for (int s = 0; s < steps; ++s) check.moveAllFishToNewPositions();
+
+			cout << fishAmount << " fish, " << steps << " steps" << endl;
+			cout << "  " << left << setw(24) << "School (TunedRules)" << right << setw(10)
+			     << tunedSeconds * 1000 / steps << " ms/step" << endl;
+			benchRuleSet<DefaultRules>("DefaultRules", start, steps, tunedSeconds);
+			benchRuleSet<RuleSchool<Cohesion<1000>, Alignment<8>, SpeedLimit<ratio<1, 2>>>>(
+				"cohesion + alignment", start, steps, tunedSeconds);
+			benchRuleSet<RuleSchool<Separation<50>, BoundPosition<ratio<1, 20>>, SpeedLimit<ratio<1, 2>>>>(
+				"separation + bounds", start, steps, tunedSeconds);
+			cout << "  max position difference, DefaultRules vs School: "
+			     << maxDifference(tunedEnd, check.getFish()) << endl;
+		}
+		return EXIT_SUCCESS;
+	}
+
+	/*
+		Naive rule 2 loop against the tiled symmetric kernel
+	*/
+	int benchSeparation(int, char **) {
+		for (int fishAmount : {300, 1000, 4000}) {
+			// let the schools settle for a while so plenty of pairs are in range
+			SchoolParams params;
+			params.fishAmount = fishAmount;
+			School naive(params, 1);
+			params.blockedSeparation = true;
+			School blocked(params, 1);
+			for (int s = 0; s < 200; ++s) naive.moveAllFishToNewPositions();
+			for (int s = 0; s < 200; ++s) blocked.moveAllFishToNewPositions();
+
+			vector<vec3> positions;
+			for (const Fish &f : naive.getFish()) positions.push_back(f.getPosition());
+
+			int repeats = max(1, 4000 / fishAmount);
+			vector<vec3> naiveOut, blockedOut;
+			double naiveSeconds = timeBest(repeats, [&] { naive.separationAll(naiveOut); });
+			double blockedSeconds = timeBest(repeats, [&] {
+				separationBlocked(positions, params.separationDistance, params.separation, blockedOut);
+			});
+
+			int mismatches = 0;
+			int pushed = 0;
+			for (size_t i = 0; i < naiveOut.size(); ++i) {
+				const vec3 &a = naiveOut[i];
+				const vec3 &b = blockedOut[i];
+				if (a.x != b.x || a.y != b.y || a.z != b.z) mismatches++;
+				if (length(a) > 0) pushed++;
+			}
+
+			cout << setw(5) << fishAmount << " fish: naive " << setw(9) << naiveSeconds * 1000 << " ms, blocked "
+			     << setw(9) << blockedSeconds * 1000 << " ms, " << setw(6) << naiveSeconds / blockedSeconds << "x, "
+			     << pushed << " fish pushed, " << mismatches << " mismatches" << endl;
+		}
+		return EXIT_SUCCESS;
+	}
+
+	/*
+		Density sampling throughput against thread count
+	*/
+	int benchDensity(int argc, char **argv) {
+		for (int n : sizeArgs(argc, argv, {64, 128, 256})) {
+			TerrainSettings settings;
+			settings.nX = settings.nY = settings.nZ = n;
+			settings.density.seed = 1;
+			double samples = double(n + 1) * (n + 1) * (n + 1);
+			size_t bytes = size_t(samples) * sizeof(vec4);
+
+			unsigned long long serialHash = 0;
+			double serialSeconds = 0;
+			for (unsigned threads : threadCounts()) {
+				settings.threads = threads;
+				unsigned long long hash = 0;
+				double seconds = timeBest(1, [&] {
+					Terrain terrain(settings, false);
+					hash = hashBytes(terrain.getGridPoints(), bytes);
+				});
+				if (threads == 1) {
+					serialHash = hash;
+					serialSeconds = seconds;
+				}
+				cout << setw(4) << n << "^3, " << setw(2) << threads << " threads: " << setw(12)
+				     << samples / seconds << " samples/s  " << setw(6) << serialSeconds / seconds << "x  "
+				     << (hash == serialHash ? "identical" : "DIFFERENT") << "  grid " << hex << hash << dec << endl;
+			}
+		}
+		return EXIT_SUCCESS;
+	}
+
+	// Distance in units in the last place between two floats of the same sign
+	long long ulpDistance(float a, float b) {
+		int ia, ib;
+		memcpy(&ia, &a, sizeof(float));
+		memcpy(&ib, &b, sizeof(float));
+		if (ia < 0) ia = int(0x80000000u - unsigned(ia));
+		if (ib < 0) ib = int(0x80000000u - unsigned(ib));
+		return llabs((long long)ia - ib);
+	}
+
+	/*
+		Scalar Perlin calls against the batch interface
+	*/
+	int benchNoise(int argc, char **argv) {
+		size_t n = (argc > 1) ? size_t(atol(argv[1])) : 1 << 20;
+		Perlin perlin(1);
+		mt19937 rng(2);
+		uniform_real_distribution<float> coord(-200, 200);
+		vector<float> x(n), y(n), z(n), scalar(n), batch(n);
+		for (size_t i = 0; i < n; ++i) {
+			x[i] = coord(rng);
+			y[i] = coord(rng);
+			z[i] = coord(rng);
+		}
+
+		double scalarSeconds = timeBest(3, [&] {
+			for (size_t i = 0; i < n; ++i) scalar[i] = perlin.noise(x[i], y[i], z[i]);
+		});
+		double batchSeconds = timeBest(3, [&] {
+			perlin.noise(x.data(), y.data(), z.data(), batch.data(), n);
+		});
+
+		long long worst = 0;
+		for (size_t i = 0; i < n; ++i) worst = max(worst, ulpDistance(scalar[i], batch[i]));
+
+		cout << n << " points: scalar " << setw(12) << n / scalarSeconds << " samples/s, batch " << setw(12)
+		     << n / batchSeconds << " samples/s, " << setw(6) << scalarSeconds / batchSeconds << "x, max "
+		     << worst << " ulp apart" << endl;
+		return EXIT_SUCCESS;
+	}
+
+	/*
+		A new Perlin for every sample (what density generation used to do)
+		against one long-lived noise context
+	*/
+	int benchContext(int argc, char **argv) {
+		for (int n : sizeArgs(argc, argv, {40, 64})) {
+			TerrainSettings settings;
+			settings.nX = settings.nY = settings.nZ = n;
+			settings.density.seed = 1;
+			settings.threads = 1;
+			const vector<Perlin::Octave> &octaves = settings.density.octaves;
+			const float step = 400.0f / n;
+			double samples = double(n + 1) * (n + 1) * (n + 1);
+
+			auto everySample = [&](const function<float(float, float, float)> &density) {
+				float sum = 0;
+				for (int i = 0; i <= n; ++i)
+					for (int j = 0; j <= n; ++j)
+						for (int k = 0; k <= n; ++k)
+							sum += density(-200 + i * step, -200 + j * step, -200 + k * step);
+				return sum;
+			};
+
+			float perSampleSum = 0, sharedSum = 0;
+			double perSample = timeBest(1, [&] {
+				perSampleSum = everySample([&](float x, float y, float z) {
+					Perlin p(settings.density.seed);
+					return p.fbm(x, y, z, octaves.data(), octaves.size());
+				});
+			});
+			Perlin context(settings.density.seed);
+			double shared = timeBest(1, [&] {
+				sharedSum = everySample([&](float x, float y, float z) {
+					return context.fbm(x, y, z, octaves.data(), octaves.size());
+				});
+			});
+			double terrain = timeBest(1, [&] { Terrain t(settings, false); });
+
+			cout << setw(4) << n << "^3: new Perlin per sample " << setw(9) << perSample * 1000 << " ms, shared context "
+			     << setw(8) << shared * 1000 << " ms (" << setw(5) << perSample / shared << "x), terrain grid "
+			     << setw(8) << terrain * 1000 << " ms (" << setw(5) << perSample / terrain << "x), "
+			     << (perSample - terrain) / samples * 1e9 << " ns saved per sample"
+			     << (perSampleSum == sharedSum ? "" : ", RESULTS DIFFER") << endl;
+		}
+		return EXIT_SUCCESS;
+	}
+
+	/*
+		Marching cubes triangle soup against the indexed mesher
+	*/
+	int benchMesh(int argc, char **argv) {
+		for (int n : sizeArgs(argc, argv, {40, 64, 128})) {
+			TerrainSettings settings;
+			settings.nX = settings.nY = settings.nZ = n;
+			settings.density.seed = 1;
+			Terrain terrain(settings, false);
+			vec4 *points = const_cast<vec4 *>(terrain.getGridPoints());
+
+			int numTriangles = 0;
+			TRIANGLE *soup = nullptr;
+			double soupSeconds = timeBest(3, [&] {
+				delete [] soup;
+				soup = MarchingCubesLinear(n, n, n, terrain.getIsoValue(), points, numTriangles);
+			});
+			MCMesh mesh;
+			double indexedSeconds = timeBest(3, [&] {
+				MarchingCubesIndexed(n, n, n, terrain.getIsoValue(), points, mesh);
+			});
+
+			// the same triangles, up to the direction each edge was interpolated in
+			size_t triangles = mesh.indices.size() / 3;
+			float diff = (triangles == size_t(numTriangles)) ? 0 : INFINITY;
+			for (size_t t = 0; t < triangles && t < size_t(numTriangles); ++t) {
+				for (int c = 0; c < 3; ++c) {
+					diff = max(diff, length(mesh.vertices[mesh.indices[3*t + c]] - soup[t].p[c]));
+				}
+			}
+			delete [] soup;
+
+			// soup: the TRIANGLE array plus Terrain's copy into points and triangles,
+			// uploaded as three positions and normals per triangle
+			double soupBytes = double(triangles) * (sizeof(TRIANGLE) + 3 * sizeof(vec3) + sizeof(triangle));
+			double soupUpload = double(triangles) * 3 * 2 * sizeof(vec3);
+			double indexedBytes = double(mesh.vertices.size()) * sizeof(vec3) + double(mesh.indices.size()) * sizeof(unsigned int);
+			double indexedUpload = double(mesh.vertices.size()) * 2 * sizeof(vec3) + double(mesh.indices.size()) * sizeof(unsigned int);
+
+			cout << setw(4) << n << "^3: " << triangles << " triangles, " << 3 * triangles << " soup vertices -> "
+			     << mesh.vertices.size() << " shared (" << setprecision(3) << 3.0 * triangles / mesh.vertices.size()
+			     << "x)" << endl;
+			cout << "  soup    " << setw(8) << soupSeconds * 1000 << " ms, " << setw(8) << soupBytes / 1048576
+			     << " MB in memory, " << setw(8) << soupUpload / 1048576 << " MB upload" << endl;
+			cout << "  indexed " << setw(8) << indexedSeconds * 1000 << " ms, " << setw(8) << indexedBytes / 1048576
+			     << " MB in memory, " << setw(8) << indexedUpload / 1048576 << " MB upload ("
+			     << soupUpload / indexedUpload << "x smaller), max vertex difference " << diff << endl;
+			cout << setprecision(6);
+		}
+		return EXIT_SUCCESS;
+	}
+
+	// The tolerance search Geometry::createNormals used to do, kept for comparison
+	vector<vec3> legacyNormals(const vector<vec3> &points, const vector<triangle> &triangles) {
+		vector<vec3> faceNormals;
+		vector<vector<int>> touching(points.size());
+		for (size_t i = 0; i < triangles.size(); ++i) {
+			vec3 vector1 = points[triangles[i].v[1].p] - points[triangles[i].v[0].p];
+			vec3 vector2 = points[triangles[i].v[2].p] - points[triangles[i].v[1].p];
+			faceNormals.push_back(normalize(cross(vector1, vector2)));
+			for (int j = 0; j < 3; ++j) {
+				const vec3 &p = points[triangles[i].v[j].p];
+				for (size_t k = 0; k < points.size(); ++k) {
+					if (0.01 > abs(p.x - points[k].x) && 0.01 > abs(p.y - points[k].y) && 0.01 > abs(p.z - points[k].z)) {
+						touching[k].push_back(int(i));
+					}
+				}
+			}
+		}
+		vector<vec3> normals(points.size(), vec3(0));
+		for (size_t k = 0; k < points.size(); ++k) {
+			vec3 norm = vec3(0);
+			for (int t : touching[k]) norm = norm + faceNormals[t];
+			if (!touching[k].empty()) normals[k] = normalize(norm);
+		}
+		return normals;
+	}
+
+	/*
+		Smooth normals for the terrain's triangle soup, tolerance search
+		against the spatial hash weld. The search is only run on small grids.
+	*/
+	int benchNormals(int argc, char **argv) {
+		for (int n : sizeArgs(argc, argv, {24, 40, 128})) {
+			TerrainSettings settings;
+			settings.nX = settings.nY = settings.nZ = n;
+			settings.density.seed = 1;
+			Terrain terrain(settings, false);
+
+			// the soup as Terrain used to hand it to Geometry
+			int numTriangles = 0;
+			TRIANGLE *soup = MarchingCubesLinear(n, n, n, terrain.getIsoValue(),
+				const_cast<vec4 *>(terrain.getGridPoints()), numTriangles);
+			vector<vec3> points;
+			vector<triangle> triangles(numTriangles);
+			for (int i = 0; i < numTriangles; ++i) {
+				for (int j = 0; j < 3; ++j) {
+					triangles[i].v[j].p = int(points.size());
+					points.push_back(soup[i].p[j]);
+				}
+			}
+			delete [] soup;
+
+			vector<vec3> welded;
+			double weldSeconds = timeBest(3, [&] {
+				welded = smoothNormals(points, triangles, NormalWeighting::Uniform, true);
+			});
+			cout << setw(4) << n << "^3, " << setw(7) << points.size() << " points: weld " << setw(9)
+			     << weldSeconds * 1000 << " ms";
+
+			if (n <= 48) {
+				vector<vec3> legacy;
+				double legacySeconds = timeBest(1, [&] { legacy = legacyNormals(points, triangles); });
+				int mismatches = 0, nan = 0;
+				for (size_t i = 0; i < points.size(); ++i) {
+					if (legacy[i].x != legacy[i].x) nan++;
+					else if (legacy[i].x != welded[i].x || legacy[i].y != welded[i].y || legacy[i].z != welded[i].z) mismatches++;
+				}
+				cout << ", search " << setw(9) << legacySeconds * 1000 << " ms (" << setw(7)
+				     << legacySeconds / weldSeconds << "x), " << mismatches << " normals differ, " << nan
+				     << " were NaN before";
+			}
+			cout << endl;
+
+			for (NormalWeighting w : {NormalWeighting::Area, NormalWeighting::Angle}) {
+				double seconds = timeBest(3, [&] { smoothNormals(points, triangles, w, true); });
+				cout << "      " << (w == NormalWeighting::Area ? "area " : "angle") << " weighted " << setw(9)
+				     << seconds * 1000 << " ms" << endl;
+			}
+		}
+		return EXIT_SUCCESS;
+	}
+
+	/*
+		Streaming chunk generation: time per chunk, and the shared face of
+		two neighbouring chunks must have identical vertices and normals
+	*/
+	int benchStream(int argc, char **argv) {
+		StreamSettings settings;
+		settings.density.seed = 1;
+		if (argc > 1) settings.chunkCells = atoi(argv[1]);
+		DensityField density(settings.density);
+
+		const int side = 4;
+		vector<ChunkMesh> chunks;
+		double seconds = timeBest(1, [&] {
+			chunks.clear();
+			for (int cx = 0; cx < side; ++cx)
+				for (int cz = 0; cz < side; ++cz)
+					chunks.push_back(generateChunk(density, settings, cx, cz));
+		});
+
+		size_t bytes = 0, triangles = 0;
+		double facing = 0;
+		for (const ChunkMesh &c : chunks) {
+			bytes += c.bytes();
+			triangles += c.indices.size() / 3;
+			// gradient normals should agree in direction with the triangle winding
+			for (size_t t = 0; t < c.indices.size(); t += 3) {
+				const vec3 &a = c.vertices[c.indices[t]], &b = c.vertices[c.indices[t+1]], &d = c.vertices[c.indices[t+2]];
+				vec3 face = cross(b - a, d - b);
+				if (length(face) > 0) facing += dot(normalize(face), c.normals[c.indices[t]]);
+			}
+		}
+
+		// chunk (0, 0) against (1, 0) along the plane x = chunkSize
+		auto onFace = [&](const ChunkMesh &c) {
+			vector<pair<vec3, vec3>> found;
+			for (size_t i = 0; i < c.vertices.size(); ++i) {
+				if (c.vertices[i].x == settings.chunkSize) found.push_back({c.vertices[i], c.normals[i]});
+			}
+			sort(found.begin(), found.end(), [](const pair<vec3, vec3> &a, const pair<vec3, vec3> &b) {
+				return make_tuple(a.first.y, a.first.z) < make_tuple(b.first.y, b.first.z);
+			});
+			return found;
+		};
+		vector<pair<vec3, vec3>> left = onFace(chunks[0]), right = onFace(chunks[side]);
+		int mismatches = (left.size() == right.size()) ? 0 : -1;
+		for (size_t i = 0; mismatches >= 0 && i < left.size(); ++i) {
+			const vec3 &p = left[i].first, &q = right[i].first, &n = left[i].second, &m = right[i].second;
+			if (p.x != q.x || p.y != q.y || p.z != q.z || n.x != m.x || n.y != m.y || n.z != m.z) mismatches++;
+		}
+
+		cout << side * side << " chunks of " << settings.chunkCells << "x" << settings.cellsY << "x" << settings.chunkCells
+		     << " cells: " << seconds * 1000 / chunks.size() << " ms per chunk, " << triangles / chunks.size()
+		     << " triangles and " << bytes / chunks.size() / 1024 << " KB per chunk" << endl;
+		cout << "  normals facing the same way as the triangles: " << (facing > 0 ? "yes" : "NO") << endl;
+		cout << "  shared face: " << left.size() << " vertices, "
+		     << (mismatches < 0 ? string("different counts") : to_string(mismatches) + " differ") << endl;
+		return EXIT_SUCCESS;
+	}
+
+	/*
+		Serial against block parallel indexed marching cubes
+	*/
+	int benchMarching(int argc, char **argv) {
+		for (int n : sizeArgs(argc, argv, {128, 256})) {
+			TerrainSettings settings;
+			settings.nX = settings.nY = settings.nZ = n;
+			settings.density.seed = 1;
+			Terrain terrain(settings, false);
+
+			MCMesh serial;
+			double serialSeconds = timeBest(3, [&] {
+				MarchingCubesIndexed(n, n, n, terrain.getIsoValue(), terrain.getGridPoints(), serial);
+			});
+			double cells = double(n) * n * n;
+			cout << setw(4) << n << "^3, " << serial.indices.size() / 3 << " triangles" << endl;
+			cout << "  serial      " << setw(9) << serialSeconds * 1000 << " ms " << setw(12) << cells / serialSeconds
+			     << " cells/s" << endl;
+
+			// more threads than cores still checks the blocks join up the same
+			vector<unsigned> counts = threadCounts();
+			if (counts.back() < 4) counts.push_back(4);
+			for (unsigned threads : counts) {
+				ThreadPool pool(threads);
+				MCMesh parallel;
+				double seconds = timeBest(3, [&] {
+					MarchingCubesIndexed(n, n, n, terrain.getIsoValue(), terrain.getGridPoints(), parallel, &pool);
+				});
+				bool same = parallel.vertices.size() == serial.vertices.size() && parallel.indices == serial.indices
+					&& hashBytes(parallel.vertices.data(), parallel.vertices.size() * sizeof(vec3))
+					== hashBytes(serial.vertices.data(), serial.vertices.size() * sizeof(vec3));
+				cout << "  " << setw(2) << threads << " threads  " << setw(9) << seconds * 1000 << " ms " << setw(12)
+				     << cells / seconds << " cells/s " << setw(6) << serialSeconds / seconds << "x  "
+				     << (same ? "identical" : "DIFFERENT") << endl;
+			}
+		}
+		return EXIT_SUCCESS;
+	}
+
+	// The soup marching cubes as it was before it counted first: room for
+	// three triangles per cell, then a copy into an array of the right size
+	TRIANGLE *overAllocatedSoup(int nX, int nY, int nZ, float minValue, const vec4 *points, int &numTriangles) {
+		TRIANGLE *triangles = new TRIANGLE[3*nX*nY*nZ];
+		numTriangles = 0;
+		int YtimeZ = (nY+1)*(nZ+1);
+		for (int i = 0; i < nX; i++) {
+			for (int j = 0; j < nY; j++) {
+				for (int k = 0; k < nZ; k++) {
+					int ind = i*YtimeZ + j*(nZ+1) + k;
+					vec4 verts[8] = { points[ind], points[ind + YtimeZ], points[ind + YtimeZ + 1], points[ind + 1],
+						points[ind + (nZ+1)], points[ind + YtimeZ + (nZ+1)], points[ind + YtimeZ + (nZ+1) + 1],
+						points[ind + (nZ+1) + 1] };
+					int cubeIndex = 0;
+					for (int c = 0; c < 8; c++) {
+						if (verts[c].w <= minValue) cubeIndex |= 1 << c;
+					}
+					if (!edgeTable[cubeIndex]) continue;
+
+					static const int ends[12][2] = { {0,1}, {1,2}, {2,3}, {3,0}, {4,5}, {5,6}, {6,7}, {7,4},
+						{0,4}, {1,5}, {2,6}, {3,7} };
+					vec3 intVerts[12];
+					for (int e = 0; e < 12; e++) {
+						if (edgeTable[cubeIndex] & (1 << e)) intVerts[e] = LinearInterp(verts[ends[e][0]], verts[ends[e][1]], minValue);
+					}
+					for (int n = 0; triTable[cubeIndex][n] != -1; n += 3) {
+						TRIANGLE &t = triangles[numTriangles++];
+						t.p[0] = intVerts[triTable[cubeIndex][n+2]];
+						t.p[1] = intVerts[triTable[cubeIndex][n+1]];
+						t.p[2] = intVerts[triTable[cubeIndex][n]];
+						t.norm = normalize(cross(t.p[1] - t.p[0], t.p[2] - t.p[0]));
+					}
+				}
+			}
+		}
+		TRIANGLE *retTriangles = new TRIANGLE[numTriangles];
+		for (int i = 0; i < numTriangles; i++) retTriangles[i] = triangles[i];
+		delete [] triangles;
+		return retTriangles;
+	}
+
+	// Bytes the resident set grows by in a fresh process running
+	// --bench peak phase n, which starts with its own heap and thread pool.
+	// -1 when that is not possible here
+	long long peakMemory(const string &phase, int n) {
+#ifdef __linux__
+		// all built before the fork, the child only execs
+		string size = to_string(n);
+		const char *args[] = { "p2", "--bench", "peak", phase.c_str(), size.c_str(), nullptr };
+		int fds[2];
+		if (pipe(fds) != 0) return -1;
+		pid_t child = fork();
+		if (child < 0) {
+			close(fds[0]);
+			close(fds[1]);
+			return -1;
+		}
+		if (child == 0) {
+			dup2(fds[1], STDOUT_FILENO);
+			close(fds[0]);
+			close(fds[1]);
+			execv("/proc/self/exe", const_cast<char **>(args));
+			_exit(127);
+		}
+		close(fds[1]);
+		string output;
+		char buffer[256];
+		ssize_t got;
+		while ((got = read(fds[0], buffer, sizeof(buffer))) > 0) output.append(buffer, size_t(got));
+		close(fds[0]);
+		int status = 0;
+		waitpid(child, &status, 0);
+		if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) return -1;
+		// the peak is the last line, after anything the phase printed
+		istringstream lines(output);
+		string line, last;
+		while (getline(lines, line)) {
+			if (!line.empty()) last = line;
+		}
+		return last.empty() ? -1 : atoll(last.c_str());
+#else
+		(void) phase;
+		(void) n;
+		return -1;
+#endif
+	}
+
+	// Bytes for printing, n/a when not known
+	string megabytes(long long bytes) {
+		ostringstream text;
+		if (bytes < 0) text << "n/a";
+		else text << fixed << setprecision(1) << bytes / 1048576.0 << " MB";
+		return text.str();
+	}
+
+	/*
+		Over-allocated soup marching cubes against count then emit
+	*/
+	int benchSoup(int argc, char **argv) {
+		for (int n : sizeArgs(argc, argv, {128, 192})) {
+			TerrainSettings settings;
+			settings.nX = settings.nY = settings.nZ = n;
+			settings.density.seed = 1;
+			Terrain terrain(settings, false);
+			vec4 *points = const_cast<vec4 *>(terrain.getGridPoints());
+			float iso = terrain.getIsoValue();
+
+			int oldCount = 0, newCount = 0;
+			unsigned long long oldHash = 0, newHash = 0;
+			double oldSeconds = timeBest(3, [&] {
+				TRIANGLE *t = overAllocatedSoup(n, n, n, iso, points, oldCount);
+				oldHash = hashBytes(t, oldCount * sizeof(TRIANGLE));
+				delete [] t;
+			});
+			double newSeconds = timeBest(3, [&] {
+				TRIANGLE *t = MarchingCubesLinear(n, n, n, iso, points, newCount);
+				newHash = hashBytes(t, newCount * sizeof(TRIANGLE));
+				delete [] t;
+			});
+			long long oldPeak = peakMemory("soup-old", n), newPeak = peakMemory("soup-new", n);
+
+			cout << setw(4) << n << "^3, " << newCount << " triangles ("
+			     << megabytes((long long) newCount * sizeof(TRIANGLE)) << ")" << endl;
+			cout << "  over-allocate + copy " << setw(9) << oldSeconds * 1000 << " ms   peak " << megabytes(oldPeak) << endl;
+			cout << "  count then emit      " << setw(9) << newSeconds * 1000 << " ms   peak " << megabytes(newPeak)
+			     << "   " << oldSeconds / newSeconds << "x  "
+			     << ((oldCount == newCount && oldHash == newHash) ? "identical" : "DIFFERENT") << endl;
+		}
+		return EXIT_SUCCESS;
+	}
+
+	/*
+		Generating a terrain mesh against reading it back from the mesh cache.
+		Headless, so the upload itself is left out: it is the same bytes either
+		way, and on a hit they go to the GPU straight from the mapping.
+	*/
+	int benchCache(int argc, char **argv) {
+		const string directory = "work/cache";
+		for (int n : sizeArgs(argc, argv, {40, 96})) {
+			TerrainSettings settings;
+			settings.nX = settings.nY = settings.nZ = n;
+			settings.density.seed = 1;
+			unsigned long long key = CacheKey().add(n).add(settings.density.seed).add("bench", 5).value();
+			size_t nodes = size_t(n+1) * (n+1) * (n+1);
+
+			// everything a miss does before the upload
+			vector<float> grid;
+			MCMesh mesh;
+			double coldSeconds;
+			try {
+				coldSeconds = timeBest(1, [&] {
+					Terrain terrain(settings, false);
+					mesh = MCMesh();
+					MarchingCubesIndexed(n, n, n, terrain.getIsoValue(), terrain.getGridPoints(), mesh, &ThreadPool::global(),
+						&terrain.getSurfaceBlocks());
+					grid.resize(nodes);
+					for (size_t i = 0; i < nodes; ++i) grid[i] = terrain.getGridPoints()[i].w;
+					writeMeshCache(directory, key, terrain.getGridPoints(), nodes, mesh.vertices, mesh.normals, mesh.indices);
+				});
+			} catch (const runtime_error &e) {
+				// with no file there is no hit to time
+				cerr << e.what() << endl;
+				return EXIT_FAILURE;
+			}
+
+			// a hit: map, check and rebuild the grid Terrain keeps
+			double warmSeconds = timeBest(5, [&] {
+				MeshCacheFile file(meshCachePath(directory, key), key);
+				vector<vec4> points(file.nodeCount());
+				for (size_t i = 0; i < points.size(); ++i) points[i] = vec4(0, 0, 0, file.densities()[i]);
+			});
+
+			MeshCacheFile file(meshCachePath(directory, key), key);
+			bool same = file.valid() && file.vertexCount() == mesh.vertices.size() && file.indexCount() == mesh.indices.size()
+				&& memcmp(file.indices(), mesh.indices.data(), mesh.indices.size() * sizeof(unsigned int)) == 0
+				&& memcmp(file.densities(), grid.data(), nodes * sizeof(float)) == 0;
+			for (size_t i = 0; same && i < mesh.vertices.size(); ++i) {
+				same = memcmp(&file.vertices()[2*i], &mesh.vertices[i], sizeof(vec3)) == 0
+					&& memcmp(&file.vertices()[2*i + 1], &mesh.normals[i], sizeof(vec3)) == 0;
+			}
+			remove(meshCachePath(directory, key).c_str());
+
+			double bytes = sizeof(float) * nodes + 2 * sizeof(vec3) * mesh.vertices.size() + sizeof(unsigned int) * mesh.indices.size();
+			cout << setw(4) << n << "^3, " << mesh.indices.size() / 3 << " triangles, " << setprecision(3)
+			     << bytes / 1048576 << " MB cached" << endl;
+			cout << "  generate + write " << setw(9) << coldSeconds * 1000 << " ms" << endl;
+			cout << "  cache hit        " << setw(9) << warmSeconds * 1000 << " ms " << setw(8)
+			     << coldSeconds / warmSeconds << "x  " << (same ? "identical" : "DIFFERENT") << endl;
+			cout << setprecision(6);
+		}
+		return EXIT_SUCCESS;
+	}
+
+	// Edges used by one triangle only, other than along the sides of the box
+	size_t openEdges(const vector<vec3> &vertices, const vector<unsigned int> &indices, vec3 low, vec3 high) {
+		map<pair<unsigned int, unsigned int>, int> uses;
+		for (size_t t = 0; t < indices.size(); t += 3) {
+			for (int j = 0; j < 3; ++j) {
+				unsigned int a = indices[t + j], b = indices[t + (j+1) % 3];
+				uses[{ min(a, b), max(a, b) }]++;
+			}
+		}
+		auto onSide = [&](const vec3 &p, const vec3 &q) {
+			return (p.x == low.x && q.x == low.x) || (p.x == high.x && q.x == high.x) || (p.y == low.y && q.y == low.y)
+				|| (p.y == high.y && q.y == high.y) || (p.z == low.z && q.z == low.z) || (p.z == high.z && q.z == high.z);
+		};
+		size_t open = 0;
+		for (auto &e : uses) {
+			if (e.second == 1 && !onSide(vertices[e.first.first], vertices[e.first.second])) open++;
+		}
+		return open;
+	}
+
+	// How far triangle centres are off the real surface, as an angle seen
+	// from the camera: density over its gradient is the distance to the
+	// surface. Mean and worst of a spread out subset of the triangles.
+	pair<double, double> screenError(const DensityField &density, const vector<vec3> &vertices,
+		const vector<unsigned int> &indices, vec3 camera) {
+		size_t triangles = indices.size() / 3, stride = max<size_t>(1, triangles / 20000);
+		vector<size_t> picked;
+		for (size_t t = 0; t < triangles; t += stride) picked.push_back(t);
+		vector<double> errors(picked.size());
+		ThreadPool::global().parallelFor(int(picked.size()), [&](int i) {
+			size_t t = 3 * picked[i];
+			vec3 c = (vertices[indices[t]] + vertices[indices[t+1]] + vertices[indices[t+2]]) / 3.0f;
+			float g = length(density.gradient(c, 0.05f));
+			errors[i] = (g > 0) ? fabs(density.at(c)) / g / max(1.0f, length(c - camera)) : 0;
+		});
+		double sum = 0, worst = 0;
+		for (double e : errors) {
+			sum += e;
+			worst = max(worst, e);
+		}
+		return { errors.empty() ? 0 : sum / errors.size(), worst };
+	}
+
+	/*
+		Uniform grids against the adaptive octree, for the default camera and
+		one down near the seabed. The octree is set against the coarsest
+		uniform grid whose mean error is no worse, the one that looks as good.
+	*/
+	int benchOctree(int argc, char **argv) {
+		OctreeSettings octree;
+		if (argc > 1) octree.maxDepth = atoi(argv[1]);
+		if (argc > 2) octree.screenError = float(atof(argv[2]));
+		const int finest = 1 << octree.maxDepth;
+		const vec3 low = TerrainSettings().minBound, high = TerrainSettings().maxBound;
+		DensitySettings densitySettings;
+		densitySettings.seed = 1;
+		DensityField density(densitySettings);
+
+		// the uniform meshes do not depend on the camera
+		vector<tuple<string, double, MCMesh>> uniform;
+		vector<int> sizes;
+		for (int n : {40, 48, 64, 80, 96, 128, 192, 256}) {
+			if (n < finest) sizes.push_back(n);
+		}
+		sizes.push_back(finest);
+		for (int n : sizes) {
+			MCMesh mesh;
+			vector<vec3> normals;
+			double seconds = timeBest(1, [&] {
+				vector<vec4> points(size_t(n+1) * (n+1) * (n+1));
+				vec3 step = (high - low) / float(n);
+				const int first[3] = { 0, 0, 0 };
+				density.sampleGrid(low, step, first, n, n, n, points.data(), &ThreadPool::global());
+				mesh = MCMesh();
+				MarchingCubesIndexed(n, n, n, 0.0f, points.data(), mesh, &ThreadPool::global());
+				normals.resize(mesh.vertices.size());
+				ThreadPool::global().parallelFor(int(mesh.vertices.size()), [&](int i) {
+					normals[i] = -normalize(density.gradient(mesh.vertices[i], 0.5f * step.x));
+				});
+			});
+			uniform.emplace_back("uniform " + to_string(n) + "^3", seconds, move(mesh));
+		}
+
+		cout << "finest cells " << (high.x - low.x) / finest << " units, screen error " << octree.screenError << endl;
+		for (vec3 camera : { vec3(0, 0, 170), vec3(0, -10, 0) }) {
+			auto report = [&](const string &name, double seconds, const vector<vec3> &vertices, const vector<unsigned int> &indices) {
+				pair<double, double> error = screenError(density, vertices, indices, camera);
+				cout << "  " << left << setw(14) << name << right << setw(9) << seconds * 1000 << " ms " << setw(8)
+				     << indices.size() / 3 << " triangles  error mean " << setw(10) << error.first << " worst " << setw(10)
+				     << error.second << "  open edges " << openEdges(vertices, indices, low, high) << endl;
+				return error.first;
+			};
+
+			cout << "camera at (" << camera.x << ", " << camera.y << ", " << camera.z << ")" << endl;
+			vector<double> uniformError;
+			for (auto &u : uniform) uniformError.push_back(report(get<0>(u), get<1>(u), get<2>(u).vertices, get<2>(u).indices));
+
+			OctreeMesh mesh;
+			double seconds = timeBest(1, [&] {
+				mesh = meshOctree(density, low, high, 0.0f, camera, octree, &ThreadPool::global());
+			});
+			double octreeError = report("octree", seconds, mesh.vertices, mesh.indices);
+			size_t matched = 0;
+			while (matched + 1 < uniform.size() && uniformError[matched] > octreeError) matched++;
+			const MCMesh &match = get<2>(uniform[matched]);
+			cout << "    as good on average as " << get<0>(uniform[matched])
+			     << (uniformError[matched] > octreeError ? " (the finest, still worse)" : "") << ": "
+			     << setprecision(3) << double(mesh.indices.size()) / max<size_t>(1, match.indices.size())
+			     << "x its triangles in " << seconds / get<1>(uniform[matched]) << "x its time" << setprecision(6) << endl;
+			cout << "    leaves with surface by size:";
+			for (int d = 0; d <= octree.maxDepth; ++d) {
+				if (mesh.leavesPerDepth[d]) cout << " " << (high.x - low.x) / (1 << d) << ":" << mesh.leavesPerDepth[d];
+			}
+			cout << endl << "    " << mesh.samples << " density samples, " << mesh.seamTriangles << " seam triangles, "
+			     << mesh.openSeams << " seams left open" << endl;
+		}
+		return EXIT_SUCCESS;
+	}
+
+	/*
+		Sampling and meshing the whole grid against skipping the blocks the
+		density's bounds rule out. The meshes must come out the same, and the
+		skipped nodes must still be rock or water like the full grid says.
+	*/
+	int benchSkip(int argc, char **argv) {
+		const vec3 low = TerrainSettings().minBound, high = TerrainSettings().maxBound;
+		const int first[3] = { 0, 0, 0 };
+		DensitySettings densitySettings;
+		densitySettings.seed = 1;
+		DensityField density(densitySettings);
+
+		for (int n : sizeArgs(argc, argv, {40, 128, 256})) {
+			vec3 step = (high - low) / float(n);
+			vector<vec4> full(size_t(n+1) * (n+1) * (n+1)), skipped(full.size());
+			MCMesh fullMesh;
+			double fullSeconds = timeBest(1, [&] {
+				density.sampleGrid(low, step, first, n, n, n, full.data(), &ThreadPool::global());
+				fullMesh = MCMesh();
+				MarchingCubesIndexed(n, n, n, 0.0f, full.data(), fullMesh, &ThreadPool::global());
+			});
+			cout << setw(4) << n << "^3, " << fullMesh.indices.size() / 3 << " triangles" << endl;
+			cout << "  every block    " << setw(9) << fullSeconds * 1000 << " ms" << endl;
+
+			for (int size : {4, 8, 16}) {
+				if (size > n) continue;
+				SurfaceBlocks blocks;
+				MCMesh mesh;
+				double seconds = timeBest(1, [&] {
+					blocks = density.surfaceBlocks(low, step, first, n, n, n, size, 0.0f);
+					density.sampleGrid(low, step, first, n, n, n, skipped.data(), &ThreadPool::global(), &blocks);
+					mesh = MCMesh();
+					MarchingCubesIndexed(n, n, n, 0.0f, skipped.data(), mesh, &ThreadPool::global(), &blocks);
+				});
+
+				size_t flipped = 0;
+				for (size_t i = 0; i < full.size(); ++i) {
+					if ((full[i].w <= 0) != (skipped[i].w <= 0)) flipped++;
+				}
+				bool same = mesh.indices == fullMesh.indices && mesh.vertices.size() == fullMesh.vertices.size()
+					&& memcmp(mesh.vertices.data(), fullMesh.vertices.data(), mesh.vertices.size() * sizeof(vec3)) == 0;
+				cout << "  blocks of " << setw(2) << size << "^3 " << setw(9) << seconds * 1000 << " ms " << setw(8)
+				     << fullSeconds / seconds << "x  " << blocks.skipped() << "/" << blocks.active.size() << " blocks ("
+				     << setprecision(3) << 100.0 * blocks.skipped() / blocks.active.size() << "%) skipped  "
+				     << setprecision(6) << ((same && !flipped) ? "identical" : "DIFFERENT") << endl;
+			}
+		}
+		return EXIT_SUCCESS;
+	}
+
+	/*
+		Normals from the grid's density gradient, made by the mesher, against
+		the face normal pass Terrain used to run after it. Both are compared
+		with the density gradient at every vertex.
+	*/
+	int benchGradient(int argc, char **argv) {
+		for (int n : sizeArgs(argc, argv, {24, 40, 128})) {
+			TerrainSettings settings;
+			settings.nX = settings.nY = settings.nZ = n;
+			settings.density.seed = 1;
+			Terrain terrain(settings, false);
+			const DensityField &density = terrain.getDensity();
+
+			MCMesh mesh;
+			double meshSeconds = timeBest(3, [&] {
+				mesh = MCMesh();
+				MarchingCubesIndexed(n, n, n, terrain.getIsoValue(), terrain.getGridPoints(), mesh, &ThreadPool::global(),
+					&terrain.getSurfaceBlocks());
+			});
+			vector<triangle> triangles(mesh.indices.size() / 3);
+			for (size_t t = 0; t < triangles.size(); ++t) {
+				for (int j = 0; j < 3; ++j) triangles[t].v[j].p = triangles[t].v[j].n = mesh.indices[3*t + j];
+			}
+			vector<vec3> faceNormals;
+			double faceSeconds = timeBest(3, [&] {
+				faceNormals = smoothNormals(mesh.vertices, triangles, NormalWeighting::Uniform, false);
+			});
+
+			// mean angle to the normal of the density smoothed to the grid's
+			// own scale, finer detail than that is not in the mesh. In degrees
+			const float h = (settings.maxBound.x - settings.minBound.x) / n;
+			auto angleError = [&](const vector<vec3> &normals) {
+				double sum = 0;
+				for (size_t i = 0; i < mesh.vertices.size(); ++i) {
+					vec3 exact = -normalize(density.gradient(mesh.vertices[i], h));
+					sum += acos(max(-1.0f, min(1.0f, dot(exact, normals[i]))));
+				}
+				return sum / max<size_t>(1, mesh.vertices.size()) * 180 / 3.14159265358979;
+			};
+
+			cout << setw(4) << n << "^3, " << setw(7) << mesh.vertices.size() << " vertices" << endl;
+			cout << "  mesher with gradient normals " << setw(9) << meshSeconds * 1000 << " ms, "
+			     << setprecision(3) << angleError(mesh.normals) << " degrees off" << endl;
+			cout << "  face normal pass after it    " << setw(9) << setprecision(6) << faceSeconds * 1000 << " ms, "
+			     << setprecision(3) << angleError(faceNormals) << " degrees off" << setprecision(6) << endl;
+		}
+		return EXIT_SUCCESS;
+	}
+
+	/*
+		Brush strokes across the seabed of a large grid, each remeshing only
+		the blocks it reaches, against meshing the whole grid again. Headless,
+		so what would go to the GPU is counted rather than sent. The blocks
+		are checked against a full remesh of the sculpted grid at the end.
+	*/
+	int benchSculpt(int argc, char **argv) {
+		int n = (argc > 1) ? atoi(argv[1]) : 256;
+		int strokes = (argc > 2) ? atoi(argv[2]) : 40;
+		TerrainSettings settings;
+		settings.nX = settings.nY = settings.nZ = n;
+		settings.density.seed = 1;
+		Terrain terrain(settings, false);
+
+		MCMesh full;
+		double fullSeconds = timeBest(1, [&] {
+			full = MCMesh();
+			MarchingCubesIndexed(n, n, n, terrain.getIsoValue(), terrain.getGridPoints(), full, &ThreadPool::global(),
+				&terrain.getSurfaceBlocks());
+		});
+		size_t fullBytes = full.vertices.size() * 2 * sizeof(vec3) + full.indices.size() * sizeof(unsigned int);
+
+		// the first stroke makes the blocks
+		vec3 hit;
+		double firstSeconds = timeBest(1, [&] {
+			if (terrain.raycast(vec3(0, 150, 0), vec3(0, -1, 0), hit)) terrain.sculpt(hit, 12.0f, -8.0f);
+		});
+
+		// then carve then fill along a line, a stroke every 4 units
+		vector<double> times;
+		size_t bytes = 0, worstBytes = 0;
+		int misses = 0;
+		for (int s = 0; s < strokes; ++s) {
+			float x = -80.0f + 4.0f * s;
+			if (!terrain.raycast(vec3(x, 150, 0.3f * x), vec3(0.1f, -1, 0), hit)) {
+				misses++;
+				continue;
+			}
+			times.push_back(timeBest(1, [&] { terrain.sculpt(hit, 12.0f, (s % 2) ? 8.0f : -8.0f); }));
+			size_t stroke = terrain.getSculptMesh()->changedBytes();
+			bytes += stroke;
+			worstBytes = max(worstBytes, stroke);
+		}
+		sort(times.begin(), times.end());
+
+		MCMesh after;
+		MarchingCubesIndexed(n, n, n, terrain.getIsoValue(), terrain.getGridPoints(), after, &ThreadPool::global(),
+			&terrain.getSurfaceBlocks());
+		bool same = after.indices.size() / 3 == terrain.getSculptMesh()->triangleCount();
+
+		cout << n << "^3, " << full.indices.size() / 3 << " triangles, brush radius 12" << endl;
+		cout << "  full remesh   " << setw(9) << fullSeconds * 1000 << " ms, " << fullBytes / 1024 << " KB to upload" << endl;
+		cout << "  first stroke  " << setw(9) << firstSeconds * 1000 << " ms (makes the blocks)" << endl;
+		if (!times.empty()) {
+			cout << "  stroke median " << setw(9) << times[times.size() / 2] * 1000 << " ms, worst " << times.back() * 1000
+			     << " ms, " << setw(8) << fullSeconds / times[times.size() / 2] << "x" << endl;
+			cout << "  upload per stroke " << bytes / times.size() / 1024 << " KB average, "
+			     << worstBytes / 1024 << " KB worst" << endl;
+		}
+		cout << "  " << misses << " strokes missed, blocks " << (same ? "match" : "DO NOT match") << " a full remesh" << endl;
+		return EXIT_SUCCESS;
+	}
+
+	/*
+		Builds the BVH over marching cubes terrain of each size and over the
+		sand.obj seabed, then traces rays from a camera above the surface one
+		at a time and in packets, random rays through the box, and closest
+		point queries from points scattered through it. A sample of each is
+		checked against testing every triangle.
+	*/
+	int benchBvh(int argc, char **argv) {
+		struct Mesh {
+			string name;
+			vector<vec3> points;
+			vector<unsigned int> indices;
+		};
+		vector<Mesh> meshes;
+		for (int n : sizeArgs(argc, argv, { 40, 128, 256 })) {
+			TerrainSettings settings;
+			settings.nX = settings.nY = settings.nZ = n;
+			settings.density.seed = 1;
+			Terrain terrain(settings, false);
+			MCMesh mesh;
+			MarchingCubesIndexed(n, n, n, terrain.getIsoValue(), terrain.getGridPoints(), mesh, &ThreadPool::global(),
+				&terrain.getSurfaceBlocks());
+			meshes.push_back({ to_string(n) + "^3", move(mesh.vertices), move(mesh.indices) });
+		}
+		{
+			Geometry sand("work/res/assets/sand.obj", false);
+			Mesh mesh{ "sand.obj", sand.getPoints(), {} };
+			for (const triangle &tri : sand.getTriangles()) {
+				for (int j = 0; j < 3; ++j) mesh.indices.push_back(unsigned(tri.v[j].p));
+			}
+			meshes.push_back(move(mesh));
+		}
+
+		const int width = 512, height = 512;
+		const size_t rayCount = size_t(width) * height;
+		const size_t pointCount = 100000;
+		for (const Mesh &mesh : meshes) {
+			size_t triangles = mesh.indices.size() / 3;
+			unique_ptr<Bvh> bvh;
+			double buildSeconds = timeBest(3, [&] { bvh.reset(new Bvh(mesh.points, mesh.indices)); });
+			vec3 low = bvh->minBound(), high = bvh->maxBound();
+			vec3 centre = (low + high) * 0.5f, extent = high - low;
+
+			// camera above and to the side looking at the middle, a 60 degree
+			// view traced in 4 by 2 tiles so packets hold neighbouring pixels
+			vec3 eye = centre + vec3(0, 0.5f * extent.y + 0.25f * extent.x, 0.6f * extent.z);
+			vec3 forward = normalize(centre - eye);
+			vec3 side = normalize(cross(forward, vec3(0, 1, 0)));
+			vec3 up = cross(side, forward);
+			float scale = tan(30.0f * 3.14159265f / 180);
+			vector<Ray> camera;
+			camera.reserve(rayCount);
+			for (int ty = 0; ty < height; ty += 2) {
+				for (int tx = 0; tx < width; tx += 4) {
+					for (int y = ty; y < ty + 2; ++y) {
+						for (int x = tx; x < tx + 4; ++x) {
+							float sx = (2 * (x + 0.5f) / width - 1) * scale, sy = (1 - 2 * (y + 0.5f) / height) * scale;
+							Ray ray;
+							ray.origin = eye;
+							ray.direction = normalize(forward + side * sx + up * sy);
+							camera.push_back(ray);
+						}
+					}
+				}
+			}
+			mt19937 rng(3);
+			uniform_real_distribution<float> unit(0, 1), signedUnit(-1, 1);
+			auto inside = [&] {
+				return low + vec3(unit(rng) * extent.x, unit(rng) * extent.y, unit(rng) * extent.z);
+			};
+			vector<Ray> scattered(rayCount);
+			for (Ray &ray : scattered) {
+				ray.origin = inside();
+				ray.direction = normalize(vec3(signedUnit(rng), signedUnit(rng), signedUnit(rng)) + vec3(0, 0, 1e-6f));
+			}
+			vector<vec3> queries(pointCount), nearby(pointCount);
+			for (vec3 &q : queries) q = centre + (inside() - centre) * 1.2f;
+			// within a couple of units of the surface, as for things moving over it
+			uniform_int_distribution<size_t> anyIndex(0, mesh.indices.size() - 1);
+			for (vec3 &q : nearby) {
+				q = mesh.points[mesh.indices[anyIndex(rng)]] + vec3(signedUnit(rng), signedUnit(rng), signedUnit(rng)) * 2.0f;
+			}
+
+			// hits of the camera rays are kept for the check below
+			vector<RayHit> single(rayCount), packets(rayCount), scatteredHits(rayCount);
+			auto trace = [&](const vector<Ray> &rays, vector<RayHit> &hits, double &oneSeconds, double &packetSeconds) {
+				oneSeconds = timeBest(3, [&] {
+					for (size_t r = 0; r < rays.size(); ++r) bvh->intersect(rays[r], hits[r]);
+				});
+				packetSeconds = timeBest(3, [&] { bvh->intersect(rays.data(), packets.data(), rays.size()); });
+				size_t hitCount = 0, differ = 0;
+				for (size_t r = 0; r < rays.size(); ++r) {
+					hitCount += hits[r].hit();
+					// a ray through an edge may name either triangle, and
+					// boxes tested in another order may round another way
+					differ += fabs(hits[r].t - packets[r].t) > 1e-5f * (1 + hits[r].t);
+				}
+				return make_pair(hitCount, differ);
+			};
+			double cameraOne, cameraPacket, randomOne, randomPacket;
+			pair<size_t, size_t> cameraHits = trace(camera, single, cameraOne, cameraPacket);
+			pair<size_t, size_t> randomHits = trace(scattered, scatteredHits, randomOne, randomPacket);
+
+			vector<SurfacePoint> closest(pointCount);
+			double closestSeconds = timeBest(3, [&] {
+				for (size_t q = 0; q < pointCount; ++q) bvh->closestPoint(queries[q], closest[q]);
+			});
+			SurfacePoint near;
+			double nearbySeconds = timeBest(3, [&] {
+				for (size_t q = 0; q < pointCount; ++q) bvh->closestPoint(nearby[q], near);
+			});
+
+			// every triangle against a few rays and points
+			size_t wrong = 0;
+			const int checks = 64;
+			for (int c = 0; c < checks; ++c) {
+				size_t r = size_t(c) * (rayCount / checks) + rayCount / (2 * checks);
+				const Ray &ray = camera[r];
+				float bestT = ray.tMax;
+				vec3 q = queries[size_t(c) * (pointCount / checks)];
+				double best = 1e30;
+				for (size_t t = 0; t < triangles; ++t) {
+					vec3 a = mesh.points[mesh.indices[3*t]], b = mesh.points[mesh.indices[3*t + 1]];
+					vec3 d = mesh.points[mesh.indices[3*t + 2]];
+					vec3 ab = b - a, ad = d - a, p = cross(ray.direction, ad);
+					float det = dot(ab, p);
+					if (det != 0) {
+						vec3 s = ray.origin - a, k = cross(s, ab);
+						float u = dot(s, p) / det, v = dot(ray.direction, k) / det, hitT = dot(ad, k) / det;
+						if (u >= 0 && v >= 0 && u + v <= 1 && hitT >= 0) bestT = min(bestT, hitT);
+					}
+					best = min(best, triangleDistance(q, a, b, d));
+				}
+				float tolerance = 1e-3f * (1 + bestT);
+				bool bothMiss = bestT >= ray.tMax && !single[r].hit();
+				if (!bothMiss && fabs(bestT - single[r].t) > tolerance) wrong++;
+				const SurfacePoint &found = closest[size_t(c) * (pointCount / checks)];
+				if (fabs(best - found.distance) > 1e-3 * (1 + best)) wrong++;
+			}
+
+			cout << mesh.name << ", " << triangles << " triangles" << endl;
+			cout << "  build          " << setw(9) << buildSeconds * 1000 << " ms, " << setw(6)
+			     << triangles / buildSeconds / 1e6 << " Mtris/s, " << bvh->nodeCount() << " nodes, depth "
+			     << bvh->depth() << endl;
+			cout << "  camera rays    " << setw(9) << rayCount / cameraOne / 1e6 << " Mrays/s one at a time, "
+			     << setw(9) << rayCount / cameraPacket / 1e6 << " in packets, " << cameraHits.first << " hits" << endl;
+			cout << "  random rays    " << setw(9) << rayCount / randomOne / 1e6 << " Mrays/s one at a time, "
+			     << setw(9) << rayCount / randomPacket / 1e6 << " in packets, " << randomHits.first << " hits" << endl;
+			cout << "  closest point  " << setw(9) << pointCount / closestSeconds / 1e6 << " Mqueries/s anywhere in the box, "
+			     << setw(9) << pointCount / nearbySeconds / 1e6 << " near the surface" << endl;
+			cout << "  packets " << ((cameraHits.second + randomHits.second) ? "DIFFER from" : "match")
+			     << " single rays, " << wrong << " of " << 2 * checks << " checks against every triangle wrong" << endl;
+		}
+		return EXIT_SUCCESS;
+	}
+
+	/*
+		Simplifies marching cubes terrain of each size and the sand.obj
+		seabed to fractions of their triangles, to error bounds, and into a
+		chain of levels of detail. The distance between the surfaces is
+		measured both ways at the points of each, with a BVH over the other:
+		from the simplified points to the original stays near the bound,
+		back from the original can be further where specks smaller than the
+		bound were collapsed away. The boundary edges are checked to come
+		through unchanged.
+	*/
+	int benchSimplify(int argc, char **argv) {
+		struct Mesh {
+			string name;
+			vector<vec3> points;
+			vector<unsigned int> indices;
+		};
+		vector<Mesh> meshes;
+		for (int n : sizeArgs(argc, argv, { 128, 256 })) {
+			TerrainSettings settings;
+			settings.nX = settings.nY = settings.nZ = n;
+			settings.density.seed = 1;
+			Terrain terrain(settings, false);
+			MCMesh mesh;
+			MarchingCubesIndexed(n, n, n, terrain.getIsoValue(), terrain.getGridPoints(), mesh, &ThreadPool::global(),
+				&terrain.getSurfaceBlocks());
+			meshes.push_back({ to_string(n) + "^3", move(mesh.vertices), move(mesh.indices) });
+		}
+		{
+			Geometry sand("work/res/assets/sand.obj", false);
+			Mesh mesh{ "sand.obj", sand.getPoints(), {} };
+			for (const triangle &tri : sand.getTriangles()) {
+				for (int j = 0; j < 3; ++j) mesh.indices.push_back(unsigned(tri.v[j].p));
+			}
+			meshes.push_back(move(mesh));
+		}
+
+		// edges with one triangle, as pairs of corner positions in order
+		auto boundary = [](const vector<vec3> &points, const vector<unsigned int> &indices) {
+			vector<array<float, 6>> edges;
+			for (size_t t = 0; t + 2 < indices.size(); t += 3) {
+				for (int j = 0; j < 3; ++j) {
+					vec3 a = points[indices[t + j]], b = points[indices[t + (j + 1) % 3]];
+					if (make_tuple(b.x, b.y, b.z) < make_tuple(a.x, a.y, a.z)) swap(a, b);
+					edges.push_back({ { a.x, a.y, a.z, b.x, b.y, b.z } });
+				}
+			}
+			sort(edges.begin(), edges.end());
+			vector<array<float, 6>> single;
+			for (size_t i = 0; i < edges.size(); ) {
+				size_t run = i;
+				while (run < edges.size() && edges[run] == edges[i]) ++run;
+				if (run - i == 1) single.push_back(edges[i]);
+				i = run;
+			}
+			return single;
+		};
+		// largest and mean distance from the corners of the triangles of one
+		// mesh to the other
+		auto distances = [](const vector<vec3> &points, const vector<unsigned int> &indices, const Bvh &to,
+			float &largest, float &mean) {
+			vector<char> used(points.size(), 0);
+			for (unsigned int i : indices) used[i] = 1;
+			double sum = 0;
+			size_t count = 0;
+			largest = 0;
+			SurfacePoint closest;
+			for (size_t i = 0; i < points.size(); ++i) {
+				if (!used[i]) continue;
+				to.closestPoint(points[i], closest);
+				largest = max(largest, closest.distance);
+				sum += closest.distance;
+				count++;
+			}
+			mean = float(sum / max<size_t>(1, count));
+		};
+
+		for (const Mesh &mesh : meshes) {
+			size_t triangles = mesh.indices.size() / 3;
+			Bvh original(mesh.points, mesh.indices);
+			vector<array<float, 6>> edges = boundary(mesh.points, mesh.indices);
+			cout << mesh.name << ", " << triangles << " triangles, " << edges.size() << " boundary edges" << endl;
+
+			auto report = [&](const string &label, const SimplifySettings &settings) {
+				SimplifiedMesh simplified;
+				double seconds = timeBest(1, [&] { simplified = simplifyMesh(mesh.points, mesh.indices, settings); });
+				Bvh after(simplified.points, simplified.indices);
+				float outLargest, outMean, backLargest, backMean;
+				distances(simplified.points, simplified.indices, original, outLargest, outMean);
+				distances(mesh.points, mesh.indices, after, backLargest, backMean);
+				bool kept = boundary(simplified.points, simplified.indices) == edges;
+				cout << "  " << left << setw(10) << label << right << setw(8) << simplified.indices.size() / 3
+				     << " triangles " << setw(8) << seconds * 1000 << " ms, " << setw(8)
+				     << triangles / seconds / 1e6 << " Mtris/s, bound " << setw(8) << simplified.error
+				     << ", off the original " << setw(8) << outLargest << " max " << setw(8) << outMean
+				     << " mean, back " << setw(8) << backLargest << " max " << setw(8) << backMean << " mean, boundary "
+				     << (kept ? "kept" : "CHANGED") << endl;
+			};
+			for (float fraction : { 0.5f, 0.25f, 0.1f }) {
+				SimplifySettings settings;
+				settings.targetTriangles = size_t(triangles * fraction);
+				report(to_string(int(fraction * 100)) + "%", settings);
+			}
+			for (float bound : { 0.25f, 1.0f }) {
+				SimplifySettings settings;
+				settings.maxError = bound;
+				ostringstream label;
+				label << "error " << bound;
+				report(label.str(), settings);
+			}
+
+			vector<SimplifiedMesh> levels;
+			double levelSeconds = timeBest(1, [&] { levels = simplifyLevels(mesh.points, mesh.indices, 4, 0.5f); });
+			cout << "  4 levels of half the triangles each in " << levelSeconds * 1000 << " ms:";
+			for (const SimplifiedMesh &level : levels) cout << " " << level.indices.size() / 3;
+			cout << endl;
+		}
+		return EXIT_SUCCESS;
+	}
+
+	// The phases of making a seabed terrain, shared by the timings of
+	// benchGenerate and the memory of benchPeak
+	TerrainSettings seabedSettings(int n) {
+		TerrainSettings settings;
+		settings.nX = settings.nY = settings.nZ = n;
+		settings.density.seed = 1;
+		return settings;
+	}
+
+	void seabedMesh(const Terrain &terrain, MCMesh &mesh) {
+		int n = terrain.getCellsX();
+		MarchingCubesIndexed(n, n, n, terrain.getIsoValue(), terrain.getGridPoints(), mesh, &ThreadPool::global(),
+			&terrain.getSurfaceBlocks());
+	}
+
+	void gradientNormals(const Terrain &terrain, const MCMesh &mesh, vector<vec3> &normals) {
+		const float h = (terrain.getMaxBound().x - terrain.getMinBound().x) / terrain.getCellsX();
+		normals.resize(mesh.vertices.size());
+		ThreadPool::global().parallelFor(int(mesh.vertices.size()), [&](int i) {
+			vec3 g = terrain.getDensity().gradient(mesh.vertices[i], h);
+			normals[i] = (length(g) > 0) ? -normalize(g) : vec3(0, 1, 0);
+		});
+	}
+
+	// what Geometry keeps of the triangles, and the buffer it sends
+	void uploadBuffers(const MCMesh &mesh, vector<triangle> &triangles, vector<vec3> &interleaved) {
+		triangles.resize(mesh.indices.size() / 3);
+		for (size_t t = 0; t < triangles.size(); ++t) {
+			for (int j = 0; j < 3; ++j) triangles[t].v[j].p = triangles[t].v[j].n = mesh.indices[3*t + j];
+		}
+		interleaved.clear();
+		interleaved.reserve(2 * mesh.vertices.size());
+		for (size_t i = 0; i < mesh.vertices.size(); ++i) {
+			interleaved.push_back(mesh.vertices[i]);
+			interleaved.push_back(mesh.normals[i]);
+		}
+	}
+
+	/*
+		A terrain made at each resolution phase by phase, as Terrain makes it:
+		the density grid, marching cubes, normals and the upload. Memory is
+		what a phase adds at its peak on top of what the phases before it
+		left, each in a fresh process with its own thread pool. The mesher takes normals from the grid as it goes, so theirs are
+		in its time; the normals line is the density gradient a simplified
+		mesh gets them from instead. Headless, so the upload is building the
+		buffers Geometry hands to OpenGL, and the bytes that would go.
+	*/
+	int benchGenerate(int argc, char **argv) {
+		for (int n : sizeArgs(argc, argv, {64, 128, 192})) {
+			TerrainSettings settings = seabedSettings(n);
+			const int repeats = (n <= 128) ? 3 : 1;
+
+			unique_ptr<Terrain> terrain;
+			double densitySeconds = timeBest(repeats, [&] {
+				terrain.reset();
+				terrain.reset(new Terrain(settings, false));
+			});
+
+			MCMesh mesh;
+			double meshSeconds = timeBest(repeats, [&] {
+				mesh = MCMesh();
+				seabedMesh(*terrain, mesh);
+			});
+
+			vector<vec3> normals;
+			double normalSeconds = timeBest(repeats, [&] { gradientNormals(*terrain, mesh, normals); });
+
+			vector<triangle> triangles;
+			vector<vec3> interleaved;
+			double uploadSeconds = timeBest(repeats, [&] { uploadBuffers(mesh, triangles, interleaved); });
+			long long uploadBytes = (long long) (interleaved.size() * sizeof(vec3) + mesh.indices.size() * sizeof(unsigned int));
+
+			double total = densitySeconds + meshSeconds + uploadSeconds;
+			cout << setw(4) << n << "^3, " << mesh.indices.size() / 3 << " triangles, " << setw(9) << total * 1000
+			     << " ms from density to upload" << endl;
+			cout << "  density  " << setw(9) << densitySeconds * 1000 << " ms   peak "
+			     << megabytes(peakMemory("density", n)) << endl;
+			cout << "  meshing  " << setw(9) << meshSeconds * 1000 << " ms   peak "
+			     << megabytes(peakMemory("mesh", n)) << endl;
+			cout << "  normals  " << setw(9) << normalSeconds * 1000 << " ms   peak "
+			     << megabytes(peakMemory("normals", n)) << "   (density gradient, already in meshing)" << endl;
+			cout << "  upload   " << setw(9) << uploadSeconds * 1000 << " ms   peak "
+			     << megabytes(peakMemory("upload", n)) << "   " << megabytes(uploadBytes) << " to send" << endl;
+		}
+		return EXIT_SUCCESS;
+	}
+
+	// Bytes the resident set grows by while fn runs, from the high water
+	// mark reset just before. -1 when it cannot be reset
+	long long residentGrowth(const function<void()> &fn) {
+#ifdef __linux__
+		auto statusKB = [](const char *field) {
+			ifstream status("/proc/self/status");
+			string line;
+			while (getline(status, line)) {
+				if (line.compare(0, strlen(field), field) == 0) return atoll(line.c_str() + strlen(field));
+			}
+			return -1ll;
+		};
+		// hand memory freed by the setup back, or fn just reuses it
+#ifdef __GLIBC__
+		malloc_trim(0);
+#endif
+		{
+			ofstream clear("/proc/self/clear_refs");
+			clear << "5" << flush;
+			if (!clear) return -1;
+		}
+		long long before = statusKB("VmRSS:");
+		fn();
+		return (statusKB("VmHWM:") - before) * 1024;
+#else
+		(void) fn;
+		return -1;
+#endif
+	}
+
+	/*
+		One phase of benchGenerate or benchSoup, for peakMemory to run in a
+		process of its own. Prints the bytes it took last.
+	*/
+	int benchPeak(int argc, char **argv) {
+		if (argc < 3) {
+			cerr << "Usage: --bench peak density|mesh|normals|upload|soup-old|soup-new <size>" << endl;
+			return EXIT_FAILURE;
+		}
+		const string phase = argv[1];
+		const int n = atoi(argv[2]);
+
+		// everything the phase starts from
+		unique_ptr<Terrain> terrain;
+		MCMesh mesh;
+		if (phase != "density") terrain.reset(new Terrain(seabedSettings(n), false));
+		if (phase == "normals" || phase == "upload") seabedMesh(*terrain, mesh);
+		const vec4 *points = terrain ? terrain->getGridPoints() : nullptr;
+		const float iso = terrain ? terrain->getIsoValue() : 0.0f;
+
+		function<void()> fn;
+		if (phase == "density") fn = [&] { Terrain t(seabedSettings(n), false); };
+		else if (phase == "mesh") fn = [&] { MCMesh m; seabedMesh(*terrain, m); };
+		else if (phase == "normals") fn = [&] { vector<vec3> normals; gradientNormals(*terrain, mesh, normals); };
+		else if (phase == "upload") fn = [&] { vector<triangle> t; vector<vec3> i; uploadBuffers(mesh, t, i); };
+		else if (phase == "soup-old") fn = [&] { int count; delete [] overAllocatedSoup(n, n, n, iso, points, count); };
+		else if (phase == "soup-new") {
+			fn = [&] { int count; delete [] MarchingCubesLinear(n, n, n, iso, const_cast<vec4 *>(points), count); };
+		} else {
+			cerr << "Unknown phase " << phase << endl;
+			return EXIT_FAILURE;
+		}
+		cout << residentGrowth(fn) << endl;
+		return EXIT_SUCCESS;
+	}
+
+	// The seabed as it was written by hand before it was an expression
+	void legacySeabedRow(const Perlin &noise, const DensitySettings &settings, float x, float y, const float *zs,
+		float *out, int n) {
+		auto inWall = [&](float z) {
+			bool xWall = (x < -160 && x > -210) || (x > 160 && x < 210);
+			return (z < -160 && z > -210) || (z > 160 && z < 210) || (xWall && z < 190 && z > -190);
+		};
+		vector<float> xs(n, x), ys(n, y), wallNoise(n, 0.0f);
+		noise.fbm(xs.data(), ys.data(), zs, out, n, settings.octaves.data(), settings.octaves.size());
+		vector<int> walled;
+		vector<float> wallZ;
+		for (int k = 0; k < n; k++) {
+			if (inWall(zs[k])) {
+				walled.push_back(k);
+				wallZ.push_back(zs[k]);
+			}
+		}
+		if (!walled.empty()) {
+			vector<float> values(walled.size());
+			noise.fbm(xs.data(), ys.data(), wallZ.data(), values.data(), walled.size(), &settings.wallOctave, 1);
+			for (size_t w = 0; w < walled.size(); w++) wallNoise[walled[w]] = values[w];
+		}
+		for (int k = 0; k < n; k++) {
+			float z = zs[k];
+			float density = -y;
+			density += out[k] - 25.0003;
+			if (z < -160 && z > -210) density += -(z + 160) + wallNoise[k];
+			if (z > 160 && z < 210) density += (z - 160) + wallNoise[k];
+			if (x < -160 && x > -210 && z < 190 && z > -190) density += -(x + 160) + wallNoise[k];
+			if (x > 160 && x < 210 && z < 190 && z > -190) density += (x - 160) + wallNoise[k];
+			out[k] = density;
+		}
+	}
+
+	/*
+		The compiled seabed expression against the hand written function it
+		replaced, row by row over the whole grid, and the blocks each lets
+		sampling skip
+	*/
+	int benchProgram(int argc, char **argv) {
+		DensitySettings settings;
+		settings.seed = 1;
+		DensityField density(settings);
+		Perlin noise(1);
+		cout << density.program().instructionCount() << " instructions, " << density.program().noiseCount()
+		     << " octaves sampled a point" << endl;
+
+		for (int n : sizeArgs(argc, argv, {128, 256})) {
+			TerrainSettings terrain;
+			const vec3 low = terrain.minBound, step = (terrain.maxBound - terrain.minBound) / float(n);
+			vector<float> zs(n + 1), legacy(size_t(n + 1) * (n + 1) * (n + 1)), compiled(legacy.size());
+			for (int k = 0; k <= n; ++k) zs[k] = low.z + k * step.z;
+			auto sweep = [&](vector<float> &out, const function<void(float, float, float *)> &row) {
+				for (int i = 0; i <= n; ++i) {
+					for (int j = 0; j <= n; ++j) {
+						row(low.x + i * step.x, low.y + j * step.y, &out[(size_t(i) * (n + 1) + j) * (n + 1)]);
+					}
+				}
+			};
+			double legacySeconds = timeBest(3, [&] {
+				sweep(legacy, [&](float x, float y, float *out) {
+					legacySeabedRow(noise, settings, x, y, zs.data(), out, n + 1);
+				});
+			});
+			double compiledSeconds = timeBest(3, [&] {
+				sweep(compiled, [&](float x, float y, float *out) { density.row(x, y, zs.data(), out, n + 1); });
+			});
+			float worst = 0;
+			size_t crossed = 0;
+			for (size_t i = 0; i < legacy.size(); ++i) {
+				worst = max(worst, fabs(legacy[i] - compiled[i]));
+				if ((legacy[i] > 0) != (compiled[i] > 0)) ++crossed;
+			}
+
+			const int first[3] = { 0, 0, 0 };
+			SurfaceBlocks blocks = density.surfaceBlocks(low, step, first, n, n, n, 4, 0.0f);
+			double samples = double(legacy.size());
+			cout << setw(4) << n << "^3" << endl;
+			cout << "  hand written " << setw(9) << legacySeconds * 1000 << " ms " << setw(12) << samples / legacySeconds
+			     << " samples/s" << endl;
+			cout << "  compiled     " << setw(9) << compiledSeconds * 1000 << " ms " << setw(12) << samples / compiledSeconds
+			     << " samples/s " << setw(6) << legacySeconds / compiledSeconds << "x, at most " << worst
+			     << " apart, " << crossed << " nodes changed side" << endl;
+			cout << "  " << blocks.skipped() << "/" << blocks.active.size() << " blocks of 4^3 skipped" << endl;
+		}
+		return EXIT_SUCCESS;
+	}
+
+	/*
+		Simplex noise against Perlin noise at the same octaves: single
+		noise, fbm, the gradient analytically against central differences,
+		and the seabed made from each
+	*/
+	int benchSimplex(int argc, char **argv) {
+		size_t n = (argc > 1) ? size_t(atol(argv[1])) : 1 << 20;
+		Perlin perlin(1);
+		Simplex simplex(1);
+		mt19937 rng(2);
+		uniform_real_distribution<float> coord(-200, 200);
+		vector<float> x(n), y(n), z(n), scalar(n), batch(n);
+		for (size_t i = 0; i < n; ++i) {
+			x[i] = coord(rng);
+			y[i] = coord(rng);
+			z[i] = coord(rng);
+		}
+		auto rate = [&](double seconds) { return double(n) / seconds; };
+
+		double perlinScalar = timeBest(3, [&] {
+			for (size_t i = 0; i < n; ++i) scalar[i] = perlin.noise(x[i], y[i], z[i]);
+		});
+		double perlinBatch = timeBest(3, [&] { perlin.noise(x.data(), y.data(), z.data(), batch.data(), n); });
+		double simplexScalar = timeBest(3, [&] {
+			for (size_t i = 0; i < n; ++i) scalar[i] = simplex.noise(x[i], y[i], z[i]);
+		});
+		double simplexBatch = timeBest(3, [&] { simplex.noise(x.data(), y.data(), z.data(), batch.data(), n); });
+		long long worst = 0;
+		float largest = 0;
+		for (size_t i = 0; i < n; ++i) {
+			worst = max(worst, ulpDistance(scalar[i], batch[i]));
+			largest = max(largest, fabs(batch[i]));
+		}
+		cout << n << " points, samples/s" << endl;
+		cout << "  noise    Perlin scalar " << setw(12) << rate(perlinScalar) << " batch " << setw(12)
+		     << rate(perlinBatch) << endl;
+		cout << "           simplex scalar " << setw(11) << rate(simplexScalar) << " batch " << setw(12)
+		     << rate(simplexBatch) << ", " << setw(5) << perlinBatch / simplexBatch << "x Perlin, batch max " << worst
+		     << " ulp from scalar, |noise| up to " << largest << " of " << Simplex::bound() << endl;
+
+		const vector<Perlin::Octave> &octaves = DensitySettings().octaves;
+		double perlinFbm = timeBest(3, [&] {
+			perlin.fbm(x.data(), y.data(), z.data(), batch.data(), n, octaves.data(), octaves.size());
+		});
+		double simplexFbm = timeBest(3, [&] {
+			simplex.fbm(x.data(), y.data(), z.data(), batch.data(), n, octaves.data(), octaves.size());
+		});
+		cout << "  fbm of " << octaves.size() << " Perlin " << setw(12) << rate(perlinFbm) << " simplex " << setw(12)
+		     << rate(simplexFbm) << ", " << setw(5) << perlinFbm / simplexFbm << "x" << endl;
+
+		// six more samples a point for differences, against one pass for the value and gradient
+		vector<float> dx(n), dy(n), dz(n), shifted(n), lower(n), upper(n);
+		const float h = 4e-3f;
+		auto difference = [&](const vector<float> &axis, float *g, int a) {
+			for (size_t i = 0; i < n; ++i) shifted[i] = axis[i] + h;
+			simplex.noise(a == 0 ? shifted.data() : x.data(), a == 1 ? shifted.data() : y.data(),
+				a == 2 ? shifted.data() : z.data(), upper.data(), n);
+			for (size_t i = 0; i < n; ++i) shifted[i] = axis[i] - h;
+			simplex.noise(a == 0 ? shifted.data() : x.data(), a == 1 ? shifted.data() : y.data(),
+				a == 2 ? shifted.data() : z.data(), lower.data(), n);
+			for (size_t i = 0; i < n; ++i) g[i] = (upper[i] - lower[i]) / (2 * h);
+		};
+		vector<float> cx(n), cy(n), cz(n);
+		double differenceSeconds = timeBest(3, [&] {
+			simplex.noise(x.data(), y.data(), z.data(), batch.data(), n);
+			difference(x, cx.data(), 0);
+			difference(y, cy.data(), 1);
+			difference(z, cz.data(), 2);
+		});
+		double analyticSeconds = timeBest(3, [&] {
+			simplex.noise(x.data(), y.data(), z.data(), batch.data(), dx.data(), dy.data(), dz.data(), n);
+		});
+		float apart = 0, steepest = 0;
+		double meanApart = 0;
+		for (size_t i = 0; i < n; ++i) {
+			float d = length(vec3(dx[i], dy[i], dz[i]) - vec3(cx[i], cy[i], cz[i]));
+			apart = max(apart, d);
+			meanApart += d / n;
+			steepest = max(steepest, length(vec3(dx[i], dy[i], dz[i])));
+		}
+		cout << "  gradient differences " << setw(12) << rate(differenceSeconds) << " analytic " << setw(12)
+		     << rate(analyticSeconds) << ", " << setw(5) << differenceSeconds / analyticSeconds << "x, " << meanApart << " apart on average and "
+		     << apart << " at most with h " << h << " (steepest " << steepest << ")" << endl;
+
+		// the default seabed with each noise, and the normals at its surface
+		for (bool useSimplex : { false, true }) {
+			DensitySettings settings;
+			settings.seed = 1;
+			settings.simplex = useSimplex;
+			DensityField density(settings);
+			TerrainSettings terrain;
+			const int cells = 128;
+			const vec3 low = terrain.minBound, step = (terrain.maxBound - terrain.minBound) / float(cells);
+			const int first[3] = { 0, 0, 0 };
+			vector<vec4> grid(size_t(cells + 1) * (cells + 1) * (cells + 1));
+			double gridSeconds = timeBest(3, [&] {
+				density.sampleGrid(low, step, first, cells, cells, cells, grid.data(), nullptr);
+			});
+			vector<vec3> surface;
+			for (size_t i = 0; i + 1 < grid.size() && surface.size() < 100000; ++i) {
+				if ((grid[i].w > 0) != (grid[i + 1].w > 0)) surface.push_back(vec3(grid[i].x, grid[i].y, grid[i].z));
+			}
+			vec3 sum;
+			double normalSeconds = timeBest(3, [&] {
+				for (const vec3 &p : surface) sum += density.gradient(p, 0.5f * step.x);
+			});
+			cout << "  seabed " << (useSimplex ? "simplex" : "Perlin ") << " " << cells << "^3 grid " << setw(9)
+			     << gridSeconds * 1000 << " ms, " << surface.size() << " surface normals " << setw(7)
+			     << normalSeconds * 1000 << " ms (" << (density.program().differentiable() ? "analytic" : "differences")
+			     << ")" << endl;
+		}
+		return EXIT_SUCCESS;
+	}
+
+	/*
+		Dual contouring against marching cubes on the same grids: the
+		default seabed, and a cube turned off the grid's axes whose edges
+		and corners are as sharp as a density gets. Fidelity is measured at
+		triangle centres against the density itself: how far off the
+		surface they are to first order, how far the face normal turns from
+		the density's, and how many triangles are slivers. The seabed's
+		finest octave is finer than these grids, so its figures are mostly
+		what no mesher of the grid could see
+	*/
+	int benchDual(int argc, char **argv) {
+		const string cube =
+			"# a cube 150 units across, turned off the grid's axes\n"
+			"u = 0.8*x + 0.6*y\n"
+			"v = -0.48*x + 0.64*y + 0.6*z\n"
+			"w = 0.36*x - 0.48*y + 0.8*z\n"
+			"density = 75 - max(abs(u), abs(v), abs(w))\n";
+		for (int n : sizeArgs(argc, argv, {64, 128})) {
+			for (int field = 0; field < 2; ++field) {
+				TerrainSettings settings;
+				settings.nX = settings.nY = settings.nZ = n;
+				settings.density.seed = 1;
+				if (field == 1) settings.density.expression = cube;
+				Terrain terrain(settings, false);
+				const DensityField &density = terrain.getDensity();
+				const vec4 *points = terrain.getGridPoints();
+				const float iso = terrain.getIsoValue();
+				const float cell = (settings.maxBound.x - settings.minBound.x) / n, h = 0.05f * cell;
+				cout << setw(4) << n << "^3 " << (field ? "turned cube" : "seabed") << endl;
+
+				auto report = [&](const char *name, double seconds, const MCMesh &mesh) {
+					size_t triangles = mesh.indices.size() / 3, slivers = 0, turned = 0;
+					double distance = 0, angle = 0;
+					float farthest = 0;
+					for (size_t t = 0; t < mesh.indices.size(); t += 3) {
+						vec3 a = mesh.vertices[mesh.indices[t]], b = mesh.vertices[mesh.indices[t+1]];
+						vec3 c = mesh.vertices[mesh.indices[t+2]];
+						vec3 centre = (a + b + c) / 3.0f;
+						vec3 g = density.gradient(centre, h);
+						float off = (length(g) > 0) ? fabs(density.at(centre) - iso) / length(g) : 0.0f;
+						distance += off;
+						farthest = max(farthest, off);
+						vec3 face = cross(b - a, c - a);
+						if (length(face) > 0 && length(g) > 0) {
+							// triangles are wound so their face normal points out of the solid
+							float degrees = acos(max(-1.0f, min(1.0f, -dot(normalize(face), normalize(g))))) * 57.2958f;
+							angle += degrees;
+							if (degrees > 10) ++turned;
+						}
+						// smallest angle of the triangle
+						float smallest = 180;
+						const vec3 corners[3] = { a, b, c };
+						for (int k = 0; k < 3; ++k) {
+							vec3 e0 = corners[(k+1)%3] - corners[k], e1 = corners[(k+2)%3] - corners[k];
+							if (length(e0) == 0 || length(e1) == 0) {
+								smallest = 0;
+								break;
+							}
+							float cosine = max(-1.0f, min(1.0f, dot(normalize(e0), normalize(e1))));
+							smallest = min(smallest, acos(cosine) * 57.2958f);
+						}
+						if (smallest < 10) ++slivers;
+					}
+					double count = double(max(triangles, size_t(1)));
+					cout << "  " << left << setw(22) << name << right << setw(8) << seconds * 1000 << " ms "
+					     << setw(8) << triangles << " triangles, off the surface " << setw(8) << distance / count
+					     << " avg " << setw(8) << farthest << " max, normals " << setw(6) << angle / count
+					     << " deg avg " << setw(5) << 100.0 * turned / count << "% over 10, " << setw(5)
+					     << 100.0 * slivers / count << "% slivers" << endl;
+				};
+
+				MCMesh marching;
+				double marchingSeconds = timeBest(3, [&] { MarchingCubesIndexed(n, n, n, iso, points, marching); });
+				report("marching cubes", marchingSeconds, marching);
+
+				MCMesh gridNormals;
+				double gridSeconds = timeBest(3, [&] { DualContour(n, n, n, iso, points, gridNormals); });
+				report("dual, grid gradients", gridSeconds, gridNormals);
+
+				DualContourSettings exact;
+				exact.gradient = [&](vec3 p) { return density.gradient(p, 0.5f * cell); };
+				MCMesh fieldNormals;
+				double fieldSeconds = timeBest(3, [&] { DualContour(n, n, n, iso, points, fieldNormals, exact); });
+				report(density.program().differentiable() ? "dual, exact gradients" : "dual, field gradients",
+					fieldSeconds, fieldNormals);
+			}
+		}
+		return EXIT_SUCCESS;
+	}
+
+	// Surface nets against marching cubes on the seabed grid, one thread
+	// and the pool, every cell and only the surface blocks
+	int benchNets(int argc, char **argv) {
+		for (int n : sizeArgs(argc, argv, {128, 256})) {
+			TerrainSettings settings;
+			settings.nX = settings.nY = settings.nZ = n;
+			settings.density.seed = 1;
+			Terrain terrain(settings, false);
+			const DensityField &density = terrain.getDensity();
+			const vec4 *points = terrain.getGridPoints();
+			const float iso = terrain.getIsoValue();
+			const float h = 0.05f * (settings.maxBound.x - settings.minBound.x) / n;
+			const SurfaceBlocks *blocks = terrain.getSurfaceBlocks().active.empty() ? nullptr : &terrain.getSurfaceBlocks();
+			ThreadPool pool(4);
+			cout << setw(4) << n << "^3" << endl;
+
+			auto distance = [&](const MCMesh &mesh) {
+				double sum = 0;
+				for (size_t t = 0; t < mesh.indices.size(); t += 3) {
+					vec3 centre = (mesh.vertices[mesh.indices[t]] + mesh.vertices[mesh.indices[t+1]]
+						+ mesh.vertices[mesh.indices[t+2]]) / 3.0f;
+					vec3 g = density.gradient(centre, h);
+					if (length(g) > 0) sum += fabs(density.at(centre) - iso) / length(g);
+				}
+				return sum / double(max(mesh.indices.size() / 3, size_t(1)));
+			};
+
+			for (int skip = 0; skip < 2; ++skip) {
+				const SurfaceBlocks *surface = skip ? blocks : nullptr;
+				if (skip && !surface) continue;
+				MCMesh marching, nets, netsPooled;
+				double marchingSeconds = timeBest(3, [&] {
+					marching = MCMesh();
+					MarchingCubesIndexed(n, n, n, iso, points, marching, nullptr, surface);
+				});
+				double netsSeconds = timeBest(3, [&] {
+					nets = MCMesh();
+					SurfaceNets(n, n, n, iso, points, nets, nullptr, surface);
+				});
+				double pooledSeconds = timeBest(3, [&] {
+					netsPooled = MCMesh();
+					SurfaceNets(n, n, n, iso, points, netsPooled, &pool, surface);
+				});
+				bool same = nets.indices == netsPooled.indices && nets.vertices.size() == netsPooled.vertices.size()
+					&& memcmp(nets.vertices.data(), netsPooled.vertices.data(), nets.vertices.size() * sizeof(vec3)) == 0;
+
+				cout << (skip ? "  surface blocks" : "  every cell") << endl;
+				cout << "    marching cubes " << setw(9) << marchingSeconds * 1000 << " ms " << setw(8)
+				     << marching.indices.size() / 3 << " triangles " << setw(8) << marching.vertices.size()
+				     << " vertices, off the surface " << distance(marching) << " avg" << endl;
+				cout << "    surface nets   " << setw(9) << netsSeconds * 1000 << " ms " << setw(8)
+				     << nets.indices.size() / 3 << " triangles " << setw(8) << nets.vertices.size()
+				     << " vertices, off the surface " << distance(nets) << " avg, " << setw(5)
+				     << marchingSeconds / netsSeconds << "x" << endl;
+				cout << "    nets, 4 threads" << setw(9) << pooledSeconds * 1000 << " ms "
+				     << (same ? "identical" : "DIFFERENT") << endl;
+			}
+		}
+		return EXIT_SUCCESS;
+	}
+
+	struct benchmark {
+		const char *name;
+		const char *usage;
+		int (*run)(int, char **);
+	};
+
+	const benchmark benchmarks[] = {
+		{ "rules", "[steps]", benchRules },
+		{ "separation", "", benchSeparation },
+		{ "density", "[sizes...]", benchDensity },
+		{ "noise", "[points]", benchNoise },
+		{ "context", "[sizes...]", benchContext },
+		{ "mesh", "[sizes...]", benchMesh },
+		{ "normals", "[sizes...]", benchNormals },
+		{ "stream", "[chunk cells]", benchStream },
+		{ "marching", "[sizes...]", benchMarching },
+		{ "soup", "[sizes...]", benchSoup },
+		{ "cache", "[sizes...]", benchCache },
+		{ "octree", "[max depth] [screen error]", benchOctree },
+		{ "skip", "[sizes...]", benchSkip },
+		{ "gradient", "[sizes...]", benchGradient },
+		{ "sculpt", "[size] [strokes]", benchSculpt },
+		{ "bvh", "[sizes...]", benchBvh },
+		{ "simplify", "[sizes...]", benchSimplify },
+		{ "generate", "[sizes...]", benchGenerate },
+		{ "peak", "<phase> <size>", benchPeak },
+		{ "program", "[sizes...]", benchProgram },
+		{ "simplex", "[points]", benchSimplex },
+		{ "dual", "[sizes...]", benchDual },
+		{ "nets", "[sizes...]", benchNets },
+	};
+}
+
+int benchMain(int argc, char **argv) {
+	if (argc > 0) {
+		for (const benchmark &b : benchmarks) {
+			if (string(argv[0]) == b.name) return b.run(argc, argv);
+		}
+		cerr << "Unknown benchmark " << argv[0] << endl;
+	}
+	cout << "Benchmarks:" << endl;
+	for (const benchmark &b : benchmarks) {
+		cout << "  --bench " << b.name << " " << b.usage << endl;
+	}
+	return EXIT_FAILURE;
+}
@@ -0,0 +1,15 @@
+//---------------------------------------------------------------------------
+//
+// Headless benchmarks
+//
+// Run from the command line with
+//   ./build/bin/p2 --bench <name> [arguments]
+// and ./build/bin/p2 --bench with no name to list them. Nothing here
+// opens a window, so benchmarks that would need OpenGL stop short of it.
+//
+//----------------------------------------------------------------------------
+
+#pragma once
+
+// Runs the benchmark named by argv[0], returns the process exit code
+int benchMain(int argc, char **argv);
@@ -0,0 +1,397 @@
+//---------------------------------------------------------------------------
+//
+// Bounding volume hierarchy over the triangles of a mesh
+//
+//----------------------------------------------------------------------------
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+#include <vector>
+
+#include "bvh.hpp"
+#include "comp308.hpp"
+#include "geometry.hpp"
+
+using namespace std;
+using namespace comp308;
+
+namespace {
+
+	const int binCount = 16;
+	// nodes with this many triangles or fewer may be leaves, nodes with
+	// more are always split
+	const int leafSize = 8;
+	// cost of visiting a node against testing one triangle
+	const float traversalCost = 1.0f;
+	// deeper than this the traversal stacks could overflow, it only happens
+	// for piles of triangles that cannot be told apart
+	const int maxDepth = 60;
+	const int packetSize = 8;
+
+	struct Box {
+		vec3 low = vec3(1e30f);
+		vec3 high = vec3(-1e30f);
+
+		void grow(vec3 p) { low = min(low, p); high = max(high, p); }
+		void grow(const Box &b) { low = min(low, b.low); high = max(high, b.high); }
+		float area() const {
+			vec3 e = high - low;
+			return (e.x < 0) ? 0 : e.x * e.y + e.y * e.z + e.z * e.x;
+		}
+	};
+
+	struct Builder {
+		vector<Box> boxes;
+		vector<vec3> centroids;
+		vector<int> order;
+		int depth = 0;
+
+		// Appends the node for order[begin, end) and everything under it
+		template <typename Node>
+		void split(vector<Node> &nodes, int begin, int end, int level) {
+			depth = max(depth, level);
+			int index = int(nodes.size());
+			nodes.push_back(Node());
+			Box bounds, centres;
+			for (int i = begin; i < end; ++i) {
+				bounds.grow(boxes[order[i]]);
+				centres.grow(centroids[order[i]]);
+			}
+			nodes[index].low = bounds.low;
+			nodes[index].high = bounds.high;
+			nodes[index].first = begin;
+			nodes[index].count = end - begin;
+			nodes[index].axis = 0;
+
+			int count = end - begin;
+			vec3 extent = centres.high - centres.low;
+			int axis = (extent.x >= extent.y && extent.x >= extent.z) ? 0 : (extent.y >= extent.z) ? 1 : 2;
+			if (count <= 2 || extent[axis] <= 0 || level >= maxDepth) return;
+
+			// triangles and bounds falling in each bin along the axis
+			Box bins[binCount];
+			int counts[binCount] = {};
+			float scale = binCount / extent[axis];
+			auto binOf = [&](int t) {
+				return min(binCount - 1, int((centroids[t][axis] - centres.low[axis]) * scale));
+			};
+			for (int i = begin; i < end; ++i) {
+				int b = binOf(order[i]);
+				bins[b].grow(boxes[order[i]]);
+				counts[b]++;
+			}
+
+			// sweep from the right to know the cost of every right side,
+			// then from the left to find the cheapest split
+			float rightCost[binCount];
+			Box right;
+			int rightCount = 0;
+			for (int b = binCount - 1; b > 0; --b) {
+				right.grow(bins[b]);
+				rightCount += counts[b];
+				rightCost[b] = right.area() * rightCount;
+			}
+			Box left;
+			int leftCount = 0;
+			float bestCost = 1e30f;
+			int bestSplit = -1;
+			for (int b = 1; b < binCount; ++b) {
+				left.grow(bins[b - 1]);
+				leftCount += counts[b - 1];
+				if (leftCount == 0 || leftCount == count) continue;
+				float cost = left.area() * leftCount + rightCost[b];
+				if (cost < bestCost) {
+					bestCost = cost;
+					bestSplit = b;
+				}
+			}
+			float area = bounds.area();
+			float splitCost = traversalCost + ((area > 0) ? bestCost / area : float(count));
+			if (bestSplit < 0 || (count <= leafSize && splitCost >= count)) return;
+
+			int middle = int(partition(order.begin() + begin, order.begin() + end,
+				[&](int t) { return binOf(t) < bestSplit; }) - order.begin());
+			nodes[index].count = 0;
+			nodes[index].axis = axis;
+			split(nodes, begin, middle, level + 1);
+			int second = int(nodes.size());
+			split(nodes, middle, end, level + 1);
+			nodes[index].first = second;
+		}
+	};
+
+	// 1/d for each axis, with zero taken as a tiny value of the same sign
+	// so the slab tests never see 0 * infinity
+	vec3 inverse(vec3 d) {
+		vec3 r;
+		for (int a = 0; a < 3; ++a) r[a] = 1.0f / ((d[a] == 0) ? 1e-30f : d[a]);
+		return r;
+	}
+
+	// Distance along the ray to where it enters the box, or 1e30 if it
+	// misses it before tMax
+	template <typename Node>
+	inline float enter(const Node &node, vec3 origin, vec3 inv, float tMax) {
+		float x0 = (node.low.x - origin.x) * inv.x, x1 = (node.high.x - origin.x) * inv.x;
+		float y0 = (node.low.y - origin.y) * inv.y, y1 = (node.high.y - origin.y) * inv.y;
+		float z0 = (node.low.z - origin.z) * inv.z, z1 = (node.high.z - origin.z) * inv.z;
+		float near = max(max(min(x0, x1), min(y0, y1)), max(min(z0, z1), 0.0f));
+		float far = min(min(max(x0, x1), max(y0, y1)), min(max(z0, z1), tMax));
+		return (near <= far) ? near : 1e30f;
+	}
+
+	// Squared distance from p to the box, zero inside it
+	template <typename Node>
+	inline float distance2(const Node &node, vec3 p) {
+		vec3 d = max(max(node.low - p, p - node.high), 0.0f);
+		return dot(d, d);
+	}
+
+	// Moller and Trumbore, tightening hit if the ray meets the triangle
+	// closer than it
+	template <typename Triangle>
+	inline void hitTriangle(const Triangle &tri, int id, vec3 origin, vec3 direction, RayHit &hit) {
+		vec3 p = cross(direction, tri.ac);
+		float det = dot(tri.ab, p);
+		if (det == 0) return;
+		float invDet = 1.0f / det;
+		vec3 s = origin - tri.a;
+		float u = dot(s, p) * invDet;
+		if (u < 0 || u > 1) return;
+		vec3 q = cross(s, tri.ab);
+		float v = dot(direction, q) * invDet;
+		if (v < 0 || u + v > 1) return;
+		float t = dot(tri.ac, q) * invDet;
+		if (t >= 0 && t < hit.t) {
+			hit.t = t;
+			hit.triangle = id;
+			hit.u = u;
+			hit.v = v;
+		}
+	}
+
+	// Products of floats are exact in double, so the region tests below do
+	// not cancel away on long thin triangles
+	inline double dotExact(vec3 a, vec3 b) {
+		return double(a.x) * b.x + double(a.y) * b.y + double(a.z) * b.z;
+	}
+
+	// Closest point on a triangle, Ericson's Real-Time Collision Detection 5.1.5
+	template <typename Triangle>
+	vec3 closestOnTriangle(vec3 p, const Triangle &tri) {
+		vec3 a = tri.a, b = tri.a + tri.ab, c = tri.a + tri.ac;
+		vec3 ap = p - a;
+		double d1 = dotExact(tri.ab, ap), d2 = dotExact(tri.ac, ap);
+		if (d1 <= 0 && d2 <= 0) return a;
+		vec3 bp = p - b;
+		double d3 = dotExact(tri.ab, bp), d4 = dotExact(tri.ac, bp);
+		if (d3 >= 0 && d4 <= d3) return b;
+		double vc = d1 * d4 - d3 * d2;
+		if (vc <= 0 && d1 >= 0 && d3 <= 0) return a + tri.ab * float(d1 / (d1 - d3));
+		vec3 cp = p - c;
+		double d5 = dotExact(tri.ab, cp), d6 = dotExact(tri.ac, cp);
+		if (d6 >= 0 && d5 <= d6) return c;
+		double vb = d5 * d2 - d1 * d6;
+		if (vb <= 0 && d2 >= 0 && d6 <= 0) return a + tri.ac * float(d2 / (d2 - d6));
+		double va = d3 * d6 - d5 * d4;
+		if (va <= 0 && d4 - d3 >= 0 && d5 - d6 >= 0) return b + (c - b) * float((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+		double denom = 1.0 / (va + vb + vc);
+		return a + tri.ab * float(vb * denom) + tri.ac * float(vc * denom);
+	}
+}
+
+Bvh::Bvh(const vector<vec3> &points, const vector<unsigned int> &indices) {
+	vector<vec3> corners(indices.size());
+	for (size_t i = 0; i < indices.size(); ++i) corners[i] = points[indices[i]];
+	build(corners);
+}
+
+Bvh::Bvh(const vector<vec3> &points, const vector<triangle> &triangles) {
+	vector<vec3> corners(3 * triangles.size());
+	for (size_t t = 0; t < triangles.size(); ++t) {
+		for (int j = 0; j < 3; ++j) corners[3 * t + j] = points[triangles[t].v[j].p];
+	}
+	build(corners);
+}
+
+Bvh::Bvh(const Geometry &geometry) : Bvh(geometry.getPoints(), geometry.getTriangles()) { }
+
+void Bvh::build(const vector<vec3> &corners) {
+	size_t count = corners.size() / 3;
+	m_nodes.clear();
+	m_triangles.clear();
+	m_ids.clear();
+	if (count == 0) return;
+
+	Builder builder;
+	builder.boxes.resize(count);
+	builder.centroids.resize(count);
+	builder.order.resize(count);
+	for (size_t t = 0; t < count; ++t) {
+		Box box;
+		for (int j = 0; j < 3; ++j) box.grow(corners[3 * t + j]);
+		builder.boxes[t] = box;
+		builder.centroids[t] = (box.low + box.high) * 0.5f;
+		builder.order[t] = int(t);
+	}
+	m_nodes.reserve(2 * count);
+	builder.split(m_nodes, 0, int(count), 0);
+	m_nodes.shrink_to_fit();
+	m_depth = builder.depth;
+
+	m_triangles.resize(count);
+	m_ids = builder.order;
+	for (size_t i = 0; i < count; ++i) {
+		const vec3 *c = &corners[3 * size_t(m_ids[i])];
+		m_triangles[i].a = c[0];
+		m_triangles[i].ab = c[1] - c[0];
+		m_triangles[i].ac = c[2] - c[0];
+	}
+}
+
+vec3 Bvh::minBound() const {
+	return m_nodes.empty() ? vec3(0) : m_nodes[0].low;
+}
+
+vec3 Bvh::maxBound() const {
+	return m_nodes.empty() ? vec3(0) : m_nodes[0].high;
+}
+
+bool Bvh::intersect(const Ray &ray, RayHit &hit) const {
+	hit = RayHit();
+	hit.t = ray.tMax;
+	if (m_nodes.empty()) return false;
+	vec3 inv = inverse(ray.direction);
+	if (enter(m_nodes[0], ray.origin, inv, hit.t) >= 1e30f) return false;
+
+	// nodes still to visit with where the ray enters them, nearest on top
+	pair<int, float> stack[maxDepth + 2];
+	int top = 0;
+	int node = 0;
+	while (true) {
+		const Node &n = m_nodes[node];
+		if (n.count > 0) {
+			for (int i = n.first; i < n.first + n.count; ++i) {
+				hitTriangle(m_triangles[i], i, ray.origin, ray.direction, hit);
+			}
+		} else {
+			int near = node + 1, far = n.first;
+			float tNear = enter(m_nodes[near], ray.origin, inv, hit.t);
+			float tFar = enter(m_nodes[far], ray.origin, inv, hit.t);
+			if (tFar < tNear) {
+				swap(near, far);
+				swap(tNear, tFar);
+			}
+			if (tNear < 1e30f) {
+				if (tFar < 1e30f) stack[top++] = make_pair(far, tFar);
+				node = near;
+				continue;
+			}
+		}
+		// skip anything the ray now meets something before
+		do {
+			if (top == 0) {
+				if (hit.hit()) hit.triangle = m_ids[hit.triangle];
+				return hit.hit();
+			}
+			--top;
+		} while (stack[top].second >= hit.t);
+		node = stack[top].first;
+	}
+}
+
+void Bvh::intersect(const Ray *rays, RayHit *hits, size_t count) const {
+	for (size_t start = 0; start < count; start += packetSize) {
+		int lanes = int(min<size_t>(packetSize, count - start));
+		const Ray *ray = rays + start;
+		RayHit *hit = hits + start;
+		vec3 inv[packetSize];
+		vec3 sum(0);
+		for (int l = 0; l < lanes; ++l) {
+			hit[l] = RayHit();
+			hit[l].t = ray[l].tMax;
+			inv[l] = inverse(ray[l].direction);
+			sum += ray[l].direction;
+		}
+		if (m_nodes.empty()) continue;
+
+		int stack[maxDepth + 2];
+		int top = 0;
+		stack[top++] = 0;
+		while (top > 0) {
+			int node = stack[--top];
+			const Node &n = m_nodes[node];
+			if (n.count > 0) {
+				// each ray that reaches the leaf is tested against all of it
+				for (int l = 0; l < lanes; ++l) {
+					if (enter(n, ray[l].origin, inv[l], hit[l].t) >= 1e30f) continue;
+					for (int i = n.first; i < n.first + n.count; ++i) {
+						hitTriangle(m_triangles[i], i, ray[l].origin, ray[l].direction, hit[l]);
+					}
+				}
+				continue;
+			}
+
+			// inner nodes are opened as soon as one ray reaches them
+			bool reached = false;
+			for (int l = 0; l < lanes && !reached; ++l) {
+				reached = enter(n, ray[l].origin, inv[l], hit[l].t) < 1e30f;
+			}
+			if (!reached) continue;
+			if (sum[n.axis] < 0) {
+				// the child the rays reach first goes on top
+				stack[top++] = node + 1;
+				stack[top++] = n.first;
+			} else {
+				stack[top++] = n.first;
+				stack[top++] = node + 1;
+			}
+		}
+		for (int l = 0; l < lanes; ++l) {
+			if (hit[l].hit()) hit[l].triangle = m_ids[hit[l].triangle];
+		}
+	}
+}
+
+bool Bvh::closestPoint(vec3 p, SurfacePoint &result, float maxDistance) const {
+	result = SurfacePoint();
+	if (m_nodes.empty()) return false;
+	float best2 = maxDistance * maxDistance;
+	int best = -1;
+
+	// nodes still to visit with their squared distance, nearest on top
+	pair<int, float> stack[maxDepth + 2];
+	int top = 0;
+	stack[top++] = make_pair(0, distance2(m_nodes[0], p));
+	while (top > 0) {
+		--top;
+		if (stack[top].second > best2) continue;
+		const Node &n = m_nodes[stack[top].first];
+		if (n.count > 0) {
+			for (int i = n.first; i < n.first + n.count; ++i) {
+				vec3 q = closestOnTriangle(p, m_triangles[i]);
+				vec3 d = q - p;
+				float d2 = dot(d, d);
+				if (d2 <= best2) {
+					best2 = d2;
+					best = i;
+					result.point = q;
+				}
+			}
+		} else {
+			int near = stack[top].first + 1, far = n.first;
+			float dNear = distance2(m_nodes[near], p), dFar = distance2(m_nodes[far], p);
+			if (dFar < dNear) {
+				swap(near, far);
+				swap(dNear, dFar);
+			}
+			if (dFar <= best2) stack[top++] = make_pair(far, dFar);
+			if (dNear <= best2) stack[top++] = make_pair(near, dNear);
+		}
+	}
+	if (best < 0) return false;
+	result.distance = sqrt(best2);
+	result.triangle = m_ids[best];
+	return true;
+}
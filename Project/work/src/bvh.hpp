@@ -0,0 +1,92 @@
+//---------------------------------------------------------------------------
+//
+// Bounding volume hierarchy over the triangles of a mesh
+//
+// Answers what a ray hits first and where the closest point on the surface
+// is without looking at every triangle. The tree is built top down, each
+// node split where the surface area heuristic says tracing through it is
+// cheapest, with the triangles binned by centroid along the longest axis.
+// Nodes are kept in one array in depth first order, so the first child of
+// a node is the node after it, and the triangles are copied in leaf order
+// with their edges worked out ready for intersecting.
+//
+// Packets trace a group of rays that start near each other and point about
+// the same way through the tree together, so each node is fetched once for
+// the group instead of once a ray.
+//
+//----------------------------------------------------------------------------
+
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include "comp308.hpp"
+#include "geometry.hpp"
+
+struct Ray {
+	comp308::vec3 origin;
+	comp308::vec3 direction;		// need not be unit length, t is in its lengths
+	float tMax = 1e30f;				// nothing further along counts
+};
+
+struct RayHit {
+	float t = 1e30f;
+	int triangle = -1;				// in the order the mesh gave them, -1 for a miss
+	float u = 0, v = 0;				// weights of the second and third corners
+
+	bool hit() const { return triangle >= 0; }
+};
+
+struct SurfacePoint {
+	comp308::vec3 point;
+	float distance = 1e30f;
+	int triangle = -1;				// -1 if nothing was within range
+};
+
+class Bvh {
+private:
+	struct Node {
+		comp308::vec3 low;
+		int first;					// leaf: first triangle, inner: second child
+		comp308::vec3 high;
+		int count;					// leaf: how many triangles, inner: 0
+		int axis;					// inner: axis the children were split on
+	};
+
+	struct Triangle {
+		comp308::vec3 a;
+		comp308::vec3 ab;
+		comp308::vec3 ac;
+	};
+
+	std::vector<Node> m_nodes;
+	std::vector<Triangle> m_triangles;
+	std::vector<int> m_ids;			// original index of each triangle
+	int m_depth = 0;
+
+	void build(const std::vector<comp308::vec3> &corners);
+
+public:
+	// Three indices into points per triangle
+	Bvh(const std::vector<comp308::vec3> &points, const std::vector<unsigned int> &indices);
+	Bvh(const std::vector<comp308::vec3> &points, const std::vector<triangle> &triangles);
+	// Over the triangles of a Geometry that kept its points, triangle
+	// numbers are the Geometry's
+	explicit Bvh(const Geometry &);
+
+	// Nearest hit closer than ray.tMax, false if there is none
+	bool intersect(const Ray &, RayHit &) const;
+	// The same for count rays, traced in packets of up to 8. Gives the same
+	// hits as tracing them one at a time.
+	void intersect(const Ray *rays, RayHit *hits, size_t count) const;
+	// Closest point on the surface to p no further than maxDistance, false
+	// if there is none
+	bool closestPoint(comp308::vec3 p, SurfacePoint &, float maxDistance = 1e30f) const;
+
+	size_t nodeCount() const { return m_nodes.size(); }
+	size_t triangleCount() const { return m_triangles.size(); }
+	int depth() const { return m_depth; }
+	comp308::vec3 minBound() const;
+	comp308::vec3 maxBound() const;
+};
@@ -0,0 +1,77 @@
+//---------------------------------------------------------------------------
+//
+// Batched debug line renderer
+//
+//----------------------------------------------------------------------------
+
+#include <cmath>
+#include <cstddef>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "comp308.hpp"
+#include "debugLines.hpp"
+
+using namespace std;
+using namespace comp308;
+
+DebugLines::~DebugLines() {
+	if (m_vbo) glDeleteBuffers(1, &m_vbo);
+}
+
+void DebugLines::setColour(float r, float g, float b) {
+	m_colour = vec3(r, g, b);
+}
+
+void DebugLines::addLine(vec3 a, vec3 b) {
+	m_vertices.push_back({a, m_colour});
+	m_vertices.push_back({b, m_colour});
+}
+
+// Axis aligned wire box between the two corners
+void DebugLines::addBox(vec3 lo, vec3 hi) {
+	vec3 c[8];
+	for (int i = 0; i < 8; ++i) {
+		c[i] = vec3((i & 1) ? hi.x : lo.x, (i & 2) ? hi.y : lo.y, (i & 4) ? hi.z : lo.z);
+	}
+	for (int i = 0; i < 8; ++i) {
+		// connect each corner to the neighbours that differ in exactly one axis
+		for (int bit = 1; bit < 8; bit <<= 1) {
+			if (!(i & bit)) addLine(c[i], c[i | bit]);
+		}
+	}
+}
+
+void DebugLines::render() {
+	if (m_vertices.empty()) return;
+
+	if (!m_vbo) glGenBuffers(1, &m_vbo);
+	glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
+
+	size_t bytes = m_vertices.size() * sizeof(lineVertex);
+	if (bytes > m_capacity) {
+		// grow geometrically so the buffer is only reallocated a handful of times
+		m_capacity = max(bytes, m_capacity * 2);
+		glBufferData(GL_ARRAY_BUFFER, m_capacity, nullptr, GL_STREAM_DRAW);
+	}
+	glBufferSubData(GL_ARRAY_BUFFER, 0, bytes, m_vertices.data());
+
+	glPushAttrib(GL_ENABLE_BIT | GL_CURRENT_BIT);
+	glPushClientAttrib(GL_CLIENT_VERTEX_ARRAY_BIT);
+	glDisable(GL_LIGHTING);
+	glDisable(GL_TEXTURE_2D);
+
+	glEnableClientState(GL_VERTEX_ARRAY);
+	glEnableClientState(GL_COLOR_ARRAY);
+	glVertexPointer(3, GL_FLOAT, sizeof(lineVertex), (const GLvoid *) offsetof(lineVertex, p));
+	glColorPointer(3, GL_FLOAT, sizeof(lineVertex), (const GLvoid *) offsetof(lineVertex, c));
+
+	glDrawArrays(GL_LINES, 0, GLsizei(m_vertices.size()));
+
+	glPopClientAttrib();
+	glPopAttrib();
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	m_vertices.clear();
+}
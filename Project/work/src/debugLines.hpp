@@ -0,0 +1,45 @@
+//---------------------------------------------------------------------------
+//
+// Batched debug line renderer
+//
+// Collects coloured line segments over a frame and draws them all from one
+// vertex buffer with a single draw call.
+//
+//----------------------------------------------------------------------------
+
+#pragma once
+
+#include <cmath>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "comp308.hpp"
+
+class DebugLines {
+private:
+	struct lineVertex {
+		comp308::vec3 p;
+		comp308::vec3 c;
+	};
+
+	std::vector<lineVertex> m_vertices;
+	comp308::vec3 m_colour = comp308::vec3(1);
+
+	// Vertex buffer, grown as needed and reused between frames
+	GLuint m_vbo = 0;
+	size_t m_capacity = 0;
+
+public:
+	DebugLines() { }
+	DebugLines(const DebugLines &) = delete;
+	DebugLines & operator=(const DebugLines &) = delete;
+	~DebugLines();
+
+	void setColour(float, float, float);
+	void addLine(comp308::vec3, comp308::vec3);
+	void addBox(comp308::vec3, comp308::vec3);
+
+	// Uploads every line added since the last call, draws them and clears the batch
+	void render();
+};
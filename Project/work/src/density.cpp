@@ -0,0 +1,194 @@
+//---------------------------------------------------------------------------
+//
+// Seabed density function
+//
+//----------------------------------------------------------------------------
+
+#include <algorithm>
+#include <cmath>
+#include <ctime>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "comp308.hpp"
+#include "density.hpp"
+#include "threadPool.hpp"
+
+using namespace std;
+using namespace comp308;
+
+string seabedSource(const DensitySettings &settings) {
+	ostringstream source;
+	source << setprecision(9);
+	const char *noise = settings.simplex ? "simplex(" : "noise(";
+	source << "# noise over a plane 25 units down\n";
+	source << "seabed = -y - 25.0003";
+	if (!settings.octaves.empty()) {
+		source << " + " << noise;
+		for (size_t o = 0; o < settings.octaves.size(); o++) {
+			source << (o ? ", " : "") << settings.octaves[o].frequency << ", " << settings.octaves[o].amplitude;
+		}
+		source << ")";
+	}
+	source << "\n";
+	if (!settings.walls) {
+		source << "density = seabed\n";
+		return source.str();
+	}
+	source << "# walls of rock 50 units thick around the edge of the 400 unit map, the\n"
+	       << "# x walls stop short of the ends of the z walls\n";
+	source << "wall = " << noise << settings.wallOctave.frequency << ", " << settings.wallOctave.amplitude << ")\n";
+	source << "density = seabed\n"
+	       << "\t+ where(box(-inf, -inf, -210, inf, inf, -160), -(z + 160) + wall)\n"
+	       << "\t+ where(box(-inf, -inf, 160, inf, inf, 210), z - 160 + wall)\n"
+	       << "\t+ where(box(-210, -inf, -190, -160, inf, 190), -(x + 160) + wall)\n"
+	       << "\t+ where(box(160, -inf, -190, 210, inf, 190), x - 160 + wall)\n";
+	return source.str();
+}
+
+DensityField::DensityField(const DensitySettings &settings)
+	: m_seed(settings.seed ? settings.seed : unsigned(time(NULL))),
+	  m_noise(m_seed),
+	  m_simplex(m_seed),
+	  m_program(settings.expression.empty() ? seabedSource(settings) : settings.expression) {
+}
+
+float DensityField::at(vec3 p) const {
+	float density;
+	row(p.x, p.y, &p.z, &density, 1);
+	return density;
+}
+
+void DensityField::row(float x, float y, const float *zs, float *out, int n) const {
+	m_program.row(m_noise, m_simplex, x, y, zs, out, n);
+}
+
+vec3 DensityField::gradient(vec3 p, float h) const {
+	if (m_program.differentiable()) {
+		vec3 g;
+		m_program.gradient(m_noise, m_simplex, p, g);
+		return g;
+	}
+	// the two z samples share a row call
+	float zs[2] = { p.z - h, p.z + h };
+	float dz[2];
+	row(p.x, p.y, zs, dz, 2);
+	return vec3(
+		at(vec3(p.x + h, p.y, p.z)) - at(vec3(p.x - h, p.y, p.z)),
+		at(vec3(p.x, p.y + h, p.z)) - at(vec3(p.x, p.y - h, p.z)),
+		dz[1] - dz[0]) / (2 * h);
+}
+
+float DensityField::trend(vec3 p) const {
+	return m_program.trend(p);
+}
+
+void DensityField::trendRow(float x, float y, const float *zs, float *out, int n) const {
+	m_program.trendRow(x, y, zs, out, n);
+}
+
+void DensityField::range(vec3 low, vec3 high, float &lowest, float &highest) const {
+	m_program.range(low, high, lowest, highest);
+}
+
+size_t SurfaceBlocks::skipped() const {
+	return size_t(count(active.begin(), active.end(), 0));
+}
+
+bool SurfaceBlocks::sampled(int i, int j, int k) const {
+	// blocks with a node from n-1 to n+1 as a corner
+	auto first = [&](int n, int count) { return min(max(n - 2, 0) / size, count - 1); };
+	auto last = [&](int n, int count) { return min((n + 1) / size, count - 1); };
+	for(int bx = first(i, countX); bx <= last(i, countX); bx++)
+		for(int by = first(j, countY); by <= last(j, countY); by++)
+			for(int bz = first(k, countZ); bz <= last(k, countZ); bz++)
+				if(holds(bx, by, bz)) return true;
+	return false;
+}
+
+SurfaceBlocks DensityField::surfaceBlocks(vec3 base, vec3 step, const int first[3],
+	int nX, int nY, int nZ, int size, float minValue) const {
+	SurfaceBlocks blocks;
+	blocks.size = size;
+	blocks.countX = (nX + size - 1) / size;
+	blocks.countY = (nY + size - 1) / size;
+	blocks.countZ = (nZ + size - 1) / size;
+	blocks.active.resize(size_t(blocks.countX) * blocks.countY * blocks.countZ);
+
+	// corners worked out exactly as sampleGrid places the nodes
+	auto corner = [&](int bx, int by, int bz) {
+		return vec3(base.x+(first[0]+min(bx*size, nX))*step.x,
+			base.y+(first[1]+min(by*size, nY))*step.y,
+			base.z+(first[2]+min(bz*size, nZ))*step.z);
+	};
+	for(int bx=0; bx < blocks.countX; bx++) {
+		for(int by=0; by < blocks.countY; by++) {
+			for(int bz=0; bz < blocks.countZ; bz++) {
+				float lowest, highest;
+				range(corner(bx, by, bz), corner(bx+1, by+1, bz+1), lowest, highest);
+				// marching cubes counts a node at exactly minValue as outside
+				bool surface = lowest <= minValue && highest > minValue;
+				blocks.active[(bx*blocks.countY + by)*blocks.countZ + bz] = surface;
+			}
+		}
+	}
+	return blocks;
+}
+
+/*
+	Each x slab is an independent task. Every sample only depends on its
+	coordinates and the seed, so the grid comes out byte for byte the same
+	however many threads share the work.
+*/
+void DensityField::sampleGrid(vec3 base, vec3 step, const int first[3],
+	int nX, int nY, int nZ, vec4 *points, ThreadPool *pool, const SurfaceBlocks *blocks) const {
+	auto slab = [&](int i) {
+		vector<float> zs(nZ+1), density(nZ+1);
+		for(int k=0; k < nZ+1; k++) {
+			zs[k] = base.z+(first[2]+k)*step.z;
+		}
+		vector<int> picked(nZ+1);
+		vector<float> pickedZ(nZ+1), trend(nZ+1);
+		float x = base.x+(first[0]+i)*step.x;
+		for(int j=0; j < nY+1; j++) {
+			float y = base.y+(first[1]+j)*step.y;
+			vec4 *out = &points[i*(nY+1)*(nZ+1) + j*(nZ+1)];
+			if(!blocks) {
+				row(x, y, zs.data(), density.data(), nZ+1);
+				for(int k=0; k < nZ+1; k++) {
+					out[k] = vec4(x, y, zs[k], density[k]);
+				}
+				continue;
+			}
+
+			// noise is only sampled where the surface can be, the nodes that
+			// are sampled come out exactly as they would without blocks
+			int n = 0;
+			bool trended = false;
+			for(int k=0; k < nZ+1; k++) {
+				if(blocks->sampled(i, j, k)) {
+					picked[n] = k;
+					pickedZ[n++] = zs[k];
+				} else {
+					if(!trended) {
+						trendRow(x, y, zs.data(), trend.data(), nZ+1);
+						trended = true;
+					}
+					out[k] = vec4(x, y, zs[k], trend[k]);
+				}
+			}
+			if(n) row(x, y, pickedZ.data(), density.data(), n);
+			for(int m=0; m < n; m++) {
+				out[picked[m]] = vec4(x, y, pickedZ[m], density[m]);
+			}
+		}
+	};
+
+	if (pool) {
+		pool->parallelFor(nX+1, slab);
+	} else {
+		for (int i = 0; i < nX+1; ++i) slab(i);
+	}
+}
@@ -0,0 +1,120 @@
+//---------------------------------------------------------------------------
+//
+// Seabed density function
+//
+// Density is positive inside rock and zero or less in open water, the
+// surface is where it crosses zero. By default it is -y plus a few octaves
+// of Perlin or simplex noise, plus walls of rock around the edge of the original 400
+// unit map, but any density expression can stand in for it (see
+// densityProgram.hpp). A DensityField owns its seeded noise and compiled
+// expression, so the same settings always give the same seabed wherever
+// and however often it is sampled: the fixed Terrain grid and streamed
+// chunks read the same function.
+//
+// The density over a whole box is known to lie in a range without sampling
+// it, by interval arithmetic on the expression. Most of the map is rock far below the
+// seabed or water far above it, and grids are cut into blocks so those can
+// be skipped by sampling and by marching cubes.
+//
+//----------------------------------------------------------------------------
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "comp308.hpp"
+#include "densityProgram.hpp"
+#include "perlin.hpp"
+#include "simplex.hpp"
+
+class ThreadPool;
+
+struct DensitySettings {
+	//noise seed, 0 picks one from the clock
+	unsigned seed = 0;
+	//noise layers summed into the density, finest first
+	std::vector<Perlin::Octave> octaves = { {1.0f, 1.0f}, {0.403f, 2.5f}, {0.196f, 5.0f}, {0.101f, 10.0f} };
+	//noise added to the walls around the edge of the map
+	Perlin::Octave wallOctave = {0.101f, 10.0f};
+	//false for an open seabed with no walls, for worlds larger than the map
+	bool walls = true;
+	//simplex noise rather than Perlin, about as rough but with the gradient
+	//worked out exactly
+	bool simplex = false;
+	//density expression to use instead of the seabed the settings above
+	//make, empty for that seabed
+	std::string expression;
+};
+
+// Which blocks of a grid can hold the surface, see DensityField::surfaceBlocks
+struct SurfaceBlocks {
+	//cells along each side of a block, the last block on an axis may be smaller
+	int size = 0;
+	//blocks on each axis
+	int countX = 0;
+	int countY = 0;
+	int countZ = 0;
+	//x then y then z, 0 for a block that is all rock or all water
+	std::vector<char> active;
+
+	bool holds(int bx, int by, int bz) const { return active[(bx*countY + by)*countZ + bz] != 0; }
+	size_t skipped() const;
+	// Whether sampleGrid samples grid node (i, j, k) rather than setting it
+	// to the trend: it or a node next to it is a corner of a block that holds
+	// surface, so gradients taken across the grid there are exact too
+	bool sampled(int i, int j, int k) const;
+};
+
+class DensityField {
+private:
+	unsigned m_seed;
+	Perlin m_noise;
+	Simplex m_simplex;
+	DensityProgram m_program;
+
+public:
+	// Throws a runtime_error if settings.expression does not compile
+	explicit DensityField(const DensitySettings & = DensitySettings());
+
+	unsigned seed() const { return m_seed; }
+	const DensityProgram & program() const { return m_program; }
+
+	float at(comp308::vec3) const;
+
+	// Density at n points along z for one (x, y)
+	void row(float x, float y, const float *zs, float *out, int n) const;
+
+	// Density with the noise left out. Inside a box range() puts wholly on
+	// one side of the surface this is on the same side, so it stands in for
+	// at() where sampling is skipped
+	float trend(comp308::vec3) const;
+	void trendRow(float x, float y, const float *zs, float *out, int n) const;
+
+	// Lowest and highest density anywhere in the box from low to high
+	void range(comp308::vec3 low, comp308::vec3 high, float &lowest, float &highest) const;
+
+	// Cuts the grid sampleGrid would fill into blocks of size cells a side
+	// and marks the ones range() cannot rule out holding the surface at
+	// minValue
+	SurfaceBlocks surfaceBlocks(comp308::vec3 base, comp308::vec3 step, const int first[3],
+		int nX, int nY, int nZ, int size, float minValue) const;
+
+	// Gradient pointing into the rock. Exact when the density has no Perlin
+	// noise, else central differences with spacing h
+	comp308::vec3 gradient(comp308::vec3, float h) const;
+
+	// Fills a (nX+1)*(nY+1)*(nZ+1) grid of points, x then y then z, with
+	// w set to the density. Node (i, j, k) is at base + (first + (i, j, k))
+	// * step, so neighbouring grids that share first/base/step put their
+	// shared nodes at exactly the same coordinates. x slabs are shared out
+	// over pool, or done on the calling thread when pool is null.
+	// With blocks, only nodes of blocks that can hold the surface and their
+	// neighbours are sampled and the rest are set to trend().
+	void sampleGrid(comp308::vec3 base, comp308::vec3 step, const int first[3],
+		int nX, int nY, int nZ, comp308::vec4 *points, ThreadPool *pool,
+		const SurfaceBlocks *blocks = nullptr) const;
+};
+
+// Source of the seabed DensitySettings make when they have no expression
+std::string seabedSource(const DensitySettings &);
@@ -0,0 +1,774 @@
+//---------------------------------------------------------------------------
+//
+// Compiled density expressions
+//
+//----------------------------------------------------------------------------
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "comp308.hpp"
+#include "densityProgram.hpp"
+#include "perlin.hpp"
+#include "simplex.hpp"
+
+using namespace std;
+using namespace comp308;
+
+namespace {
+
+	struct Token {
+		enum Kind { Number, Name, Symbol, End } kind;
+		string text;
+		float number = 0;
+		int line = 0;
+	};
+
+	[[noreturn]] void fail(int line, const string &message) {
+		throw runtime_error("Error :: density line " + to_string(line) + ": " + message + ".");
+	}
+
+	// A newline ends a statement unless the line ends in the middle of one
+	vector<Token> tokenize(const string &source) {
+		vector<Token> tokens;
+		int line = 1, depth = 0;
+		auto continues = [&]() {
+			if (tokens.empty() || tokens.back().kind == Token::End) return true;
+			return tokens.back().kind == Token::Symbol && tokens.back().text != ")";
+		};
+		for (size_t i = 0; i < source.size();) {
+			char c = source[i];
+			if (c == '#') {
+				while (i < source.size() && source[i] != '\n') ++i;
+			} else if (c == '\n') {
+				if (depth == 0 && !continues()) tokens.push_back({Token::End, "", 0, line});
+				++line;
+				++i;
+			} else if (isspace((unsigned char) c)) {
+				++i;
+			} else if (isdigit((unsigned char) c) || c == '.') {
+				char *end;
+				float value = strtof(source.c_str() + i, &end);
+				if (end == source.c_str() + i) fail(line, "bad number");
+				tokens.push_back({Token::Number, source.substr(i, end - source.c_str() - i), value, line});
+				i = end - source.c_str();
+			} else if (isalpha((unsigned char) c) || c == '_') {
+				size_t start = i;
+				while (i < source.size() && (isalnum((unsigned char) source[i]) || source[i] == '_')) ++i;
+				tokens.push_back({Token::Name, source.substr(start, i - start), 0, line});
+			} else if (strchr("+-*/(),=", c)) {
+				if (c == '(') ++depth;
+				if (c == ')' && --depth < 0) fail(line, "unmatched )");
+				tokens.push_back({Token::Symbol, string(1, c), 0, line});
+				++i;
+			} else {
+				fail(line, string("unexpected '") + c + "'");
+			}
+		}
+		if (depth != 0) fail(line, "unmatched (");
+		if (!tokens.empty() && tokens.back().kind != Token::End) tokens.push_back({Token::End, "", 0, line});
+
+		// statements start with a name, so a line starting with an operator
+		// goes on from the one before
+		vector<Token> joined;
+		for (size_t t = 0; t < tokens.size(); ++t) {
+			if (tokens[t].kind == Token::End && t + 1 < tokens.size() && tokens[t + 1].kind == Token::Symbol) continue;
+			joined.push_back(tokens[t]);
+		}
+		return joined;
+	}
+
+	// Value or row of values an instruction reads
+	struct Lanes {
+		const float *p;			// nullptr for one value for every lane
+		float v;
+	};
+
+	template <typename F>
+	void unary(float *r, Lanes a, int n, F f) {
+		for (int i = 0; i < n; ++i) r[i] = f(a.p[i]);
+	}
+
+	template <typename F>
+	void binary(float *r, Lanes a, Lanes b, int n, F f) {
+		if (a.p && b.p) {
+			for (int i = 0; i < n; ++i) r[i] = f(a.p[i], b.p[i]);
+		} else if (a.p) {
+			float bv = b.v;
+			for (int i = 0; i < n; ++i) r[i] = f(a.p[i], bv);
+		} else {
+			float av = a.v;
+			for (int i = 0; i < n; ++i) r[i] = f(av, b.p[i]);
+		}
+	}
+
+	struct Interval {
+		float low, high;
+	};
+
+	Interval hull(float a, float b, float c, float d) {
+		float low = min(min(a, b), min(c, d)), high = max(max(a, b), max(c, d));
+		// infinities times zero
+		if (std::isnan(low) || std::isnan(high)) return { -INFINITY, INFINITY };
+		return { low, high };
+	}
+}
+
+float DensityProgram::scalar(const Instruction &ins, float a, float b) {
+	switch (ins.op) {
+	case Op::Add: return a + b;
+	case Op::Sub: return a - b;
+	case Op::Mul: return a * b;
+	case Op::Div: return a / b;
+	case Op::Neg: return -a;
+	case Op::Min: return min(a, b);
+	case Op::Max: return max(a, b);
+	case Op::Abs: return fabs(a);
+	case Op::Square: return a * a;
+	case Op::Sqrt: return sqrt(max(a, 0.0f));
+	case Op::Sin: return sin(a);
+	case Op::Cos: return cos(a);
+	case Op::Between: return (a > ins.low && a < ins.high) ? 1.0f : 0.0f;
+	case Op::Where: return (a != 0) ? b : 0.0f;
+	default: return 0;
+	}
+}
+
+/*
+	Parses straight into instructions, so every subexpression is looked up
+	by its operation and operands as it is made and made only once. The
+	instructions are then cut down to the ones the density uses, put in an
+	order where where() conditions come before the noise they gate, and
+	given row buffers that are reused once nothing reads them any more.
+*/
+class DensityProgram::Compiler {
+private:
+	DensityProgram &m_program;
+	vector<Token> m_tokens;
+	size_t m_next = 0;
+	vector<Instruction> m_nodes;
+	map<string, int> m_made;
+	map<string, Operand> m_names;
+
+	static int arity(Op op) {
+		switch (op) {
+		case Op::X: case Op::Y: case Op::Z: case Op::Noise: case Op::Simplex: return 0;
+		case Op::Neg: case Op::Abs: case Op::Square: case Op::Sqrt: case Op::Sin: case Op::Cos: case Op::Between:
+			return 1;
+		default: return 2;
+		}
+	}
+
+	static Operand constant(float value) {
+		Operand o;
+		o.value = value;
+		return o;
+	}
+
+	static bool is(const Operand &o, float value) { return o.index < 0 && o.value == value; }
+
+	Operand make(Op op, Operand a = Operand(), Operand b = Operand(), float low = 0, float high = 0, float frequency = 0) {
+		Instruction ins;
+		ins.op = op;
+		ins.low = low;
+		ins.high = high;
+		ins.frequency = frequency;
+		int n = arity(op);
+		if (n > 0 && a.index < 0 && (n < 2 || b.index < 0)) return constant(scalar(ins, a.value, b.value));
+
+		bool commutative = op == Op::Add || op == Op::Mul || op == Op::Min || op == Op::Max;
+		if (commutative && (a.index < 0 || (b.index >= 0 && b.index < a.index))) swap(a, b);
+		switch (op) {
+		case Op::Add: if (is(b, 0)) return a; break;
+		case Op::Sub: if (is(b, 0)) return a; if (is(a, 0)) return make(Op::Neg, b); break;
+		case Op::Mul:
+			if (is(b, 1)) return a;
+			if (is(b, 0)) return constant(0);
+			if (is(b, -1)) return make(Op::Neg, a);
+			if (a.index == b.index) return make(Op::Square, a);
+			break;
+		case Op::Div: if (is(b, 1)) return a; break;
+		case Op::Min: if (is(b, INFINITY)) return a; break;
+		case Op::Max: if (is(b, -INFINITY)) return a; break;
+		case Op::Neg: if (m_nodes[a.index].op == Op::Neg) return m_nodes[a.index].a; break;
+		case Op::Between: if (low == -INFINITY && high == INFINITY) return constant(1); break;
+		case Op::Where: if (a.index < 0) return (a.value != 0) ? b : constant(0); break;
+		default: break;
+		}
+
+		ins.a = a;
+		ins.b = b;
+		ins.varying = op == Op::Z || sampled(op) || (a.index >= 0 && m_nodes[a.index].varying)
+			|| (b.index >= 0 && m_nodes[b.index].varying);
+
+		string key(1, char(op));
+		for (const Operand &o : { a, b }) {
+			key.append((const char *) &o.index, sizeof(int));
+			if (o.index < 0) key.append((const char *) &o.value, sizeof(float));
+		}
+		for (float f : { low, high, frequency }) key.append((const char *) &f, sizeof(float));
+		auto found = m_made.find(key);
+		Operand result;
+		if (found != m_made.end()) {
+			result.index = found->second;
+		} else {
+			result.index = int(m_nodes.size());
+			m_nodes.push_back(ins);
+			m_made[key] = result.index;
+		}
+		return result;
+	}
+
+	const Token & peek() const { return m_tokens[m_next]; }
+	bool accept(const char *symbol) {
+		if (peek().kind == Token::Symbol && peek().text == symbol) {
+			++m_next;
+			return true;
+		}
+		return false;
+	}
+	void expect(const char *symbol) {
+		if (!accept(symbol)) fail(peek().line, string("expected '") + symbol + "'");
+	}
+
+	Operand expression() {
+		Operand value = term();
+		while (true) {
+			if (accept("+")) value = make(Op::Add, value, term());
+			else if (accept("-")) value = make(Op::Sub, value, term());
+			else return value;
+		}
+	}
+
+	Operand term() {
+		Operand value = factor();
+		while (true) {
+			if (accept("*")) value = make(Op::Mul, value, factor());
+			else if (accept("/")) value = make(Op::Div, value, factor());
+			else return value;
+		}
+	}
+
+	Operand factor() {
+		if (accept("-")) return make(Op::Neg, factor());
+		const Token &token = peek();
+		if (token.kind == Token::Number) {
+			++m_next;
+			return constant(token.number);
+		}
+		if (accept("(")) {
+			Operand value = expression();
+			expect(")");
+			return value;
+		}
+		if (token.kind != Token::Name) fail(token.line, "expected a value");
+		++m_next;
+		if (accept("(")) return call(token);
+		if (token.text == "x") return make(Op::X);
+		if (token.text == "y") return make(Op::Y);
+		if (token.text == "z") return make(Op::Z);
+		if (token.text == "inf") return constant(INFINITY);
+		auto named = m_names.find(token.text);
+		if (named == m_names.end()) fail(token.line, "unknown name '" + token.text + "'");
+		return named->second;
+	}
+
+	Operand call(const Token &name) {
+		vector<Operand> args;
+		if (!accept(")")) {
+			do {
+				args.push_back(expression());
+			} while (accept(","));
+			expect(")");
+		}
+		const string &f = name.text;
+		auto count = [&](size_t n) {
+			if (args.size() != n) fail(name.line, f + "() takes " + to_string(n) + " values");
+		};
+		auto constants = [&]() {
+			for (const Operand &a : args) {
+				if (a.index >= 0) fail(name.line, f + "() needs constant values");
+			}
+		};
+
+		if (f == "noise" || f == "simplex") {
+			constants();
+			if (args.empty() || args.size() % 2) fail(name.line, f + "() takes pairs of frequency and amplitude");
+			// one instruction an octave, so octaves shared between noise() calls are sampled once
+			Operand sum = constant(0);
+			for (size_t o = 0; o < args.size(); o += 2) {
+				Operand octave = make(f == "noise" ? Op::Noise : Op::Simplex, Operand(), Operand(), 0, 0, args[o].value);
+				sum = make(Op::Add, sum, make(Op::Mul, octave, args[o + 1]));
+			}
+			return sum;
+		}
+		if (f == "plane") {
+			count(4);
+			Operand sum = args[3];
+			const Op axes[3] = { Op::X, Op::Y, Op::Z };
+			for (int a = 0; a < 3; ++a) sum = make(Op::Add, sum, make(Op::Mul, args[a], make(axes[a])));
+			return sum;
+		}
+		if (f == "ball") {
+			count(4);
+			Operand sum = constant(0);
+			const Op axes[3] = { Op::X, Op::Y, Op::Z };
+			for (int a = 0; a < 3; ++a) sum = make(Op::Add, sum, make(Op::Square, make(Op::Sub, make(axes[a]), args[a])));
+			return make(Op::Sub, args[3], make(Op::Sqrt, sum));
+		}
+		if (f == "box") {
+			count(6);
+			constants();
+			Operand inside = constant(1);
+			const Op axes[3] = { Op::X, Op::Y, Op::Z };
+			for (int a = 0; a < 3; ++a) {
+				inside = make(Op::Mul, inside, make(Op::Between, make(axes[a]), Operand(), args[a].value, args[a + 3].value));
+			}
+			return inside;
+		}
+		if (f == "where") {
+			count(2);
+			return make(Op::Where, args[0], args[1]);
+		}
+		if (f == "blend") {
+			count(3);
+			Operand t = make(Op::Min, make(Op::Max, args[2], constant(0)), constant(1));
+			return make(Op::Add, args[0], make(Op::Mul, make(Op::Sub, args[1], args[0]), t));
+		}
+		if (f == "min" || f == "max") {
+			if (args.size() < 2) fail(name.line, f + "() takes two or more values");
+			Operand value = args[0];
+			for (size_t a = 1; a < args.size(); ++a) value = make(f == "min" ? Op::Min : Op::Max, value, args[a]);
+			return value;
+		}
+		if (f == "clamp") {
+			count(3);
+			return make(Op::Min, make(Op::Max, args[0], args[1]), args[2]);
+		}
+		const struct { const char *name; Op op; } functions[] = {
+			{ "abs", Op::Abs }, { "sqrt", Op::Sqrt }, { "sin", Op::Sin }, { "cos", Op::Cos }
+		};
+		for (const auto &function : functions) {
+			if (f == function.name) {
+				count(1);
+				return make(function.op, args[0]);
+			}
+		}
+		fail(name.line, "unknown function '" + f + "'");
+	}
+
+	void statement() {
+		const Token &name = peek();
+		if (name.kind != Token::Name) fail(name.line, "expected a name");
+		if (name.text == "x" || name.text == "y" || name.text == "z" || name.text == "inf") {
+			fail(name.line, "'" + name.text + "' cannot be set");
+		}
+		if (m_names.count(name.text)) fail(name.line, "'" + name.text + "' is set twice");
+		++m_next;
+		expect("=");
+		Operand value = expression();
+		if (peek().kind != Token::End) fail(peek().line, "expected the end of the line");
+		++m_next;
+		m_names[name.text] = value;
+	}
+
+	void finish(Operand root) {
+		m_program.m_result = root;
+		if (root.index < 0) return;
+		const int count = int(m_nodes.size());
+
+		// where() conditions each instruction is under, none if it is used
+		// anywhere else. Noise under nested where()s only looks at the inner
+		// condition, which samples a few points it need not
+		vector<char> everywhere(count, 0);
+		vector<set<int>> gates(count);
+		function<void(int, int)> visit = [&](int node, int gate) {
+			if (everywhere[node]) return;
+			if (gate < 0) {
+				everywhere[node] = 1;
+				gates[node].clear();
+			} else if (!gates[node].insert(gate).second) {
+				return;
+			}
+			const Instruction &ins = m_nodes[node];
+			if (ins.a.index >= 0) visit(ins.a.index, gate);
+			if (ins.b.index >= 0) visit(ins.b.index, ins.op == Op::Where ? ins.a.index : gate);
+		};
+		visit(root.index, -1);
+		for (int node = 0; node < count; ++node) {
+			if (!sampled(m_nodes[node].op)) gates[node].clear();
+		}
+
+		// a condition that needs the noise it gates cannot come before it
+		auto dependsOn = [&](int from, int target) {
+			vector<char> seen(count, 0);
+			vector<int> stack = { from };
+			while (!stack.empty()) {
+				int node = stack.back();
+				stack.pop_back();
+				if (node == target) return true;
+				if (seen[node]) continue;
+				seen[node] = 1;
+				const Instruction &ins = m_nodes[node];
+				if (ins.a.index >= 0) stack.push_back(ins.a.index);
+				if (ins.b.index >= 0) stack.push_back(ins.b.index);
+				for (int g : gates[node]) stack.push_back(g);
+			}
+			return false;
+		};
+		for (int node = 0; node < count; ++node) {
+			for (int g : gates[node]) {
+				if (dependsOn(g, node)) {
+					gates[node].clear();
+					break;
+				}
+			}
+		}
+
+		// operands and conditions before what reads them, leaving out what
+		// the density does not use
+		vector<int> position(count, -1);
+		vector<int> order;
+		function<void(int)> place = [&](int node) {
+			if (position[node] != -1) return;
+			position[node] = -2;
+			const Instruction &ins = m_nodes[node];
+			if (ins.a.index >= 0) place(ins.a.index);
+			if (ins.b.index >= 0) place(ins.b.index);
+			for (int g : gates[node]) place(g);
+			position[node] = int(order.size());
+			order.push_back(node);
+		};
+		place(root.index);
+
+		vector<Instruction> &code = m_program.m_code;
+		for (int node : order) {
+			Instruction ins = m_nodes[node];
+			if (ins.a.index >= 0) ins.a.index = position[ins.a.index];
+			if (ins.b.index >= 0) ins.b.index = position[ins.b.index];
+			ins.gateFirst = int(m_program.m_gates.size());
+			ins.gateCount = int(gates[node].size());
+			for (int g : gates[node]) m_program.m_gates.push_back(position[g]);
+			code.push_back(ins);
+		}
+		m_program.m_result.index = position[root.index];
+
+		// row buffers, freed after their last reader
+		const int size = int(code.size());
+		vector<int> lastUse(size, -1);
+		auto reads = [&](int p, const function<void(int)> &fn) {
+			const Instruction &ins = code[p];
+			set<int> read;
+			if (ins.a.index >= 0) read.insert(ins.a.index);
+			if (ins.b.index >= 0) read.insert(ins.b.index);
+			for (int g = 0; g < ins.gateCount; ++g) read.insert(m_program.m_gates[ins.gateFirst + g]);
+			for (int r : read) fn(r);
+		};
+		for (int p = 0; p < size; ++p) reads(p, [&](int r) { lastUse[r] = p; });
+		lastUse[m_program.m_result.index] = size;
+		vector<int> free;
+		for (int p = 0; p < size; ++p) {
+			Instruction &ins = code[p];
+			if (ins.varying && ins.op != Op::Z) {
+				if (free.empty()) {
+					ins.slot = m_program.m_slots++;
+				} else {
+					ins.slot = free.back();
+					free.pop_back();
+				}
+			}
+			reads(p, [&](int r) {
+				if (lastUse[r] == p && code[r].slot >= 0) free.push_back(code[r].slot);
+			});
+		}
+	}
+
+public:
+	Compiler(DensityProgram &program, const string &source) : m_program(program), m_tokens(tokenize(source)) {
+		while (m_next < m_tokens.size()) statement();
+		auto density = m_names.find("density");
+		if (density == m_names.end()) fail(m_tokens.empty() ? 1 : m_tokens.back().line, "nothing sets density");
+		finish(density->second);
+	}
+};
+
+DensityProgram::DensityProgram(const string &source) : m_source(source) {
+	Compiler(*this, source);
+}
+
+void DensityProgram::evaluate(const Perlin *noise, const Simplex *simplex, float x, float y, const float *zs, float *out, int n) const {
+	if (m_result.index < 0) {
+		fill(out, out + n, m_result.value);
+		return;
+	}
+	// kept for the thread's next row
+	thread_local vector<float> buffer;
+	thread_local vector<float> uniform;
+	thread_local vector<int> picked;
+	if (buffer.size() < size_t(m_slots + 4) * n) buffer.resize(size_t(m_slots + 4) * n);
+	if (uniform.size() < m_code.size()) uniform.resize(m_code.size());
+	float *sx = &buffer[size_t(m_slots) * n], *sy = sx + n, *sz = sy + n, *gathered = sz + n;
+
+	auto lanes = [&](const Operand &o) {
+		if (o.index < 0) return Lanes{ nullptr, o.value };
+		const Instruction &ins = m_code[o.index];
+		if (!ins.varying) return Lanes{ nullptr, uniform[o.index] };
+		if (ins.op == Op::Z) return Lanes{ zs, 0 };
+		return Lanes{ &buffer[size_t(ins.slot) * n], 0 };
+	};
+
+	for (size_t c = 0; c < m_code.size(); ++c) {
+		const Instruction &ins = m_code[c];
+		if (!ins.varying) {
+			if (ins.op == Op::X) uniform[c] = x;
+			else if (ins.op == Op::Y) uniform[c] = y;
+			else uniform[c] = scalar(ins, lanes(ins.a).v, lanes(ins.b).v);
+			continue;
+		}
+		if (ins.op == Op::Z) continue;
+
+		float *r = &buffer[size_t(ins.slot) * n];
+		Lanes a = lanes(ins.a), b = lanes(ins.b);
+		switch (ins.op) {
+		case Op::Noise:
+		case Op::Simplex: {
+			if (ins.op == Op::Noise ? !noise : !simplex) {
+				fill(r, r + n, 0.0f);
+				break;
+			}
+			// the lanes any of its conditions hold in
+			picked.clear();
+			bool all = ins.gateCount == 0;
+			for (int g = 0; g < ins.gateCount && !all; ++g) {
+				Lanes gate = lanes(Operand{ m_gates[ins.gateFirst + g], 0 });
+				if (!gate.p) all = gate.v != 0;
+			}
+			if (!all) {
+				for (int i = 0; i < n; ++i) {
+					for (int g = 0; g < ins.gateCount; ++g) {
+						Lanes gate = lanes(Operand{ m_gates[ins.gateFirst + g], 0 });
+						if (gate.p && gate.p[i] != 0) {
+							picked.push_back(i);
+							break;
+						}
+					}
+				}
+				all = int(picked.size()) == n;
+			}
+			const float f = ins.frequency;
+			int m = all ? n : int(picked.size());
+			for (int i = 0; i < m; ++i) {
+				sx[i] = x*f;
+				sy[i] = y*f;
+				sz[i] = zs[all ? i : picked[i]]*f;
+			}
+			float *samples = all ? r : gathered;
+			if (m && ins.op == Op::Noise) noise->noise(sx, sy, sz, samples, m);
+			else if (m) simplex->noise(sx, sy, sz, samples, m);
+			if (!all) {
+				fill(r, r + n, 0.0f);
+				for (int i = 0; i < m; ++i) r[picked[i]] = samples[i];
+			}
+			break;
+		}
+		case Op::Add: binary(r, a, b, n, [](float p, float q) { return p + q; }); break;
+		case Op::Sub: binary(r, a, b, n, [](float p, float q) { return p - q; }); break;
+		case Op::Mul: binary(r, a, b, n, [](float p, float q) { return p * q; }); break;
+		case Op::Div: binary(r, a, b, n, [](float p, float q) { return p / q; }); break;
+		case Op::Min: binary(r, a, b, n, [](float p, float q) { return min(p, q); }); break;
+		case Op::Max: binary(r, a, b, n, [](float p, float q) { return max(p, q); }); break;
+		case Op::Where: binary(r, a, b, n, [](float p, float q) { return (p != 0) ? q : 0.0f; }); break;
+		case Op::Neg: unary(r, a, n, [](float p) { return -p; }); break;
+		case Op::Abs: unary(r, a, n, [](float p) { return fabs(p); }); break;
+		case Op::Square: unary(r, a, n, [](float p) { return p * p; }); break;
+		case Op::Sqrt: unary(r, a, n, [](float p) { return sqrt(max(p, 0.0f)); }); break;
+		case Op::Sin: unary(r, a, n, [](float p) { return sin(p); }); break;
+		case Op::Cos: unary(r, a, n, [](float p) { return cos(p); }); break;
+		case Op::Between: {
+			const float low = ins.low, high = ins.high;
+			unary(r, a, n, [=](float p) { return (p > low && p < high) ? 1.0f : 0.0f; });
+			break;
+		}
+		default: break;
+		}
+	}
+
+	Lanes result = lanes(m_result);
+	if (result.p) copy(result.p, result.p + n, out);
+	else fill(out, out + n, result.v);
+}
+
+void DensityProgram::row(const Perlin &noise, const Simplex &simplex, float x, float y, const float *zs, float *out,
+	int n) const {
+	evaluate(&noise, &simplex, x, y, zs, out, n);
+}
+
+void DensityProgram::trendRow(float x, float y, const float *zs, float *out, int n) const {
+	evaluate(nullptr, nullptr, x, y, zs, out, n);
+}
+
+float DensityProgram::trend(vec3 p) const {
+	float density;
+	evaluate(nullptr, nullptr, p.x, p.y, &p.z, &density, 1);
+	return density;
+}
+
+bool DensityProgram::differentiable() const {
+	return none_of(m_code.begin(), m_code.end(), [](const Instruction &ins) { return ins.op == Op::Noise; });
+}
+
+/*
+	The instructions once over for one point, each carrying its gradient
+	by the chain rule. Values round as row() does. box() and where() are
+	flat away from their edges, and min(), max() and abs() take the
+	gradient of the side they pick.
+*/
+float DensityProgram::gradient(const Perlin &noise, const Simplex &simplex, vec3 p, vec3 &gradient) const {
+	if (m_result.index < 0) {
+		gradient = vec3(0);
+		return m_result.value;
+	}
+	thread_local vector<float> values;
+	thread_local vector<vec3> slopes;
+	if (values.size() < m_code.size()) {
+		values.resize(m_code.size());
+		slopes.resize(m_code.size());
+	}
+	auto value = [&](const Operand &o) { return (o.index < 0) ? o.value : values[o.index]; };
+	auto slope = [&](const Operand &o) { return (o.index < 0) ? vec3(0) : slopes[o.index]; };
+
+	for (size_t c = 0; c < m_code.size(); ++c) {
+		const Instruction &ins = m_code[c];
+		float a = value(ins.a), b = value(ins.b);
+		vec3 da = slope(ins.a), db = slope(ins.b);
+		float &r = values[c];
+		vec3 &dr = slopes[c];
+		dr = vec3(0);
+		switch (ins.op) {
+		case Op::X: r = p.x; dr.x = 1; break;
+		case Op::Y: r = p.y; dr.y = 1; break;
+		case Op::Z: r = p.z; dr.z = 1; break;
+		case Op::Noise:
+		case Op::Simplex: {
+			bool gated = ins.gateCount > 0;
+			for (int g = 0; g < ins.gateCount && gated; ++g) gated = values[m_gates[ins.gateFirst + g]] == 0;
+			if (gated) {
+				r = 0;
+				break;
+			}
+			const float f = ins.frequency;
+			if (ins.op == Op::Noise) {
+				r = noise.noise(p.x*f, p.y*f, p.z*f);
+			} else {
+				float g[3];
+				r = simplex.noise(p.x*f, p.y*f, p.z*f, g);
+				dr = vec3(g[0], g[1], g[2]) * f;
+			}
+			break;
+		}
+		case Op::Add: r = a + b; dr = da + db; break;
+		case Op::Sub: r = a - b; dr = da - db; break;
+		case Op::Mul: r = a * b; dr = da * b + db * a; break;
+		case Op::Div: r = a / b; dr = (da * b - db * a) / (b * b); break;
+		case Op::Neg: r = -a; dr = -da; break;
+		case Op::Min: r = min(a, b); dr = (b < a) ? db : da; break;
+		case Op::Max: r = max(a, b); dr = (a < b) ? db : da; break;
+		case Op::Abs: r = fabs(a); dr = (a < 0) ? -da : da; break;
+		case Op::Square: r = a * a; dr = da * (2 * a); break;
+		case Op::Sqrt:
+			r = sqrt(max(a, 0.0f));
+			if (r > 0) dr = da * (0.5f / r);
+			break;
+		case Op::Sin: r = sin(a); dr = da * cos(a); break;
+		case Op::Cos: r = cos(a); dr = da * -sin(a); break;
+		case Op::Between: r = scalar(ins, a, b); break;
+		case Op::Where:
+			r = (a != 0) ? b : 0.0f;
+			if (a != 0) dr = db;
+			break;
+		}
+	}
+	gradient = slope(m_result);
+	return value(m_result);
+}
+
+/*
+	Interval arithmetic along the same instructions. A where() whose
+	condition may or may not hold can be its expression or 0.
+*/
+void DensityProgram::range(vec3 low, vec3 high, float &lowest, float &highest) const {
+	vector<Interval> values(m_code.size());
+	auto interval = [&](const Operand &o) { return (o.index < 0) ? Interval{ o.value, o.value } : values[o.index]; };
+	for (size_t c = 0; c < m_code.size(); ++c) {
+		const Instruction &ins = m_code[c];
+		Interval a = interval(ins.a), b = interval(ins.b);
+		Interval &r = values[c];
+		switch (ins.op) {
+		case Op::X: r = { low.x, high.x }; break;
+		case Op::Y: r = { low.y, high.y }; break;
+		case Op::Z: r = { low.z, high.z }; break;
+		case Op::Noise: r = { -Perlin::bound(), Perlin::bound() }; break;
+		case Op::Simplex: r = { -Simplex::bound(), Simplex::bound() }; break;
+		case Op::Add: r = { a.low + b.low, a.high + b.high }; break;
+		case Op::Sub: r = { a.low - b.high, a.high - b.low }; break;
+		case Op::Mul: r = hull(a.low * b.low, a.low * b.high, a.high * b.low, a.high * b.high); break;
+		case Op::Div:
+			if (b.low > 0 || b.high < 0) r = hull(a.low / b.low, a.low / b.high, a.high / b.low, a.high / b.high);
+			else r = { -INFINITY, INFINITY };
+			break;
+		case Op::Neg: r = { -a.high, -a.low }; break;
+		case Op::Min: r = { min(a.low, b.low), min(a.high, b.high) }; break;
+		case Op::Max: r = { max(a.low, b.low), max(a.high, b.high) }; break;
+		case Op::Abs:
+		case Op::Square:
+			if (a.low >= 0) r = a;
+			else if (a.high <= 0) r = { -a.high, -a.low };
+			else r = { 0, max(-a.low, a.high) };
+			if (ins.op == Op::Square) r = { r.low * r.low, r.high * r.high };
+			break;
+		case Op::Sqrt: r = { sqrt(max(a.low, 0.0f)), sqrt(max(a.high, 0.0f)) }; break;
+		case Op::Sin: case Op::Cos: r = { -1, 1 }; break;
+		case Op::Between:
+			if (a.low > ins.low && a.high < ins.high) r = { 1, 1 };
+			else if (a.high <= ins.low || a.low >= ins.high) r = { 0, 0 };
+			else r = { 0, 1 };
+			break;
+		case Op::Where:
+			if (a.low > 0 || a.high < 0) r = b;
+			else if (a.low == 0 && a.high == 0) r = { 0, 0 };
+			else r = { min(b.low, 0.0f), max(b.high, 0.0f) };
+			break;
+		}
+	}
+	Interval result = interval(m_result);
+	// covers the float rounding in row()
+	float rounding = 0.01f + 1e-5f * max(fabs(result.low), fabs(result.high));
+	lowest = result.low - rounding;
+	highest = result.high + rounding;
+}
+
+size_t DensityProgram::noiseCount() const {
+	return size_t(count_if(m_code.begin(), m_code.end(), [](const Instruction &ins) { return sampled(ins.op); }));
+}
+
+string readDensitySource(const string &filename) {
+	ifstream file(filename);
+	if (!file.is_open()) {
+		cerr << "Error reading " << filename << endl;
+		throw runtime_error("Error :: could not open file.");
+	}
+	stringstream source;
+	source << file.rdbuf();
+	return source.str();
+}
@@ -0,0 +1,104 @@
+//---------------------------------------------------------------------------
+//
+// Compiled density expressions
+//
+// A density function written as text, so trying a different seabed does
+// not need a rebuild. The source is parsed once into a flat list of
+// instructions, each an operation on the results of ones before it. Equal
+// subexpressions become one instruction and constants are folded, so noise
+// the expression asks for in several places is sampled once. Instructions
+// that only depend on x and y are worked out once a row, the rest run over
+// a whole row of z at a time.
+//
+// Source is lines of name = expression, the one named density is the
+// result. # starts a comment. A line that ends in an operator or a comma
+// or inside brackets goes on to the next, as does one that starts with an
+// operator from the line before. Expressions have + - * /
+// and brackets over numbers, x, y, z, inf, names from earlier lines and
+//   noise(f, a, ...)              octaves of Perlin noise, pairs of
+//                                 frequency and amplitude
+//   simplex(f, a, ...)            the same with simplex noise
+//   plane(nx, ny, nz, d)          nx*x + ny*y + nz*z + d
+//   ball(x, y, z, r)              r less the distance to the centre
+//   box(x0, y0, z0, x1, y1, z1)   1 strictly inside the box, else 0
+//   where(c, e)                   e where c is not 0, else 0. Noise only
+//                                 used under where() is only sampled there
+//   blend(a, b, t)                a to b as t goes from 0 to 1
+//   min(a, b, ...), max(a, b, ...), clamp(v, lo, hi), abs(v), sqrt(v),
+//   sin(v), cos(v)
+//
+// A program with no Perlin noise in it has its gradient worked out along
+// with its value, from the derivatives simplex noise gives, so normals do
+// not need samples either side of the point.
+//
+//----------------------------------------------------------------------------
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "comp308.hpp"
+#include "perlin.hpp"
+#include "simplex.hpp"
+
+class DensityProgram {
+private:
+	enum class Op : unsigned char {
+		X, Y, Z, Noise, Simplex, Add, Sub, Mul, Div, Neg, Min, Max, Abs, Square, Sqrt, Sin, Cos, Between, Where
+	};
+
+	struct Operand {
+		int index = -1;				// instruction giving the value, -1 for a constant
+		float value = 0;
+	};
+
+	struct Instruction {
+		Op op;
+		bool varying = false;		// depends on z, else worked out once a row
+		Operand a, b;
+		float low = 0, high = 0;	// Between: the open interval it tests for
+		float frequency = 0;		// Noise, Simplex: one octave at this frequency
+		int gateFirst = 0;			// Noise, Simplex: the where() conditions it is under,
+		int gateCount = 0;			// sampled everywhere if none
+		int slot = -1;				// row buffer of a varying result
+	};
+
+	class Compiler;
+
+	std::vector<Instruction> m_code;
+	std::vector<int> m_gates;
+	Operand m_result;
+	int m_slots = 0;
+	std::string m_source;
+
+	static bool sampled(Op op) { return op == Op::Noise || op == Op::Simplex; }
+	static float scalar(const Instruction &, float a, float b);
+	// row() and trendRow(), noise is taken as 0 when there is none
+	void evaluate(const Perlin *, const Simplex *, float x, float y, const float *zs, float *out, int n) const;
+
+public:
+	// Throws a runtime_error naming the line if source does not compile
+	explicit DensityProgram(const std::string &source);
+
+	// Density at n points along z for one (x, y)
+	void row(const Perlin &, const Simplex &, float x, float y, const float *zs, float *out, int n) const;
+	// Whether gradient() is exact, there is no Perlin noise
+	bool differentiable() const;
+	// Density at p with its gradient, Perlin noise is sampled but taken as flat
+	float gradient(const Perlin &, const Simplex &, comp308::vec3 p, comp308::vec3 &gradient) const;
+	// Density with every noise octave taken as 0
+	float trend(comp308::vec3) const;
+	void trendRow(float x, float y, const float *zs, float *out, int n) const;
+	// Lowest and highest density anywhere in the box from low to high, with
+	// noise anywhere within Perlin::bound() or Simplex::bound()
+	void range(comp308::vec3 low, comp308::vec3 high, float &lowest, float &highest) const;
+
+	const std::string & source() const { return m_source; }
+	size_t instructionCount() const { return m_code.size(); }
+	// Octaves sampled at each point, at most
+	size_t noiseCount() const;
+};
+
+// Reads a density source file, throws if it cannot
+std::string readDensitySource(const std::string &filename);
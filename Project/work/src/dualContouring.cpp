@@ -0,0 +1,312 @@
+//---------------------------------------------------------------------------
+//
+// Dual contouring
+//
+//----------------------------------------------------------------------------
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "comp308.hpp"
+#include "density.hpp"
+#include "dualContouring.hpp"
+#include "threadPool.hpp"
+
+using namespace std;
+using namespace comp308;
+
+namespace {
+	// Tangent plane where the surface crosses a grid edge
+	struct Crossing {
+		vec3 point;
+		vec3 normal;	// out of the solid, 0 where the gradient is
+	};
+
+	// Eigenvalues of the symmetric a, left on its diagonal, and its
+	// eigenvectors as the columns of v, by Jacobi rotations
+	void eigenSymmetric(float a[3][3], float v[3][3]) {
+		for (int r = 0; r < 3; ++r) {
+			for (int c = 0; c < 3; ++c) v[r][c] = (r == c) ? 1.0f : 0.0f;
+		}
+		const int pairs[3][2] = { {0, 1}, {0, 2}, {1, 2} };
+		for (int sweep = 0; sweep < 8; ++sweep) {
+			float off = fabs(a[0][1]) + fabs(a[0][2]) + fabs(a[1][2]);
+			if (off < 1e-9f) break;
+			for (const auto &pq : pairs) {
+				int p = pq[0], q = pq[1];
+				if (fabs(a[p][q]) < 1e-12f) continue;
+				float theta = (a[q][q] - a[p][p]) / (2 * a[p][q]);
+				float t = ((theta >= 0) ? 1.0f : -1.0f) / (fabs(theta) + sqrt(theta * theta + 1));
+				float c = 1 / sqrt(t * t + 1), s = t * c;
+				for (int k = 0; k < 3; ++k) {
+					float akp = a[k][p], akq = a[k][q];
+					a[k][p] = c * akp - s * akq;
+					a[k][q] = s * akp + c * akq;
+				}
+				for (int k = 0; k < 3; ++k) {
+					float apk = a[p][k], aqk = a[q][k];
+					a[p][k] = c * apk - s * aqk;
+					a[q][k] = s * apk + c * aqk;
+				}
+				for (int k = 0; k < 3; ++k) {
+					float vkp = v[k][p], vkq = v[k][q];
+					v[k][p] = c * vkp - s * vkq;
+					v[k][q] = s * vkp + c * vkq;
+				}
+			}
+		}
+	}
+
+	// Minimises |A x - b|^2 through the pseudo-inverse of A^T A, leaving out
+	// the eigenvectors whose eigenvalues are under cutoff times the largest
+	vec3 solveQEF(float ata[3][3], vec3 atb, float cutoff) {
+		float v[3][3];
+		eigenSymmetric(ata, v);
+		float largest = max(max(ata[0][0], ata[1][1]), ata[2][2]);
+		vec3 x(0);
+		for (int e = 0; e < 3; ++e) {
+			float lambda = ata[e][e];
+			if (lambda <= 0 || lambda < cutoff * largest) continue;
+			vec3 axis(v[0][e], v[1][e], v[2][e]);
+			x += axis * (dot(axis, atb) / lambda);
+		}
+		return x;
+	}
+
+	struct DCBlock {
+		std::vector<vec3> vertices;
+		std::vector<vec3> normals;
+		std::vector<unsigned int> indices;
+	};
+
+	struct Grid {
+		int nX, nY, nZ;
+		int YtimeZ;
+		float minValue;
+		const vec4 *points;
+		vec3 spacing;
+
+		int node(int i, int j, int k) const { return i*YtimeZ + j*(nZ+1) + k; }
+		size_t cell(int i, int j, int k) const { return (size_t(i)*nY + j)*nZ + k; }
+		bool solid(int n) const { return points[n].w > minValue; }
+	};
+
+	// Places the vertex of every cell from x lo up to hi that the surface
+	// passes through, and stores its index in the block in cellVertex
+	void placeVertices(int lo, int hi, const Grid &grid, const DualContourSettings &settings,
+		const SurfaceBlocks *skip, std::vector<int> &cellVertex, DCBlock &block) {
+		const int nY = grid.nY, nZ = grid.nZ;
+		const vec4 *points = grid.points;
+		// crossings on the three edges from each node of slab i (cache[0])
+		// and slab i+1 (cache[1]), worked out once for the cells around them
+		const int face = grid.YtimeZ;
+		std::vector<Crossing> cache[2];
+		std::vector<char> made[2];
+		for (int s = 0; s < 2; ++s) {
+			cache[s].resize(3*face);
+			made[s].assign(3*face, 0);
+		}
+		auto crossing = [&](int a, int b, int c, int axis, int slab) -> const Crossing & {
+			int at = 3*(b*(nZ+1) + c) + axis;
+			Crossing &x = cache[slab][at];
+			if (made[slab][at]) return x;
+			made[slab][at] = 1;
+			int p0 = grid.node(a, b, c);
+			int p1 = p0 + (axis == 0 ? grid.YtimeZ : axis == 1 ? (nZ+1) : 1);
+			x.point = LinearInterp(points[p0], points[p1], grid.minValue);
+			vec3 g;
+			if (settings.gradient) {
+				g = settings.gradient(x.point);
+			} else {
+				vec3 gLo = GridGradient(points, a, b, c, grid.nX, nY, nZ, grid.spacing);
+				vec3 gHi = GridGradient(points, a + (axis == 0), b + (axis == 1), c + (axis == 2),
+					grid.nX, nY, nZ, grid.spacing);
+				float t = (points[p0].w != points[p1].w)
+					? (grid.minValue - points[p0].w) / (points[p1].w - points[p0].w) : 0.0f;
+				g = gLo + (gHi - gLo) * t;
+			}
+			x.normal = (length(g) > 0) ? -normalize(g) : vec3(0);
+			return x;
+		};
+
+		for (int i = lo; i < hi; i++) {
+			for (int j = 0; j < nY; j++) {
+				for (int k = 0; k < nZ; k++) {
+					//jump to the end of a block without surface
+					if (skip && !skip->holds(i / skip->size, j / skip->size, k / skip->size)) {
+						k = min(nZ, (k / skip->size + 1) * skip->size) - 1;
+						continue;
+					}
+					// solid corners, bit x + 2y + 4z of the corner's offset
+					int ind = grid.node(i, j, k);
+					int solid = 0;
+					for (int c = 0; c < 8; c++) {
+						if (grid.solid(ind + (c & 1)*grid.YtimeZ + ((c >> 1) & 1)*(nZ+1) + (c >> 2))) solid |= 1 << c;
+					}
+					if (solid == 0 || solid == 255) continue;
+
+					// edge e runs along axis e/4 from the corner offset by the
+					// other two axes' bits of e
+					const Crossing *crossed[12];
+					int count = 0;
+					for (int e = 0; e < 12; e++) {
+						int axis = e / 4, o[3];
+						o[axis] = 0;
+						o[(axis + 1) % 3] = e & 1;
+						o[(axis + 2) % 3] = (e >> 1) & 1;
+						int c0 = o[0] + 2*o[1] + 4*o[2], c1 = c0 + (1 << axis);
+						if (((solid >> c0) & 1) == ((solid >> c1) & 1)) continue;
+						crossed[count++] = &crossing(i + o[0], j + o[1], k + o[2], axis, o[0]);
+					}
+
+					vec3 mass(0), normal(0);
+					for (int e = 0; e < count; e++) {
+						mass += crossed[e]->point;
+						normal += crossed[e]->normal;
+					}
+					mass /= float(count);
+					// planes taken about the mass point, so dropped directions stay there
+					float ata[3][3] = { {0, 0, 0}, {0, 0, 0}, {0, 0, 0} };
+					vec3 atb(0);
+					for (int e = 0; e < count; e++) {
+						const vec3 &n = crossed[e]->normal;
+						float d = dot(n, crossed[e]->point - mass);
+						for (int r = 0; r < 3; r++) {
+							for (int c = 0; c < 3; c++) ata[r][c] += n[r] * n[c];
+						}
+						atb += n * d;
+					}
+					vec3 v = mass + solveQEF(ata, atb, settings.cutoff);
+
+					// kept in its cell, a vertex outside it can fold the quads over
+					const vec4 &low = points[ind];
+					const vec4 &high = points[ind + grid.YtimeZ + (nZ+1) + 1];
+					v = vec3(min(max(v.x, low.x), high.x), min(max(v.y, low.y), high.y), min(max(v.z, low.z), high.z));
+
+					cellVertex[grid.cell(i, j, k)] = int(block.vertices.size());
+					block.vertices.push_back(v);
+					block.normals.push_back((length(normal) > 0) ? normalize(normal) : vec3(0, 1, 0));
+				}
+			}
+			//slab i+1 becomes the low slab of the next row of cells
+			cache[0].swap(cache[1]);
+			made[0].swap(made[1]);
+			fill(made[1].begin(), made[1].end(), 0);
+		}
+	}
+
+	// A quad for every crossed edge starting at a node of the cells from x lo
+	// up to hi. Each such edge is the one from the low corner of the cell
+	// highest on the other two axes of the four around it, so it is only
+	// looked at once, from a cell that has a vertex
+	void makeQuads(int lo, int hi, const Grid &grid, const std::vector<int> &cellVertex,
+		const std::vector<unsigned int> &slabStart, const std::vector<vec3> &vertices, DCBlock &block) {
+		for (int i = lo; i < hi; i++) {
+			for (int j = 0; j < grid.nY; j++) {
+				for (int k = 0; k < grid.nZ; k++) {
+					if (cellVertex[grid.cell(i, j, k)] < 0) continue;
+					int ind = grid.node(i, j, k);
+					bool inside = grid.solid(ind);
+					const int at[3] = { i, j, k };
+					for (int axis = 0; axis < 3; axis++) {
+						int b = (axis + 1) % 3, c = (axis + 2) % 3;
+						if (at[b] == 0 || at[c] == 0) continue;
+						int step = (axis == 0) ? grid.YtimeZ : (axis == 1) ? (grid.nZ+1) : 1;
+						if (grid.solid(ind + step) == inside) continue;
+
+						// the four cells around the edge, turning from b to c,
+						// which goes anticlockwise about the axis
+						const int around[4][2] = { {0, 0}, {1, 0}, {1, 1}, {0, 1} };
+						unsigned int q[4];
+						bool complete = true;
+						for (int n = 0; n < 4; n++) {
+							int cell[3] = { i, j, k };
+							cell[b] -= around[n][0];
+							cell[c] -= around[n][1];
+							int local = cellVertex[grid.cell(cell[0], cell[1], cell[2])];
+							complete = complete && local >= 0;
+							q[n] = slabStart[cell[0]] + unsigned(local);
+						}
+						if (!complete) continue;
+						// marching cubes winds clockwise seen from outside, which
+						// this order is when the edge goes into the solid
+						if (!inside) swap(q[1], q[3]);
+
+						vec3 d02 = vertices[q[2]] - vertices[q[0]], d13 = vertices[q[3]] - vertices[q[1]];
+						const unsigned int *t = q;
+						unsigned int turned[4] = { q[1], q[2], q[3], q[0] };
+						if (dot(d13, d13) < dot(d02, d02)) t = turned;
+						const unsigned int triangles[6] = { t[0], t[1], t[2], t[0], t[2], t[3] };
+						block.indices.insert(block.indices.end(), triangles, triangles + 6);
+					}
+				}
+			}
+		}
+	}
+}
+
+/*
+	Two passes over blocks of whole x slabs, each on its own: the first
+	places the vertices of the block's cells, the second joins them with
+	quads once every block's vertices have their place in the output, as
+	quads on a block's near face reach into the block before. Vertices and
+	quads come out in cell order, the same for any number of blocks.
+*/
+void DualContour(int ncellsX, int ncellsY, int ncellsZ, float minValue, const vec4 * points,
+	MCMesh &mesh, const DualContourSettings &settings, ThreadPool * pool, const SurfaceBlocks * surface)
+{
+	Grid grid;
+	grid.nX = ncellsX;
+	grid.nY = ncellsY;
+	grid.nZ = ncellsZ;
+	grid.YtimeZ = (ncellsY+1)*(ncellsZ+1);
+	grid.minValue = minValue;
+	grid.points = points;
+	grid.spacing = vec3(points[grid.YtimeZ].x - points[0].x, points[ncellsZ+1].y - points[0].y,
+		points[1].z - points[0].z);
+
+	int nBlocks = 1;
+	if (pool && pool->size() > 1) {
+		nBlocks = max(1, min(ncellsX, 4*int(pool->size())));
+	}
+	auto blockStart = [&](int b) { return int((long long) ncellsX * b / nBlocks); };
+	auto run = [&](const function<void(int)> &fn) {
+		if (nBlocks == 1) fn(0);
+		else pool->parallelFor(nBlocks, fn);
+	};
+
+	std::vector<int> cellVertex(size_t(ncellsX)*ncellsY*ncellsZ, -1);
+	std::vector<DCBlock> blocks(nBlocks);
+	run([&](int b) {
+		placeVertices(blockStart(b), blockStart(b+1), grid, settings, surface, cellVertex, blocks[b]);
+	});
+
+	// where each block's vertices start, and so each slab's cells'
+	std::vector<size_t> vertexStart(nBlocks+1, 0);
+	for (int b = 0; b < nBlocks; b++) vertexStart[b+1] = vertexStart[b] + blocks[b].vertices.size();
+	std::vector<unsigned int> slabStart(ncellsX);
+	for (int b = 0; b < nBlocks; b++) {
+		for (int i = blockStart(b); i < blockStart(b+1); i++) slabStart[i] = unsigned(vertexStart[b]);
+	}
+	mesh.vertices.resize(vertexStart[nBlocks]);
+	mesh.normals.resize(vertexStart[nBlocks]);
+	run([&](int b) {
+		copy(blocks[b].vertices.begin(), blocks[b].vertices.end(), mesh.vertices.begin() + vertexStart[b]);
+		copy(blocks[b].normals.begin(), blocks[b].normals.end(), mesh.normals.begin() + vertexStart[b]);
+	});
+
+	run([&](int b) {
+		makeQuads(blockStart(b), blockStart(b+1), grid, cellVertex, slabStart, mesh.vertices, blocks[b]);
+	});
+	if (nBlocks == 1) {
+		mesh.indices.swap(blocks[0].indices);
+		return;
+	}
+	std::vector<size_t> indexStart(nBlocks+1, 0);
+	for (int b = 0; b < nBlocks; b++) indexStart[b+1] = indexStart[b] + blocks[b].indices.size();
+	mesh.indices.resize(indexStart[nBlocks]);
+	run([&](int b) {
+		copy(blocks[b].indices.begin(), blocks[b].indices.end(), mesh.indices.begin() + indexStart[b]);
+	});
+}
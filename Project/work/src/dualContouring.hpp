@@ -0,0 +1,50 @@
+//---------------------------------------------------------------------------
+//
+// Dual contouring
+//
+// Meshes the same density grid as marching cubes, but with one vertex in
+// every cell the surface passes through rather than one on every grid edge
+// it crosses, and a quad across every crossed edge joining the vertices of
+// the four cells around it. Each vertex goes where it is nearest, in the
+// least squares sense, to the tangent planes at the edge crossings of its
+// cell (the quadratic error function, QEF). Where the planes meet at a
+// ridge or a corner the vertex lands on it, so sharp features stay sharp
+// at resolutions marching cubes rounds them off at, and a coarser grid
+// does as well. The quads make about as many triangles as marching cubes
+// does on the same grid, but far fewer slivers.
+//
+// Directions the planes do not pin down, along a flat patch or a ridge,
+// keep the vertex at the average of the crossings, and a vertex the planes
+// would put outside its cell is pulled back to the cell's edge.
+//
+//----------------------------------------------------------------------------
+
+#pragma once
+
+#include <functional>
+
+#include "comp308.hpp"
+#include "marchingCubes.hpp"
+
+class ThreadPool;
+struct SurfaceBlocks;
+
+struct DualContourSettings {
+	//density gradient at a point, pointing into the solid. Empty takes it
+	//from central differences on the grid, blended along each edge as
+	//marching cubes does, which rounds ridges off over a cell or two
+	std::function<comp308::vec3(comp308::vec3)> gradient;
+	//eigenvalues of the QEF below this fraction of the largest are taken
+	//as 0, the planes are too near parallel to place the vertex that way
+	float cutoff = 0.1f;
+};
+
+// Meshes the grid of (ncellsX+1)*(ncellsY+1)*(ncellsZ+1) points, ordered and
+// with solid above minValue as for MarchingCubesIndexed, into mesh. Quads
+// are split along their shorter diagonal and wound as marching cubes winds
+// its triangles, and normals average the crossings' normals. Blocks of x
+// slabs go to pool when given, the result is the same either way. Cells
+// in blocks surface marks as holding none are not looked at.
+void DualContour(int ncellsX, int ncellsY, int ncellsZ, float minValue, const comp308::vec4 * points,
+	MCMesh &mesh, const DualContourSettings & = DualContourSettings(), ThreadPool * pool = nullptr,
+	const SurfaceBlocks * surface = nullptr);
@@ -14,6 +14,7 @@
 #include "fish.hpp"
 #include "school.hpp"
 #include "geometry.hpp"
+#include "debugLines.hpp"
 
 using namespace std;
 using namespace comp308;
@@ -23,7 +24,7 @@ Fish::Fish() {
 	velocity = vec3(0, 0, 0);
 }
 
-void Fish::renderFish(bool info, Geometry * geometry, bool isSpongebob) {
+void Fish::renderFish(Geometry * geometry, bool isSpongebob) {
 
 	if (isSpongebob) {
 		glPushMatrix(); {
@@ -57,17 +58,6 @@ void Fish::renderFish(bool info, Geometry * geometry, bool isSpongebob) {
 
 			glRotatef(angle, axis.x, axis.y, axis.z);
 
-			if (info) {
-				// velocity vector
-				glPushMatrix(); {
-					glColor3f(0.9, 0.3, 0.3); // light red
-
-					GLUquadricObj *quadObj = gluNewQuadric();
-					gluCylinder(quadObj, 0.03, 0.03, length(velocity) + fishLength, 10, 10);
-				} 
-				glPopMatrix();
-			}
-			
 			// render geometry
 			glColor3f(0.9, 0.9, 0.9); // light grey
 
@@ -84,18 +74,8 @@ void Fish::renderFish(bool info, Geometry * geometry, bool isSpongebob) {
 	}
 }
 
-vec3 Fish::getPosition() {
-	return position;
+void Fish::addDebugLines(DebugLines *lines) {
+	// velocity vector, drawn from the tail out past the nose
+	lines->setColour(0.9, 0.3, 0.3); // light red
+	lines->addLine(position, position + normalize(velocity) * (length(velocity) + fishLength));
 }
-
-vec3 Fish::getVelocity() {
-	return velocity;
-}
-
-void Fish::setPosition(vec3 pos) {
-	position = pos;
-}
-
-void Fish::setVelocity(vec3 vel) {
-	velocity = vel;
-}
\ No newline at end of file
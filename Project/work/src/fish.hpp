@@ -13,6 +13,7 @@
 
 #include "comp308.hpp"
 #include "geometry.hpp"
+#include "debugLines.hpp"
 
 class Fish {
 private:
@@ -23,11 +24,13 @@ public:
 
 	float fishLength = 1.5;
 
-	void renderFish(bool, Geometry *, bool);
+	void renderFish(Geometry *, bool);
+	void addDebugLines(DebugLines *);
 
-	comp308::vec3 getPosition();
-	comp308::vec3 getVelocity();
+	// defined here so the boids loops can inline them
+	comp308::vec3 getPosition() const { return position; }
+	comp308::vec3 getVelocity() const { return velocity; }
 
-	void setPosition(comp308::vec3);
-	void setVelocity(comp308::vec3);
+	void setPosition(comp308::vec3 pos) { position = pos; }
+	void setVelocity(comp308::vec3 vel) { velocity = vel; }
 };
\ No newline at end of file
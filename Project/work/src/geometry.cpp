@@ -6,30 +6,34 @@
 //
 //----------------------------------------------------------------------------
 
+#include <algorithm>
 #include <cmath>
 #include <iostream> // input/output streams
 #include <fstream>  // file streams
 #include <sstream>  // string streams
 #include <string>
 #include <stdexcept>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
 #include "comp308.hpp"
 #include "geometry.hpp"
+#include "threadPool.hpp"
 
 using namespace std;
 using namespace comp308;
 
 
-Geometry::Geometry(string filename) {
+Geometry::Geometry(string filename, bool upload) {
 	m_filename = filename;
 	readOBJ(filename);
-	if (m_triangles.size() > 0) {
+	if (upload && m_triangles.size() > 0) {
 		createDisplayListPoly();
 	}
 }
 
-Geometry::Geometry(vector<vec3> points, vector<triangle> triangles) {
+Geometry::Geometry(vector<vec3> points, vector<triangle> triangles, NormalWeighting weighting) {
 	// Make sure our geometry information is cleared
 	m_points.clear();
 	m_uvs.clear();
@@ -40,13 +44,43 @@ Geometry::Geometry(vector<vec3> points, vector<triangle> triangles) {
 	m_triangles = triangles;
 	cout << "points size: " << m_points.size() << endl;
 	cout << "triangles size: " << m_triangles.size() << endl;
-	createNormals();
+	createNormals(weighting);
 	cout << "normals size: " << m_normals.size() << endl;
 	if (m_triangles.size() > 0) {
 		createDisplayListPoly();
 	}
 }
 
+Geometry::Geometry(vector<vec3> points, const vector<unsigned int> &indices, NormalWeighting weighting) {
+	m_points = move(points);
+	setTriangles(indices);
+	createNormals(weighting, false);
+	if (m_triangles.size() > 0) {
+		createBuffers(indices);
+	}
+}
+
+Geometry::Geometry(vector<vec3> points, vector<vec3> normals, const vector<unsigned int> &indices) {
+	m_points = move(points);
+	m_normals = move(normals);
+	setTriangles(indices);
+	if (m_triangles.size() > 0) {
+		createBuffers(indices);
+	}
+}
+
+Geometry::Geometry(const vec3 *interleaved, size_t vertexCount, const unsigned int *indices, size_t indexCount) {
+	if (indexCount > 0) {
+		uploadBuffers(interleaved, vertexCount, indices, indexCount);
+	}
+}
+
+Geometry::~Geometry() {
+	if (m_displayListPoly) glDeleteLists(m_displayListPoly, 1);
+	if (m_vbo) glDeleteBuffers(1, &m_vbo);
+	if (m_ibo) glDeleteBuffers(1, &m_ibo);
+}
+
 void Geometry::readOBJ(string filename) {
 
 	// Make sure our geometry information is cleared
@@ -129,64 +163,206 @@ void Geometry::readOBJ(string filename) {
 			}
 		}
 	}
+	// OBJ counts from 1, files saved by saveGeo before it did count from 0
+	bool zeroBased = false;
+	for (const triangle &tri : m_triangles) {
+		for (int j = 0; j < 3; ++j) zeroBased = zeroBased || tri.v[j].p == 0;
+	}
+	if (zeroBased) {
+		for (triangle &tri : m_triangles) {
+			for (int j = 0; j < 3; ++j) {
+				tri.v[j].p++;
+				if (m_uvs.size() > 1) tri.v[j].t++;
+				if (m_normals.size() > 1) tri.v[j].n++;
+			}
+		}
+	}
+
 	// If we didn't have any normals, create them
-	if (m_normals.size() <= 1) createNormals();
+	if (m_normals.size() <= 1) createNormals(NormalWeighting::Uniform);
 }
 
-void Geometry::createNormals() {
-	std::vector<comp308::vec3> face_normals;
-	//     create array of int lists with size points.size,
-	//     list of the index number of triangles which relate to a point
-	std::vector<std::vector<int>> triangles_which_intersect_point;
-	unsigned int i;
-	unsigned int j;
-	for(i=0;i<m_points.size();++i){
-	  std::vector<int> a;
-	  triangles_which_intersect_point.push_back(a);
-	  m_normals.push_back(comp308::vec3(0));
+namespace {
+
+	// Face normal of a triangle as seen from each of its corners, with the weighting applied
+	void cornerNormals(const vector<vec3> &points, const triangle &tri, NormalWeighting weighting, vec3 out[3]) {
+		vec3 vector1 = points[tri.v[1].p] - points[tri.v[0].p];
+		vec3 vector2 = points[tri.v[2].p] - points[tri.v[1].p];
+		vec3 faceNormal = cross(vector1, vector2);
+		// slivers where the surface passes through a grid point have no direction
+		if (length(faceNormal) == 0) {
+			out[0] = out[1] = out[2] = vec3(0);
+			return;
+		}
+		if (weighting != NormalWeighting::Area) faceNormal = normalize(faceNormal);
+		for (int j = 0; j < 3; ++j) {
+			out[j] = faceNormal;
+			if (weighting == NormalWeighting::Angle) {
+				vec3 a = points[tri.v[(j+1)%3].p] - points[tri.v[j].p];
+				vec3 b = points[tri.v[(j+2)%3].p] - points[tri.v[j].p];
+				float la = length(a), lb = length(b);
+				float c = (la > 0 && lb > 0) ? dot(a, b) / (la * lb) : 1;
+				out[j] = faceNormal * acos(max(-1.0f, min(1.0f, c)));
+			}
+		}
 	}
-	
-	for(i=0;i<m_triangles.size();++i) {
-	// create the face normals for each tri using cross product
-	  comp308::vec3 vector1 = m_points[m_triangles[i].v[1].p] - m_points[m_triangles[i].v[0].p];
-	  comp308::vec3 vector2 = m_points[m_triangles[i].v[2].p] - m_points[m_triangles[i].v[1].p];
-	  face_normals.push_back(normalize(cross(vector1, vector2)));
-	  
-	// for each vertex in triangle, add triangle index to list under array of points
-	  for (int j=0; j<3; ++j) {
-	    for(int k=0; k<m_points.size();++k){
-	      if(0.01 > abs(m_points[m_triangles[i].v[j].p].x - m_points[k].x) &&
-		 0.01 > abs(m_points[m_triangles[i].v[j].p].y - m_points[k].y) &&
-		 0.01 > abs(m_points[m_triangles[i].v[j].p].z - m_points[k].z)) {
-		triangles_which_intersect_point[k].push_back(i);
-	      }
-	    }
-	  }
-	//     now you have an array of lists, the index relates to the index of a point,
-	//     and the list os of the indexes of the triangles which intersect this point
+
+	// Spatial hash cell of a point, cells are twice the weld tolerance so
+	// any two points that weld are in the same or neighbouring cells
+	long long weldCell(float v) {
+		return (long long) floor(v / 0.02);
 	}
-	
-	// Trying to do smooth shading not working
-	// for each point calculate it's normal
-	for(i=0;i<m_points.size();++i){
-	  // add vectors up
-	  comp308::vec3 norm = comp308::vec3(0);
-	  for(j=0;j<triangles_which_intersect_point[i].size();++j){
-	    norm = norm + face_normals[triangles_which_intersect_point[i][j]];
-	  }
-	  // normalize and save
-	  if(triangles_which_intersect_point[i].size()>0){
-	    m_normals[i] = normalize(norm);
-	  }
+
+	unsigned long long weldKey(long long x, long long y, long long z) {
+		const unsigned long long mask = (1ull << 21) - 1;
+		return ((x & mask) << 42) | ((y & mask) << 21) | (z & mask);
+	}
+}
+
+/*
+	Two passes over the mesh instead of one search per corner:
+
+	1. Every corner's (weighted) face normal, and the corners of each point
+	   gathered into one array with an offset per point (counting sort).
+	2. For each point, the corners of every point it welds with, put back
+	   into triangle order and summed, then normalized.
+
+	Summing in triangle order is what the original search over every point
+	did, so the uniform result is the same bit for bit (apart from zero area
+	triangles, which used to turn the normal into NaN and are now skipped).
+	Both passes work one point or triangle at a time and run in parallel.
+*/
+vector<vec3> smoothNormals(const vector<vec3> &points, const vector<triangle> &triangles,
+	NormalWeighting weighting, bool weld) {
+	const int nPoints = int(points.size());
+	const int nTriangles = int(triangles.size());
+	const int chunk = 4096;
+	ThreadPool &pool = ThreadPool::global();
+
+	vector<vec3> corner(3 * size_t(nTriangles));
+	pool.parallelFor((nTriangles + chunk - 1) / chunk, [&](int c) {
+		for (int i = c * chunk; i < min(nTriangles, (c + 1) * chunk); ++i) {
+			cornerNormals(points, triangles[i], weighting, &corner[3 * size_t(i)]);
+		}
+	});
+
+	// corners using each point, in triangle order
+	vector<int> cornerStart(nPoints + 1, 0);
+	for (const triangle &tri : triangles) {
+		for (int j = 0; j < 3; ++j) cornerStart[tri.v[j].p + 1]++;
+	}
+	for (int i = 0; i < nPoints; ++i) cornerStart[i + 1] += cornerStart[i];
+	vector<int> corners(cornerStart[nPoints]);
+	{
+		vector<int> fill(cornerStart.begin(), cornerStart.end() - 1);
+		for (int i = 0; i < nTriangles; ++i) {
+			for (int j = 0; j < 3; ++j) corners[fill[triangles[i].v[j].p]++] = 3 * i + j;
+		}
+	}
+
+	// points in each spatial hash cell, same layout
+	unordered_map<unsigned long long, int> cellIndex;
+	vector<int> cellOf, cellStart, cellPoints;
+	if (weld) {
+		cellOf.resize(nPoints);
+		cellIndex.reserve(nPoints);
+		for (int i = 0; i < nPoints; ++i) {
+			unsigned long long key = weldKey(weldCell(points[i].x), weldCell(points[i].y), weldCell(points[i].z));
+			auto found = cellIndex.emplace(key, int(cellIndex.size()));
+			cellOf[i] = found.first->second;
+		}
+		cellStart.assign(cellIndex.size() + 1, 0);
+		for (int i = 0; i < nPoints; ++i) cellStart[cellOf[i] + 1]++;
+		for (size_t c = 0; c < cellIndex.size(); ++c) cellStart[c + 1] += cellStart[c];
+		cellPoints.resize(nPoints);
+		vector<int> fill(cellStart.begin(), cellStart.end() - 1);
+		for (int i = 0; i < nPoints; ++i) cellPoints[fill[cellOf[i]]++] = i;
+	}
+
+	vector<vec3> normals(nPoints, vec3(0));
+	pool.parallelFor((nPoints + chunk - 1) / chunk, [&](int c) {
+		vector<int> found;
+		for (int k = c * chunk; k < min(nPoints, (c + 1) * chunk); ++k) {
+			found.clear();
+			if (!weld) {
+				found.assign(corners.begin() + cornerStart[k], corners.begin() + cornerStart[k + 1]);
+			} else {
+				const vec3 &pk = points[k];
+				long long cx = weldCell(pk.x), cy = weldCell(pk.y), cz = weldCell(pk.z);
+				for (int dx = -1; dx <= 1; ++dx) {
+					for (int dy = -1; dy <= 1; ++dy) {
+						for (int dz = -1; dz <= 1; ++dz) {
+							auto cell = cellIndex.find(weldKey(cx + dx, cy + dy, cz + dz));
+							if (cell == cellIndex.end()) continue;
+							for (int s = cellStart[cell->second]; s < cellStart[cell->second + 1]; ++s) {
+								const vec3 &pq = points[cellPoints[s]];
+								if (0.01 > abs(pq.x - pk.x) && 0.01 > abs(pq.y - pk.y) && 0.01 > abs(pq.z - pk.z)) {
+									int q = cellPoints[s];
+									found.insert(found.end(), corners.begin() + cornerStart[q], corners.begin() + cornerStart[q + 1]);
+								}
+							}
+						}
+					}
+				}
+				sort(found.begin(), found.end());
+			}
+
+			vec3 norm = vec3(0);
+			for (int f : found) norm = norm + corner[f];
+			if (length(norm) > 0) normals[k] = normalize(norm);
+		}
+	});
+	return normals;
+}
+
+void Geometry::createNormals(NormalWeighting weighting, bool weld) {
+	vector<vec3> normals = smoothNormals(m_points, m_triangles, weighting, weld);
+	// points no triangle uses keep whatever normal they had (OBJ files start
+	// with a dummy one)
+	if (m_normals.size() < m_points.size()) m_normals.resize(m_points.size(), vec3(0));
+	for (size_t i = 0; i < normals.size(); ++i) {
+		if (length(normals[i]) > 0) m_normals[i] = normals[i];
 	}
 	// for each triangle add normals to the vertexes
-	for(i=0;i<m_triangles.size();++i){
-	  m_triangles[i].v[0].n=m_triangles[i].v[0].p;
-	  m_triangles[i].v[1].n=m_triangles[i].v[1].p;
-	  m_triangles[i].v[2].n=m_triangles[i].v[2].p;
+	for (triangle &tri : m_triangles) {
+		for (int j = 0; j < 3; ++j) tri.v[j].n = tri.v[j].p;
 	}
 }
 
+// Uploads points and normals interleaved, plus the index list
+// Point and normal of every vertex share an index
+void Geometry::setTriangles(const vector<unsigned int> &indices) {
+	m_triangles.resize(indices.size() / 3);
+	for (size_t i = 0; i < m_triangles.size(); ++i) {
+		for (int j = 0; j < 3; ++j) {
+			m_triangles[i].v[j].p = indices[3*i + j];
+			m_triangles[i].v[j].n = indices[3*i + j];
+		}
+	}
+}
+
+void Geometry::createBuffers(const vector<unsigned int> &indices) {
+	vector<vec3> interleaved;
+	interleaved.reserve(2 * m_points.size());
+	for (size_t i = 0; i < m_points.size(); ++i) {
+		interleaved.push_back(m_points[i]);
+		interleaved.push_back(m_normals[i]);
+	}
+	uploadBuffers(interleaved.data(), m_points.size(), indices.data(), indices.size());
+}
+
+void Geometry::uploadBuffers(const vec3 *interleaved, size_t vertexCount, const unsigned int *indices, size_t indexCount) {
+	if (!m_vbo) glGenBuffers(1, &m_vbo);
+	if (!m_ibo) glGenBuffers(1, &m_ibo);
+	glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
+	glBufferData(GL_ARRAY_BUFFER, 2 * vertexCount * sizeof(vec3), interleaved, GL_STATIC_DRAW);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_ibo);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexCount * sizeof(unsigned int), indices, GL_STATIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	m_indexCount = GLsizei(indexCount);
+}
+
 void Geometry::createDisplayListPoly() {
 	// Delete old list if there is one
 	if (m_displayListPoly) glDeleteLists(m_displayListPoly, 1);
@@ -243,13 +419,33 @@ void Geometry::saveGeo() {
 	for(int i=0;i<m_normals.size(); ++i) {
 		file << "vn " << m_normals[i].x << " " << m_normals[i].y << " " << m_normals[i].z << "\n";
 	}
+	// OBJ counts from 1
 	for(int i=0;i<m_triangles.size(); ++i) {
-		file << "f " << m_triangles[i].v[0].p << "//" << m_triangles[i].v[0].n
-		      << " " << m_triangles[i].v[1].p << "//" << m_triangles[i].v[1].n
-		      << " " << m_triangles[i].v[2].p << "//" << m_triangles[i].v[2].n << "\n";
+		file << "f " << m_triangles[i].v[0].p + 1 << "//" << m_triangles[i].v[0].n + 1
+		      << " " << m_triangles[i].v[1].p + 1 << "//" << m_triangles[i].v[1].n + 1
+		      << " " << m_triangles[i].v[2].p + 1 << "//" << m_triangles[i].v[2].n + 1 << "\n";
 	}
 }
 
 void Geometry::renderGeometry() {
-	glCallList(m_displayListPoly);
+	if (!m_vbo) {
+		glCallList(m_displayListPoly);
+		return;
+	}
+
+	glPolygonMode(GL_FRONT, GL_FILL);
+	glPolygonMode(GL_BACK, GL_FILL);
+	glPushClientAttrib(GL_CLIENT_VERTEX_ARRAY_BIT);
+	glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_ibo);
+	glEnableClientState(GL_VERTEX_ARRAY);
+	glEnableClientState(GL_NORMAL_ARRAY);
+	glVertexPointer(3, GL_FLOAT, 2 * sizeof(vec3), (const GLvoid *) 0);
+	glNormalPointer(GL_FLOAT, 2 * sizeof(vec3), (const GLvoid *) sizeof(vec3));
+
+	glDrawElements(GL_TRIANGLES, m_indexCount, GL_UNSIGNED_INT, (const GLvoid *) 0);
+
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	glPopClientAttrib();
 }
\ No newline at end of file
@@ -26,6 +26,21 @@ struct triangle {
 	vertex v[3]; //requires 3 verticies
 };
 
+// How the face normals around a point are weighted in its smooth normal
+enum class NormalWeighting {
+	Uniform,	// every triangle counts the same
+	Area,		// larger triangles count for more
+	Angle		// by the triangle's angle at the point
+};
+
+// Smooth normal for every point, the normalized sum of the face normals of
+// the triangles that use it. With weld, triangles using any point within
+// 0.01 on every axis count too (found with a spatial hash), so points
+// repeated at the same position share a normal. Points no triangle touches
+// get a zero vector. Runs in linear time, spread over the global thread pool.
+std::vector<comp308::vec3> smoothNormals(const std::vector<comp308::vec3> &points,
+	const std::vector<triangle> &triangles, NormalWeighting weighting, bool weld);
+
 class Geometry {
 private:
 
@@ -39,16 +54,45 @@ private:
 	// IDs for the display list to render
 	GLuint m_displayListPoly = 0; // DisplayList for Polygon
 
+	// Vertex and index buffers, used instead of the display list for indexed meshes
+	GLuint m_vbo = 0;
+	GLuint m_ibo = 0;
+	GLsizei m_indexCount = 0;
+
 	void readOBJ(std::string);
-	void createNormals();
+	void setTriangles(const std::vector<unsigned int> &);
+	void createNormals(NormalWeighting, bool weld = true);
 	void createDisplayListPoly();
+	void createBuffers(const std::vector<unsigned int> &);
+	void uploadBuffers(const comp308::vec3 *interleaved, size_t vertexCount,
+		const unsigned int *indices, size_t indexCount);
 
 public:
-	Geometry(std::string);
-	Geometry(std::vector<comp308::vec3>, std::vector<triangle>);
-	// ~GeometryManager();
+	// With upload false the file is only read, no OpenGL is needed
+	Geometry(std::string, bool upload = true);
+	Geometry(std::vector<comp308::vec3>, std::vector<triangle>,
+		NormalWeighting = NormalWeighting::Uniform);
+	// Indexed mesh, three indices into points per triangle. Points are
+	// already shared between triangles so normals need no welding.
+	Geometry(std::vector<comp308::vec3>, const std::vector<unsigned int> &,
+		NormalWeighting = NormalWeighting::Uniform);
+	// Indexed mesh that comes with its own normal for each point
+	Geometry(std::vector<comp308::vec3> points, std::vector<comp308::vec3> normals,
+		const std::vector<unsigned int> &);
+	// Mesh that is already laid out for the GPU, a position then a normal
+	// for each vertex. It is uploaded as it is and not kept, so the point
+	// and normal lists stay empty.
+	Geometry(const comp308::vec3 *interleaved, size_t vertexCount,
+		const unsigned int *indices, size_t indexCount);
+	Geometry(const Geometry &) = delete;
+	Geometry & operator=(const Geometry &) = delete;
+	~Geometry();
 
 	void saveGeo();
 	void renderGeometry();
+
+	const std::vector<comp308::vec3> & getPoints() const { return m_points; }
+	const std::vector<comp308::vec3> & getNormals() const { return m_normals; }
+	const std::vector<triangle> & getTriangles() const { return m_triangles; }
 	
 };
\ No newline at end of file
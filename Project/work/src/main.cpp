@@ -12,15 +12,22 @@
 //
 //----------------------------------------------------------------------------
 
+#include <chrono>
 #include <cmath>
 #include <cstdlib>
 #include <iostream>
 #include <string>
 
 #include "comp308.hpp"
+#include "densityProgram.hpp"
 #include "terrain.hpp"
+#include "streamTerrain.hpp"
 #include "coral.hpp"
 #include "school.hpp"
+#include "sweep.hpp"
+#include "simplify.hpp"
+#include "bench.hpp"
+#include "navigation.hpp"
 #include "shaderLoader.hpp"
 #include "imageLoader.hpp"
 
@@ -39,6 +46,8 @@ GLuint g_mainWindow = 0;
 // Terrain loader and drawer
 //
 Terrain *g_terrain = nullptr;
+// Open seabed streamed around the camera, replaces g_terrain on screen with --stream
+ChunkedTerrain *g_streamTerrain = nullptr;
 Coral *g_coral1 = nullptr;
 Coral *g_coral2 = nullptr;
 // Coral *g_coral3 = nullptr;
@@ -47,6 +56,9 @@ Coral *g_coral2 = nullptr;
 // Coral *g_coral6 = nullptr;
 // Coral *g_coral7 = nullptr;
 
+// When main started, for the time to the first frame
+chrono::steady_clock::time_point g_startTime;
+
 // Shader information
 //
 GLuint g_shader = 0;
@@ -61,6 +73,11 @@ GLuint g_spongebobTex = 0;
 bool play = false;
 bool info = false;
 
+// Feeding spots the school can be sent to, cycled with 'g'
+Navigation *g_navigation = nullptr;
+vec3 g_goals[] = { vec3(40.0f, -15.0f, -40.0f), vec3(-40.0f, -15.0f, 40.0f) };
+int g_goalIndex = -1; // -1 for no goal
+
 
 // toggle values
 bool g_terrainActive = false;
@@ -68,6 +85,9 @@ bool g_coralActive = false;
 bool g_fogActive = false;
 bool g_fishActive = false;
 bool g_causticsActive = false;
+// While sculpting, dragging with the left mouse button carves the seabed
+// and with the right fills it, instead of turning the camera
+bool g_sculpting = false;
 
 
 // Projection values
@@ -171,6 +191,43 @@ void setUpCamera() {
 	glRotatef(g_yWorldRotation, 0, 1, 0);
 }
 
+// Where the camera is in world space, undoing the transforms in setUpCamera
+vec3 cameraPosition() {
+	float xw = g_xWorldRotation*PI/180;
+	float yw = g_yWorldRotation*PI/180;
+	vec3 p(-g_xPos, -g_yPos, -g_zPos);
+	vec3 q(p.x, p.y*cos(xw) + p.z*sin(xw), -p.y*sin(xw) + p.z*cos(xw));
+	return vec3(q.x*cos(yw) - q.z*sin(yw), q.y, q.x*sin(yw) + q.z*cos(yw));
+}
+
+// Carves (or fills) the terrain where the ray through window point (x, y) hits it
+void sculptAt(int x, int y, bool carve) {
+	if (!g_terrain || g_streamTerrain || !g_terrainActive) return;
+	setUpCamera();
+	GLdouble modelView[16], projection[16];
+	GLint viewport[4];
+	glGetDoublev(GL_MODELVIEW_MATRIX, modelView);
+	glGetDoublev(GL_PROJECTION_MATRIX, projection);
+	glGetIntegerv(GL_VIEWPORT, viewport);
+	GLdouble nx, ny, nz, fx, fy, fz;
+	gluUnProject(x, g_winHeight - y, 0.0, modelView, projection, viewport, &nx, &ny, &nz);
+	gluUnProject(x, g_winHeight - y, 1.0, modelView, projection, viewport, &fx, &fy, &fz);
+
+	vec3 nearPoint(nx, ny, nz), farPoint(fx, fy, fz);
+	vec3 hit;
+	const float radius = 10.0f;
+	if (g_terrain->raycast(nearPoint, farPoint - nearPoint, hit)) {
+		if (!g_terrain->sculpt(hit, radius, carve ? -6.0f : 6.0f)) {
+			cout << "This terrain cannot be sculpted" << endl;
+			g_sculpting = false;
+		} else if (g_navigation) {
+			// the goal's field is marched again around the new rock, the
+			// school gets it from draw once it is ready
+			g_navigation->refresh(*g_terrain, hit, radius);
+		}
+	}
+}
+
 void initShader() {
 	g_shader = makeShaderProgram("work/assets/shaders/shaderDemo.vert", "work/assets/shaders/shaderDemo.frag");
 }
@@ -206,7 +263,13 @@ void draw() {
 
 	// Render 
 	if (g_terrainActive) {
-		g_terrain->renderTerrain();
+		if (g_streamTerrain) {
+			g_streamTerrain->update(cameraPosition());
+			g_streamTerrain->render();
+		} else {
+			g_terrain->update(cameraPosition());
+			g_terrain->renderTerrain();
+		}
 	}
 	if(g_coralActive) {
 		g_coral1->renderCoral();
@@ -219,6 +282,12 @@ void draw() {
 	}
 
 	if (g_fishActive) {
+		// the field is null until its background thread has finished
+		if (g_navigation && g_goalIndex >= 0) {
+			g_school->setGoal(g_navigation->field(g_goals[g_goalIndex]), g_goals[g_goalIndex]);
+		} else {
+			g_school->setGoal(nullptr, vec3());
+		}
 		enableTextureSpongebob();
 		g_school->update(play, info);
 	}
@@ -243,6 +312,16 @@ void draw() {
 
 	glutSwapBuffers();
 
+	// Startup cost, from main to the first frame actually on screen
+	static bool firstFrame = true;
+	if (firstFrame) {
+		glFinish();
+		firstFrame = false;
+		double seconds = chrono::duration<double>(chrono::steady_clock::now() - g_startTime).count();
+		cout << "First frame after " << seconds * 1000 << " ms"
+		     << (g_terrain->fromCache() ? " (terrain from the mesh cache)" : "") << endl;
+	}
+
 	// Queue the next frame to be drawn straight away
 	glutPostRedisplay();
 }
@@ -332,6 +411,15 @@ void keyboardCallback(unsigned char key, int x, int y) {
 		case 'i': // toggles fish information
 			info = !info;
 			break;
+
+		case 'k': // toggle sculpting with the mouse
+			g_sculpting = !g_sculpting;
+			break;
+
+		case 'g': // cycle the school's goal through the feeding spots
+			g_goalIndex++;
+			if (g_goalIndex >= int(sizeof(g_goals) / sizeof(g_goals[0]))) g_goalIndex = -1;
+			break;
 	}
 }
 
@@ -358,10 +446,12 @@ void mouseCallback(int button, int state, int x, int y) {
 		case 0: //left mouse button
 			g_lMouseDown = (state==0);
 			g_lMousePos = vec2(x, y);
+			if (g_sculpting && g_lMouseDown) sculptAt(x, y, true);
 			break;
 		case 2: //left mouse button
 			g_rMouseDown = (state==0);
 			g_rMousePos = vec2(x, y);
+			if (g_sculpting && g_rMouseDown) sculptAt(x, y, false);
 			break;
 		case 3: //scroll foward/up
 			g_xPos -= cos(g_xRotation*PI/180)*sin(g_yRotation*PI/180);
@@ -383,6 +473,10 @@ void mouseCallback(int button, int state, int x, int y) {
 // 
 void mouseMotionCallback(int x, int y) {
 	cout << "Mouse Motion Callback :: (" << x << "," << y << ")" << endl;
+	if (g_sculpting) {
+		if (g_lMouseDown || g_rMouseDown) sculptAt(x, y, g_lMouseDown);
+		return;
+	}
 	if (g_lMouseDown) {
 		vec2 dif = vec2(x,y) - g_lMousePos;
 		g_lMousePos = vec2(x,y);
@@ -407,9 +501,111 @@ void mouseMotionCallback(int x, int y) {
 //Main program
 // 
 int main(int argc, char **argv) {
+	g_startTime = chrono::steady_clock::now();
+
+	// Headless boids parameter sweep, runs without opening a window
+	if(argc > 1 && string(argv[1]) == "--sweep") {
+		if(argc != 4) {
+			cout << "Usage: " << argv[0] << " --sweep <grid file> <output csv>" << endl;
+			exit(EXIT_FAILURE);
+		}
+		return sweepMain(argv[2], argv[3]);
+	}
+
+	// Headless mesh simplification of an OBJ file
+	if(argc > 1 && string(argv[1]) == "--simplify") {
+		if(argc != 5 && argc != 6) {
+			cout << "Usage: " << argv[0] << " --simplify <in obj> <out obj> <fraction of triangles> [max error]" << endl;
+			exit(EXIT_FAILURE);
+		}
+		return simplifyMain(argv[2], argv[3], strtof(argv[4], nullptr), (argc == 6) ? strtof(argv[5], nullptr) : 1e30f);
+	}
 
-	if(argc > 2){
-		cout << "Too many arguments" << endl;
+	// Headless benchmarks
+	if(argc > 1 && string(argv[1]) == "--bench") {
+		return benchMain(argc - 2, argv + 2);
+	}
+
+	// [--stream] [--adaptive] [--seed <n>] [--simplify-error <e>] [--config <file>] [--density <file>]
+	// [--simplex] [--mesher marching|dual|nets] [--blocked-separation] [--cells <n>] [--bounds <min x y z> <max x y z>] or an OBJ file to load as the terrain
+	bool stream = false;
+	string terrainFile;
+	TerrainSettings terrainSettings;
+	SchoolParams schoolParams;
+	for(int a = 1; a < argc; a++) {
+		string arg = argv[a];
+		if(arg == "--stream") {
+			stream = true;
+		} else if(arg == "--adaptive") {
+			terrainSettings.adaptive = true;
+		} else if(arg == "--seed" && a + 1 < argc) {
+			// the same seed makes the same terrain, so its mesh is cached
+			terrainSettings.density.seed = unsigned(strtoul(argv[++a], nullptr, 10));
+			terrainSettings.meshCache = "work/cache";
+		} else if(arg == "--simplify-error" && a + 1 < argc) {
+			terrainSettings.simplifyError = strtof(argv[++a], nullptr);
+		} else if(arg == "--config" && a + 1 < argc) {
+			// flags after the file win over it
+			try {
+				readTerrainSettings(argv[++a], terrainSettings);
+			} catch (const exception &e) {
+				cerr << e.what() << endl;
+				exit(EXIT_FAILURE);
+			}
+		} else if(arg == "--density" && a + 1 < argc) {
+			// compiled here too, so a mistake shows before the window opens
+			try {
+				terrainSettings.density.expression = readDensitySource(argv[++a]);
+				DensityProgram check(terrainSettings.density.expression);
+			} catch (const exception &e) {
+				cerr << e.what() << endl;
+				exit(EXIT_FAILURE);
+			}
+		} else if(arg == "--blocked-separation") {
+			schoolParams.blockedSeparation = true;
+		} else if(arg == "--simplex") {
+			terrainSettings.density.simplex = true;
+		} else if(arg == "--mesher" && a + 1 < argc) {
+			try {
+				terrainSettings.mesher = mesherNamed(argv[++a]);
+			} catch (const exception &e) {
+				cerr << e.what() << endl;
+				exit(EXIT_FAILURE);
+			}
+		} else if(arg == "--cells" && a + 1 < argc) {
+			char *end;
+			long cells = strtol(argv[++a], &end, 10);
+			if(*end != '\0' || end == argv[a] || cells < 1 || cells > 1024) {
+				cerr << "Error :: --cells takes a whole number from 1 to 1024, not '" << argv[a] << "'." << endl;
+				exit(EXIT_FAILURE);
+			}
+			terrainSettings.nX = terrainSettings.nY = terrainSettings.nZ = int(cells);
+		} else if(arg == "--bounds" && a + 6 < argc) {
+			float b[6];
+			for(int i = 0; i < 6; i++) {
+				char *end;
+				b[i] = strtof(argv[++a], &end);
+				if(*end != '\0' || end == argv[a]) {
+					cerr << "Error :: --bounds takes six numbers, not '" << argv[a] << "'." << endl;
+					exit(EXIT_FAILURE);
+				}
+			}
+			terrainSettings.minBound = vec3(b[0], b[1], b[2]);
+			terrainSettings.maxBound = vec3(b[3], b[4], b[5]);
+		} else if(terrainFile.empty() && arg.compare(0, 2, "--") != 0) {
+			terrainFile = arg;
+		} else {
+			cout << "Usage: " << argv[0] << " [--stream] [--adaptive] [--seed <n>] [--simplify-error <e>] [--config <file>]"
+			     << " [--density <file>] [--simplex] [--mesher marching|dual|nets] [--blocked-separation] [--cells <n>] [--bounds <min x y z> <max x y z>] [terrain obj]" << endl;
+			exit(EXIT_FAILURE);
+		}
+	}
+	if(terrainSettings.adaptive) terrainSettings.viewpoint = cameraPosition();
+	// the file and the flags together, before the window opens
+	try {
+		checkTerrainSettings(terrainSettings);
+	} catch (const exception &e) {
+		cerr << e.what() << endl;
 		exit(EXIT_FAILURE);
 	}
 
@@ -438,11 +634,19 @@ int main(int argc, char **argv) {
 	cout << "Using OpenGL " << glGetString(GL_VERSION) << endl;
 	cout << "Using GLEW " << glewGetString(GLEW_VERSION) << endl;
 
-	// Create terrain
-	if(argc == 2) {
-		g_terrain = new Terrain(argv[1]);
-	} else {
-		g_terrain = new Terrain();
+	// Create terrain, the fixed one is still what the fish navigate with when streaming
+	try {
+		if(!terrainFile.empty()) {
+			g_terrain = new Terrain(terrainFile, terrainSettings.simplifyError);
+		} else {
+			g_terrain = new Terrain(terrainSettings);
+		}
+	} catch (const exception &e) {
+		cerr << e.what() << endl;
+		exit(EXIT_FAILURE);
+	}
+	if(stream) {
+		g_streamTerrain = new ChunkedTerrain();
 	}
 	// Create coral
 	g_coral1 = new Coral(0.0f,-25.0f,0.0f,5.0f, 2.0f,6,1);
@@ -462,7 +666,9 @@ int main(int argc, char **argv) {
 
 	// Fishy stuff
 	Geometry * spongebob = new Geometry("work/assets/SpongeBob/spongebob.obj");
-	g_school = new School(spongebob);
+	g_school = new School(spongebob, schoolParams);
+	// keep the fish out of the terrain and the coral around the origin
+	g_navigation = new Navigation(*g_terrain, { {vec3(0.0f,-18.0f,0.0f), vec3(8.0f, 7.0f, 8.0f)} });
 	// SpongeBob model retrieved from http://www.models-resource.com/pc_computer/spongebobsquarepants3dobstacleodyssey/model/8478/
 
 	// Register functions for callback
@@ -487,6 +693,8 @@ int main(int argc, char **argv) {
 	glutMainLoop();
 
 	// Don't forget to delete all pointers that we made
+	delete g_navigation;
+	delete g_streamTerrain;
 	delete g_terrain;
 	delete g_school;
 	return 0;
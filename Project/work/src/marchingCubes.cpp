@@ -8,7 +8,14 @@
 //	Description:	Marching Cubes Algorithm
 /////////////////////////////////////////////////////////////////////////////////////////////
 
+#include <algorithm>
+#include <functional>
+#include <vector>
+
+#include "density.hpp"
 #include "marchingCubes.hpp"
+#include "mcTable.hpp"
+#include "threadPool.hpp"
 
 vec3 LinearInterp(vec4 p1, vec4 p2, float value)
 {
@@ -28,16 +35,72 @@ vec3 LinearInterp(vec4 p1, vec4 p2, float value)
 //////////////////////////////////////////////////////////////////////////////////////////////////////
 //	MARCHING CUBES	//
 
+namespace {
+	//which corners of the cell at ind are outside (value <= minValue), as an index into the tables
+	inline int cubeIndexAt(const vec4 * points, int ind, int YtimeZ, int ncellsZ, float minValue)
+	{
+		int cubeIndex = int(0);
+		if(points[ind].w <= minValue) cubeIndex |= 1;
+		if(points[ind + YtimeZ].w <= minValue) cubeIndex |= 2;
+		if(points[ind + YtimeZ + 1].w <= minValue) cubeIndex |= 4;
+		if(points[ind + 1].w <= minValue) cubeIndex |= 8;
+		if(points[ind + (ncellsZ+1)].w <= minValue) cubeIndex |= 16;
+		if(points[ind + YtimeZ + (ncellsZ+1)].w <= minValue) cubeIndex |= 32;
+		if(points[ind + YtimeZ + (ncellsZ+1) + 1].w <= minValue) cubeIndex |= 64;
+		if(points[ind + (ncellsZ+1) + 1].w <= minValue) cubeIndex |= 128;
+		return cubeIndex;
+	}
+
+	//number of triangles triTable makes for each cube index
+	struct TriangleCounts {
+		int count[256];
+		TriangleCounts() {
+			for(int c=0; c < 256; c++) {
+				int n = 0;
+				while(triTable[c][n] != -1) n++;
+				count[c] = n / 3;
+			}
+		}
+	};
+	const TriangleCounts triangleCounts;
+
+	//calls fn for every x slab, over the pool when there is one
+	void forEachSlab(int ncellsX, ThreadPool * pool, const std::function<void(int)> &fn)
+	{
+		if(pool) pool->parallelFor(ncellsX, fn);
+		else for(int i=0; i < ncellsX; i++) fn(i);
+	}
+}
+
 //  VERSION  1A).  //
+/*
+	Two passes, so the output is allocated once at exactly the right size:
+	the first only classifies cells and counts the triangles in each x slab,
+	an exclusive scan of the counts gives every slab its first triangle, and
+	the second pass writes the triangles straight into place. Slabs are
+	independent in both passes and run in parallel with a pool.
+*/
 TRIANGLE* MarchingCubes(int ncellsX, int ncellsY, int ncellsZ, float minValue, vec4 * points,  
-										INTERSECTION intersection, int &numTriangles)
+										INTERSECTION intersection, int &numTriangles, ThreadPool * pool)
 {
-	TRIANGLE * triangles = new TRIANGLE[3*ncellsX*ncellsY*ncellsZ];//this should be enough space, if not change 4 to 5
-	numTriangles = int(0);
-
 	int YtimeZ = (ncellsY+1)*(ncellsZ+1);
-	//go through all the points
-	for(int i=0; i < ncellsX; i++)			//x axis
+
+	//pass 1: count
+	std::vector<int> slabStart(ncellsX+1, 0);
+	forEachSlab(ncellsX, pool, [&](int i) {
+		int count = 0;
+		for(int j=0; j < ncellsY; j++)
+			for(int k=0; k < ncellsZ; k++)
+				count += triangleCounts.count[cubeIndexAt(points, i*YtimeZ + j*(ncellsZ+1) + k, YtimeZ, ncellsZ, minValue)];
+		slabStart[i+1] = count;
+	});
+	for(int i=0; i < ncellsX; i++) slabStart[i+1] += slabStart[i];
+	numTriangles = slabStart[ncellsX];
+	TRIANGLE * triangles = new TRIANGLE[numTriangles];
+
+	//pass 2: emit
+	forEachSlab(ncellsX, pool, [&](int i) {
+		int t = slabStart[i];
 		for(int j=0; j < ncellsY; j++)		//y axis
 			for(int k=0; k < ncellsZ; k++)	//z axis
 			{
@@ -54,9 +117,7 @@ TRIANGLE* MarchingCubes(int ncellsX, int ncellsY, int ncellsZ, float minValue, v
 				verts[7] = points[ind + (ncellsZ+1) + 1];
 				
 				//get the index
-				int cubeIndex = int(0);
-				for(int n=0; n < 8; n++)
-   /*(step 4)*/		if(verts[n].w <= minValue) cubeIndex |= (1 << n);
+   /*(step 4)*/ int cubeIndex = cubeIndexAt(points, ind, YtimeZ, ncellsZ, minValue);
 
 				//check if its completely inside or outside
    /*(step 5)*/ if(!edgeTable[cubeIndex]) continue;
@@ -78,32 +139,26 @@ TRIANGLE* MarchingCubes(int ncellsX, int ncellsY, int ncellsZ, float minValue, v
 
 				//now build the triangles using triTable
 				for (int n=0; triTable[cubeIndex][n] != -1; n+=3) {
-   /*(step 7)*/ 	triangles[numTriangles].p[0] = intVerts[triTable[cubeIndex][n+2]];
-					triangles[numTriangles].p[1] = intVerts[triTable[cubeIndex][n+1]];
-					triangles[numTriangles].p[2] = intVerts[triTable[cubeIndex][n]];
-   /*(step 8)*/ 	triangles[numTriangles].norm = normalize(cross((triangles[numTriangles].p[1] - 
-						triangles[numTriangles].p[0]),(triangles[numTriangles].p[2] - 
-						triangles[numTriangles].p[0])));
-					numTriangles++;
+   /*(step 7)*/ 	triangles[t].p[0] = intVerts[triTable[cubeIndex][n+2]];
+					triangles[t].p[1] = intVerts[triTable[cubeIndex][n+1]];
+					triangles[t].p[2] = intVerts[triTable[cubeIndex][n]];
+   /*(step 8)*/ 	triangles[t].norm = normalize(cross((triangles[t].p[1] - 
+						triangles[t].p[0]),(triangles[t].p[2] - 
+						triangles[t].p[0])));
+					t++;
 				}
-			
-			}	//END OF FOR LOOP
-		
-		//free all the wasted space
-		TRIANGLE * retTriangles = new TRIANGLE[numTriangles];
-		for(int i=0; i < numTriangles; i++)
-			retTriangles[i] = triangles[i];
-		delete [] triangles;
+			}
+	});
 	
-	return retTriangles;
+	return triangles;
 }
 
 
 //	VERSION  1B).  //
 TRIANGLE* MarchingCubesLinear(int ncellsX, int ncellsY, int ncellsZ, float minValue, 
-									vec4 * points, int &numTriangles)
+									vec4 * points, int &numTriangles, ThreadPool * pool)
 {
-	return MarchingCubes(ncellsX, ncellsY, ncellsZ, minValue, points, LinearInterp, numTriangles);
+	return MarchingCubes(ncellsX, ncellsY, ncellsZ, minValue, points, LinearInterp, numTriangles, pool);
 }
 
 
@@ -143,4 +198,192 @@ TRIANGLE* MarchingCubesLinear(float mcMinX, float mcMaxX, float mcMinY, float mc
 {
 	return MarchingCubes(mcMinX, mcMaxX, mcMinY, mcMaxY, mcMinZ, mcMaxZ, ncellsX, ncellsY, ncellsZ, minValue,
 		formula, LinearInterp, numTriangles);
-}
\ No newline at end of file
+}
+
+
+//	VERSION  3).  //
+vec3 GridGradient(const vec4 * points, int i, int j, int k, int ncellsX, int ncellsY, int ncellsZ, vec3 spacing)
+{
+	int YtimeZ = (ncellsY+1)*(ncellsZ+1);
+	const vec4 *p = points + i*YtimeZ + j*(ncellsZ+1) + k;
+	int x0 = (i > 0), x1 = (i < ncellsX);
+	int y0 = (j > 0), y1 = (j < ncellsY);
+	int z0 = (k > 0), z1 = (k < ncellsZ);
+	return vec3((p[x1*YtimeZ].w - p[-x0*YtimeZ].w) / (spacing.x * (x0 + x1)),
+		(p[y1*(ncellsZ+1)].w - p[-y0*(ncellsZ+1)].w) / (spacing.y * (y0 + y1)),
+		(p[z1].w - p[-z0].w) / (spacing.z * (z0 + z1)));
+}
+
+namespace {
+	//for each of the 12 cube edges: offset of its lower grid point from the cell and its axis (0 x, 1 y, 2 z)
+	const int edgeOrigin[12][4] = {
+		{0,0,0, 0}, {1,0,0, 2}, {0,0,1, 0}, {0,0,0, 2},
+		{0,1,0, 0}, {1,1,0, 2}, {0,1,1, 0}, {0,1,0, 2},
+		{0,0,0, 1}, {1,0,0, 1}, {1,0,1, 1}, {0,0,1, 1}
+	};
+
+	//mesh of a box of cells
+	struct MCBlock {
+		std::vector<vec3> vertices;
+		std::vector<vec3> normals;
+		//>= 0 for a vertex of this block, -(1 + slot) for the vertex the block before made
+		// on the y or z edge at slot 3*node + axis of the shared face
+		std::vector<int> indices;
+		//vertex on each edge of the far face in x, -1 for none
+		std::vector<int> lastFace;
+	};
+
+	//meshes the cells from lo up to but not including hi. With joined the block before in x,
+	// which ends where this one starts, has made the vertices on the face between them
+	void meshBlock(const int lo[3], const int hi[3], bool joined, int ncellsX, int ncellsY, int ncellsZ,
+		float minValue, const vec4 * points, const SurfaceBlocks * skip, MCBlock &block)
+	{
+		int YtimeZ = (ncellsY+1)*(ncellsZ+1);
+		vec3 spacing(points[YtimeZ].x - points[0].x, points[ncellsZ+1].y - points[0].y, points[1].z - points[0].z);
+		//grid points across one x slab of the box
+		int faceZ = hi[2] - lo[2] + 1;
+		int face = (hi[1] - lo[1] + 1) * faceZ;
+		//vertex index of each edge starting at a grid point of slab i (cache[0]) and slab i+1 (cache[1]),
+		// three edges per point, -1 when not made yet
+		std::vector<int> cache[2];
+		cache[0].assign(3*face, -1);
+		cache[1].assign(3*face, -1);
+
+		for(int i=lo[0]; i < hi[0]; i++) {			//x axis
+			for(int j=lo[1]; j < hi[1]; j++)		//y axis
+				for(int k=lo[2]; k < hi[2]; k++)	//z axis
+				{
+					//jump to the end of a block without surface
+					if(skip && !skip->holds(i / skip->size, j / skip->size, k / skip->size)) {
+						k = std::min(hi[2], (k / skip->size + 1) * skip->size) - 1;
+						continue;
+					}
+					int ind = i*YtimeZ + j*(ncellsZ+1) + k;
+					int cubeIndex = cubeIndexAt(points, ind, YtimeZ, ncellsZ, minValue);
+
+					if(!edgeTable[cubeIndex]) continue;
+
+					//look up or make the vertex on each crossed edge
+					int edgeVerts[12];
+					for(int e=0; e < 12; e++) {
+						if(!(edgeTable[cubeIndex] & (1 << e))) continue;
+						const int *o = edgeOrigin[e];
+						int node = (j-lo[1]+o[1])*faceZ + (k-lo[2]+o[2]);
+						//a crossed y or z edge on the near face is crossed for the cell on
+						// the other side too, so the block before has always made it
+						if(joined && i == lo[0] && o[0] == 0 && o[3] != 0) {
+							edgeVerts[e] = -(1 + 3*node + o[3]);
+							continue;
+						}
+						int &slot = cache[o[0]][3*node + o[3]];
+						if(slot < 0) {
+							int a = i+o[0], b = j+o[1], c = k+o[2];
+							int p0 = a*YtimeZ + b*(ncellsZ+1) + c;
+							int p1 = p0 + (o[3] == 0 ? YtimeZ : o[3] == 1 ? (ncellsZ+1) : 1);
+							slot = int(block.vertices.size());
+							block.vertices.push_back(LinearInterp(points[p0], points[p1], minValue));
+
+							//the gradient at both ends blended like the position, the density
+							// grows into the solid so the normal points down it
+							vec3 gLo = GridGradient(points, a, b, c, ncellsX, ncellsY, ncellsZ, spacing);
+							vec3 gHi = GridGradient(points, a + (o[3] == 0), b + (o[3] == 1), c + (o[3] == 2),
+								ncellsX, ncellsY, ncellsZ, spacing);
+							float t = (points[p0].w != points[p1].w)
+								? (minValue - points[p0].w) / (points[p1].w - points[p0].w) : 0.0f;
+							vec3 g = gLo + (gHi - gLo) * t;
+							block.normals.push_back(length(g) > 0 ? -normalize(g) : vec3(0, 1, 0));
+						}
+						edgeVerts[e] = slot;
+					}
+
+					for (int n=0; triTable[cubeIndex][n] != -1; n+=3) {
+						block.indices.push_back(edgeVerts[triTable[cubeIndex][n+2]]);
+						block.indices.push_back(edgeVerts[triTable[cubeIndex][n+1]]);
+						block.indices.push_back(edgeVerts[triTable[cubeIndex][n]]);
+					}
+				}
+
+			//slab i+1 becomes the low slab of the next row of cells
+			cache[0].swap(cache[1]);
+			std::fill(cache[1].begin(), cache[1].end(), -1);
+		}
+		block.lastFace.swap(cache[0]);
+	}
+}
+
+/*
+	The grid is cut into blocks of whole x slabs that are meshed on their
+	own, each into its own buffers. A prefix sum over the block sizes then
+	gives where each block goes in the output, and the blocks are copied
+	there with their indices shifted, and the indices of vertices on the
+	face shared with the block before looked up in that block.
+
+	Blocks number their vertices in the order they make them, which is the
+	order a single pass over the grid makes them in, so the result is the
+	same vertices and indices in the same order whatever the block count.
+*/
+void MarchingCubesIndexed(int ncellsX, int ncellsY, int ncellsZ, float minValue,
+									const vec4 * points, MCMesh &mesh, ThreadPool * pool,
+									const SurfaceBlocks * surface)
+{
+	int nBlocks = 1;
+	if(pool && pool->size() > 1) {
+		//a few blocks per thread evens out blocks with more surface in them
+		nBlocks = std::max(1, std::min(ncellsX, 4*int(pool->size())));
+	}
+
+	std::vector<MCBlock> blocks(nBlocks);
+	auto blockStart = [&](int b) { return int((long long) ncellsX * b / nBlocks); };
+	auto runBlock = [&](int b) {
+		const int lo[3] = { blockStart(b), 0, 0 };
+		const int hi[3] = { blockStart(b+1), ncellsY, ncellsZ };
+		meshBlock(lo, hi, b > 0, ncellsX, ncellsY, ncellsZ, minValue, points, surface, blocks[b]);
+	};
+	if(nBlocks == 1) runBlock(0);
+	else pool->parallelFor(nBlocks, runBlock);
+
+	if(nBlocks == 1) {
+		mesh.vertices.swap(blocks[0].vertices);
+		mesh.normals.swap(blocks[0].normals);
+		mesh.indices.assign(blocks[0].indices.begin(), blocks[0].indices.end());
+		return;
+	}
+
+	//exclusive scan of the vertex and index counts
+	std::vector<size_t> vertexStart(nBlocks+1, 0), indexStart(nBlocks+1, 0);
+	for(int b=0; b < nBlocks; b++) {
+		vertexStart[b+1] = vertexStart[b] + blocks[b].vertices.size();
+		indexStart[b+1] = indexStart[b] + blocks[b].indices.size();
+	}
+	mesh.vertices.resize(vertexStart[nBlocks]);
+	mesh.normals.resize(vertexStart[nBlocks]);
+	mesh.indices.resize(indexStart[nBlocks]);
+
+	auto copyBlock = [&](int b) {
+		const MCBlock &block = blocks[b];
+		std::copy(block.vertices.begin(), block.vertices.end(), mesh.vertices.begin() + vertexStart[b]);
+		std::copy(block.normals.begin(), block.normals.end(), mesh.normals.begin() + vertexStart[b]);
+		unsigned int *out = &mesh.indices[0] + indexStart[b];
+		for(size_t n=0; n < block.indices.size(); n++) {
+			int v = block.indices[n];
+			out[n] = (v >= 0) ? unsigned(vertexStart[b] + v)
+				: unsigned(vertexStart[b-1] + blocks[b-1].lastFace[-v - 1]);
+		}
+	};
+	pool->parallelFor(nBlocks, copyBlock);
+}
+
+/*
+	One block that is not joined to any other, so every vertex on the box's
+	faces is its own. Those vertices come out exactly as the cells on the
+	other side of the face make them.
+*/
+void MarchingCubesBox(int ncellsX, int ncellsY, int ncellsZ, const int lo[3], const int hi[3], float minValue,
+									const vec4 * points, MCMesh &mesh, const SurfaceBlocks * surface)
+{
+	MCBlock block;
+	meshBlock(lo, hi, false, ncellsX, ncellsY, ncellsZ, minValue, points, surface, block);
+	mesh.vertices.swap(block.vertices);
+	mesh.normals.swap(block.normals);
+	mesh.indices.assign(block.indices.begin(), block.indices.end());
+}
@@ -8,9 +8,11 @@
 //	Description:	Marching Cubes Algorithm
 /////////////////////////////////////////////////////////////////////////////////////////////
 
+#pragma once
+
+#include <vector>
 
 #include "comp308.hpp"
-#include "mcTable.hpp"
 
 using namespace comp308;
 
@@ -49,12 +51,16 @@ typedef float (*FORMULA)(vec3);
 //		 following index: i*(ncellsY+1)*(ncellsZ+1) + j*(ncellsZ+1) + k .
 //		Also, the array starts at the minimum on all axes.
 //TODO: another algorithm which takes array of JUST values. Coordinates then start at farthest, lower-right corner.
+//the returned array holds exactly numTriangles: cells are counted first and the triangles
+// written straight into place. With a pool both passes run over x slabs in parallel, the
+// result is the same.
+class ThreadPool;
 TRIANGLE* MarchingCubes(int ncellsX, int ncellsY, int ncellsZ, float minValue, vec4 * points,  
-									INTERSECTION intersection, int &numTriangles);
+									INTERSECTION intersection, int &numTriangles, ThreadPool * pool = nullptr);
 //  1B).
 //same as above only does linear interpolation so no INTERSECTION function is needed
 TRIANGLE* MarchingCubesLinear(int ncellsX, int ncellsY, int ncellsZ, float minValue, 
-									vec4 * points, int &numTriangles);
+									vec4 * points, int &numTriangles, ThreadPool * pool = nullptr);
 
 
 //	2A).
@@ -73,4 +79,39 @@ TRIANGLE* MarchingCubes(float mcMinX, float mcMaxX, float mcMinY, float mcMaxY,
 // INTERSECTION function is no more needed
 TRIANGLE* MarchingCubesLinear(float mcMinX, float mcMaxX, float mcMinY, float mcMaxY, float mcMinZ, float mcMaxZ, 
 									int ncellsX, int ncellsY, int ncellsZ, float minValue, 
-									FORMULA formula, int &numTriangles);
\ No newline at end of file
+									FORMULA formula, int &numTriangles);
+
+
+//	3).
+//indexed version of 1B): every grid edge the surface crosses becomes one vertex, shared by
+// all the cells around that edge, and triangles are three indices into mesh.vertices.
+// Triangles come out in the same order and winding as 1B) and edge vertices are always
+// interpolated from the lower to the higher grid point, so neighbouring cells agree exactly.
+//note: only two x slabs of edges are cached at any time, so the extra memory is
+//       O(ncellsY*ncellsZ) rather than the whole grid.
+// With a pool, blocks of x slabs are meshed in parallel into their own buffers and joined
+// afterwards; the output is exactly the same as without.
+// With surface blocks (see density.hpp) cells in blocks marked as holding no surface are not
+// looked at, the output is again the same as long as the marking is right.
+struct SurfaceBlocks;
+// Every vertex also gets a normal from the density gradient, worked out by central
+// differences on the grid at both ends of its edge and blended like the position, so no
+// pass over the triangles is needed for smooth normals.
+struct MCMesh {
+	std::vector<vec3> vertices;
+	std::vector<vec3> normals;			//one per vertex, pointing out of the solid
+	std::vector<unsigned int> indices;	//three per triangle
+};
+void MarchingCubesIndexed(int ncellsX, int ncellsY, int ncellsZ, float minValue,
+									const vec4 * points, MCMesh &mesh, ThreadPool * pool = nullptr,
+									const SurfaceBlocks * surface = nullptr);
+//density gradient at grid point (i, j, k) by central differences, one sided on the
+// outside of the grid. spacing is the distance between grid points on each axis
+vec3 GridGradient(const vec4 * points, int i, int j, int k, int ncellsX, int ncellsY, int ncellsZ, vec3 spacing);
+
+//	4).
+//same as 3) for only the cells from lo up to but not including hi on each axis. Vertices on the
+// box's faces are not shared with the cells outside it, but are exactly where those cells put
+// theirs, so boxes meshed on their own meet without cracks.
+void MarchingCubesBox(int ncellsX, int ncellsY, int ncellsZ, const int lo[3], const int hi[3], float minValue,
+									const vec4 * points, MCMesh &mesh, const SurfaceBlocks * surface = nullptr);
@@ -0,0 +1,192 @@
+//---------------------------------------------------------------------------
+//
+// On-disk cache of baked terrain meshes
+//
+//----------------------------------------------------------------------------
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "comp308.hpp"
+#include "meshCache.hpp"
+
+using namespace std;
+using namespace comp308;
+
+namespace {
+
+	const char magic[8] = { 'P', '2', 'M', 'E', 'S', 'H', '1', '\0' };
+
+	// Followed by nodeCount floats, 2 * vertexCount vec3s and indexCount
+	// indices, with nothing in between
+	struct Header {
+		char magic[8];
+		uint64_t key;
+		uint32_t nodeCount;
+		uint32_t vertexCount;
+		uint32_t indexCount;
+		uint32_t unused;
+	};
+
+	size_t fileSize(const Header &h) {
+		return sizeof(Header) + h.nodeCount * sizeof(float) + h.vertexCount * 2 * sizeof(vec3)
+			+ h.indexCount * sizeof(unsigned int);
+	}
+
+	// Makes directory and any of its parents that are missing, failures
+	// show up when the file is written
+	void makeDirectory(const string &directory) {
+		for (size_t end = 0; end != string::npos; ) {
+			end = directory.find_first_of("/\\", end + 1);
+			string prefix = directory.substr(0, end);
+#ifdef _WIN32
+			_mkdir(prefix.c_str());
+#else
+			mkdir(prefix.c_str(), 0755);
+#endif
+		}
+	}
+}
+
+CacheKey & CacheKey::add(const void *data, size_t bytes) {
+	const unsigned char *c = static_cast<const unsigned char *>(data);
+	for (size_t i = 0; i < bytes; ++i) {
+		m_hash = (m_hash ^ c[i]) * 1099511628211ull;
+	}
+	return *this;
+}
+
+string meshCachePath(const string &directory, unsigned long long key) {
+	ostringstream path;
+	path << directory << "/terrain-" << hex << key << ".mesh";
+	return path.str();
+}
+
+MeshCacheFile::MeshCacheFile(const string &path, unsigned long long key) {
+#ifdef _WIN32
+	ifstream file(path, ios::binary | ios::ate);
+	if (!file) return;
+	m_copy.resize(size_t(file.tellg()));
+	file.seekg(0);
+	if (!file.read(m_copy.data(), m_copy.size())) return;
+	m_data = m_copy.data();
+	m_size = m_copy.size();
+#else
+	int fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0) return;
+	struct stat info;
+	if (fstat(fd, &info) == 0 && size_t(info.st_size) >= sizeof(Header)) {
+		void *mapped = mmap(nullptr, size_t(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+		if (mapped != MAP_FAILED) {
+			m_data = static_cast<const char *>(mapped);
+			m_size = size_t(info.st_size);
+		}
+	}
+	// the mapping stays valid once the file is closed
+	close(fd);
+	if (!m_data) return;
+#endif
+
+	Header header;
+	bool ok = m_size >= sizeof(Header);
+	if (ok) {
+		memcpy(&header, m_data, sizeof(Header));
+		ok = memcmp(header.magic, magic, sizeof(magic)) == 0 && header.key == key && fileSize(header) == m_size;
+	}
+	if (!ok) {
+		unmap();
+		return;
+	}
+	m_nodeCount = header.nodeCount;
+	m_vertexCount = header.vertexCount;
+	m_indexCount = header.indexCount;
+}
+
+MeshCacheFile::~MeshCacheFile() {
+	unmap();
+}
+
+void MeshCacheFile::unmap() {
+#ifndef _WIN32
+	if (m_data) munmap(const_cast<char *>(m_data), m_size);
+#endif
+	m_copy.clear();
+	m_data = nullptr;
+	m_size = 0;
+}
+
+const float * MeshCacheFile::densities() const {
+	return reinterpret_cast<const float *>(m_data + sizeof(Header));
+}
+
+const vec3 * MeshCacheFile::vertices() const {
+	return reinterpret_cast<const vec3 *>(m_data + sizeof(Header) + m_nodeCount * sizeof(float));
+}
+
+const unsigned int * MeshCacheFile::indices() const {
+	return reinterpret_cast<const unsigned int *>(vertices() + 2 * m_vertexCount);
+}
+
+void writeMeshCache(const string &directory, unsigned long long key, const vec4 *grid, size_t nodeCount,
+	const vector<vec3> &points, const vector<vec3> &normals, const vector<unsigned int> &indices) {
+	makeDirectory(directory);
+	string path = meshCachePath(directory, key);
+	string temporary = path + ".tmp";
+
+	Header header;
+	memcpy(header.magic, magic, sizeof(magic));
+	header.key = key;
+	header.nodeCount = uint32_t(nodeCount);
+	header.vertexCount = uint32_t(points.size());
+	header.indexCount = uint32_t(indices.size());
+	header.unused = 0;
+
+	vector<float> densities(nodeCount);
+	for (size_t n = 0; n < nodeCount; ++n) densities[n] = grid[n].w;
+	vector<vec3> interleaved;
+	interleaved.reserve(2 * points.size());
+	for (size_t i = 0; i < points.size(); ++i) {
+		interleaved.push_back(points[i]);
+		interleaved.push_back(normals[i]);
+	}
+
+	{
+		ofstream file(temporary, ios::binary | ios::trunc);
+		if (file) {
+			file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+			file.write(reinterpret_cast<const char *>(densities.data()), densities.size() * sizeof(float));
+			file.write(reinterpret_cast<const char *>(interleaved.data()), interleaved.size() * sizeof(vec3));
+			file.write(reinterpret_cast<const char *>(indices.data()), indices.size() * sizeof(unsigned int));
+		}
+		if (!file) {
+			cerr << "Error writing " << temporary << endl;
+			remove(temporary.c_str());
+			throw runtime_error("Error :: could not write mesh cache.");
+		}
+	}
+#ifdef _WIN32
+	// rename only replaces an existing file on POSIX
+	remove(path.c_str());
+#endif
+	if (rename(temporary.c_str(), path.c_str()) != 0) {
+		cerr << "Error writing " << path << endl;
+		remove(temporary.c_str());
+		throw runtime_error("Error :: could not write mesh cache.");
+	}
+}
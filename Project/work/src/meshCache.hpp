@@ -0,0 +1,81 @@
+//---------------------------------------------------------------------------
+//
+// On-disk cache of baked terrain meshes
+//
+// A cache file holds everything Terrain makes from its settings: the
+// density at every grid node (navigation still needs the grid) and the
+// final mesh, laid out exactly as it goes into the vertex and index
+// buffers. Reading one back is a memory map and a few size checks, so a
+// hit skips density sampling, marching cubes and the normals entirely.
+//
+// Files are written in the machine's own byte order and are only meant to
+// be read back on the machine that wrote them. The key, a hash of every
+// setting the mesh depends on, is stored in the header and in the file
+// name, so changing any setting simply misses.
+//
+//----------------------------------------------------------------------------
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "comp308.hpp"
+
+// Incremental FNV-1a hash for building cache keys
+class CacheKey {
+private:
+	unsigned long long m_hash = 14695981039346656037ull;
+
+public:
+	CacheKey & add(const void *data, size_t bytes);
+	template <typename T>
+	CacheKey & add(const T &value) { return add(&value, sizeof(T)); }
+
+	unsigned long long value() const { return m_hash; }
+};
+
+// Path of the cache file for key inside directory
+std::string meshCachePath(const std::string &directory, unsigned long long key);
+
+// Read only view of a cache file, mapped into memory for as long as it lives
+class MeshCacheFile {
+private:
+	const char *m_data = nullptr;
+	size_t m_size = 0;
+	std::vector<char> m_copy; // used where files cannot be mapped
+
+	size_t m_nodeCount = 0;
+	size_t m_vertexCount = 0;
+	size_t m_indexCount = 0;
+
+	void unmap();
+
+public:
+	// Maps path, valid() is false if it is missing, was written with a
+	// different key or is not a complete cache file
+	MeshCacheFile(const std::string &path, unsigned long long key);
+	MeshCacheFile(const MeshCacheFile &) = delete;
+	MeshCacheFile & operator=(const MeshCacheFile &) = delete;
+	~MeshCacheFile();
+
+	bool valid() const { return m_data != nullptr; }
+
+	// Density of every grid node, in grid order
+	const float * densities() const;
+	size_t nodeCount() const { return m_nodeCount; }
+	// Position then normal for each vertex
+	const comp308::vec3 * vertices() const;
+	size_t vertexCount() const { return m_vertexCount; }
+	const unsigned int * indices() const;
+	size_t indexCount() const { return m_indexCount; }
+};
+
+// Writes a cache file, creating directory and its parents if needed. The file is written
+// under a temporary name and renamed into place, so a reader never sees
+// half of one. Throws runtime_error if it cannot be written.
+void writeMeshCache(const std::string &directory, unsigned long long key,
+	const comp308::vec4 *grid, size_t nodeCount,
+	const std::vector<comp308::vec3> &points, const std::vector<comp308::vec3> &normals,
+	const std::vector<unsigned int> &indices);
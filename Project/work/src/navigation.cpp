@@ -0,0 +1,283 @@
+//---------------------------------------------------------------------------
+//
+// Navigation distance fields for goal seeking fish
+//
+//----------------------------------------------------------------------------
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <future>
+#include <limits>
+#include <memory>
+#include <queue>
+#include <utility>
+#include <vector>
+
+#include "comp308.hpp"
+#include "navigation.hpp"
+#include "terrain.hpp"
+
+using namespace std;
+using namespace comp308;
+
+namespace {
+	const float farAway = numeric_limits<float>::infinity();
+}
+
+int NavGrid::nearestOpen(vec3 p) const {
+	vec3 u = (p - origin) / spacing;
+	int ci = int(floor(u.x + 0.5f));
+	int cj = int(floor(u.y + 0.5f));
+	int ck = int(floor(u.z + 0.5f));
+
+	// look at the closest node first, then its direct neighbourhood
+	int best = -1;
+	float bestDist = farAway;
+	for (int i = ci - 1; i <= ci + 1; ++i) {
+		for (int j = cj - 1; j <= cj + 1; ++j) {
+			for (int k = ck - 1; k <= ck + 1; ++k) {
+				if (i < 0 || j < 0 || k < 0 || i >= nX || j >= nY || k >= nZ) continue;
+				int n = index(i, j, k);
+				if (!open[n]) continue;
+				float d = length(origin + vec3(i, j, k) * spacing - p);
+				if (d < bestDist) {
+					bestDist = d;
+					best = n;
+				}
+			}
+		}
+	}
+	return best;
+}
+
+NavField::NavField(const NavGrid &grid, int goalNode) {
+	m_shape.nX = grid.nX;
+	m_shape.nY = grid.nY;
+	m_shape.nZ = grid.nZ;
+	m_shape.origin = grid.origin;
+	m_shape.spacing = grid.spacing;
+
+	m_distance.assign(grid.open.size(), farAway);
+	m_direction.assign(grid.open.size(), vec3());
+	if (goalNode >= 0) {
+		march(grid, goalNode);
+		computeDirections(grid);
+	}
+}
+
+/*
+	Fast marching method
+
+	Grows the known region outwards from the goal in order of distance,
+	solving the eikonal equation |grad T| = 1 at each node from its known
+	neighbours on each axis (first order upwind scheme).
+*/
+void NavField::march(const NavGrid &grid, int goal) {
+	int strides[3] = { grid.nY*grid.nZ, grid.nZ, 1 };
+	int sizes[3] = { grid.nX, grid.nY, grid.nZ };
+	float h[3] = { grid.spacing.x, grid.spacing.y, grid.spacing.z };
+
+	vector<unsigned char> known(m_distance.size(), 0);
+	typedef pair<float, int> entry;
+	priority_queue<entry, vector<entry>, greater<entry>> trial;
+
+	m_distance[goal] = 0;
+	trial.push(entry(0, goal));
+
+	while (!trial.empty()) {
+		int n = trial.top().second;
+		trial.pop();
+		if (known[n]) continue; // stale entry, already finalised with a smaller distance
+		known[n] = 1;
+
+		int coord[3] = { n / strides[0], (n / strides[1]) % sizes[1], n % sizes[2] };
+
+		for (int axis = 0; axis < 3; ++axis) {
+			for (int dir = -1; dir <= 1; dir += 2) {
+				int c = coord[axis] + dir;
+				if (c < 0 || c >= sizes[axis]) continue;
+				int m = n + dir * strides[axis];
+				if (known[m] || !grid.open[m]) continue;
+
+				// smallest known neighbour along each axis
+				int mc[3] = { coord[0], coord[1], coord[2] };
+				mc[axis] = c;
+				pair<float, float> terms[3]; // (distance, spacing)
+				int numTerms = 0;
+				for (int a = 0; a < 3; ++a) {
+					float best = farAway;
+					for (int d = -1; d <= 1; d += 2) {
+						int cc = mc[a] + d;
+						if (cc < 0 || cc >= sizes[a]) continue;
+						int o = m + d * strides[a];
+						if (known[o]) best = min(best, m_distance[o]);
+					}
+					if (best < farAway) terms[numTerms++] = make_pair(best, h[a]);
+				}
+				sort(terms, terms + numTerms);
+
+				// add axes in increasing order while the solution stays upwind of them
+				float t = farAway;
+				float qa = 0, qb = 0, qc = -1;
+				for (int a = 0; a < numTerms; ++a) {
+					float w = 1.0f / (terms[a].second * terms[a].second);
+					qa += w;
+					qb -= 2 * terms[a].first * w;
+					qc += terms[a].first * terms[a].first * w;
+					float disc = qb*qb - 4*qa*qc;
+					if (disc < 0) break;
+					float s = (-qb + sqrt(disc)) / (2*qa);
+					if (a + 1 < numTerms && s > terms[a + 1].first) {
+						t = s;
+						continue;
+					}
+					t = s;
+					break;
+				}
+
+				if (t < m_distance[m]) {
+					m_distance[m] = t;
+					trial.push(entry(t, m));
+				}
+			}
+		}
+	}
+}
+
+void NavField::computeDirections(const NavGrid &grid) {
+	int strides[3] = { grid.nY*grid.nZ, grid.nZ, 1 };
+	int sizes[3] = { grid.nX, grid.nY, grid.nZ };
+	float h[3] = { grid.spacing.x, grid.spacing.y, grid.spacing.z };
+
+	for (int n = 0; n < int(m_distance.size()); ++n) {
+		if (m_distance[n] == farAway || m_distance[n] == 0) continue;
+
+		int coord[3] = { n / strides[0], (n / strides[1]) % sizes[1], n % sizes[2] };
+		vec3 gradient;
+		for (int a = 0; a < 3; ++a) {
+			float lo = (coord[a] > 0) ? m_distance[n - strides[a]] : farAway;
+			float hi = (coord[a] + 1 < sizes[a]) ? m_distance[n + strides[a]] : farAway;
+			if (lo < farAway && hi < farAway) {
+				gradient[a] = (hi - lo) / (2 * h[a]);
+			} else if (lo < farAway) {
+				gradient[a] = (m_distance[n] - lo) / h[a];
+			} else if (hi < farAway) {
+				gradient[a] = (hi - m_distance[n]) / h[a];
+			}
+		}
+		if (length(gradient) > 0) m_direction[n] = -normalize(gradient);
+	}
+}
+
+vec3 NavField::directionAt(vec3 p) const {
+	// blend the directions stored at the corners of the cell containing p
+	vec3 u = (p - m_shape.origin) / m_shape.spacing;
+	int i = max(0, min(m_shape.nX - 2, int(floor(u.x))));
+	int j = max(0, min(m_shape.nY - 2, int(floor(u.y))));
+	int k = max(0, min(m_shape.nZ - 2, int(floor(u.z))));
+	vec3 t = clamp(u - vec3(i, j, k), 0.0f, 1.0f);
+
+	vec3 dir;
+	for (int c = 0; c < 8; ++c) {
+		int di = c & 1, dj = (c >> 1) & 1, dk = (c >> 2) & 1;
+		float w = (di ? t.x : 1 - t.x) * (dj ? t.y : 1 - t.y) * (dk ? t.z : 1 - t.z);
+		dir += m_direction[m_shape.index(i + di, j + dj, k + dk)] * w;
+	}
+
+	if (length(dir) < 1e-4f) return vec3();
+	return normalize(dir);
+}
+
+float NavField::distanceAt(vec3 p) const {
+	vec3 u = (p - m_shape.origin) / m_shape.spacing;
+	int i = max(0, min(m_shape.nX - 1, int(floor(u.x + 0.5f))));
+	int j = max(0, min(m_shape.nY - 1, int(floor(u.y + 0.5f))));
+	int k = max(0, min(m_shape.nZ - 1, int(floor(u.z + 0.5f))));
+	return m_distance[m_shape.index(i, j, k)];
+}
+
+bool Navigation::isOpen(const vec4 &point) const {
+	// water is where marching cubes treats a point as below the iso value
+	if (point.w > m_isoValue) return false;
+	vec3 p = vec3(point);
+	for (const NavObstacle &o : m_obstacles) {
+		vec3 d = abs(p - o.centre);
+		if (d.x <= o.halfSize.x && d.y <= o.halfSize.y && d.z <= o.halfSize.z) return false;
+	}
+	return true;
+}
+
+Navigation::Navigation(const Terrain &terrain, const vector<NavObstacle> &obstacles)
+	: m_obstacles(obstacles), m_isoValue(terrain.getIsoValue()) {
+	const vec4 *points = terrain.getGridPoints();
+	if (!points) return; // terrain loaded from a file has no density grid
+
+	shared_ptr<NavGrid> grid = make_shared<NavGrid>();
+	grid->nX = terrain.getCellsX() + 1;
+	grid->nY = terrain.getCellsY() + 1;
+	grid->nZ = terrain.getCellsZ() + 1;
+	grid->origin = vec3(points[0]);
+	vec3 far = vec3(points[grid->index(grid->nX - 1, grid->nY - 1, grid->nZ - 1)]);
+	grid->spacing = (far - grid->origin) / vec3(grid->nX - 1, grid->nY - 1, grid->nZ - 1);
+
+	grid->open.resize(grid->nX * grid->nY * grid->nZ);
+	for (size_t n = 0; n < grid->open.size(); ++n) {
+		grid->open[n] = isOpen(points[n]);
+	}
+	m_grid = grid;
+}
+
+shared_ptr<const NavField> Navigation::field(vec3 goal) {
+	if (!m_grid) return nullptr;
+
+	for (auto s = m_stale.begin(); s != m_stale.end(); ) {
+		if (s->wait_for(chrono::seconds(0)) == future_status::ready) s = m_stale.erase(s);
+		else ++s;
+	}
+
+	int key = m_grid->nearestOpen(goal);
+	auto it = m_fields.find(key);
+	if (it == m_fields.end()) {
+		// while sculpting, wait for the last outdated march rather than
+		// starting one for every stroke
+		if (!m_stale.empty()) return nullptr;
+		// march on a background thread, which holds on to the grid it started with
+		shared_ptr<const NavGrid> grid = m_grid;
+		shared_future<shared_ptr<const NavField>> f = async(launch::async, [grid, key] {
+			return shared_ptr<const NavField>(make_shared<NavField>(*grid, key));
+		}).share();
+		it = m_fields.insert(make_pair(key, f)).first;
+	}
+
+	if (it->second.wait_for(chrono::seconds(0)) != future_status::ready) return nullptr;
+	return it->second.get();
+}
+
+void Navigation::refresh(const Terrain &terrain, vec3 centre, float radius) {
+	const vec4 *points = terrain.getGridPoints();
+	if (!m_grid || !points) return;
+
+	shared_ptr<NavGrid> grid = make_shared<NavGrid>(*m_grid);
+	int lo[3], hi[3];
+	const int sizes[3] = { grid->nX, grid->nY, grid->nZ };
+	for (int a = 0; a < 3; a++) {
+		lo[a] = max(0, int(floor((centre[a] - radius - grid->origin[a]) / grid->spacing[a])));
+		hi[a] = min(sizes[a] - 1, int(ceil((centre[a] + radius - grid->origin[a]) / grid->spacing[a])));
+	}
+	for (int i = lo[0]; i <= hi[0]; i++) {
+		for (int j = lo[1]; j <= hi[1]; j++) {
+			for (int k = lo[2]; k <= hi[2]; k++) {
+				int n = grid->index(i, j, k);
+				grid->open[n] = isOpen(points[n]);
+			}
+		}
+	}
+	m_grid = grid;
+
+	for (auto &f : m_fields) {
+		if (f.second.wait_for(chrono::seconds(0)) != future_status::ready) m_stale.push_back(f.second);
+	}
+	m_fields.clear();
+}
@@ -0,0 +1,86 @@
+//---------------------------------------------------------------------------
+//
+// Navigation distance fields for goal seeking fish
+//
+// A NavField holds the travel distance from every node of the terrain's
+// marching cubes grid to one goal, found with the fast marching method so
+// the distance bends around terrain ridges and obstacles instead of going
+// through them. Following the field downhill is a single lookup per fish
+// per step, no path search is needed.
+//
+//----------------------------------------------------------------------------
+
+#pragma once
+
+#include <future>
+#include <list>
+#include <map>
+#include <memory>
+#include <vector>
+
+#include "comp308.hpp"
+
+class Terrain;
+
+// Axis aligned box that fish can not swim through
+struct NavObstacle {
+	comp308::vec3 centre;
+	comp308::vec3 halfSize;
+};
+
+// Which nodes of the grid are open water
+struct NavGrid {
+	int nX = 0, nY = 0, nZ = 0;         // number of nodes on each axis
+	comp308::vec3 origin;               // position of node (0, 0, 0)
+	comp308::vec3 spacing;              // distance between nodes on each axis
+	std::vector<unsigned char> open;    // 1 where a fish can be
+
+	int index(int i, int j, int k) const { return (i*nY + j)*nZ + k; }
+
+	// Index of the open node nearest to p, -1 if there is none close by
+	int nearestOpen(comp308::vec3) const;
+};
+
+class NavField {
+private:
+	NavGrid m_shape;                       // grid dimensions only, open is left empty
+	std::vector<float> m_distance;         // travel distance to the goal, infinite if unreachable
+	std::vector<comp308::vec3> m_direction; // unit direction of steepest descent, zero if none
+
+	void march(const NavGrid &, int goal);
+	void computeDirections(const NavGrid &);
+
+public:
+	NavField(const NavGrid &, int goalNode);
+
+	// Direction to swim from p towards the goal, zero when there is no way there
+	comp308::vec3 directionAt(comp308::vec3) const;
+	float distanceAt(comp308::vec3) const;
+};
+
+class Navigation {
+private:
+	// replaced rather than changed, a field being marched keeps the one it started with
+	std::shared_ptr<const NavGrid> m_grid;
+	std::vector<NavObstacle> m_obstacles;
+	float m_isoValue = 0.0f;
+	// one field per goal node, computed on a background thread the first time it is asked for
+	std::map<int, std::shared_future<std::shared_ptr<const NavField>>> m_fields;
+	// fields of an older grid still being marched, kept until they finish so
+	// dropping them does not wait for the march
+	std::list<std::shared_future<std::shared_ptr<const NavField>>> m_stale;
+
+	bool isOpen(const comp308::vec4 &) const;
+
+public:
+	Navigation(const Terrain &, const std::vector<NavObstacle> &);
+
+	// The field for goal if it has been computed, nullptr while still being worked on
+	std::shared_ptr<const NavField> field(comp308::vec3 goal);
+
+	// Reads the nodes within radius of centre from the terrain's grid again
+	// after it has been sculpted there, and drops every field made before,
+	// so they are marched again around the new rock as they are asked for.
+	// No field is handed out until marches of the old grid have finished.
+	void refresh(const Terrain &, comp308::vec3 centre, float radius);
+};
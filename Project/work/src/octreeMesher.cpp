@@ -0,0 +1,601 @@
+//---------------------------------------------------------------------------
+//
+// Adaptive octree marching cubes
+//
+//----------------------------------------------------------------------------
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <map>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "comp308.hpp"
+#include "marchingCubes.hpp"
+#include "mcTable.hpp"
+#include "octreeMesher.hpp"
+#include "threadPool.hpp"
+
+using namespace std;
+using namespace comp308;
+
+namespace {
+
+	// Corners and edges as numbered by the marching cubes tables, corners as
+	// offsets along x, y and z
+	const int cornerOffset[8][3] = {
+		{0,0,0}, {1,0,0}, {1,0,1}, {0,0,1}, {0,1,0}, {1,1,0}, {1,1,1}, {0,1,1}
+	};
+	const int edgeCorners[12][2] = {
+		{0,1}, {1,2}, {2,3}, {3,0}, {4,5}, {5,6}, {6,7}, {7,4}, {0,4}, {1,5}, {2,6}, {3,7}
+	};
+
+	// Bit set of the faces an edge lies on, faces numbered x low, x high,
+	// y low, y high, z low, z high
+	int edgeFaces(int e) {
+		const int *a = cornerOffset[edgeCorners[e][0]], *b = cornerOffset[edgeCorners[e][1]];
+		int faces = 0;
+		for (int axis = 0; axis < 3; ++axis) {
+			if (a[axis] == b[axis]) faces |= 1 << (2*axis + a[axis]);
+		}
+		return faces;
+	}
+
+	struct Cell {
+		int p[3];				// lowest corner, in finest cells
+		int depth = 0;
+		int child = -1;			// first of eight children, -1 for a leaf
+		bool surface = false;	// might hold some surface
+	};
+
+	// Directed edge of a leaf's triangles lying on one of its faces
+	struct FaceEdge {
+		int face;
+		uint64_t from, to;
+	};
+
+	struct LeafMesh {
+		vector<uint64_t> triangles;				// vertex keys, three per triangle
+		vector<pair<uint64_t, vec3>> vertices;	// key and position of each vertex used
+		vector<FaceEdge> outline;				// where the surface meets the faces
+	};
+
+	void forEach(ThreadPool *pool, int count, const function<void(int)> &fn) {
+		if (pool) pool->parallelFor(count, fn);
+		else for (int i = 0; i < count; ++i) fn(i);
+	}
+
+	class OctreeBuilder {
+	private:
+		const DensityField &m_density;
+		vec3 m_min;
+		vec3 m_step;			// size of a finest cell
+		float m_maxStep;
+		float m_iso;
+		vec3 m_viewpoint;
+		OctreeSettings m_settings;
+		ThreadPool *m_pool;
+		int m_res;				// finest cells along each axis
+
+		vector<Cell> m_cells;
+		unordered_map<uint64_t, float> m_samples;	// density at nodes
+		unordered_map<uint64_t, float> m_values;	// the same, hanging nodes interpolated
+
+		// z in the low bits, so sorted keys run along z rows
+		static uint64_t nodeKey(int x, int y, int z) { return uint64_t(z) | uint64_t(y) << 20 | uint64_t(x) << 40; }
+		static uint64_t nodeKey(const int n[3]) { return nodeKey(n[0], n[1], n[2]); }
+
+		int size(const Cell &cell) const { return m_res >> cell.depth; }
+
+		vec3 position(int x, int y, int z) const {
+			return vec3(m_min.x + x*m_step.x, m_min.y + y*m_step.y, m_min.z + z*m_step.z);
+		}
+
+		float sample(int x, int y, int z) const { return m_samples.at(nodeKey(x, y, z)); }
+
+		// Evaluates the density at every node in keys not already known, a
+		// row call for each run of nodes along z
+		void sampleNodes(vector<uint64_t> &keys) {
+			sort(keys.begin(), keys.end());
+			keys.erase(unique(keys.begin(), keys.end()), keys.end());
+			keys.erase(remove_if(keys.begin(), keys.end(), [&](uint64_t k) { return m_samples.count(k) > 0; }), keys.end());
+
+			vector<size_t> runs;
+			for (size_t i = 0; i < keys.size(); ++i) {
+				if (i == 0 || keys[i] >> 20 != keys[i-1] >> 20) runs.push_back(i);
+			}
+			runs.push_back(keys.size());
+
+			vector<float> values(keys.size());
+			const int chunk = 64;
+			forEach(m_pool, int((runs.size() - 1 + chunk - 1) / chunk), [&](int c) {
+				size_t last = min(runs.size() - 1, size_t(c + 1) * chunk);
+				vector<float> zs;
+				for (size_t r = size_t(c) * chunk; r < last; ++r) {
+					size_t begin = runs[r], end = runs[r+1];
+					uint64_t k = keys[begin];
+					vec3 row = position(int(k >> 40), int(k >> 20 & 0xfffff), 0);
+					zs.clear();
+					for (size_t i = begin; i < end; ++i) zs.push_back(m_min.z + int(keys[i] & 0xfffff) * m_step.z);
+					m_density.row(row.x, row.y, zs.data(), &values[begin], int(end - begin));
+				}
+			});
+			for (size_t i = 0; i < keys.size(); ++i) m_samples[keys[i]] = values[i];
+		}
+
+		// The 27 nodes a cell's children have as corners
+		void childNodes(int c, vector<uint64_t> &out) const {
+			const Cell &cell = m_cells[c];
+			int h = size(cell) / 2;
+			for (int a = 0; a < 3; ++a)
+				for (int b = 0; b < 3; ++b)
+					for (int d = 0; d < 3; ++d)
+						out.push_back(nodeKey(cell.p[0] + a*h, cell.p[1] + b*h, cell.p[2] + d*h));
+		}
+
+		void split(int c) {
+			Cell parent = m_cells[c];
+			int h = size(parent) / 2;
+			m_cells[c].child = int(m_cells.size());
+			for (int o = 0; o < 8; ++o) {
+				Cell child;
+				for (int a = 0; a < 3; ++a) child.p[a] = parent.p[a] + ((o >> a) & 1) * h;
+				child.depth = parent.depth + 1;
+				m_cells.push_back(child);
+			}
+		}
+
+		int findLeaf(const int q[3]) const {
+			int c = 0;
+			while (m_cells[c].child >= 0) {
+				const Cell &cell = m_cells[c];
+				int h = size(cell) / 2;
+				int octant = 0;
+				for (int a = 0; a < 3; ++a) {
+					if (q[a] >= cell.p[a] + h) octant |= 1 << a;
+				}
+				c = cell.child + octant;
+			}
+			return c;
+		}
+
+		float distanceTo(const Cell &cell) const {
+			vec3 low = position(cell.p[0], cell.p[1], cell.p[2]);
+			int s = size(cell);
+			vec3 high = position(cell.p[0] + s, cell.p[1] + s, cell.p[2] + s);
+			vec3 nearest(max(low.x, min(m_viewpoint.x, high.x)), max(low.y, min(m_viewpoint.y, high.y)),
+				max(low.z, min(m_viewpoint.z, high.z)));
+			return length(m_viewpoint - nearest);
+		}
+
+		// Whether the surface might pass through a leaf, from its corners. No
+		// point in the cell is further than 0.87 of its size from a corner.
+		// The finest leaves can only ever mesh a change of sign at their
+		// corners, so for them that is all that counts.
+		bool leafSurface(const Cell &cell) const {
+			int s = size(cell);
+			bool inside = false, outside = false;
+			float nearest = numeric_limits<float>::max();
+			for (int k = 0; k < 8; ++k) {
+				float v = sample(cell.p[0] + cornerOffset[k][0]*s, cell.p[1] + cornerOffset[k][1]*s, cell.p[2] + cornerOffset[k][2]*s);
+				(v > m_iso ? inside : outside) = true;
+				nearest = min(nearest, fabs(v - m_iso));
+			}
+			if (cell.depth == m_settings.maxDepth) return inside && outside;
+			return (inside && outside) || nearest < m_settings.lipschitz * 0.87f * s * m_maxStep;
+		}
+
+		/*
+			A cell is split when its corners alone do not describe the density
+			well enough for how far it is from the camera: the worst difference
+			between the density and its trilinear interpolation at the other 19
+			of the 27 child nodes, against the allowed error at that distance.
+			Cells that cannot hold surface are never split.
+		*/
+		bool shouldSplit(int c) const {
+			const Cell &cell = m_cells[c];
+			int s = size(cell), h = s / 2;
+			float v[3][3][3];
+			bool inside = false, outside = false;
+			float nearest = numeric_limits<float>::max();
+			for (int a = 0; a < 3; ++a) {
+				for (int b = 0; b < 3; ++b) {
+					for (int d = 0; d < 3; ++d) {
+						v[a][b][d] = sample(cell.p[0] + a*h, cell.p[1] + b*h, cell.p[2] + d*h);
+						(v[a][b][d] > m_iso ? inside : outside) = true;
+						nearest = min(nearest, fabs(v[a][b][d] - m_iso));
+					}
+				}
+			}
+			float worldSize = s * m_maxStep;
+			if (cell.depth < m_settings.minDepth) return true;
+			// every point of the cell is within 0.44 of its size from one of the
+			// nodes. Children that are the finest leaves only mesh a change of
+			// sign among the nodes though.
+			bool surface = inside && outside;
+			if (cell.depth + 1 < m_settings.maxDepth) surface = surface || nearest < m_settings.lipschitz * 0.44f * worldSize;
+			if (!surface) return false;
+
+			float error = 0;
+			for (int a = 0; a < 3; ++a) {
+				for (int b = 0; b < 3; ++b) {
+					for (int d = 0; d < 3; ++d) {
+						if (a != 1 && b != 1 && d != 1) continue;
+						float u = a * 0.5f, w = b * 0.5f, t = d * 0.5f;
+						float interpolated =
+							(1-u)*(1-w)*(1-t)*v[0][0][0] + u*(1-w)*(1-t)*v[2][0][0] +
+							(1-u)*w*(1-t)*v[0][2][0] + u*w*(1-t)*v[2][2][0] +
+							(1-u)*(1-w)*t*v[0][0][2] + u*(1-w)*t*v[2][0][2] +
+							(1-u)*w*t*v[0][2][2] + u*w*t*v[2][2][2];
+						error = max(error, fabs(v[a][b][d] - interpolated));
+					}
+				}
+			}
+			return error > m_settings.screenError * max(distanceTo(cell), worldSize);
+		}
+
+		// Density used for meshing at a node: the sample, unless the node lies
+		// on the face or edge of a larger leaf without being one of its
+		// corners. Then it is interpolated from the largest such leaf, so
+		// every leaf touching that face sees the same values on it.
+		float value(const int n[3]) {
+			uint64_t key = nodeKey(n);
+			auto found = m_values.find(key);
+			if (found != m_values.end()) return found->second;
+
+			int hanging = -1;
+			for (int o = 0; o < 8; ++o) {
+				int q[3];
+				bool inRange = true;
+				for (int a = 0; a < 3; ++a) {
+					q[a] = n[a] - ((o >> a) & 1);
+					inRange = inRange && q[a] >= 0 && q[a] < m_res;
+				}
+				if (!inRange) continue;
+				int l = findLeaf(q);
+				const Cell &cell = m_cells[l];
+				int s = size(cell);
+				bool corner = true;
+				for (int a = 0; a < 3; ++a) {
+					corner = corner && (n[a] == cell.p[a] || n[a] == cell.p[a] + s);
+				}
+				if (!corner && (hanging < 0 || cell.depth < m_cells[hanging].depth)) hanging = l;
+			}
+
+			float v = 0;
+			if (hanging < 0) {
+				v = m_samples.at(key);
+			} else {
+				Cell cell = m_cells[hanging];
+				int s = size(cell);
+				for (int k = 0; k < 8; ++k) {
+					float weight = 1;
+					int corner[3];
+					for (int a = 0; a < 3; ++a) {
+						float t = float(n[a] - cell.p[a]) / s;
+						weight *= cornerOffset[k][a] ? t : 1 - t;
+						corner[a] = cell.p[a] + cornerOffset[k][a] * s;
+					}
+					if (weight != 0) v += weight * value(corner);
+				}
+			}
+			m_values[key] = v;
+			return v;
+		}
+
+		// The longest leaf edge that contains the edge of length s along axis
+		// starting at node a. Its start and length are written to start and
+		// length, a vertex on any part of it is worked out on all of it.
+		void longestEdge(const int a[3], int axis, int s, int start[3], int &length) const {
+			int p = (axis + 1) % 3, q = (axis + 2) % 3;
+			for (int i = 0; i < 3; ++i) start[i] = a[i];
+			length = s;
+			for (int o = 0; o < 4; ++o) {
+				int c[3] = { a[0], a[1], a[2] };
+				c[p] -= o & 1;
+				c[q] -= (o >> 1) & 1;
+				if (c[p] < 0 || c[p] >= m_res || c[q] < 0 || c[q] >= m_res) continue;
+				const Cell &cell = m_cells[findLeaf(c)];
+				int cs = size(cell);
+				if (cs <= length) continue;
+				if ((a[p] == cell.p[p] || a[p] == cell.p[p] + cs) && (a[q] == cell.p[q] || a[q] == cell.p[q] + cs)) {
+					start[axis] = cell.p[axis];
+					length = cs;
+				}
+			}
+		}
+
+		LeafMesh meshLeaf(int c) const {
+			LeafMesh out;
+			const Cell &cell = m_cells[c];
+			int s = size(cell);
+
+			int corner[8][3];
+			int cubeIndex = 0;
+			for (int k = 0; k < 8; ++k) {
+				for (int a = 0; a < 3; ++a) corner[k][a] = cell.p[a] + cornerOffset[k][a] * s;
+				if (m_values.at(nodeKey(corner[k])) <= m_iso) cubeIndex |= 1 << k;
+			}
+			if (!edgeTable[cubeIndex]) return out;
+
+			uint64_t keys[12];
+			for (int e = 0; e < 12; ++e) {
+				if (!(edgeTable[cubeIndex] & (1 << e))) continue;
+				const int *a = corner[edgeCorners[e][0]], *b = corner[edgeCorners[e][1]];
+				int axis = (a[0] != b[0]) ? 0 : (a[1] != b[1]) ? 1 : 2;
+				const int *low = (a[axis] < b[axis]) ? a : b;
+				int start[3], length;
+				longestEdge(low, axis, s, start, length);
+				int end[3] = { start[0], start[1], start[2] };
+				end[axis] += length;
+
+				keys[e] = nodeKey(start) | uint64_t(axis) << 60;
+				vec3 p0 = position(start[0], start[1], start[2]), p1 = position(end[0], end[1], end[2]);
+				out.vertices.push_back({ keys[e], LinearInterp(vec4(p0, m_values.at(nodeKey(start))),
+					vec4(p1, m_values.at(nodeKey(end))), m_iso) });
+			}
+
+			// same winding as the other meshers
+			vector<pair<int, int>> directed;
+			for (int n = 0; triTable[cubeIndex][n] != -1; n += 3) {
+				int t[3] = { triTable[cubeIndex][n+2], triTable[cubeIndex][n+1], triTable[cubeIndex][n] };
+				for (int j = 0; j < 3; ++j) {
+					out.triangles.push_back(keys[t[j]]);
+					directed.push_back({ t[j], t[(j+1) % 3] });
+				}
+			}
+
+			// edges only one of the leaf's triangles uses are where its surface
+			// meets its faces
+			for (const pair<int, int> &d : directed) {
+				if (find(directed.begin(), directed.end(), make_pair(d.second, d.first)) != directed.end()) continue;
+				int faces = edgeFaces(d.first) & edgeFaces(d.second);
+				for (int f = 0; f < 6; ++f) {
+					if (faces & (1 << f)) {
+						out.outline.push_back({ f, keys[d.first], keys[d.second] });
+						break;
+					}
+				}
+			}
+			return out;
+		}
+
+		// Leaves across face f of cell a, in the layer of finest cells touching it
+		void leavesAcross(int c, const Cell &a, int f, vector<int> &out) const {
+			const Cell &cell = m_cells[c];
+			int axis = f / 2, s = size(a), cs = size(cell);
+			int layer = (f & 1) ? a.p[axis] + s : a.p[axis] - 1;
+			if (layer < cell.p[axis] || layer >= cell.p[axis] + cs) return;
+			for (int i = 1; i < 3; ++i) {
+				int b = (axis + i) % 3;
+				if (cell.p[b] >= a.p[b] + s || cell.p[b] + cs <= a.p[b]) return;
+			}
+			if (cell.child < 0) {
+				out.push_back(c);
+			} else {
+				for (int o = 0; o < 8; ++o) leavesAcross(cell.child + o, a, f, out);
+			}
+		}
+
+	public:
+		OctreeBuilder(const DensityField &density, vec3 minBound, vec3 maxBound, float iso, vec3 viewpoint,
+			const OctreeSettings &settings, ThreadPool *pool)
+			: m_density(density), m_min(minBound), m_iso(iso), m_viewpoint(viewpoint), m_settings(settings), m_pool(pool) {
+			m_settings.maxDepth = max(1, min(16, m_settings.maxDepth));
+			m_res = 1 << m_settings.maxDepth;
+			m_step = (maxBound - minBound) / float(m_res);
+			m_maxStep = max(m_step.x, max(m_step.y, m_step.z));
+		}
+
+		// Splits cells level by level from the whole box down
+		void refine() {
+			Cell root;
+			root.p[0] = root.p[1] = root.p[2] = 0;
+			m_cells.push_back(root);
+			vector<int> frontier = { 0 };
+			for (int depth = 0; depth < m_settings.maxDepth && !frontier.empty(); ++depth) {
+				vector<uint64_t> wanted;
+				for (int c : frontier) childNodes(c, wanted);
+				sampleNodes(wanted);
+
+				vector<char> splits(frontier.size());
+				forEach(m_pool, int(frontier.size()), [&](int i) { splits[i] = shouldSplit(frontier[i]); });
+				vector<int> next;
+				for (size_t i = 0; i < frontier.size(); ++i) {
+					if (!splits[i]) continue;
+					split(frontier[i]);
+					for (int o = 0; o < 8; ++o) next.push_back(m_cells[frontier[i]].child + o);
+				}
+				frontier.swap(next);
+			}
+			for (Cell &cell : m_cells) {
+				if (cell.child < 0) cell.surface = leafSurface(cell);
+			}
+		}
+
+		// Splits leaves until no leaf that might hold surface has a neighbour,
+		// across a face, edge or corner, more than one level bigger. Siblings
+		// share their neighbours outside the parent, so the neighbours are
+		// looked for once per parent of such leaves.
+		void balance() {
+			for (;;) {
+				vector<int> toSplit;
+				for (size_t c = 0; c < m_cells.size(); ++c) {
+					const Cell &cell = m_cells[c];
+					if (cell.child < 0) continue;
+					bool surface = false;
+					for (int o = 0; o < 8; ++o) {
+						const Cell &child = m_cells[cell.child + o];
+						surface = surface || (child.child < 0 && child.surface);
+					}
+					if (!surface) continue;
+					int s = size(cell);
+					for (int n = 0; n < 27; ++n) {
+						int delta[3] = { n % 3 - 1, n / 3 % 3 - 1, n / 9 - 1 };
+						if (!delta[0] && !delta[1] && !delta[2]) continue;
+						int q[3];
+						bool inRange = true;
+						for (int a = 0; a < 3; ++a) {
+							q[a] = delta[a] < 0 ? cell.p[a] - 1 : delta[a] > 0 ? cell.p[a] + s : cell.p[a];
+							inRange = inRange && q[a] >= 0 && q[a] < m_res;
+						}
+						if (!inRange) continue;
+						int l = findLeaf(q);
+						if (m_cells[l].depth < cell.depth) toSplit.push_back(l);
+					}
+				}
+				if (toSplit.empty()) break;
+
+				sort(toSplit.begin(), toSplit.end());
+				toSplit.erase(unique(toSplit.begin(), toSplit.end()), toSplit.end());
+				vector<uint64_t> wanted;
+				for (int c : toSplit) childNodes(c, wanted);
+				sampleNodes(wanted);
+				for (int c : toSplit) {
+					split(c);
+					for (int o = 0; o < 8; ++o) {
+						Cell &child = m_cells[m_cells[c].child + o];
+						child.surface = leafSurface(child);
+					}
+				}
+			}
+		}
+
+		OctreeMesh mesh() {
+			OctreeMesh out;
+			out.viewpoint = m_viewpoint;
+			out.leavesPerDepth.assign(m_settings.maxDepth + 1, 0);
+
+			vector<int> leaves;
+			for (size_t c = 0; c < m_cells.size(); ++c) {
+				if (m_cells[c].child < 0) leaves.push_back(int(c));
+			}
+			// meshing only reads values, so work them all out first
+			for (int c : leaves) {
+				int s = size(m_cells[c]);
+				for (int k = 0; k < 8; ++k) {
+					int corner[3];
+					for (int a = 0; a < 3; ++a) corner[a] = m_cells[c].p[a] + cornerOffset[k][a] * s;
+					value(corner);
+				}
+			}
+
+			vector<LeafMesh> meshes(leaves.size());
+			forEach(m_pool, int(leaves.size()), [&](int i) { meshes[i] = meshLeaf(leaves[i]); });
+
+			unordered_map<uint64_t, unsigned int> index;
+			vector<int> meshOf(m_cells.size(), -1);
+			for (size_t i = 0; i < leaves.size(); ++i) {
+				meshOf[leaves[i]] = int(i);
+				const LeafMesh &leaf = meshes[i];
+				if (leaf.triangles.empty()) continue;
+				out.leavesPerDepth[m_cells[leaves[i]].depth]++;
+				for (const pair<uint64_t, vec3> &v : leaf.vertices) {
+					if (index.emplace(v.first, unsigned(out.vertices.size())).second) out.vertices.push_back(v.second);
+				}
+				for (uint64_t key : leaf.triangles) out.indices.push_back(index.at(key));
+			}
+
+			/*
+				Seams, from the larger leaf's side of each face with smaller
+				leaves across it. The outlines on the face from both sides, each
+				turned round, join up into loops around the gaps between them
+				(edges both sides share cancel out). Each loop is filled with a
+				fan, wound against both sides so it faces the same way they do.
+			*/
+			for (size_t i = 0; i < leaves.size(); ++i) {
+				const Cell &cell = m_cells[leaves[i]];
+				int s = size(cell);
+				for (int f = 0; f < 6; ++f) {
+					int axis = f / 2;
+					int q[3] = { cell.p[0], cell.p[1], cell.p[2] };
+					q[axis] = (f & 1) ? cell.p[axis] + s : cell.p[axis] - 1;
+					if (q[axis] < 0 || q[axis] >= m_res) continue;
+					if (size(m_cells[findLeaf(q)]) >= s) continue;
+
+					map<pair<uint64_t, uint64_t>, int> edges;
+					for (const FaceEdge &e : meshes[i].outline) {
+						if (e.face == f) edges[{ e.to, e.from }]++;
+					}
+					vector<int> across;
+					leavesAcross(0, cell, f, across);
+					for (int l : across) {
+						for (const FaceEdge &e : meshes[meshOf[l]].outline) {
+							if (e.face == (f ^ 1)) edges[{ e.to, e.from }]++;
+						}
+					}
+					for (auto &e : edges) {
+						auto reverse = edges.find({ e.first.second, e.first.first });
+						if (reverse == edges.end()) continue;
+						int shared = min(e.second, reverse->second);
+						e.second -= shared;
+						reverse->second -= shared;
+					}
+					map<uint64_t, vector<uint64_t>> next;
+					size_t remaining = 0;
+					for (auto &e : edges) {
+						for (int n = 0; n < e.second; ++n) next[e.first.first].push_back(e.first.second);
+						remaining += e.second;
+					}
+
+					while (remaining > 0) {
+						auto first = next.begin();
+						while (first->second.empty()) ++first;
+						uint64_t start = first->first;
+						vector<uint64_t> loop = { start };
+						uint64_t at = first->second.back();
+						first->second.pop_back();
+						remaining--;
+						bool closed = true;
+						while (at != start) {
+							loop.push_back(at);
+							auto step = next.find(at);
+							if (step == next.end() || step->second.empty()) {
+								closed = false;
+								break;
+							}
+							at = step->second.back();
+							step->second.pop_back();
+							remaining--;
+						}
+						if (!closed) {
+							out.openSeams++;
+							continue;
+						}
+						for (size_t k = 1; k + 1 < loop.size(); ++k) {
+							out.indices.push_back(index.at(loop[0]));
+							out.indices.push_back(index.at(loop[k]));
+							out.indices.push_back(index.at(loop[k+1]));
+							out.seamTriangles++;
+						}
+					}
+				}
+			}
+
+			// density grows into the rock, so the surface faces down the gradient
+			out.normals.resize(out.vertices.size());
+			const int chunk = 256;
+			forEach(m_pool, int((out.vertices.size() + chunk - 1) / chunk), [&](int c) {
+				size_t end = min(out.vertices.size(), size_t(c + 1) * chunk);
+				for (size_t i = size_t(c) * chunk; i < end; ++i) {
+					vec3 g = m_density.gradient(out.vertices[i], 0.5f * m_maxStep);
+					out.normals[i] = (length(g) > 0) ? -normalize(g) : vec3(0, 1, 0);
+				}
+			});
+			out.samples = m_samples.size();
+			return out;
+		}
+	};
+}
+
+OctreeMesh meshOctree(const DensityField &density, vec3 minBound, vec3 maxBound, float minValue,
+	vec3 viewpoint, const OctreeSettings &settings, ThreadPool *pool) {
+	OctreeBuilder builder(density, minBound, maxBound, minValue, viewpoint, settings, pool);
+	builder.refine();
+	builder.balance();
+	return builder.mesh();
+}
@@ -0,0 +1,64 @@
+//---------------------------------------------------------------------------
+//
+// Adaptive octree marching cubes
+//
+// The terrain box is split as an octree, finest near the camera and where
+// the density is not well described by its values at a cell's corners, and
+// every leaf is meshed with the usual marching cubes tables at its own size.
+// Neighbouring leaves differ by at most one level wherever there is surface.
+//
+// Where a large leaf meets smaller ones the two sides would not line up on
+// their shared face, so three things keep the mesh closed:
+//  - the density at a corner of a small leaf that lies on the face or edge
+//    of a larger leaf (a hanging node) is interpolated from the larger
+//    leaf's corners, so both sides agree on the face;
+//  - a vertex on an edge shared by leaves of different sizes is always
+//    worked out on the longest of those edges, so it is one vertex;
+//  - the larger leaf crosses the face in one straight line where the small
+//    leaves follow a bend, the flat gap between the two is filled in.
+//
+//----------------------------------------------------------------------------
+
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include "comp308.hpp"
+#include "density.hpp"
+
+class ThreadPool;
+
+struct OctreeSettings {
+	//leaves are never bigger than the box split this many times
+	int minDepth = 2;
+	//the finest leaves are the box split this many times, 2^maxDepth across
+	int maxDepth = 7;
+	//density error allowed per unit of distance from the camera. Density
+	//changes by about one per world unit, so this is roughly the error on
+	//screen in radians. Much below 0.02 every leaf with surface ends up at
+	//maxDepth
+	float screenError = 0.04f;
+	//bound on how fast the density can change per world unit, used to tell
+	//that a cell cannot hold any surface
+	float lipschitz = 4.0f;
+	//Terrain remeshes once the camera is this far from where it last did
+	float rebuildDistance = 30.0f;
+};
+
+struct OctreeMesh {
+	std::vector<comp308::vec3> vertices;
+	std::vector<comp308::vec3> normals;	// from the density gradient
+	std::vector<unsigned int> indices;
+	comp308::vec3 viewpoint;			// camera position it was made for
+
+	std::vector<int> leavesPerDepth;	// leaves that made triangles
+	size_t samples = 0;					// density evaluations
+	size_t seamTriangles = 0;			// filling gaps between leaf sizes
+	size_t openSeams = 0;				// gaps that could not be closed
+};
+
+// Meshes the surface of density between minBound and maxBound for a camera
+// at viewpoint. Sampling and meshing are shared out over pool when given.
+OctreeMesh meshOctree(const DensityField &, comp308::vec3 minBound, comp308::vec3 maxBound, float minValue,
+	comp308::vec3 viewpoint, const OctreeSettings &, ThreadPool *pool);
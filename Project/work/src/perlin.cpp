@@ -10,9 +10,21 @@
 #include <cstdlib>
 #include <ctime>
 #include <cmath>
+#include <random>
 
-Perlin::Perlin() {
-	srand(time(NULL));
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define PERLIN_X86_SIMD
+#include <immintrin.h>
+#endif
+
+Perlin::Perlin() : Perlin(unsigned(time(NULL))) {
+}
+
+Perlin::Perlin(unsigned seed) {
+	// Own generator rather than rand() so construction is repeatable and
+	// safe to do from several threads at once
+	std::minstd_rand rng(seed);
+	std::uniform_real_distribution<float> gradient(-1.0f, 1.0f);
 
 	p = new int[256];
 	Gx = new float[256];
@@ -22,15 +34,15 @@ Perlin::Perlin() {
 	for (int i=0; i<256; ++i) {
 		p[i] = i;
 
-		Gx[i] = (float(rand()) / (RAND_MAX/2)) - 1.0f;
-		Gy[i] = (float(rand()) / (RAND_MAX/2)) - 1.0f;
-		Gz[i] = (float(rand()) / (RAND_MAX/2)) - 1.0f;
+		Gx[i] = gradient(rng);
+		Gy[i] = gradient(rng);
+		Gz[i] = gradient(rng);
 	}
 
 	int j=0;
 	int swp=0;
 	for (int i=0; i<256; i++) {
-		j = rand() & 255;
+		j = rng() & 255;
 
 		swp = p[i];
 		p[i] = p[j];
@@ -40,14 +52,14 @@ Perlin::Perlin() {
 
 Perlin::~Perlin()
 {
-	delete p;
-	delete Gx;
-	delete Gy;
-	delete Gz;
+	delete [] p;
+	delete [] Gx;
+	delete [] Gy;
+	delete [] Gz;
 }
 
 
-float Perlin::noise(float sample_x, float sample_y, float sample_z)
+float Perlin::noise(float sample_x, float sample_y, float sample_z) const
 {
 	// Unit cube vertex coordinates surrounding the sample point
 	int x0 = int(floorf(sample_x));
@@ -100,4 +112,254 @@ float Perlin::noise(float sample_x, float sample_y, float sample_z)
 	float value = ya + wz*(yb - ya);
 
 	return value;
-}
\ No newline at end of file
+}
+
+
+// Batch noise
+//
+// The vector versions repeat the scalar function operation for operation
+// (no FMA, same association), so every lane rounds exactly like noise().
+// They are compiled for their instruction set with target attributes and
+// picked at run time, the rest of the program needs no special flags.
+
+#ifdef PERLIN_X86_SIMD
+namespace {
+
+#define PERLIN_AVX2 __attribute__((target("avx2")))
+#define PERLIN_SSE41 __attribute__((target("sse4.1")))
+
+	PERLIN_AVX2 inline __m256 dotGradient8(const float *Gx, const float *Gy, const float *Gz, __m256i g,
+		__m256 px, __m256 py, __m256 pz) {
+		__m256 gx = _mm256_i32gather_ps(Gx, g, 4);
+		__m256 gy = _mm256_i32gather_ps(Gy, g, 4);
+		__m256 gz = _mm256_i32gather_ps(Gz, g, 4);
+		return _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(gx, px), _mm256_mul_ps(gy, py)), _mm256_mul_ps(gz, pz));
+	}
+
+	PERLIN_AVX2 inline __m256 fade8(__m256 t) {
+		__m256 w = _mm256_sub_ps(_mm256_mul_ps(_mm256_set1_ps(6.0f), t), _mm256_set1_ps(15.0f));
+		w = _mm256_add_ps(_mm256_mul_ps(w, t), _mm256_set1_ps(10.0f));
+		return _mm256_mul_ps(_mm256_mul_ps(_mm256_mul_ps(w, t), t), t);
+	}
+
+	PERLIN_AVX2 inline __m256 lerp8(__m256 a, __m256 b, __m256 w) {
+		return _mm256_add_ps(a, _mm256_mul_ps(w, _mm256_sub_ps(b, a)));
+	}
+
+	// Returns how many points it did, always a multiple of 8
+	PERLIN_AVX2 size_t noiseAVX2(const int *p, const float *Gx, const float *Gy, const float *Gz,
+		const float *xs, const float *ys, const float *zs, float *out, size_t n) {
+		const __m256i mask = _mm256_set1_epi32(255);
+		const __m256i one = _mm256_set1_epi32(1);
+		const __m256 onef = _mm256_set1_ps(1.0f);
+
+		size_t i = 0;
+		for (; i + 8 <= n; i += 8) {
+			__m256 sx = _mm256_loadu_ps(xs + i);
+			__m256 sy = _mm256_loadu_ps(ys + i);
+			__m256 sz = _mm256_loadu_ps(zs + i);
+
+			// Unit cube vertex coordinates surrounding the sample point
+			__m256 fx = _mm256_floor_ps(sx);
+			__m256 fy = _mm256_floor_ps(sy);
+			__m256 fz = _mm256_floor_ps(sz);
+			__m256i x0 = _mm256_cvttps_epi32(fx);
+			__m256i y0 = _mm256_cvttps_epi32(fy);
+			__m256i z0 = _mm256_cvttps_epi32(fz);
+			__m256i x1 = _mm256_add_epi32(x0, one);
+			__m256i y1 = _mm256_add_epi32(y0, one);
+			__m256i z1 = _mm256_add_epi32(z0, one);
+
+			// Sample point position within unit cube
+			__m256 px0 = _mm256_sub_ps(sx, fx);
+			__m256 py0 = _mm256_sub_ps(sy, fy);
+			__m256 pz0 = _mm256_sub_ps(sz, fz);
+			__m256 px1 = _mm256_sub_ps(px0, onef);
+			__m256 py1 = _mm256_sub_ps(py0, onef);
+			__m256 pz1 = _mm256_sub_ps(pz0, onef);
+
+			// Permutation chain, shared between corners where possible
+			__m256i hz0 = _mm256_i32gather_epi32(p, _mm256_and_si256(z0, mask), 4);
+			__m256i hz1 = _mm256_i32gather_epi32(p, _mm256_and_si256(z1, mask), 4);
+			__m256i h00 = _mm256_i32gather_epi32(p, _mm256_and_si256(_mm256_add_epi32(y0, hz0), mask), 4);
+			__m256i h10 = _mm256_i32gather_epi32(p, _mm256_and_si256(_mm256_add_epi32(y1, hz0), mask), 4);
+			__m256i h01 = _mm256_i32gather_epi32(p, _mm256_and_si256(_mm256_add_epi32(y0, hz1), mask), 4);
+			__m256i h11 = _mm256_i32gather_epi32(p, _mm256_and_si256(_mm256_add_epi32(y1, hz1), mask), 4);
+
+#define PERLIN_CORNER8(xc, h) _mm256_i32gather_epi32(p, _mm256_and_si256(_mm256_add_epi32(xc, h), mask), 4)
+			__m256 d000 = dotGradient8(Gx, Gy, Gz, PERLIN_CORNER8(x0, h00), px0, py0, pz0);
+			__m256 d001 = dotGradient8(Gx, Gy, Gz, PERLIN_CORNER8(x1, h00), px1, py0, pz0);
+			__m256 d010 = dotGradient8(Gx, Gy, Gz, PERLIN_CORNER8(x0, h10), px0, py1, pz0);
+			__m256 d011 = dotGradient8(Gx, Gy, Gz, PERLIN_CORNER8(x1, h10), px1, py1, pz0);
+			__m256 d100 = dotGradient8(Gx, Gy, Gz, PERLIN_CORNER8(x0, h01), px0, py0, pz1);
+			__m256 d101 = dotGradient8(Gx, Gy, Gz, PERLIN_CORNER8(x1, h01), px1, py0, pz1);
+			__m256 d110 = dotGradient8(Gx, Gy, Gz, PERLIN_CORNER8(x0, h11), px0, py1, pz1);
+			__m256 d111 = dotGradient8(Gx, Gy, Gz, PERLIN_CORNER8(x1, h11), px1, py1, pz1);
+#undef PERLIN_CORNER8
+
+			__m256 wx = fade8(px0);
+			__m256 wy = fade8(py0);
+			__m256 wz = fade8(pz0);
+
+			__m256 xa = lerp8(d000, d001, wx);
+			__m256 xb = lerp8(d010, d011, wx);
+			__m256 xc = lerp8(d100, d101, wx);
+			__m256 xd = lerp8(d110, d111, wx);
+			__m256 ya = lerp8(xa, xb, wy);
+			__m256 yb = lerp8(xc, xd, wy);
+			_mm256_storeu_ps(out + i, lerp8(ya, yb, wz));
+		}
+		return i;
+	}
+
+	// SSE has no gather, the table lookups go through memory one lane at a time
+	PERLIN_SSE41 inline __m128i gather4i(const int *t, __m128i idx) {
+		alignas(16) int k[4];
+		_mm_store_si128(reinterpret_cast<__m128i *>(k), idx);
+		return _mm_setr_epi32(t[k[0]], t[k[1]], t[k[2]], t[k[3]]);
+	}
+
+	PERLIN_SSE41 inline __m128 dotGradient4(const float *Gx, const float *Gy, const float *Gz, __m128i g,
+		__m128 px, __m128 py, __m128 pz) {
+		alignas(16) int k[4];
+		_mm_store_si128(reinterpret_cast<__m128i *>(k), g);
+		__m128 gx = _mm_setr_ps(Gx[k[0]], Gx[k[1]], Gx[k[2]], Gx[k[3]]);
+		__m128 gy = _mm_setr_ps(Gy[k[0]], Gy[k[1]], Gy[k[2]], Gy[k[3]]);
+		__m128 gz = _mm_setr_ps(Gz[k[0]], Gz[k[1]], Gz[k[2]], Gz[k[3]]);
+		return _mm_add_ps(_mm_add_ps(_mm_mul_ps(gx, px), _mm_mul_ps(gy, py)), _mm_mul_ps(gz, pz));
+	}
+
+	PERLIN_SSE41 inline __m128 fade4(__m128 t) {
+		__m128 w = _mm_sub_ps(_mm_mul_ps(_mm_set1_ps(6.0f), t), _mm_set1_ps(15.0f));
+		w = _mm_add_ps(_mm_mul_ps(w, t), _mm_set1_ps(10.0f));
+		return _mm_mul_ps(_mm_mul_ps(_mm_mul_ps(w, t), t), t);
+	}
+
+	PERLIN_SSE41 inline __m128 lerp4(__m128 a, __m128 b, __m128 w) {
+		return _mm_add_ps(a, _mm_mul_ps(w, _mm_sub_ps(b, a)));
+	}
+
+	// Returns how many points it did, always a multiple of 4
+	PERLIN_SSE41 size_t noiseSSE41(const int *p, const float *Gx, const float *Gy, const float *Gz,
+		const float *xs, const float *ys, const float *zs, float *out, size_t n) {
+		const __m128i mask = _mm_set1_epi32(255);
+		const __m128i one = _mm_set1_epi32(1);
+		const __m128 onef = _mm_set1_ps(1.0f);
+
+		size_t i = 0;
+		for (; i + 4 <= n; i += 4) {
+			__m128 sx = _mm_loadu_ps(xs + i);
+			__m128 sy = _mm_loadu_ps(ys + i);
+			__m128 sz = _mm_loadu_ps(zs + i);
+
+			__m128 fx = _mm_floor_ps(sx);
+			__m128 fy = _mm_floor_ps(sy);
+			__m128 fz = _mm_floor_ps(sz);
+			__m128i x0 = _mm_cvttps_epi32(fx);
+			__m128i y0 = _mm_cvttps_epi32(fy);
+			__m128i z0 = _mm_cvttps_epi32(fz);
+			__m128i x1 = _mm_add_epi32(x0, one);
+			__m128i y1 = _mm_add_epi32(y0, one);
+			__m128i z1 = _mm_add_epi32(z0, one);
+
+			__m128 px0 = _mm_sub_ps(sx, fx);
+			__m128 py0 = _mm_sub_ps(sy, fy);
+			__m128 pz0 = _mm_sub_ps(sz, fz);
+			__m128 px1 = _mm_sub_ps(px0, onef);
+			__m128 py1 = _mm_sub_ps(py0, onef);
+			__m128 pz1 = _mm_sub_ps(pz0, onef);
+
+			__m128i hz0 = gather4i(p, _mm_and_si128(z0, mask));
+			__m128i hz1 = gather4i(p, _mm_and_si128(z1, mask));
+			__m128i h00 = gather4i(p, _mm_and_si128(_mm_add_epi32(y0, hz0), mask));
+			__m128i h10 = gather4i(p, _mm_and_si128(_mm_add_epi32(y1, hz0), mask));
+			__m128i h01 = gather4i(p, _mm_and_si128(_mm_add_epi32(y0, hz1), mask));
+			__m128i h11 = gather4i(p, _mm_and_si128(_mm_add_epi32(y1, hz1), mask));
+
+#define PERLIN_CORNER4(xc, h) gather4i(p, _mm_and_si128(_mm_add_epi32(xc, h), mask))
+			__m128 d000 = dotGradient4(Gx, Gy, Gz, PERLIN_CORNER4(x0, h00), px0, py0, pz0);
+			__m128 d001 = dotGradient4(Gx, Gy, Gz, PERLIN_CORNER4(x1, h00), px1, py0, pz0);
+			__m128 d010 = dotGradient4(Gx, Gy, Gz, PERLIN_CORNER4(x0, h10), px0, py1, pz0);
+			__m128 d011 = dotGradient4(Gx, Gy, Gz, PERLIN_CORNER4(x1, h10), px1, py1, pz0);
+			__m128 d100 = dotGradient4(Gx, Gy, Gz, PERLIN_CORNER4(x0, h01), px0, py0, pz1);
+			__m128 d101 = dotGradient4(Gx, Gy, Gz, PERLIN_CORNER4(x1, h01), px1, py0, pz1);
+			__m128 d110 = dotGradient4(Gx, Gy, Gz, PERLIN_CORNER4(x0, h11), px0, py1, pz1);
+			__m128 d111 = dotGradient4(Gx, Gy, Gz, PERLIN_CORNER4(x1, h11), px1, py1, pz1);
+#undef PERLIN_CORNER4
+
+			__m128 wx = fade4(px0);
+			__m128 wy = fade4(py0);
+			__m128 wz = fade4(pz0);
+
+			__m128 xa = lerp4(d000, d001, wx);
+			__m128 xb = lerp4(d010, d011, wx);
+			__m128 xc = lerp4(d100, d101, wx);
+			__m128 xd = lerp4(d110, d111, wx);
+			__m128 ya = lerp4(xa, xb, wy);
+			__m128 yb = lerp4(xc, xd, wy);
+			_mm_storeu_ps(out + i, lerp4(ya, yb, wz));
+		}
+		return i;
+	}
+
+	typedef size_t (*BatchKernel)(const int *, const float *, const float *, const float *,
+		const float *, const float *, const float *, float *, size_t);
+
+	BatchKernel pickKernel() {
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("avx2")) return noiseAVX2;
+		if (__builtin_cpu_supports("sse4.1")) return noiseSSE41;
+		return nullptr;
+	}
+}
+#endif
+
+void Perlin::noise(const float *x, const float *y, const float *z, float *out, size_t n) const
+{
+	size_t done = 0;
+#ifdef PERLIN_X86_SIMD
+	static const BatchKernel kernel = pickKernel();
+	if (kernel) done = kernel(p, Gx, Gy, Gz, x, y, z, out, n);
+#endif
+	// whatever is left over after the last full vector
+	for (size_t i = done; i < n; ++i) {
+		out[i] = noise(x[i], y[i], z[i]);
+	}
+}
+
+
+float Perlin::fbm(float sample_x, float sample_y, float sample_z, const Octave *octaves, size_t count) const
+{
+	float value = 0;
+	for (size_t o = 0; o < count; ++o) {
+		float f = octaves[o].frequency;
+		value += noise(sample_x*f, sample_y*f, sample_z*f) * octaves[o].amplitude;
+	}
+	return value;
+}
+
+void Perlin::fbm(const float *x, const float *y, const float *z, float *out, size_t n,
+	const Octave *octaves, size_t count) const
+{
+	// scaled positions go through a small buffer on the stack, one chunk at a time
+	const size_t chunk = 256;
+	float sx[chunk], sy[chunk], sz[chunk], value[chunk];
+
+	for (size_t start = 0; start < n; start += chunk) {
+		size_t m = (n - start < chunk) ? n - start : chunk;
+		float *result = out + start;
+		for (size_t i = 0; i < m; ++i) result[i] = 0;
+
+		for (size_t o = 0; o < count; ++o) {
+			float f = octaves[o].frequency;
+			float a = octaves[o].amplitude;
+			for (size_t i = 0; i < m; ++i) {
+				sx[i] = x[start + i]*f;
+				sy[i] = y[start + i]*f;
+				sz[i] = z[start + i]*f;
+			}
+			noise(sx, sy, sz, value, m);
+			for (size_t i = 0; i < m; ++i) result[i] += value[i] * a;
+		}
+	}
+}
@@ -8,13 +8,45 @@
  * Author: Chris Little
  */
 
+#pragma once
+
+#include <cstddef>
+
 class Perlin {
 public:
+	// Seeded from the clock
 	Perlin();
+	// The same seed always gives the same noise
+	explicit Perlin(unsigned seed);
+	Perlin(const Perlin &) = delete;
+	Perlin & operator=(const Perlin &) = delete;
 	~Perlin();
 
 	// Generates a Perlin (smoothed) noise value between -1 and 1, at the given 3D position.
-	float noise(float sample_x, float sample_y, float sample_z);
+	float noise(float sample_x, float sample_y, float sample_z) const;
+
+	// Strict bound on |noise|. Gradients are within [-1, 1] on each axis, so
+	// a corner's dot product is at most the sample's city block distance to
+	// it, and blended with the fade weights that is at most 0.5 per axis.
+	// Actual values rarely pass 1.
+	static float bound() { return 1.5f; }
+
+	// Noise at n points at once, out[i] = noise(x[i], y[i], z[i]) exactly.
+	// Uses AVX2 gathers or SSE4.1 when the CPU has them, scalar otherwise.
+	void noise(const float *x, const float *y, const float *z, float *out, size_t n) const;
+
+	// One octave of fractal noise: noise at position*frequency, times amplitude
+	struct Octave {
+		float frequency;
+		float amplitude;
+	};
+
+	// Fractal Brownian motion, the sum of the given octaves added in order
+	float fbm(float sample_x, float sample_y, float sample_z, const Octave *octaves, size_t count) const;
+
+	// fbm at n points at once, through the batch noise above
+	void fbm(const float *x, const float *y, const float *z, float *out, size_t n,
+		const Octave *octaves, size_t count) const;
 
 
 private:
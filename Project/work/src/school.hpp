@@ -8,22 +8,35 @@
 
 #include <cmath>
 #include <iostream>
+#include <memory>
+#include <random>
 #include <string>
 #include <vector>
 
 #include "comp308.hpp"
 #include "fish.hpp"
 #include "geometry.hpp"
+#include "debugLines.hpp"
+#include "navigation.hpp"
+#include "schoolRules.hpp" // SchoolParams
 
 class School {
 private:
-	int fishAmount = 300;
+	SchoolParams params;
 	std::vector<Fish> schoolOfFish;
+	std::mt19937 rng;
 	bool info = false;
 	Geometry * spongebob = nullptr;
+	DebugLines debugLines;
+	std::shared_ptr<const NavField> navField; // leads to the current goal, if any
+	comp308::vec3 goal;
+	std::vector<comp308::vec3> positions;   // scratch for the blocked separation kernel
+	std::vector<comp308::vec3> separations;
 
 public:
-	School(Geometry * g);
+	School(Geometry * g, const SchoolParams & = SchoolParams());
+	// Headless school for batch runs, nothing is rendered
+	School(const SchoolParams &, unsigned seed);
 
 	float boundsRadius = 20.0;
 	bool step = false;
@@ -31,17 +44,20 @@ public:
 	void update(bool, bool); // run every frame
 
 	void renderSchool();
+	void renderInfo();
 	void renderBounds();
 
 	void initialisePositions();
 
+	// Gives the school somewhere to swim to, a null field means no goal
+	void setGoal(std::shared_ptr<const NavField>, comp308::vec3);
+
 	void moveAllFishToNewPositions();
-	comp308::vec3 rule1(Fish *);
 	comp308::vec3 rule2(Fish *);
-	comp308::vec3 rule3(Fish *);
-	comp308::vec3 boundPosition(Fish *);
-	comp308::vec3 avoidCoral(Fish *);
-	
-	void limitVelocity(Fish *);
+	void separationAll(std::vector<comp308::vec3> &);
+
 	bool detectCoral(Fish *);
+
+	const std::vector<Fish> & getFish() const { return schoolOfFish; }
+	const SchoolParams & getParams() const { return params; }
 };
\ No newline at end of file
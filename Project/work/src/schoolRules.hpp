@@ -0,0 +1,418 @@
+//---------------------------------------------------------------------------
+//
+// Compile time composable boids rules
+//
+// RuleSchool is a school whose rule set is fixed at compile time by a pack
+// of rule policies, each carrying its weights as template parameters. All
+// pairwise rules share one pass over the other fish and every rule call is
+// a static function, so the chosen set compiles down to a single loop with
+// no calls or branches for rules that are not in the pack.
+//
+//   RuleSchool<Cohesion<1000>, Alignment<8>, SpeedLimit<std::ratio<1, 2>>>
+//
+// School runs the same loop with TunedRules, whose policies read their
+// weights from SchoolParams at runtime so they can be tuned and swept.
+// DefaultRules below is that rule set with the default weights fixed at
+// compile time. Every policy works out its rule with the functions in
+// boids, so there is one copy of the rules whichever way the weights are
+// given.
+//
+//----------------------------------------------------------------------------
+
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <ratio>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include "comp308.hpp"
+#include "fish.hpp"
+#include "navigation.hpp"
+
+// Tunable weights of the boids rules. The defaults are the values the
+// school was tuned with by hand.
+struct SchoolParams {
+	int fishAmount = 300;
+	float cohesion = 1000;        // rule 1 divisor, larger is weaker
+	float separation = 50;        // rule 2 divisor
+	float separationDistance = 1.5;
+	float alignment = 8;          // rule 3 divisor
+	float boundPush = 0.05;       // velocity added when outside the bounds
+	float goalPush = 0.02;        // velocity added towards the current goal
+	float velocityLimit = 0.5;
+	// Compute rule 2 for the whole school up front with the tiled all-pairs
+	// kernel. Separation then sees every fish where it was at the start of
+	// the step rather than where earlier fish have already moved to, so the
+	// school follows a different path from the default, which updates in
+	// place. --blocked-separation in the app, blocked 1 in a sweep
+	bool blockedSeparation = false;
+};
+
+// The rules themselves, weights passed in
+namespace boids {
+	const comp308::vec3 coralCentre(0.0f, -18.0f, 0.0f);
+	const comp308::vec3 coralSize(8.0f, 7.0f, 8.0f);	// half extents
+	const float fishSize = 1.5f;
+
+	// Rule 1, cohesion: a part of the way to the centre of the others,
+	// given the sum of their positions
+	inline comp308::vec3 cohesion(const comp308::vec3 &positionSum, int others, const comp308::vec3 &pos,
+		float divisor) {
+		comp308::vec3 pcj = positionSum / others;
+		return (pcj - pos) / divisor;
+	}
+
+	// Rule 2, separation: push collects the way away from every other fish
+	// closer than distance, and the velocity change is a part of it
+	inline void separate(comp308::vec3 &push, const comp308::vec3 &pos, const comp308::vec3 &otherPos, float distance) {
+		comp308::vec3 d = otherPos - pos;
+		if (length(d) < distance) push = push - d;
+	}
+
+	inline comp308::vec3 separation(const comp308::vec3 &push, float divisor) {
+		return push / divisor;
+	}
+
+	// Rule 3, alignment: a part of the way to the others' mean velocity,
+	// given the sum of their velocities
+	inline comp308::vec3 alignment(const comp308::vec3 &velocitySum, int others, const comp308::vec3 &vel,
+		float divisor) {
+		comp308::vec3 pvj = velocitySum / others;
+		return (pvj - vel) / divisor;
+	}
+
+	// Pushes back into the box boundsRadius high and 2.5 times that across
+	inline comp308::vec3 boundPosition(const comp308::vec3 &pos, float boundsRadius, float push) {
+		comp308::vec3 lo(-boundsRadius * 2.5f, -boundsRadius, -boundsRadius * 2.5f);
+		comp308::vec3 hi(boundsRadius * 2.5f, boundsRadius, boundsRadius * 2.5f);
+		comp308::vec3 v;
+		for (int a = 0; a < 3; ++a) {
+			if (pos[a] < lo[a]) v[a] = push;
+			else if (pos[a] > hi[a]) v[a] = -push;
+		}
+		return v;
+	}
+
+	inline bool inCoral(const comp308::vec3 &pos) {
+		return std::abs(pos.x - coralCentre.x) < fishSize + coralSize.x &&
+			std::abs(pos.y - coralCentre.y) < fishSize + coralSize.y &&
+			std::abs(pos.z - coralCentre.z) < fishSize + coralSize.z;
+	}
+
+	// Steers away from the coral around the origin
+	inline comp308::vec3 avoidCoral(const comp308::vec3 &pos, float push) {
+		comp308::vec3 v;
+		if (inCoral(pos)) {
+			if (pos.x > (coralCentre.x - coralSize.x)) v.x = -push;
+			else if (pos.x < (coralCentre.x + coralSize.x)) v.x = push;
+
+			if (pos.y < (coralCentre.y + coralSize.y)) v.y = push;
+
+			if (pos.z > (coralCentre.z - coralSize.z)) v.z = -push;
+			else if (pos.z < (coralCentre.z + coralSize.z)) v.z = push;
+		}
+		return v;
+	}
+
+	inline void limitSpeed(comp308::vec3 &velocity, float limit) {
+		if (length(velocity) > limit) {
+			velocity = (velocity / length(velocity)) * limit;
+		}
+	}
+}
+
+struct RuleContext {
+	int count = 0;             // number of fish in the school
+	int index = 0;             // fish being moved
+	float boundsRadius = 20.0;
+	const SchoolParams *params = nullptr;   // weights for the Tuned rules
+	const NavField *goal = nullptr;         // for SeekGoal, null for no goal
+	const std::vector<comp308::vec3> *separations = nullptr; // for PresetSeparation
+};
+
+// Defaults for every hook, a policy only overrides what it needs
+struct RuleBase {
+	static constexpr bool pairwise = false;
+	struct accumulator { };
+
+	// called once for every other fish when pairwise is true
+	static void accumulate(accumulator &, const comp308::vec3 &, const comp308::vec3 &,
+		const comp308::vec3 &, const comp308::vec3 &, const RuleContext &) { }
+
+	// velocity change for a fish once all pairs have been seen
+	static comp308::vec3 apply(const accumulator &, const comp308::vec3 &, const comp308::vec3 &,
+		const RuleContext &) { return comp308::vec3(); }
+
+	// applied to the new velocity after every rule has been added
+	static void constrain(comp308::vec3 &, const RuleContext &) { }
+};
+
+template <typename R> constexpr float ratioValue() {
+	return float(R::num) / float(R::den);
+}
+
+/*
+	Cohesion, see boids::cohesion
+*/
+template <int Divisor>
+struct Cohesion : RuleBase {
+	static constexpr bool pairwise = true;
+	struct accumulator { comp308::vec3 centre; };
+
+	static void accumulate(accumulator &a, const comp308::vec3 &, const comp308::vec3 &,
+		const comp308::vec3 &otherPos, const comp308::vec3 &, const RuleContext &) {
+		a.centre = a.centre + otherPos;
+	}
+
+	static comp308::vec3 apply(const accumulator &a, const comp308::vec3 &pos, const comp308::vec3 &,
+		const RuleContext &ctx) {
+		return boids::cohesion(a.centre, ctx.count - 1, pos, float(Divisor));
+	}
+};
+
+/*
+	Separation, see boids::separation
+*/
+template <int Divisor, typename Distance = std::ratio<3, 2>>
+struct Separation : RuleBase {
+	static constexpr bool pairwise = true;
+	struct accumulator { comp308::vec3 push; };
+
+	static void accumulate(accumulator &a, const comp308::vec3 &pos, const comp308::vec3 &,
+		const comp308::vec3 &otherPos, const comp308::vec3 &, const RuleContext &) {
+		boids::separate(a.push, pos, otherPos, ratioValue<Distance>());
+	}
+
+	static comp308::vec3 apply(const accumulator &a, const comp308::vec3 &, const comp308::vec3 &,
+		const RuleContext &) {
+		return boids::separation(a.push, float(Divisor));
+	}
+};
+
+/*
+	Alignment, see boids::alignment
+*/
+template <int Divisor>
+struct Alignment : RuleBase {
+	static constexpr bool pairwise = true;
+	struct accumulator { comp308::vec3 velocity; };
+
+	static void accumulate(accumulator &a, const comp308::vec3 &, const comp308::vec3 &,
+		const comp308::vec3 &, const comp308::vec3 &otherVel, const RuleContext &) {
+		a.velocity = a.velocity + otherVel;
+	}
+
+	static comp308::vec3 apply(const accumulator &a, const comp308::vec3 &, const comp308::vec3 &vel,
+		const RuleContext &ctx) {
+		return boids::alignment(a.velocity, ctx.count - 1, vel, float(Divisor));
+	}
+};
+
+/*
+	Keeps the school inside its box, see boids::boundPosition
+*/
+template <typename Push>
+struct BoundPosition : RuleBase {
+	static comp308::vec3 apply(const accumulator &, const comp308::vec3 &pos, const comp308::vec3 &,
+		const RuleContext &ctx) {
+		return boids::boundPosition(pos, ctx.boundsRadius, ratioValue<Push>());
+	}
+};
+
+/*
+	Steers away from the coral around the origin, see boids::avoidCoral
+*/
+template <typename Push>
+struct AvoidCoral : RuleBase {
+	static comp308::vec3 apply(const accumulator &, const comp308::vec3 &pos, const comp308::vec3 &,
+		const RuleContext &) {
+		return boids::avoidCoral(pos, ratioValue<Push>());
+	}
+};
+
+/*
+	Caps the speed of a fish, see boids::limitSpeed
+*/
+template <typename Limit>
+struct SpeedLimit : RuleBase {
+	static void constrain(comp308::vec3 &velocity, const RuleContext &) {
+		boids::limitSpeed(velocity, ratioValue<Limit>());
+	}
+};
+
+/*
+	Runtime weighted rules, the weights come from the SchoolParams in the
+	context rather than from template parameters
+*/
+struct TunedCohesion : Cohesion<1> {
+	static comp308::vec3 apply(const accumulator &a, const comp308::vec3 &pos, const comp308::vec3 &,
+		const RuleContext &ctx) {
+		return boids::cohesion(a.centre, ctx.count - 1, pos, ctx.params->cohesion);
+	}
+};
+
+struct TunedSeparation : Separation<1> {
+	static void accumulate(accumulator &a, const comp308::vec3 &pos, const comp308::vec3 &,
+		const comp308::vec3 &otherPos, const comp308::vec3 &, const RuleContext &ctx) {
+		boids::separate(a.push, pos, otherPos, ctx.params->separationDistance);
+	}
+
+	static comp308::vec3 apply(const accumulator &a, const comp308::vec3 &, const comp308::vec3 &,
+		const RuleContext &ctx) {
+		return boids::separation(a.push, ctx.params->separation);
+	}
+};
+
+struct TunedAlignment : Alignment<1> {
+	static comp308::vec3 apply(const accumulator &a, const comp308::vec3 &, const comp308::vec3 &vel,
+		const RuleContext &ctx) {
+		return boids::alignment(a.velocity, ctx.count - 1, vel, ctx.params->alignment);
+	}
+};
+
+struct TunedBoundPosition : RuleBase {
+	static comp308::vec3 apply(const accumulator &, const comp308::vec3 &pos, const comp308::vec3 &,
+		const RuleContext &ctx) {
+		return boids::boundPosition(pos, ctx.boundsRadius, ctx.params->boundPush);
+	}
+};
+
+struct TunedSpeedLimit : RuleBase {
+	static void constrain(comp308::vec3 &velocity, const RuleContext &ctx) {
+		boids::limitSpeed(velocity, ctx.params->velocityLimit);
+	}
+};
+
+/*
+	Rule 2 worked out for the whole school before the step, see
+	SchoolParams::blockedSeparation
+*/
+struct PresetSeparation : RuleBase {
+	static comp308::vec3 apply(const accumulator &, const comp308::vec3 &, const comp308::vec3 &,
+		const RuleContext &ctx) {
+		return (*ctx.separations)[ctx.index];
+	}
+};
+
+/*
+	Follows the navigation field downhill, which leads around the terrain
+	and coral rather than straight at the goal
+*/
+struct SeekGoal : RuleBase {
+	static comp308::vec3 apply(const accumulator &, const comp308::vec3 &pos, const comp308::vec3 &,
+		const RuleContext &ctx) {
+		if (!ctx.goal) return comp308::vec3();
+		return ctx.goal->directionAt(pos) * ctx.params->goalPush;
+	}
+};
+
+// The fused step for a pack of rules, shared by RuleSchool and School
+template <typename... Rules>
+struct RuleSet {
+	static constexpr bool anyPairwise() {
+		bool flags[] = { false, Rules::pairwise... };
+		bool any = false;
+		for (bool f : flags) any = any || f;
+		return any;
+	}
+
+	template <std::size_t... I>
+	static void accumulateAll(std::tuple<typename Rules::accumulator...> &acc, const comp308::vec3 &pos,
+		const comp308::vec3 &vel, const Fish &other, const RuleContext &ctx, std::index_sequence<I...>) {
+		const comp308::vec3 otherPos = other.getPosition();
+		const comp308::vec3 otherVel = other.getVelocity();
+		int expand[] = { 0, (Rules::pairwise ? (Rules::accumulate(std::get<I>(acc), pos, vel, otherPos, otherVel, ctx), 0) : 0)... };
+		(void) expand;
+	}
+
+	template <std::size_t... I>
+	static comp308::vec3 applyAll(const std::tuple<typename Rules::accumulator...> &acc, const comp308::vec3 &pos,
+		const comp308::vec3 &vel, const RuleContext &ctx, std::index_sequence<I...>) {
+		// rules are added in pack order, then constrained in pack order
+		comp308::vec3 velocity = vel;
+		int expand[] = { 0, (velocity = velocity + Rules::apply(std::get<I>(acc), pos, vel, ctx), 0)... };
+		int constrain[] = { 0, (Rules::constrain(velocity, ctx), 0)... };
+		(void) expand;
+		(void) constrain;
+		return velocity;
+	}
+
+	// One step of the boids simulation, fish are moved in place in order,
+	// so later fish see where earlier ones have already moved to
+	static void moveAllFish(std::vector<Fish> &schoolOfFish, RuleContext ctx) {
+		ctx.count = int(schoolOfFish.size());
+
+		for (int i = 0; i < ctx.count; ++i) {
+			Fish &fish = schoolOfFish[i];
+			const comp308::vec3 pos = fish.getPosition();
+			const comp308::vec3 vel = fish.getVelocity();
+			ctx.index = i;
+
+			std::tuple<typename Rules::accumulator...> acc;
+			if (anyPairwise()) {
+				for (int j = 0; j < ctx.count; ++j) {
+					if (j == i) continue;
+					accumulateAll(acc, pos, vel, schoolOfFish[j], ctx, std::index_sequence_for<Rules...>());
+				}
+			}
+
+			comp308::vec3 velocity = applyAll(acc, pos, vel, ctx, std::index_sequence_for<Rules...>());
+			fish.setVelocity(velocity);
+			fish.setPosition(pos + velocity);
+		}
+	}
+};
+
+template <typename... Rules>
+class RuleSchool {
+private:
+	std::vector<Fish> schoolOfFish;
+
+public:
+	float boundsRadius = 20.0;
+
+	explicit RuleSchool(const std::vector<Fish> &fish) : schoolOfFish(fish) { }
+
+	const std::vector<Fish> & getFish() const { return schoolOfFish; }
+
+	void moveAllFishToNewPositions() {
+		RuleContext ctx;
+		ctx.boundsRadius = boundsRadius;
+		RuleSet<Rules...>::moveAllFish(schoolOfFish, ctx);
+	}
+};
+
+// The rules and weights School uses by default
+typedef RuleSchool<
+	Cohesion<1000>,
+	Separation<50, std::ratio<3, 2>>,
+	Alignment<8>,
+	BoundPosition<std::ratio<1, 20>>,
+	AvoidCoral<std::ratio<1, 20>>,
+	SpeedLimit<std::ratio<1, 2>>
+> DefaultRules;
+
+// The rules School runs, weighted by its SchoolParams
+typedef RuleSet<
+	TunedCohesion,
+	TunedSeparation,
+	TunedAlignment,
+	TunedBoundPosition,
+	AvoidCoral<std::ratio<1, 20>>,
+	SeekGoal,
+	TunedSpeedLimit
+> TunedRules;
+
+// The same with rule 2 from the blocked kernel
+typedef RuleSet<
+	TunedCohesion,
+	PresetSeparation,
+	TunedAlignment,
+	TunedBoundPosition,
+	AvoidCoral<std::ratio<1, 20>>,
+	SeekGoal,
+	TunedSpeedLimit
+> BlockedTunedRules;
@@ -0,0 +1,211 @@
+//---------------------------------------------------------------------------
+//
+// Terrain mesh kept in blocks, for sculpting
+//
+//----------------------------------------------------------------------------
+
+#include <algorithm>
+#include <vector>
+
+#include "comp308.hpp"
+#include "marchingCubes.hpp"
+#include "sculptMesh.hpp"
+#include "threadPool.hpp"
+
+using namespace std;
+using namespace comp308;
+
+SculptMesh::SculptMesh(int nX, int nY, int nZ, float minValue, const vec4 *points,
+	const SurfaceBlocks *surface, int blockCells, ThreadPool *pool)
+	: m_nX(nX), m_nY(nY), m_nZ(nZ), m_minValue(minValue), m_size(blockCells), m_pool(pool) {
+	m_countX = (nX + m_size - 1) / m_size;
+	m_countY = (nY + m_size - 1) / m_size;
+	m_countZ = (nZ + m_size - 1) / m_size;
+	m_blocks.resize(size_t(m_countX) * m_countY * m_countZ);
+
+	vector<int> all(m_blocks.size());
+	for (size_t b = 0; b < all.size(); ++b) all[b] = int(b);
+	meshBlocks(all, points, surface);
+}
+
+SculptMesh::~SculptMesh() {
+	if (m_vbo) glDeleteBuffers(1, &m_vbo);
+	if (m_ibo) glDeleteBuffers(1, &m_ibo);
+}
+
+// Blocks are meshed in parallel, then placed in the buffers in order
+void SculptMesh::meshBlocks(const vector<int> &ids, const vec4 *points, const SurfaceBlocks *surface) {
+	vector<MCMesh> meshes(ids.size());
+	auto meshOne = [&](int n) {
+		int b = ids[n];
+		int bx = b / (m_countY * m_countZ), by = (b / m_countZ) % m_countY, bz = b % m_countZ;
+		const int lo[3] = { bx * m_size, by * m_size, bz * m_size };
+		const int hi[3] = { min(lo[0] + m_size, m_nX), min(lo[1] + m_size, m_nY), min(lo[2] + m_size, m_nZ) };
+		MarchingCubesBox(m_nX, m_nY, m_nZ, lo, hi, m_minValue, points, meshes[n], surface);
+	};
+	if (m_pool) {
+		m_pool->parallelFor(int(ids.size()), meshOne);
+	} else {
+		for (size_t n = 0; n < ids.size(); ++n) meshOne(int(n));
+	}
+
+	for (size_t n = 0; n < ids.size(); ++n) {
+		place(m_blocks[ids[n]], meshes[n]);
+	}
+}
+
+// Writes a block's mesh into its ranges, moving it to the end of the
+// buffers with a quarter more room if it has outgrown them
+void SculptMesh::place(Block &block, const MCMesh &mesh) {
+	size_t vertexCount = mesh.vertices.size();
+	size_t indexCount = mesh.indices.size();
+	if (vertexCount > block.vertexCapacity || indexCount > block.indexCapacity) {
+		m_vertexUsed -= block.vertexCapacity;
+		m_indexUsed -= block.indexCapacity;
+		block.vertexCapacity = vertexCount + vertexCount / 4 + 8;
+		block.indexCapacity = indexCount + indexCount / 4 + 24;
+		block.vertexStart = m_vertexEnd;
+		block.indexStart = m_indexEnd;
+		m_vertexEnd += block.vertexCapacity;
+		m_indexEnd += block.indexCapacity;
+		m_vertexUsed += block.vertexCapacity;
+		m_indexUsed += block.indexCapacity;
+
+		// the copies grow by half again, the GPU buffers follow on the next upload
+		if (2 * m_vertexEnd > m_vertices.size()) {
+			m_vertices.resize(2 * max(m_vertexEnd, m_vertices.size() / 2 * 3 / 2));
+			m_resized = true;
+		}
+		if (m_indexEnd > m_indices.size()) {
+			m_indices.resize(max(m_indexEnd, m_indices.size() * 3 / 2));
+			m_resized = true;
+		}
+	}
+
+	for (size_t v = 0; v < vertexCount; ++v) {
+		m_vertices[2 * (block.vertexStart + v)] = mesh.vertices[v];
+		m_vertices[2 * (block.vertexStart + v) + 1] = mesh.normals[v];
+	}
+	for (size_t i = 0; i < indexCount; ++i) {
+		m_indices[block.indexStart + i] = unsigned(block.vertexStart + mesh.indices[i]);
+	}
+	block.vertexCount = vertexCount;
+	block.indexCount = indexCount;
+	block.dirty = true;
+	m_drawStale = true;
+}
+
+// Packs every block's ranges together again, keeping their room to grow
+void SculptMesh::relayout() {
+	vector<vec3> vertices(2 * m_vertexUsed);
+	vector<unsigned int> indices(m_indexUsed);
+	size_t vertexEnd = 0, indexEnd = 0;
+	for (Block &block : m_blocks) {
+		copy(m_vertices.begin() + 2 * block.vertexStart, m_vertices.begin() + 2 * (block.vertexStart + block.vertexCount),
+			vertices.begin() + 2 * vertexEnd);
+		for (size_t i = 0; i < block.indexCount; ++i) {
+			indices[indexEnd + i] = unsigned(m_indices[block.indexStart + i] - block.vertexStart + vertexEnd);
+		}
+		block.vertexStart = vertexEnd;
+		block.indexStart = indexEnd;
+		vertexEnd += block.vertexCapacity;
+		indexEnd += block.indexCapacity;
+	}
+	m_vertices.swap(vertices);
+	m_indices.swap(indices);
+	m_vertexEnd = vertexEnd;
+	m_indexEnd = indexEnd;
+	m_resized = true;
+	m_drawStale = true;
+}
+
+int SculptMesh::remesh(const int lo[3], const int hi[3], const vec4 *points, const SurfaceBlocks *surface) {
+	int from[3], to[3];
+	const int counts[3] = { m_countX, m_countY, m_countZ };
+	for (int a = 0; a < 3; ++a) {
+		from[a] = max(0, lo[a] / m_size);
+		to[a] = min(counts[a] - 1, (hi[a] - 1) / m_size);
+	}
+	vector<int> ids;
+	for (int bx = from[0]; bx <= to[0]; ++bx) {
+		for (int by = from[1]; by <= to[1]; ++by) {
+			for (int bz = from[2]; bz <= to[2]; ++bz) {
+				ids.push_back((bx * m_countY + by) * m_countZ + bz);
+			}
+		}
+	}
+	bool resized = m_resized;
+	meshBlocks(ids, points, surface);
+	if (m_vertexEnd > 2 * m_vertexUsed || m_indexEnd > 2 * m_indexUsed) {
+		relayout();
+	}
+
+	if (m_resized && !resized) {
+		m_changed = m_vertices.size() * sizeof(vec3) + m_indices.size() * sizeof(unsigned int);
+	} else {
+		m_changed = 0;
+		for (int b : ids) {
+			m_changed += 2 * m_blocks[b].vertexCount * sizeof(vec3) + m_blocks[b].indexCount * sizeof(unsigned int);
+		}
+	}
+	return int(ids.size());
+}
+
+void SculptMesh::upload() {
+	if (!m_vbo) glGenBuffers(1, &m_vbo);
+	if (!m_ibo) glGenBuffers(1, &m_ibo);
+	glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_ibo);
+	if (m_resized) {
+		glBufferData(GL_ARRAY_BUFFER, m_vertices.size() * sizeof(vec3), m_vertices.data(), GL_DYNAMIC_DRAW);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, m_indices.size() * sizeof(unsigned int), m_indices.data(), GL_DYNAMIC_DRAW);
+		m_resized = false;
+		for (Block &block : m_blocks) block.dirty = false;
+	} else {
+		for (Block &block : m_blocks) {
+			if (!block.dirty) continue;
+			glBufferSubData(GL_ARRAY_BUFFER, 2 * block.vertexStart * sizeof(vec3), 2 * block.vertexCount * sizeof(vec3),
+				&m_vertices[2 * block.vertexStart]);
+			glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, block.indexStart * sizeof(unsigned int),
+				block.indexCount * sizeof(unsigned int), &m_indices[block.indexStart]);
+			block.dirty = false;
+		}
+	}
+}
+
+void SculptMesh::render() {
+	if (m_drawStale) {
+		m_drawCounts.clear();
+		m_drawOffsets.clear();
+		for (const Block &block : m_blocks) {
+			if (!block.indexCount) continue;
+			m_drawCounts.push_back(GLsizei(block.indexCount));
+			m_drawOffsets.push_back((const GLvoid *) (block.indexStart * sizeof(unsigned int)));
+		}
+		m_drawStale = false;
+	}
+
+	glPolygonMode(GL_FRONT, GL_FILL);
+	glPolygonMode(GL_BACK, GL_FILL);
+	glPushClientAttrib(GL_CLIENT_VERTEX_ARRAY_BIT);
+	upload();
+	glEnableClientState(GL_VERTEX_ARRAY);
+	glEnableClientState(GL_NORMAL_ARRAY);
+	glVertexPointer(3, GL_FLOAT, 2 * sizeof(vec3), (const GLvoid *) 0);
+	glNormalPointer(GL_FLOAT, 2 * sizeof(vec3), (const GLvoid *) sizeof(vec3));
+
+	if (!m_drawCounts.empty()) {
+		glMultiDrawElements(GL_TRIANGLES, m_drawCounts.data(), GL_UNSIGNED_INT, m_drawOffsets.data(),
+			GLsizei(m_drawCounts.size()));
+	}
+
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	glPopClientAttrib();
+}
+
+size_t SculptMesh::triangleCount() const {
+	size_t indices = 0;
+	for (const Block &block : m_blocks) indices += block.indexCount;
+	return indices / 3;
+}
@@ -0,0 +1,95 @@
+//---------------------------------------------------------------------------
+//
+// Terrain mesh kept in blocks, for sculpting
+//
+// The density grid is cut into blocks of cells that are meshed on their
+// own, each into its own range of one vertex buffer and one index buffer.
+// After the density changes in part of the grid only the blocks around it
+// are meshed again, and only their ranges of the buffers are uploaded. A
+// block whose new mesh does not fit its range moves to the end of the
+// buffers with room to grow, and the buffers are laid out afresh once
+// more than half of them is left unused.
+//
+// Vertices on the face between two blocks are made by both from the same
+// grid points in the same way, so blocks meet without cracks.
+//
+//----------------------------------------------------------------------------
+
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include "comp308.hpp"
+#include "density.hpp"
+#include "marchingCubes.hpp"
+
+class ThreadPool;
+
+class SculptMesh {
+private:
+	struct Block {
+		// ranges in the buffers, in vertices and in indices
+		size_t vertexStart = 0;
+		size_t vertexCapacity = 0;
+		size_t vertexCount = 0;
+		size_t indexStart = 0;
+		size_t indexCapacity = 0;
+		size_t indexCount = 0;
+		// changed since the last upload
+		bool dirty = false;
+	};
+
+	int m_nX, m_nY, m_nZ;
+	float m_minValue;
+	int m_size;
+	int m_countX, m_countY, m_countZ;
+	ThreadPool *m_pool;
+	std::vector<Block> m_blocks;
+
+	// Copy of the buffers: a position then a normal for each vertex, and
+	// indices into the whole vertex buffer
+	std::vector<comp308::vec3> m_vertices;
+	std::vector<unsigned int> m_indices;
+	// first unused vertex and index at the end, and how many are in use
+	size_t m_vertexEnd = 0;
+	size_t m_indexEnd = 0;
+	size_t m_vertexUsed = 0;
+	size_t m_indexUsed = 0;
+
+	GLuint m_vbo = 0;
+	GLuint m_ibo = 0;
+	// the buffers on the GPU need uploading whole
+	bool m_resized = true;
+	// index count and byte offset of every block with triangles
+	std::vector<GLsizei> m_drawCounts;
+	std::vector<const GLvoid *> m_drawOffsets;
+	bool m_drawStale = true;
+	size_t m_changed = 0;
+
+	void meshBlocks(const std::vector<int> &, const comp308::vec4 *points, const SurfaceBlocks *surface);
+	void place(Block &, const MCMesh &);
+	void relayout();
+	void upload();
+
+public:
+	// Meshes the whole grid, laid out as Terrain keeps it, in blocks of
+	// blockCells cells a side. Meshing is shared out over pool if given.
+	SculptMesh(int nX, int nY, int nZ, float minValue, const comp308::vec4 *points,
+		const SurfaceBlocks *surface, int blockCells = 16, ThreadPool *pool = nullptr);
+	SculptMesh(const SculptMesh &) = delete;
+	SculptMesh & operator=(const SculptMesh &) = delete;
+	~SculptMesh();
+
+	// Meshes again every block with a cell from lo up to but not including
+	// hi, returns how many. Nothing is uploaded until the next render.
+	int remesh(const int lo[3], const int hi[3], const comp308::vec4 *points, const SurfaceBlocks *surface);
+
+	// Uploads whatever changed, then draws every block in one call
+	void render();
+
+	size_t triangleCount() const;
+	// Bytes of the buffers the last remesh changed, all of them if it had
+	// to lay them out again
+	size_t changedBytes() const { return m_changed; }
+};
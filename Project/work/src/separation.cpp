@@ -0,0 +1,140 @@
+//---------------------------------------------------------------------------
+//
+// Exact all-pairs separation kernels
+//
+//----------------------------------------------------------------------------
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "comp308.hpp"
+#include "separation.hpp"
+
+using namespace std;
+using namespace comp308;
+
+namespace {
+
+	// Fish per tile: two tiles of positions and pushes plus one row of pair
+	// terms come to about 15KB, comfortably inside a 32KB L1
+	const int tileSize = 256;
+
+	/*
+		Pair terms between fish i and fish j0 .. j0+count-1
+
+		Writes the masked offsets d = pj - pi of the close pairs to (tx, ty, tz)
+		and applies them to the other fish straight away: rule 2 for fish j
+		subtracts pi - pj, which is exactly +d.
+	*/
+	void pairRow(float xi, float yi, float zi, const float *xj, const float *yj, const float *zj,
+		float *cxj, float *cyj, float *czj, int count, float minDistance,
+		float *tx, float *ty, float *tz) {
+		int t = 0;
+#ifdef __SSE2__
+		const __m128 pxi = _mm_set1_ps(xi);
+		const __m128 pyi = _mm_set1_ps(yi);
+		const __m128 pzi = _mm_set1_ps(zi);
+		const __m128 limit = _mm_set1_ps(minDistance);
+		for (; t + 4 <= count; t += 4) {
+			__m128 dx = _mm_sub_ps(_mm_loadu_ps(xj + t), pxi);
+			__m128 dy = _mm_sub_ps(_mm_loadu_ps(yj + t), pyi);
+			__m128 dz = _mm_sub_ps(_mm_loadu_ps(zj + t), pzi);
+			// same operation order as comp308::length
+			__m128 len = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz)));
+			__m128 close = _mm_cmplt_ps(len, limit);
+			dx = _mm_and_ps(dx, close);
+			dy = _mm_and_ps(dy, close);
+			dz = _mm_and_ps(dz, close);
+			_mm_storeu_ps(tx + t, dx);
+			_mm_storeu_ps(ty + t, dy);
+			_mm_storeu_ps(tz + t, dz);
+			_mm_storeu_ps(cxj + t, _mm_add_ps(_mm_loadu_ps(cxj + t), dx));
+			_mm_storeu_ps(cyj + t, _mm_add_ps(_mm_loadu_ps(cyj + t), dy));
+			_mm_storeu_ps(czj + t, _mm_add_ps(_mm_loadu_ps(czj + t), dz));
+		}
+#endif
+		for (; t < count; ++t) {
+			float dx = xj[t] - xi;
+			float dy = yj[t] - yi;
+			float dz = zj[t] - zi;
+			bool close = std::sqrt(dx * dx + dy * dy + dz * dz) < minDistance;
+			tx[t] = close ? dx : 0.0f;
+			ty[t] = close ? dy : 0.0f;
+			tz[t] = close ? dz : 0.0f;
+			cxj[t] += tx[t];
+			cyj[t] += ty[t];
+			czj[t] += tz[t];
+		}
+	}
+}
+
+void separationNaive(const vector<vec3> &positions, float minDistance, float divisor, vector<vec3> &out) {
+	out.resize(positions.size());
+	for (size_t i = 0; i < positions.size(); ++i) {
+		vec3 c = vec3();
+		for (size_t j = 0; j < positions.size(); ++j) {
+			if (j != i) {
+				vec3 distanceBetweenFish = positions[j] - positions[i];
+				if (length(distanceBetweenFish) < minDistance) {
+					c = c - distanceBetweenFish;
+				}
+			}
+		}
+		out[i] = c / divisor;
+	}
+}
+
+/*
+	Tiles are visited row by row over the upper triangle. For any fish the
+	terms from lower numbered fish arrive first (as the j side of earlier
+	rows), then its own row in increasing j, which is the naive loop's order.
+	Pairs that are too far apart add zero, which leaves a sum unchanged.
+*/
+void separationBlocked(const vector<vec3> &positions, float minDistance, float divisor, vector<vec3> &out) {
+	const int n = int(positions.size());
+	vector<float> x(n), y(n), z(n);
+	vector<float> cx(n, 0.0f), cy(n, 0.0f), cz(n, 0.0f);
+	for (int i = 0; i < n; ++i) {
+		x[i] = positions[i].x;
+		y[i] = positions[i].y;
+		z[i] = positions[i].z;
+	}
+
+	float tx[tileSize], ty[tileSize], tz[tileSize];
+
+	for (int bi = 0; bi < n; bi += tileSize) {
+		int iEnd = min(bi + tileSize, n);
+		for (int bj = bi; bj < n; bj += tileSize) {
+			int jEnd = min(bj + tileSize, n);
+			for (int i = bi; i < iEnd; ++i) {
+				int j0 = (bj == bi) ? i + 1 : bj;
+				int count = jEnd - j0;
+				if (count <= 0) continue;
+
+				pairRow(x[i], y[i], z[i], &x[j0], &y[j0], &z[j0], &cx[j0], &cy[j0], &cz[j0],
+					count, minDistance, tx, ty, tz);
+
+				// fish i's own sum has to be added up in j order to stay exact
+				float sx = cx[i], sy = cy[i], sz = cz[i];
+				for (int t = 0; t < count; ++t) {
+					sx = sx - tx[t];
+					sy = sy - ty[t];
+					sz = sz - tz[t];
+				}
+				cx[i] = sx;
+				cy[i] = sy;
+				cz[i] = sz;
+			}
+		}
+	}
+
+	out.resize(n);
+	for (int i = 0; i < n; ++i) {
+		out[i] = vec3(cx[i], cy[i], cz[i]) / divisor;
+	}
+}
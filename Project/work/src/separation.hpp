@@ -0,0 +1,26 @@
+//---------------------------------------------------------------------------
+//
+// Exact all-pairs separation kernels
+//
+// Both functions compute boids rule 2 (see School::rule2) for every fish
+// against one snapshot of positions: out[i] is the push away from every
+// other fish closer than minDistance, divided by divisor.
+//
+// separationBlocked walks the pairs in L1 sized tiles of structure of
+// arrays positions, computes each pair once and applies it to both fish,
+// and uses SSE where available. Pair terms reach every fish in the same
+// order as the naive loop, so the two agree bit for bit.
+//
+//----------------------------------------------------------------------------
+
+#pragma once
+
+#include <vector>
+
+#include "comp308.hpp"
+
+void separationNaive(const std::vector<comp308::vec3> &positions, float minDistance, float divisor,
+	std::vector<comp308::vec3> &out);
+
+void separationBlocked(const std::vector<comp308::vec3> &positions, float minDistance, float divisor,
+	std::vector<comp308::vec3> &out);
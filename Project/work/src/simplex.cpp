@@ -0,0 +1,369 @@
+//---------------------------------------------------------------------------
+//
+// Simplex noise
+//
+//----------------------------------------------------------------------------
+
+#include "simplex.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <ctime>
+#include <random>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SIMPLEX_X86_SIMD
+#include <immintrin.h>
+#endif
+
+namespace {
+	// skew to the grid of cubes cut into simplices and back again
+	const float F3 = 1.0f / 3.0f;
+	const float G3 = 1.0f / 6.0f;
+	const float F4 = 0.309016994f;	// (sqrt(5) - 1) / 4
+	const float G4 = 0.138196601f;	// (5 - sqrt(5)) / 20
+
+	// scale the sums so the bound below is just under 1, sampled maxima
+	// come to 0.988 in 3D and 0.986 in 4D
+	const float scale3 = 76.0f;
+	const float scale4 = 62.0f;
+}
+
+Simplex::Simplex() : Simplex(unsigned(time(NULL))) {
+}
+
+// The permutation is shuffled exactly as Perlin's is for the same seed
+Simplex::Simplex(unsigned seed) {
+	std::minstd_rand rng(seed);
+	std::uniform_real_distribution<float> gradient(-1.0f, 1.0f);
+	for (int i = 0; i < 256; ++i) {
+		m_perm[i] = i;
+		// Perlin draws its gradients here, draw the same to keep in step
+		gradient(rng);
+		gradient(rng);
+		gradient(rng);
+	}
+	for (int i = 0; i < 256; i++) {
+		int j = rng() & 255;
+		std::swap(m_perm[i], m_perm[j]);
+	}
+
+	static const float edges3[12][3] = {
+		{1, 1, 0}, {-1, 1, 0}, {1, -1, 0}, {-1, -1, 0},
+		{1, 0, 1}, {-1, 0, 1}, {1, 0, -1}, {-1, 0, -1},
+		{0, 1, 1}, {0, -1, 1}, {0, 1, -1}, {0, -1, -1}
+	};
+	for (int h = 0; h < 256; ++h) {
+		m_gx[h] = edges3[h % 12][0];
+		m_gy[h] = edges3[h % 12][1];
+		m_gz[h] = edges3[h % 12][2];
+
+		// one axis 0 and the others +-1, every sign combination
+		int zero = (h % 32) / 8, signs = h % 8;
+		for (int a = 0, s = 0; a < 4; ++a) {
+			m_g4[a][h] = (a == zero) ? 0.0f : ((signs >> s++) & 1) ? -1.0f : 1.0f;
+		}
+	}
+}
+
+namespace {
+	/*
+		One 3D sample, with the gradient too when Gradient is set. The batch
+		kernel below repeats this operation for operation, so keep it in
+		step with this.
+	*/
+	template <bool Gradient>
+	inline float simplex3(const int *perm, const float *Gx, const float *Gy, const float *Gz,
+		float x, float y, float z, float *gradient) {
+		// cell of the skewed grid, and the point relative to its first corner
+		float s = (x + y + z) * F3;
+		float fi = floorf(x + s);
+		float fj = floorf(y + s);
+		float fk = floorf(z + s);
+		float t = (fi + fj + fk) * G3;
+		float x0 = x - (fi - t);
+		float y0 = y - (fj - t);
+		float z0 = z - (fk - t);
+
+		// which of the cube's six simplices, from the order of x0, y0 and z0
+		int xy = x0 >= y0, yz = y0 >= z0, xz = x0 >= z0;
+		int i = int(fi), j = int(fj), k = int(fk);
+
+		float value = 0;
+		float gx = 0, gy = 0, gz = 0;
+		auto corner = [&](int oi, int oj, int ok, float unskew) {
+			float dx = (x0 - float(oi)) + unskew;
+			float dy = (y0 - float(oj)) + unskew;
+			float dz = (z0 - float(ok)) + unskew;
+			int h = perm[(i + oi + perm[(j + oj + perm[(k + ok) & 255]) & 255]) & 255];
+
+			float falloff = std::max(0.5f - dx*dx - dy*dy - dz*dz, 0.0f);
+			float f2 = falloff * falloff;
+			float f4 = f2 * f2;
+			float dot = Gx[h]*dx + Gy[h]*dy + Gz[h]*dz;
+			value += f4 * dot;
+			if (Gradient) {
+				// d/dp of falloff^4 dot is falloff^4 g - 8 falloff^3 dot p
+				float radial = f2 * falloff * dot * -8.0f;
+				gx += f4 * Gx[h] + radial * dx;
+				gy += f4 * Gy[h] + radial * dy;
+				gz += f4 * Gz[h] + radial * dz;
+			}
+		};
+		corner(0, 0, 0, 0.0f);
+		corner(xy & xz, (1 - xy) & yz, (1 - xz) & (1 - yz), G3);
+		corner(xy | xz, (1 - xy) | yz, 1 - (xz & yz), 2 * G3);
+		corner(1, 1, 1, 3 * G3);
+
+		if (Gradient) {
+			gradient[0] = gx * scale3;
+			gradient[1] = gy * scale3;
+			gradient[2] = gz * scale3;
+		}
+		return value * scale3;
+	}
+}
+
+float Simplex::noise(float x, float y, float z) const {
+	return simplex3<false>(m_perm, m_gx, m_gy, m_gz, x, y, z, nullptr);
+}
+
+float Simplex::noise(float x, float y, float z, float *gradient) const {
+	if (!gradient) return noise(x, y, z);
+	return simplex3<true>(m_perm, m_gx, m_gy, m_gz, x, y, z, gradient);
+}
+
+float Simplex::noise4(float x, float y, float z, float w, float *gradient) const {
+	const float p[4] = { x, y, z, w };
+	float s = (x + y + z + w) * F4;
+	float cell[4], d0[4];
+	float t = 0;
+	for (int a = 0; a < 4; ++a) {
+		cell[a] = floorf(p[a] + s);
+		t += cell[a];
+	}
+	t *= G4;
+	for (int a = 0; a < 4; ++a) d0[a] = p[a] - (cell[a] - t);
+
+	// rank of each axis, how many of the others it is larger than. The
+	// corners step along the axes from the highest rank down
+	int rank[4] = { 0, 0, 0, 0 };
+	for (int a = 0; a < 4; ++a) {
+		for (int b = a + 1; b < 4; ++b) {
+			if (d0[a] >= d0[b]) rank[a]++;
+			else rank[b]++;
+		}
+	}
+
+	float value = 0;
+	float g[4] = { 0, 0, 0, 0 };
+	for (int c = 0; c < 5; ++c) {
+		int offset[4];
+		float d[4];
+		for (int a = 0; a < 4; ++a) {
+			offset[a] = rank[a] >= 4 - c;
+			d[a] = d0[a] - float(offset[a]) + c * G4;
+		}
+		int h = 0;
+		for (int a = 3; a >= 0; --a) h = m_perm[(int(cell[a]) + offset[a] + h) & 255];
+
+		float falloff = 0.5f;
+		float dot = 0;
+		for (int a = 0; a < 4; ++a) {
+			falloff -= d[a] * d[a];
+			dot += m_g4[a][h] * d[a];
+		}
+		falloff = std::max(falloff, 0.0f);
+		float f2 = falloff * falloff;
+		float f4 = f2 * f2;
+		value += f4 * dot;
+		if (gradient) {
+			float radial = f2 * falloff * dot * -8.0f;
+			for (int a = 0; a < 4; ++a) g[a] += f4 * m_g4[a][h] + radial * d[a];
+		}
+	}
+	if (gradient) {
+		for (int a = 0; a < 4; ++a) gradient[a] = g[a] * scale4;
+	}
+	return value * scale4;
+}
+
+
+// Batch noise
+//
+// The AVX2 version repeats the scalar function operation for operation
+// (no FMA, same association), so every lane rounds exactly like noise().
+// It is compiled for AVX2 with a target attribute and picked at run time.
+
+#ifdef SIMPLEX_X86_SIMD
+namespace {
+
+#define SIMPLEX_AVX2 __attribute__((target("avx2")))
+
+	// simplex3() for 8 points at a time. Returns how many points it did,
+	// always a multiple of 8. Gradients are only worked out when dx is given
+	SIMPLEX_AVX2 size_t noiseAVX2(const int *perm, const float *Gx, const float *Gy, const float *Gz,
+		const float *xs, const float *ys, const float *zs, float *out, float *dxs, float *dys, float *dzs, size_t n) {
+		const __m256i mask = _mm256_set1_epi32(255);
+		const __m256i oneBit = _mm256_set1_epi32(1);
+		const __m256 zero = _mm256_setzero_ps();
+		const __m256 half = _mm256_set1_ps(0.5f);
+		const __m256 minusEight = _mm256_set1_ps(-8.0f);
+		const __m256 scale = _mm256_set1_ps(scale3);
+		const __m256 unskew[4] = { _mm256_set1_ps(0.0f), _mm256_set1_ps(G3), _mm256_set1_ps(2 * G3),
+			_mm256_set1_ps(3 * G3) };
+		const __m256 allSet = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+
+		size_t i = 0;
+		for (; i + 8 <= n; i += 8) {
+			__m256 x = _mm256_loadu_ps(xs + i);
+			__m256 y = _mm256_loadu_ps(ys + i);
+			__m256 z = _mm256_loadu_ps(zs + i);
+
+			__m256 s = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(x, y), z), _mm256_set1_ps(F3));
+			__m256 fi = _mm256_floor_ps(_mm256_add_ps(x, s));
+			__m256 fj = _mm256_floor_ps(_mm256_add_ps(y, s));
+			__m256 fk = _mm256_floor_ps(_mm256_add_ps(z, s));
+			__m256 t = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(fi, fj), fk), _mm256_set1_ps(G3));
+			__m256 x0 = _mm256_sub_ps(x, _mm256_sub_ps(fi, t));
+			__m256 y0 = _mm256_sub_ps(y, _mm256_sub_ps(fj, t));
+			__m256 z0 = _mm256_sub_ps(z, _mm256_sub_ps(fk, t));
+
+			__m256 xy = _mm256_cmp_ps(x0, y0, _CMP_GE_OQ);
+			__m256 yz = _mm256_cmp_ps(y0, z0, _CMP_GE_OQ);
+			__m256 xz = _mm256_cmp_ps(x0, z0, _CMP_GE_OQ);
+			__m256 corner[4][3] = {
+				{ zero, zero, zero },
+				{ _mm256_and_ps(xy, xz), _mm256_andnot_ps(xy, yz), _mm256_andnot_ps(_mm256_or_ps(xz, yz), allSet) },
+				{ _mm256_or_ps(xy, xz), _mm256_or_ps(_mm256_andnot_ps(xy, allSet), yz),
+					_mm256_andnot_ps(_mm256_and_ps(xz, yz), allSet) },
+				{ allSet, allSet, allSet }
+			};
+			__m256i ci = _mm256_cvttps_epi32(fi);
+			__m256i cj = _mm256_cvttps_epi32(fj);
+			__m256i ck = _mm256_cvttps_epi32(fk);
+
+			__m256 value = zero;
+			__m256 gx = zero, gy = zero, gz = zero;
+			for (int c = 0; c < 4; ++c) {
+				// the corner masks as 0 or 1, in floats and ints
+				__m256 ox = _mm256_and_ps(corner[c][0], _mm256_set1_ps(1.0f));
+				__m256 oy = _mm256_and_ps(corner[c][1], _mm256_set1_ps(1.0f));
+				__m256 oz = _mm256_and_ps(corner[c][2], _mm256_set1_ps(1.0f));
+				__m256i oi = _mm256_and_si256(_mm256_castps_si256(corner[c][0]), oneBit);
+				__m256i oj = _mm256_and_si256(_mm256_castps_si256(corner[c][1]), oneBit);
+				__m256i ok = _mm256_and_si256(_mm256_castps_si256(corner[c][2]), oneBit);
+
+				__m256 dx = _mm256_add_ps(_mm256_sub_ps(x0, ox), unskew[c]);
+				__m256 dy = _mm256_add_ps(_mm256_sub_ps(y0, oy), unskew[c]);
+				__m256 dz = _mm256_add_ps(_mm256_sub_ps(z0, oz), unskew[c]);
+
+				__m256i h = _mm256_i32gather_epi32(perm, _mm256_and_si256(_mm256_add_epi32(ck, ok), mask), 4);
+				h = _mm256_i32gather_epi32(perm, _mm256_and_si256(_mm256_add_epi32(_mm256_add_epi32(cj, oj), h), mask), 4);
+				h = _mm256_i32gather_epi32(perm, _mm256_and_si256(_mm256_add_epi32(_mm256_add_epi32(ci, oi), h), mask), 4);
+				__m256 hx = _mm256_i32gather_ps(Gx, h, 4);
+				__m256 hy = _mm256_i32gather_ps(Gy, h, 4);
+				__m256 hz = _mm256_i32gather_ps(Gz, h, 4);
+
+				__m256 falloff = _mm256_sub_ps(_mm256_sub_ps(_mm256_sub_ps(half, _mm256_mul_ps(dx, dx)),
+					_mm256_mul_ps(dy, dy)), _mm256_mul_ps(dz, dz));
+				falloff = _mm256_max_ps(falloff, zero);
+				__m256 f2 = _mm256_mul_ps(falloff, falloff);
+				__m256 f4 = _mm256_mul_ps(f2, f2);
+				__m256 dot = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(hx, dx), _mm256_mul_ps(hy, dy)), _mm256_mul_ps(hz, dz));
+				value = _mm256_add_ps(value, _mm256_mul_ps(f4, dot));
+				if (dxs) {
+					__m256 radial = _mm256_mul_ps(_mm256_mul_ps(_mm256_mul_ps(f2, falloff), dot), minusEight);
+					gx = _mm256_add_ps(gx, _mm256_add_ps(_mm256_mul_ps(f4, hx), _mm256_mul_ps(radial, dx)));
+					gy = _mm256_add_ps(gy, _mm256_add_ps(_mm256_mul_ps(f4, hy), _mm256_mul_ps(radial, dy)));
+					gz = _mm256_add_ps(gz, _mm256_add_ps(_mm256_mul_ps(f4, hz), _mm256_mul_ps(radial, dz)));
+				}
+			}
+			_mm256_storeu_ps(out + i, _mm256_mul_ps(value, scale));
+			if (dxs) {
+				_mm256_storeu_ps(dxs + i, _mm256_mul_ps(gx, scale));
+				_mm256_storeu_ps(dys + i, _mm256_mul_ps(gy, scale));
+				_mm256_storeu_ps(dzs + i, _mm256_mul_ps(gz, scale));
+			}
+		}
+		return i;
+	}
+
+	bool hasAVX2() {
+		__builtin_cpu_init();
+		return __builtin_cpu_supports("avx2");
+	}
+}
+#endif
+
+void Simplex::noise(const float *x, const float *y, const float *z, float *out, size_t n) const {
+	size_t done = 0;
+#ifdef SIMPLEX_X86_SIMD
+	static const bool avx2 = hasAVX2();
+	if (avx2) done = noiseAVX2(m_perm, m_gx, m_gy, m_gz, x, y, z, out, nullptr, nullptr, nullptr, n);
+#endif
+	// whatever is left over after the last full vector
+	for (size_t i = done; i < n; ++i) {
+		out[i] = noise(x[i], y[i], z[i]);
+	}
+}
+
+void Simplex::noise(const float *x, const float *y, const float *z, float *out, float *dx, float *dy, float *dz,
+	size_t n) const {
+	size_t done = 0;
+#ifdef SIMPLEX_X86_SIMD
+	static const bool avx2 = hasAVX2();
+	if (avx2) done = noiseAVX2(m_perm, m_gx, m_gy, m_gz, x, y, z, out, dx, dy, dz, n);
+#endif
+	for (size_t i = done; i < n; ++i) {
+		float gradient[3];
+		out[i] = noise(x[i], y[i], z[i], gradient);
+		dx[i] = gradient[0];
+		dy[i] = gradient[1];
+		dz[i] = gradient[2];
+	}
+}
+
+float Simplex::fbm(float x, float y, float z, const Octave *octaves, size_t count) const {
+	return fbm(x, y, z, octaves, count, nullptr);
+}
+
+float Simplex::fbm(float x, float y, float z, const Octave *octaves, size_t count, float *gradient) const {
+	float value = 0;
+	if (gradient) gradient[0] = gradient[1] = gradient[2] = 0;
+	for (size_t o = 0; o < count; ++o) {
+		float f = octaves[o].frequency;
+		float g[3];
+		value += noise(x*f, y*f, z*f, gradient ? g : nullptr) * octaves[o].amplitude;
+		if (gradient) {
+			// the chain rule brings the frequency out
+			for (int a = 0; a < 3; ++a) gradient[a] += g[a] * (octaves[o].amplitude * f);
+		}
+	}
+	return value;
+}
+
+void Simplex::fbm(const float *x, const float *y, const float *z, float *out, size_t n,
+	const Octave *octaves, size_t count) const {
+	// scaled positions go through a small buffer on the stack, one chunk at a time
+	const size_t chunk = 256;
+	float sx[chunk], sy[chunk], sz[chunk], value[chunk];
+
+	for (size_t start = 0; start < n; start += chunk) {
+		size_t m = (n - start < chunk) ? n - start : chunk;
+		float *result = out + start;
+		for (size_t i = 0; i < m; ++i) result[i] = 0;
+
+		for (size_t o = 0; o < count; ++o) {
+			float f = octaves[o].frequency;
+			float a = octaves[o].amplitude;
+			for (size_t i = 0; i < m; ++i) {
+				sx[i] = x[start + i]*f;
+				sy[i] = y[start + i]*f;
+				sz[i] = z[start + i]*f;
+			}
+			noise(sx, sy, sz, value, m);
+			for (size_t i = 0; i < m; ++i) result[i] += value[i] * a;
+		}
+	}
+}
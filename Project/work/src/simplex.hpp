@@ -0,0 +1,69 @@
+//---------------------------------------------------------------------------
+//
+// Simplex noise
+//
+// Smooth noise like Perlin's, but summed over the corners of the simplex
+// the point is in rather than the cube: 4 corners in 3D and 5 in 4D, where
+// Perlin's noise blends 8 and 16. Each corner's part is a radial falloff
+// times a dot product, so the derivatives come out of the same sum
+// without sampling again.
+//
+// Seeded the same way as Perlin, so one seed makes a repeatable field of
+// either kind, and with the same scalar, batch and fbm calls so the two
+// can stand in for each other.
+//
+//----------------------------------------------------------------------------
+
+#pragma once
+
+#include <cstddef>
+
+#include "perlin.hpp"
+
+class Simplex {
+private:
+	int m_perm[256];
+	// gradient of each permutation value, one of the 12 cube edge directions
+	float m_gx[256];
+	float m_gy[256];
+	float m_gz[256];
+	// in 4D, one of the 32 edge directions of the 4D cube
+	float m_g4[4][256];
+
+public:
+	typedef Perlin::Octave Octave;
+
+	// Seeded from the clock
+	Simplex();
+	// The same seed always gives the same noise
+	explicit Simplex(unsigned seed);
+
+	// Noise at a 3D position, actual values stay close to [-1, 1]
+	float noise(float x, float y, float z) const;
+	// The same with its gradient written to gradient[0..2]
+	float noise(float x, float y, float z, float *gradient) const;
+	// 4D noise, w can be time for noise that changes smoothly. The gradient
+	// is written to gradient[0..3] when given
+	float noise4(float x, float y, float z, float w, float *gradient = nullptr) const;
+
+	// Strict bound on |noise| in 3D and 4D. Each corner adds at most its
+	// falloff times |gradient| times the distance to it, and the sum of that
+	// over a fine grid of the cell peaks at 0.998 in 3D and 0.989 in 4D, so
+	// this leaves a margin for the grid spacing and rounding
+	static float bound() { return 1.02f; }
+
+	// Noise at n points at once, out[i] = noise(x[i], y[i], z[i]) exactly.
+	// Uses AVX2 gathers when the CPU has them, scalar otherwise.
+	void noise(const float *x, const float *y, const float *z, float *out, size_t n) const;
+	// The same with the gradient at each point in dx, dy and dz
+	void noise(const float *x, const float *y, const float *z, float *out, float *dx, float *dy, float *dz,
+		size_t n) const;
+
+	// Fractal Brownian motion, the sum of the given octaves added in order
+	float fbm(float x, float y, float z, const Octave *octaves, size_t count) const;
+	// The same with its gradient written to gradient[0..2]
+	float fbm(float x, float y, float z, const Octave *octaves, size_t count, float *gradient) const;
+	// fbm at n points at once, through the batch noise above
+	void fbm(const float *x, const float *y, const float *z, float *out, size_t n,
+		const Octave *octaves, size_t count) const;
+};
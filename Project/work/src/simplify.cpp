@@ -0,0 +1,457 @@
+//---------------------------------------------------------------------------
+//
+// Mesh simplification by quadric error
+//
+//----------------------------------------------------------------------------
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <queue>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "comp308.hpp"
+#include "geometry.hpp"
+#include "simplify.hpp"
+
+using namespace std;
+using namespace comp308;
+
+namespace {
+
+	// Planes along boundary edges, square to the triangle, count this many
+	// times a triangle's plane when the boundary is not locked
+	const double boundaryWeight = 100.0;
+
+	// Sum of squared distances to planes, the symmetric 4x4 matrix of the
+	// plane coefficients kept as its upper triangle row by row
+	struct Quadric {
+		double m[10] = {};
+
+		void addPlane(vec3 n, double d, double weight = 1.0) {
+			const double p[4] = { n.x, n.y, n.z, d };
+			int e = 0;
+			for (int r = 0; r < 4; ++r) {
+				for (int c = r; c < 4; ++c) m[e++] += weight * p[r] * p[c];
+			}
+		}
+
+		Quadric & operator+=(const Quadric &q) {
+			for (int e = 0; e < 10; ++e) m[e] += q.m[e];
+			return *this;
+		}
+
+		double error(vec3 p) const {
+			double x = p.x, y = p.y, z = p.z;
+			return m[0]*x*x + 2*m[1]*x*y + 2*m[2]*x*z + 2*m[3]*x + m[4]*y*y + 2*m[5]*y*z + 2*m[6]*y
+				+ m[7]*z*z + 2*m[8]*z + m[9];
+		}
+
+		// Where the error is smallest, false if there is no one such point
+		// (all the planes are parallel or meet in a line)
+		bool minimum(vec3 &p) const {
+			double a = m[0], b = m[1], c = m[2], e = m[4], f = m[5], i = m[7];
+			double c0 = e * i - f * f, c1 = c * f - b * i, c2 = b * f - c * e;
+			double det = a * c0 + b * c1 + c * c2;
+			double trace = a + e + i;
+			if (fabs(det) <= 1e-9 * trace * trace * trace) return false;
+			double r0 = -m[3], r1 = -m[6], r2 = -m[8];
+			p.x = float((c0 * r0 + c1 * r1 + c2 * r2) / det);
+			p.y = float((c1 * r0 + (a * i - c * c) * r1 + (b * c - a * f) * r2) / det);
+			p.z = float((c2 * r0 + (b * c - a * f) * r1 + (a * e - b * b) * r2) / det);
+			return true;
+		}
+	};
+
+	// Index of the first point at the same position for every point, and
+	// those first points in order
+	vector<unsigned int> weld(const vector<vec3> &points, vector<vec3> &welded) {
+		struct Key {
+			uint32_t bits[3];
+			bool operator==(const Key &o) const { return memcmp(bits, o.bits, sizeof(bits)) == 0; }
+		};
+		struct KeyHash {
+			size_t operator()(const Key &k) const {
+				return (size_t(k.bits[0]) * 73856093u) ^ (size_t(k.bits[1]) * 19349663u) ^ (size_t(k.bits[2]) * 83492791u);
+			}
+		};
+		unordered_map<Key, unsigned int, KeyHash> first;
+		first.reserve(points.size());
+		vector<unsigned int> remap(points.size());
+		for (size_t i = 0; i < points.size(); ++i) {
+			Key key;
+			for (int a = 0; a < 3; ++a) {
+				// adding zero makes -0 into +0
+				float v = points[i][a] + 0.0f;
+				memcpy(&key.bits[a], &v, sizeof(v));
+			}
+			auto found = first.insert(make_pair(key, unsigned(welded.size())));
+			if (found.second) welded.push_back(points[i]);
+			remap[i] = found.first->second;
+		}
+		return remap;
+	}
+
+	// Kept small, the queue holds many stale ones
+	struct Candidate {
+		float cost;
+		unsigned int from, to;	// from is merged into to
+		unsigned int stamp;		// sum of the ends' versions, which only grow
+
+		bool operator>(const Candidate &o) const { return cost > o.cost; }
+	};
+
+	class Simplifier {
+	private:
+		const SimplifySettings &m_settings;
+		vector<vec3> m_points;
+		vector<Quadric> m_quadrics;
+		vector<unsigned int> m_versions;
+		vector<char> m_boundary;
+		vector<char> m_removed;
+		vector<unsigned int> m_faces;			// three per triangle
+		vector<char> m_dead;
+		vector<vector<unsigned int>> m_around;	// triangles using each point
+		size_t m_live = 0;
+		// scratch lists kept between collapses
+		vector<unsigned int> m_fromRing, m_toRing, m_common;
+		priority_queue<Candidate, vector<Candidate>, greater<Candidate>> m_queue;
+
+		// Points sharing a triangle with p, each once
+		void neighbours(unsigned int p, vector<unsigned int> &out) const {
+			out.clear();
+			for (unsigned int f : m_around[p]) {
+				for (int j = 0; j < 3; ++j) {
+					if (m_faces[3*f + j] != p) out.push_back(m_faces[3*f + j]);
+				}
+			}
+			sort(out.begin(), out.end());
+			out.erase(unique(out.begin(), out.end()), out.end());
+		}
+
+		void findBoundary();
+		bool plan(unsigned int &from, unsigned int &to, vec3 &target, float &cost) const;
+		bool candidate(unsigned int u, unsigned int v, Candidate &) const;
+		bool flips(unsigned int moved, unsigned int other, vec3 target) const;
+		bool collapse(unsigned int from, unsigned int to, vec3 target, float cost);
+
+	public:
+		float error = 0;
+
+		Simplifier(const vector<vec3> &points, const vector<unsigned int> &indices, const SimplifySettings &);
+		void run();
+		SimplifiedMesh result() const;
+	};
+
+	Simplifier::Simplifier(const vector<vec3> &points, const vector<unsigned int> &indices,
+		const SimplifySettings &settings) : m_settings(settings) {
+		vector<unsigned int> remap = weld(points, m_points);
+		size_t count = m_points.size();
+		m_quadrics.resize(count);
+		m_versions.assign(count, 0);
+		m_boundary.assign(count, 0);
+		m_removed.assign(count, 0);
+		m_around.resize(count);
+
+		// triangles left with two corners in one place by the weld are dropped
+		for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+			unsigned int a = remap[indices[i]], b = remap[indices[i + 1]], c = remap[indices[i + 2]];
+			if (a == b || b == c || c == a) continue;
+			unsigned int f = unsigned(m_faces.size() / 3);
+			m_faces.push_back(a);
+			m_faces.push_back(b);
+			m_faces.push_back(c);
+			m_around[a].push_back(f);
+			m_around[b].push_back(f);
+			m_around[c].push_back(f);
+
+			vec3 n = cross(m_points[b] - m_points[a], m_points[c] - m_points[a]);
+			float area = length(n);
+			if (area == 0) continue;
+			n = n / area;
+			Quadric q;
+			q.addPlane(n, -dot(n, m_points[a]));
+			m_quadrics[a] += q;
+			m_quadrics[b] += q;
+			m_quadrics[c] += q;
+		}
+		m_live = m_faces.size() / 3;
+		m_dead.assign(m_live, 0);
+		findBoundary();
+	}
+
+	// An edge with one triangle is on the boundary, and so is one with more
+	// than two so the sheets meeting there are never pulled apart. Queues
+	// every edge once.
+	void Simplifier::findBoundary() {
+		vector<unsigned int> others;
+		for (unsigned int p = 0; p < m_points.size(); ++p) {
+			others.clear();
+			for (unsigned int f : m_around[p]) {
+				for (int j = 0; j < 3; ++j) {
+					if (m_faces[3*f + j] != p) others.push_back(m_faces[3*f + j]);
+				}
+			}
+			sort(others.begin(), others.end());
+			for (size_t i = 0; i < others.size(); ) {
+				size_t run = i;
+				while (run < others.size() && others[run] == others[i]) ++run;
+				unsigned int q = others[i];
+				if (run - i != 2) {
+					m_boundary[p] = 1;
+					// a plane along the edge square to its triangle, added from
+					// both ends so each edge counts once at each
+					for (unsigned int f : m_around[p]) {
+						const unsigned int *c = &m_faces[3*f];
+						if (run - i != 1 || (c[0] != q && c[1] != q && c[2] != q)) continue;
+						vec3 n = cross(m_points[c[1]] - m_points[c[0]], m_points[c[2]] - m_points[c[0]]);
+						vec3 side = cross(m_points[q] - m_points[p], n);
+						if (length(side) == 0) continue;
+						side = normalize(side);
+						m_quadrics[p].addPlane(side, -dot(side, m_points[p]), boundaryWeight);
+					}
+				}
+				i = run;
+			}
+		}
+		vector<unsigned int> next;
+		vector<Candidate> all;
+		Candidate c;
+		for (unsigned int p = 0; p < m_points.size(); ++p) {
+			neighbours(p, next);
+			for (unsigned int q : next) {
+				if (q > p && candidate(p, q, c)) all.push_back(c);
+			}
+		}
+		// made into a heap in one go rather than pushed one at a time
+		m_queue = priority_queue<Candidate, vector<Candidate>, greater<Candidate>>(greater<Candidate>(), move(all));
+	}
+
+	// Which end of an edge goes and where the other moves to, false if the
+	// edge has to stay. The same for as long as neither end changes, so it
+	// is worked out again rather than kept in the queue
+	bool Simplifier::plan(unsigned int &from, unsigned int &to, vec3 &target, float &cost) const {
+		Quadric q = m_quadrics[from];
+		q += m_quadrics[to];
+		if (m_settings.lockBoundary && (m_boundary[from] || m_boundary[to])) {
+			// the boundary end stays put, an edge along the boundary stays too
+			if (m_boundary[from] && m_boundary[to]) return false;
+			if (m_boundary[from]) swap(from, to);
+			target = m_points[to];
+		} else {
+			vec3 middle = (m_points[from] + m_points[to]) * 0.5f;
+			float reach = length(m_points[from] - m_points[to]);
+			// the best point can be far off when the planes are nearly
+			// parallel, then the ends and the middle are all that is tried
+			if (!q.minimum(target) || length(target - middle) > reach) {
+				target = middle;
+				if (q.error(m_points[from]) < q.error(target)) target = m_points[from];
+				if (q.error(m_points[to]) < q.error(target)) target = m_points[to];
+			}
+		}
+		cost = float(max(0.0, q.error(target)));
+		return true;
+	}
+
+	bool Simplifier::candidate(unsigned int u, unsigned int v, Candidate &c) const {
+		vec3 target;
+		if (!plan(u, v, target, c.cost)) return false;
+		c.from = u;
+		c.to = v;
+		c.stamp = m_versions[u] + m_versions[v];
+		return true;
+	}
+
+	// Whether moving a point to target turns any of its triangles that do
+	// not also use other over, or flattens one to nothing
+	bool Simplifier::flips(unsigned int moved, unsigned int other, vec3 target) const {
+		for (unsigned int f : m_around[moved]) {
+			const unsigned int *c = &m_faces[3*f];
+			if (c[0] == other || c[1] == other || c[2] == other) continue;
+			vec3 before[3], after[3];
+			for (int j = 0; j < 3; ++j) {
+				before[j] = m_points[c[j]];
+				after[j] = (c[j] == moved) ? target : before[j];
+			}
+			vec3 n0 = cross(before[1] - before[0], before[2] - before[0]);
+			vec3 n1 = cross(after[1] - after[0], after[2] - after[0]);
+			if (dot(n0, n1) <= 0) return true;
+		}
+		return false;
+	}
+
+	bool Simplifier::collapse(unsigned int from, unsigned int to, vec3 target, float cost) {
+
+		// the points around both ends must be the ones across the triangles
+		// they share, any more and the collapse would pinch the surface
+		neighbours(from, m_fromRing);
+		neighbours(to, m_toRing);
+		size_t shared = 0;
+		for (unsigned int f : m_around[from]) {
+			const unsigned int *v = &m_faces[3*f];
+			if (v[0] == to || v[1] == to || v[2] == to) shared++;
+		}
+		m_common.clear();
+		set_intersection(m_fromRing.begin(), m_fromRing.end(), m_toRing.begin(), m_toRing.end(), back_inserter(m_common));
+		if (m_common.size() != shared) return false;
+		// two boundary points joined across the inside would pinch it too
+		if (m_boundary[from] && m_boundary[to] && shared != 1) return false;
+		if (flips(from, to, target) || flips(to, from, target)) return false;
+
+		m_points[to] = target;
+		m_quadrics[to] += m_quadrics[from];
+		m_boundary[to] |= m_boundary[from];
+		for (unsigned int f : m_around[from]) {
+			unsigned int *v = &m_faces[3*f];
+			if (v[0] == to || v[1] == to || v[2] == to) {
+				m_dead[f] = 1;
+				m_live--;
+			} else {
+				for (int j = 0; j < 3; ++j) {
+					if (v[j] == from) v[j] = to;
+				}
+				m_around[to].push_back(f);
+			}
+		}
+		vector<unsigned int>().swap(m_around[from]);
+		m_removed[from] = 1;
+		auto dead = [&](unsigned int f) { return m_dead[f] != 0; };
+		m_around[to].erase(remove_if(m_around[to].begin(), m_around[to].end(), dead), m_around[to].end());
+		m_versions[from]++;
+		m_versions[to]++;
+		error = max(error, sqrt(cost));
+
+		neighbours(to, m_toRing);
+		Candidate c;
+		for (unsigned int q : m_toRing) {
+			if (candidate(to, q, c)) m_queue.push(c);
+		}
+		return true;
+	}
+
+	void Simplifier::run() {
+		double limit = double(m_settings.maxError) * m_settings.maxError;
+		while (!m_queue.empty() && m_live > m_settings.targetTriangles) {
+			Candidate c = m_queue.top();
+			if (c.cost > limit) break;
+			m_queue.pop();
+			if (m_removed[c.from] || m_removed[c.to]) continue;
+			if (c.stamp != m_versions[c.from] + m_versions[c.to]) continue;
+			// a refused edge is queued again once either end moves
+			vec3 target;
+			float cost;
+			plan(c.from, c.to, target, cost);
+			collapse(c.from, c.to, target, cost);
+		}
+	}
+
+	// The triangles left, over only the points they use
+	SimplifiedMesh Simplifier::result() const {
+		SimplifiedMesh mesh;
+		mesh.error = error;
+		vector<unsigned int> index(m_points.size(), ~0u);
+		mesh.indices.reserve(3 * m_live);
+		for (size_t f = 0; f < m_dead.size(); ++f) {
+			if (m_dead[f]) continue;
+			for (int j = 0; j < 3; ++j) {
+				unsigned int p = m_faces[3*f + j];
+				if (index[p] == ~0u) {
+					index[p] = unsigned(mesh.points.size());
+					mesh.points.push_back(m_points[p]);
+				}
+				mesh.indices.push_back(index[p]);
+			}
+		}
+		return mesh;
+	}
+}
+
+SimplifiedMesh simplifyMesh(const vector<vec3> &points, const vector<unsigned int> &indices,
+	const SimplifySettings &settings) {
+	Simplifier simplifier(points, indices, settings);
+	simplifier.run();
+	return simplifier.result();
+}
+
+SimplifiedMesh simplifyMesh(const Geometry &geometry, const SimplifySettings &settings) {
+	vector<unsigned int> indices;
+	indices.reserve(3 * geometry.getTriangles().size());
+	for (const triangle &tri : geometry.getTriangles()) {
+		for (int j = 0; j < 3; ++j) indices.push_back(unsigned(tri.v[j].p));
+	}
+	return simplifyMesh(geometry.getPoints(), indices, settings);
+}
+
+vector<SimplifiedMesh> simplifyLevels(const vector<vec3> &points, const vector<unsigned int> &indices,
+	int levels, float ratio, float maxError) {
+	vector<SimplifiedMesh> result;
+	SimplifySettings settings;
+	settings.maxError = maxError;
+	const vector<vec3> *from = &points;
+	const vector<unsigned int> *fromIndices = &indices;
+	for (int level = 0; level < levels; ++level) {
+		size_t triangles = fromIndices->size() / 3;
+		settings.targetTriangles = size_t(triangles * ratio);
+		SimplifiedMesh mesh = simplifyMesh(*from, *fromIndices, settings);
+		if (mesh.indices.size() / 3 >= triangles) break;
+		// errors add up from level to level
+		if (!result.empty()) mesh.error += result.back().error;
+		result.push_back(move(mesh));
+		from = &result.back().points;
+		fromIndices = &result.back().indices;
+	}
+	return result;
+}
+
+void writeOBJ(const string &filename, const SimplifiedMesh &mesh) {
+	vector<triangle> triangles(mesh.indices.size() / 3);
+	for (size_t t = 0; t < triangles.size(); ++t) {
+		for (int j = 0; j < 3; ++j) triangles[t].v[j].p = triangles[t].v[j].n = int(mesh.indices[3*t + j]);
+	}
+	vector<vec3> normals = smoothNormals(mesh.points, triangles, NormalWeighting::Area, false);
+
+	ofstream file(filename);
+	for (const vec3 &p : mesh.points) file << "v " << p.x << " " << p.y << " " << p.z << "\n";
+	for (const vec3 &n : normals) file << "vn " << n.x << " " << n.y << " " << n.z << "\n";
+	// OBJ counts from 1
+	for (const triangle &tri : triangles) {
+		file << "f";
+		for (int j = 0; j < 3; ++j) file << " " << tri.v[j].p + 1 << "//" << tri.v[j].n + 1;
+		file << "\n";
+	}
+	if (!file) {
+		cerr << "Error writing " << filename << endl;
+		throw runtime_error("Error :: could not write file.");
+	}
+}
+
+int simplifyMain(const string &in, const string &out, float fraction, float maxError) {
+	try {
+		Geometry geometry(in, false);
+		size_t before = geometry.getTriangles().size();
+		SimplifySettings settings;
+		settings.targetTriangles = size_t(before * fraction);
+		settings.maxError = maxError;
+
+		auto start = chrono::steady_clock::now();
+		SimplifiedMesh mesh = simplifyMesh(geometry, settings);
+		double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+		cout << before << " triangles down to " << mesh.indices.size() / 3 << " in " << seconds * 1000
+		     << " ms, error " << mesh.error << endl;
+
+		writeOBJ(out, mesh);
+	} catch (const exception &e) {
+		cerr << e.what() << endl;
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,63 @@
+//---------------------------------------------------------------------------
+//
+// Mesh simplification by quadric error
+//
+// Garland and Heckbert's edge collapse: every point keeps a quadric, the
+// sum of the squared distances to the planes of the triangles around it,
+// and the cheapest edge is collapsed into one point placed where the two
+// quadrics together are smallest. Edges wait in a priority queue and are
+// only looked at again once one of their ends has moved, so the cost stays
+// near n log n.
+//
+// Points in the same place are welded first, a triangle soup collapses as
+// well as an indexed mesh. Collapses that would fold a triangle over or
+// join two sheets of the surface are refused. Points on the boundary of
+// the mesh can be kept where they are, so meshes cut from the same surface
+// still meet after each is simplified on its own. Loose specks smaller than
+// the error bound can collapse away entirely.
+//
+//----------------------------------------------------------------------------
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "comp308.hpp"
+#include "geometry.hpp"
+
+struct SimplifySettings {
+	//stop once this many triangles are left, 0 for no target
+	size_t targetTriangles = 0;
+	//never collapse an edge whose error is more than this. The error is a
+	//bound on how far, in world units, the new point is from the planes of
+	//the triangles it stands for
+	float maxError = 1e30f;
+	//points on the boundary of the mesh are never moved or removed
+	bool lockBoundary = true;
+};
+
+struct SimplifiedMesh {
+	std::vector<comp308::vec3> points;
+	std::vector<unsigned int> indices;	// three per triangle
+	float error = 0;					// largest error of any collapse made
+};
+
+// Simplifies the triangles given as three indices into points each
+SimplifiedMesh simplifyMesh(const std::vector<comp308::vec3> &points, const std::vector<unsigned int> &indices,
+	const SimplifySettings &);
+// Simplifies the triangles of a Geometry that kept its points
+SimplifiedMesh simplifyMesh(const Geometry &, const SimplifySettings &);
+
+// Levels of detail, each with ratio of the triangles of the one before and
+// made from it, finest first. Stops early once an error bound of maxError
+// keeps a level from getting smaller.
+std::vector<SimplifiedMesh> simplifyLevels(const std::vector<comp308::vec3> &points,
+	const std::vector<unsigned int> &indices, int levels, float ratio = 0.5f, float maxError = 1e30f);
+
+// Writes the mesh as an OBJ file with smooth normals, throws if it cannot
+void writeOBJ(const std::string &filename, const SimplifiedMesh &);
+
+// Entry point for --simplify, returns the process exit code
+int simplifyMain(const std::string &in, const std::string &out, float fraction, float maxError);
@@ -0,0 +1,199 @@
+//---------------------------------------------------------------------------
+//
+// Chunked, camera driven streaming terrain
+//
+//----------------------------------------------------------------------------
+
+#include <algorithm>
+#include <cmath>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "comp308.hpp"
+#include "marchingCubes.hpp"
+#include "streamTerrain.hpp"
+
+using namespace std;
+using namespace comp308;
+
+ChunkMesh generateChunk(const DensityField &density, const StreamSettings &settings, int cx, int cz) {
+	const int n = settings.chunkCells;
+	const int nY = settings.cellsY;
+	vec3 step(settings.chunkSize / n, (settings.maxY - settings.minY) / nY, settings.chunkSize / n);
+	// nodes are numbered across the whole world, so two chunks meeting at a
+	// face compute the same coordinates for it
+	const int first[3] = { cx * n, 0, cz * n };
+
+	vector<vec4> points((n+1) * (nY+1) * (n+1));
+	density.sampleGrid(vec3(0, settings.minY, 0), step, first, n, nY, n, points.data(), nullptr);
+
+	ChunkMesh chunk;
+	chunk.cx = cx;
+	chunk.cz = cz;
+	MCMesh mesh;
+	MarchingCubesIndexed(n, nY, n, 0.0f, points.data(), mesh);
+	chunk.vertices = move(mesh.vertices);
+	chunk.indices = move(mesh.indices);
+
+	// density grows into the rock, so the surface faces down the gradient
+	chunk.normals.resize(chunk.vertices.size());
+	for (size_t i = 0; i < chunk.vertices.size(); ++i) {
+		vec3 g = density.gradient(chunk.vertices[i], 0.5f * step.x);
+		chunk.normals[i] = (length(g) > 0) ? -normalize(g) : vec3(0, 1, 0);
+	}
+	return chunk;
+}
+
+// One worker fewer than there are cores, but always at least one so
+// nothing is ever generated on the render thread
+ChunkedTerrain::ChunkedTerrain(const StreamSettings &settings)
+	: m_settings(settings),
+	  m_density(make_shared<DensityField>(settings.density)),
+	  m_shared(make_shared<Shared>()),
+	  m_workers(max(2u, thread::hardware_concurrency())) {
+}
+
+ChunkedTerrain::~ChunkedTerrain() {
+	// queued chunks are skipped, the pool then waits for any in progress
+	m_shared->stopping = true;
+	for (auto &entry : m_chunks) {
+		if (entry.second.vbo) glDeleteBuffers(1, &entry.second.vbo);
+		if (entry.second.ibo) glDeleteBuffers(1, &entry.second.ibo);
+	}
+}
+
+void ChunkedTerrain::request(int cx, int cz) {
+	Chunk &chunk = m_chunks[key(cx, cz)];
+	chunk.cx = cx;
+	chunk.cz = cz;
+	m_inFlight++;
+
+	// the task holds its own references, it may finish after this terrain is gone
+	shared_ptr<const DensityField> density = m_density;
+	shared_ptr<Shared> shared = m_shared;
+	StreamSettings settings = m_settings;
+	m_workers.submit([density, shared, settings, cx, cz] {
+		if (shared->stopping) return;
+		ChunkMesh mesh = generateChunk(*density, settings, cx, cz);
+		lock_guard<mutex> lock(shared->mutex);
+		shared->done.push_back(move(mesh));
+	});
+}
+
+void ChunkedTerrain::upload(ChunkMesh &mesh) {
+	auto found = m_chunks.find(key(mesh.cx, mesh.cz));
+	if (found == m_chunks.end()) return;
+	Chunk &chunk = found->second;
+
+	vector<vec3> interleaved;
+	interleaved.reserve(2 * mesh.vertices.size());
+	for (size_t i = 0; i < mesh.vertices.size(); ++i) {
+		interleaved.push_back(mesh.vertices[i]);
+		interleaved.push_back(mesh.normals[i]);
+	}
+	if (!mesh.indices.empty()) {
+		glGenBuffers(1, &chunk.vbo);
+		glGenBuffers(1, &chunk.ibo);
+		glBindBuffer(GL_ARRAY_BUFFER, chunk.vbo);
+		glBufferData(GL_ARRAY_BUFFER, interleaved.size() * sizeof(vec3), interleaved.data(), GL_STATIC_DRAW);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, chunk.ibo);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, mesh.indices.size() * sizeof(unsigned int), mesh.indices.data(), GL_STATIC_DRAW);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	}
+
+	chunk.indexCount = GLsizei(mesh.indices.size());
+	chunk.bytes = mesh.bytes();
+	chunk.ready = true;
+	chunk.lastSeen = m_frame;
+	m_bytes += chunk.bytes;
+	m_lru.push_front(found->first);
+	chunk.lru = m_lru.begin();
+}
+
+// Drops the least recently seen chunks until under the cap, but never one
+// that is in view this frame
+void ChunkedTerrain::evict() {
+	while (m_bytes > m_settings.memoryCap && !m_lru.empty()) {
+		auto found = m_chunks.find(m_lru.back());
+		Chunk &chunk = found->second;
+		if (chunk.lastSeen == m_frame) break;
+
+		if (chunk.vbo) glDeleteBuffers(1, &chunk.vbo);
+		if (chunk.ibo) glDeleteBuffers(1, &chunk.ibo);
+		m_bytes -= chunk.bytes;
+		m_lru.pop_back();
+		m_chunks.erase(found);
+	}
+}
+
+void ChunkedTerrain::update(vec3 camera) {
+	m_frame++;
+
+	// pick up whatever the workers have finished, without waiting for them
+	{
+		lock_guard<mutex> lock(m_shared->mutex);
+		while (!m_shared->done.empty()) {
+			m_uploads.push_back(move(m_shared->done.front()));
+			m_shared->done.pop_front();
+			m_inFlight--;
+		}
+	}
+	for (int u = 0; u < m_settings.uploadsPerFrame && !m_uploads.empty(); ++u) {
+		upload(m_uploads.front());
+		m_uploads.pop_front();
+	}
+
+	// chunks in view, nearest first so the ground under the camera comes first
+	const int r = m_settings.viewRadius;
+	int ccx = int(floor(camera.x / m_settings.chunkSize));
+	int ccz = int(floor(camera.z / m_settings.chunkSize));
+	vector<pair<int, pair<int, int>>> wanted;
+	for (int dx = -r; dx <= r; ++dx) {
+		for (int dz = -r; dz <= r; ++dz) {
+			if (dx*dx + dz*dz <= r*r) wanted.push_back({dx*dx + dz*dz, {ccx + dx, ccz + dz}});
+		}
+	}
+	sort(wanted.begin(), wanted.end());
+
+	// keep the queue short so chunks the camera has already left are not
+	// generated long after
+	const int maxInFlight = 2 * int(m_workers.size() - 1);
+	for (auto &w : wanted) {
+		int cx = w.second.first, cz = w.second.second;
+		auto found = m_chunks.find(key(cx, cz));
+		if (found == m_chunks.end()) {
+			if (m_inFlight < maxInFlight) request(cx, cz);
+		} else if (found->second.ready) {
+			found->second.lastSeen = m_frame;
+			m_lru.splice(m_lru.begin(), m_lru, found->second.lru);
+		}
+	}
+
+	evict();
+}
+
+void ChunkedTerrain::render() {
+	glShadeModel(GL_SMOOTH);
+	glColor3f(173.0f/255.0f,177.0f/255.0f,157.0f/255.0f);
+	glPolygonMode(GL_FRONT, GL_FILL);
+	glPolygonMode(GL_BACK, GL_FILL);
+	glPushClientAttrib(GL_CLIENT_VERTEX_ARRAY_BIT);
+	glEnableClientState(GL_VERTEX_ARRAY);
+	glEnableClientState(GL_NORMAL_ARRAY);
+
+	for (auto &entry : m_chunks) {
+		const Chunk &chunk = entry.second;
+		if (!chunk.ready || !chunk.indexCount || chunk.lastSeen != m_frame) continue;
+		glBindBuffer(GL_ARRAY_BUFFER, chunk.vbo);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, chunk.ibo);
+		glVertexPointer(3, GL_FLOAT, 2 * sizeof(vec3), (const GLvoid *) 0);
+		glNormalPointer(GL_FLOAT, 2 * sizeof(vec3), (const GLvoid *) sizeof(vec3));
+		glDrawElements(GL_TRIANGLES, chunk.indexCount, GL_UNSIGNED_INT, (const GLvoid *) 0);
+	}
+
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	glPopClientAttrib();
+}
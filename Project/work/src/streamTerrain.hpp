@@ -0,0 +1,118 @@
+//---------------------------------------------------------------------------
+//
+// Chunked, camera driven streaming terrain
+//
+// The seabed is split into square columns of fixed size in x and z
+// (chunks) that are generated on background threads around the camera,
+// drawn once they have been uploaded and evicted least recently seen
+// first when the meshes on the GPU go over a memory cap. The render
+// thread never waits: it only queues work, picks up finished meshes and
+// uploads a few of them per frame.
+//
+// Neighbouring chunks sample the density at exactly the same coordinates
+// along their shared face and take their normals from the density
+// gradient rather than from their own triangles, so borders are seamless.
+//
+//----------------------------------------------------------------------------
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "comp308.hpp"
+#include "density.hpp"
+#include "threadPool.hpp"
+
+struct StreamSettings {
+	//density function, without the walls of the fixed map by default
+	DensitySettings density;
+	//world units and cells across a chunk in x and z
+	float chunkSize = 100.0f;
+	int chunkCells = 20;
+	//height range every chunk covers, and cells across it
+	float minY = -100.0f;
+	float maxY = 50.0f;
+	int cellsY = 30;
+	//chunks within this many chunk widths of the camera are kept loaded
+	int viewRadius = 4;
+	//bytes of vertex and index data allowed on the GPU
+	size_t memoryCap = size_t(64) << 20;
+	//finished chunks uploaded per frame, bounds the time spent uploading
+	int uploadsPerFrame = 2;
+
+	StreamSettings() { density.walls = false; }
+};
+
+// One chunk's mesh, made on a background thread without OpenGL
+struct ChunkMesh {
+	int cx = 0, cz = 0;
+	std::vector<comp308::vec3> vertices;
+	std::vector<comp308::vec3> normals;
+	std::vector<unsigned int> indices;
+
+	// size of the mesh once uploaded
+	size_t bytes() const { return vertices.size() * 2 * sizeof(comp308::vec3) + indices.size() * sizeof(unsigned int); }
+};
+
+ChunkMesh generateChunk(const DensityField &, const StreamSettings &, int cx, int cz);
+
+class ChunkedTerrain {
+private:
+	struct Chunk {
+		int cx = 0, cz = 0;
+		bool ready = false;         // false while it is being generated
+		GLuint vbo = 0, ibo = 0;
+		GLsizei indexCount = 0;
+		size_t bytes = 0;
+		unsigned long lastSeen = 0; // frame it was last within view
+		std::list<uint64_t>::iterator lru;
+	};
+
+	// Finished meshes handed from the generator threads to the render thread
+	struct Shared {
+		std::mutex mutex;
+		std::deque<ChunkMesh> done;
+		std::atomic<bool> stopping{false};
+	};
+
+	StreamSettings m_settings;
+	std::shared_ptr<const DensityField> m_density;
+	std::shared_ptr<Shared> m_shared;
+
+	std::unordered_map<uint64_t, Chunk> m_chunks;
+	std::list<uint64_t> m_lru;       // ready chunks, most recently seen first
+	std::deque<ChunkMesh> m_uploads; // finished, waiting for their upload slot
+	size_t m_bytes = 0;
+	int m_inFlight = 0;
+	unsigned long m_frame = 0;
+
+	// declared last so the workers are joined before anything they use goes
+	ThreadPool m_workers;
+
+	static uint64_t key(int cx, int cz) { return (uint64_t(uint32_t(cx)) << 32) | uint32_t(cz); }
+	void request(int cx, int cz);
+	void upload(ChunkMesh &);
+	void evict();
+
+public:
+	explicit ChunkedTerrain(const StreamSettings & = StreamSettings());
+	ChunkedTerrain(const ChunkedTerrain &) = delete;
+	ChunkedTerrain & operator=(const ChunkedTerrain &) = delete;
+	~ChunkedTerrain();
+
+	// Once a frame on the render thread: queues chunks around the camera,
+	// uploads finished ones and evicts over the memory cap
+	void update(comp308::vec3 camera);
+	void render();
+
+	size_t residentBytes() const { return m_bytes; }
+	int residentChunks() const { return int(m_lru.size()); }
+	int pendingChunks() const { return m_inFlight; }
+};
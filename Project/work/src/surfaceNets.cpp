@@ -0,0 +1,249 @@
+//---------------------------------------------------------------------------
+//
+// Surface nets
+//
+//----------------------------------------------------------------------------
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "comp308.hpp"
+#include "density.hpp"
+#include "surfaceNets.hpp"
+#include "threadPool.hpp"
+
+using namespace std;
+using namespace comp308;
+
+namespace {
+	// Corners of a cell are numbered x + 2y + 4z by their offset from its
+	// low corner. Edge e runs along axis e/4 from the corner offset on the
+	// other two axes by the bits of e
+	struct CellEdges {
+		int from[12];				// first corner
+		int axis[12];
+		unsigned short crossed[256];	// edges a corner code has crossed, bit e for edge e
+
+		CellEdges() {
+			for (int e = 0; e < 12; e++) {
+				int o[3];
+				axis[e] = e / 4;
+				o[axis[e]] = 0;
+				o[(axis[e] + 1) % 3] = e & 1;
+				o[(axis[e] + 2) % 3] = (e >> 1) & 1;
+				from[e] = o[0] + 2*o[1] + 4*o[2];
+			}
+			for (int code = 0; code < 256; code++) {
+				crossed[code] = 0;
+				for (int e = 0; e < 12; e++) {
+					int to = from[e] + (1 << axis[e]);
+					if (((code >> from[e]) & 1) != ((code >> to) & 1)) crossed[code] |= 1 << e;
+				}
+			}
+		}
+	};
+	const CellEdges cellEdges;
+
+	//mesh of a block of x slabs
+	struct NetBlock {
+		std::vector<vec3> vertices;
+		std::vector<vec3> normals;
+		//>= 0 for a vertex of this block, -(1 + j*ncellsZ + k) for the vertex of
+		// cell (j, k) in the last slab of the block before
+		std::vector<int> indices;
+		//vertex of each cell in the block's last slab, where it has one
+		std::vector<int> lastSlab;
+	};
+
+	//meshes the cells with x from lo up to but not including hi. With joined
+	// the block before ends where this one starts and has made the cells of
+	// slab lo-1
+	void meshBlock(int lo, int hi, bool joined, int ncellsY, int ncellsZ, float minValue,
+		const vec4 * points, const SurfaceBlocks * skip, NetBlock &block)
+	{
+		const int YtimeZ = (ncellsY+1)*(ncellsZ+1), rowZ = ncellsZ+1;
+		const vec3 spacing(points[YtimeZ].x - points[0].x, points[rowZ].y - points[0].y, points[1].z - points[0].z);
+
+		const vec3 origin(points[0].x, points[0].y, points[0].z);
+
+		//densities of slab i ([0]) and slab i+1 ([1]) packed together, so the
+		//cells with a vertex read them from cache rather than the grid a
+		//slab apart, and 1 for each of their solid nodes. Rows are copied
+		//when first needed, filled[n][j] is the slab row j of [n] holds
+		std::vector<float> values[2];
+		std::vector<unsigned char> signs[2];
+		std::vector<int> filled[2];
+		for(int n=0; n < 2; n++) {
+			values[n].resize(YtimeZ);
+			signs[n].resize(YtimeZ);
+			filled[n].assign(ncellsY+1, -1);
+		}
+		auto fillRow = [&](int n, int i, int j) {
+			if(filled[n][j] == i) return;
+			filled[n][j] = i;
+			const vec4 *p = points + size_t(i)*YtimeZ + j*rowZ;
+			float *value = &values[n][j*rowZ];
+			unsigned char *sign = &signs[n][j*rowZ];
+			for(int k=0; k < rowZ; k++) value[k] = p[k].w;
+			for(int k=0; k < rowZ; k++) sign[k] = value[k] > minValue;
+		};
+		//corner bits x + 2y of a row of nodes, and the codes of a row of cells
+		//codes padded to whole words of 8 with empty cells
+		const int words = (ncellsZ + 7) / 8;
+		std::vector<unsigned char> corners(rowZ), codes(size_t(words)*8, 0);
+		//vertex of each cell in slab i-1 (cells[0]) and slab i (cells[1]). Only
+		// read for cells the surface passes through, so never cleared
+		std::vector<int> cells[2];
+		cells[0].resize(size_t(ncellsY)*ncellsZ);
+		cells[1].resize(size_t(ncellsY)*ncellsZ);
+
+		for(int i=lo; i < hi; i++) {
+			//cells of slab i-1 are the block before's on the near face
+			bool deferred = joined && i == lo;
+			for(int j=0; j < ncellsY; j++) {
+				if(skip) {
+					bool any = false;
+					for(int bz=0; bz < skip->countZ && !any; bz++) any = skip->holds(i / skip->size, j / skip->size, bz);
+					if(!any) continue;
+				}
+				fillRow(0, i, j);
+				fillRow(0, i, j+1);
+				fillRow(1, i+1, j);
+				fillRow(1, i+1, j+1);
+				const unsigned char *a = &signs[0][j*rowZ], *b = &signs[0][(j+1)*rowZ];
+				const unsigned char *c = &signs[1][j*rowZ], *d = &signs[1][(j+1)*rowZ];
+				unsigned char *corner = corners.data(), *code = codes.data();
+				for(int k=0; k < rowZ; k++) corner[k] = (unsigned char)(a[k] | (c[k] << 1) | (b[k] << 2) | (d[k] << 3));
+				for(int k=0; k < ncellsZ; k++) code[k] = (unsigned char)(corner[k] | (corner[k+1] << 4));
+
+				for(int k=0; k < ncellsZ; k++) {
+					//most rows are wholly inside or outside, step over them 8 cells at a time
+					if((k & 7) == 0) {
+						uint64_t word;
+						memcpy(&word, code + k, sizeof word);
+						if(word == 0 || word == ~uint64_t(0)) {
+							k += 7;
+							continue;
+						}
+					}
+					int cube = code[k];
+					if(cube == 0 || cube == 255) continue;
+
+					int ind = j*rowZ + k;
+					float w[8];
+					for(int n=0; n < 8; n++) w[n] = values[n & 1][ind + ((n >> 1) & 1)*rowZ + (n >> 2)];
+
+					//the average of the crossings, in the cell's own coordinates
+					vec3 local(0);
+					int count = 0;
+					const unsigned crossed = cellEdges.crossed[cube];
+					for(int e=0; e < 12; e++) {
+						if(!(crossed & (1 << e))) continue;
+						int from = cellEdges.from[e], axis = cellEdges.axis[e];
+						vec3 offset(float(from & 1), float((from >> 1) & 1), float(from >> 2));
+						offset[axis] = (minValue - w[from]) / (w[from + (1 << axis)] - w[from]);
+						local += offset;
+						count++;
+					}
+					local /= float(count);
+					vec3 vertex(origin.x + (float(i) + local.x)*spacing.x, origin.y + (float(j) + local.y)*spacing.y,
+						origin.z + (float(k) + local.z)*spacing.z);
+
+					//gradient of the trilinear density at the vertex
+					float lx = local.x, ly = local.y, lz = local.z;
+					vec3 g(((w[1]-w[0])*(1-ly)*(1-lz) + (w[3]-w[2])*ly*(1-lz) + (w[5]-w[4])*(1-ly)*lz + (w[7]-w[6])*ly*lz)
+							/ spacing.x,
+						((w[2]-w[0])*(1-lx)*(1-lz) + (w[3]-w[1])*lx*(1-lz) + (w[6]-w[4])*(1-lx)*lz + (w[7]-w[5])*lx*lz)
+							/ spacing.y,
+						((w[4]-w[0])*(1-lx)*(1-ly) + (w[5]-w[1])*lx*(1-ly) + (w[6]-w[2])*(1-lx)*ly + (w[7]-w[3])*lx*ly)
+							/ spacing.z);
+
+					int self = int(block.vertices.size());
+					cells[1][size_t(j)*ncellsZ + k] = self;
+					block.vertices.push_back(vertex);
+					block.normals.push_back(length(g) > 0 ? -normalize(g) : vec3(0, 1, 0));
+
+					//a quad for each crossed edge from the cell's low corner, which
+					// is the last of the four cells around it to be made
+					auto at = [&](int di, int dj, int dk) {
+						size_t slot = size_t(j - dj)*ncellsZ + (k - dk);
+						if(di == 0) return cells[1][slot];
+						return deferred ? -(1 + int(slot)) : cells[0][slot];
+					};
+					bool inside = cube & 1;
+					auto quad = [&](int q1, int q2, int q3) {
+						int q[4] = { self, q1, q2, q3 };
+						//wound as marching cubes winds, see DualContour
+						if(!inside) std::swap(q[1], q[3]);
+						const int triangles[6] = { q[0], q[1], q[2], q[0], q[2], q[3] };
+						block.indices.insert(block.indices.end(), triangles, triangles + 6);
+					};
+					//each turning anticlockwise about its axis
+					if(((cube >> 1) & 1) != inside && j > 0 && k > 0) quad(at(0, 1, 0), at(0, 1, 1), at(0, 0, 1));
+					if(((cube >> 2) & 1) != inside && k > 0 && i > 0) quad(at(0, 0, 1), at(1, 0, 1), at(1, 0, 0));
+					if(((cube >> 4) & 1) != inside && i > 0 && j > 0) quad(at(1, 0, 0), at(1, 1, 0), at(0, 1, 0));
+				}
+			}
+			//slab i becomes the one before the next
+			cells[0].swap(cells[1]);
+			values[0].swap(values[1]);
+			signs[0].swap(signs[1]);
+			filled[0].swap(filled[1]);
+		}
+		block.lastSlab.swap(cells[0]);
+	}
+}
+
+/*
+	Blocks of whole x slabs are meshed on their own and joined as
+	MarchingCubesIndexed joins them: quads on a block's near face use the
+	vertices of the block before's last slab, looked up once every block's
+	vertices have their place in the output.
+*/
+void SurfaceNets(int ncellsX, int ncellsY, int ncellsZ, float minValue, const vec4 * points,
+	MCMesh &mesh, ThreadPool * pool, const SurfaceBlocks * surface)
+{
+	int nBlocks = 1;
+	if(pool && pool->size() > 1) {
+		nBlocks = std::max(1, std::min(ncellsX, 4*int(pool->size())));
+	}
+
+	std::vector<NetBlock> blocks(nBlocks);
+	auto blockStart = [&](int b) { return int((long long) ncellsX * b / nBlocks); };
+	auto runBlock = [&](int b) {
+		meshBlock(blockStart(b), blockStart(b+1), b > 0, ncellsY, ncellsZ, minValue, points, surface, blocks[b]);
+	};
+	if(nBlocks == 1) runBlock(0);
+	else pool->parallelFor(nBlocks, runBlock);
+
+	if(nBlocks == 1) {
+		mesh.vertices.swap(blocks[0].vertices);
+		mesh.normals.swap(blocks[0].normals);
+		mesh.indices.assign(blocks[0].indices.begin(), blocks[0].indices.end());
+		return;
+	}
+
+	std::vector<size_t> vertexStart(nBlocks+1, 0), indexStart(nBlocks+1, 0);
+	for(int b=0; b < nBlocks; b++) {
+		vertexStart[b+1] = vertexStart[b] + blocks[b].vertices.size();
+		indexStart[b+1] = indexStart[b] + blocks[b].indices.size();
+	}
+	mesh.vertices.resize(vertexStart[nBlocks]);
+	mesh.normals.resize(vertexStart[nBlocks]);
+	mesh.indices.resize(indexStart[nBlocks]);
+
+	pool->parallelFor(nBlocks, [&](int b) {
+		const NetBlock &block = blocks[b];
+		std::copy(block.vertices.begin(), block.vertices.end(), mesh.vertices.begin() + vertexStart[b]);
+		std::copy(block.normals.begin(), block.normals.end(), mesh.normals.begin() + vertexStart[b]);
+		unsigned int *out = &mesh.indices[0] + indexStart[b];
+		for(size_t n=0; n < block.indices.size(); n++) {
+			int v = block.indices[n];
+			out[n] = (v >= 0) ? unsigned(vertexStart[b] + v)
+				: unsigned(vertexStart[b-1] + blocks[b-1].lastSlab[-v - 1]);
+		}
+	});
+}
@@ -0,0 +1,37 @@
+//---------------------------------------------------------------------------
+//
+// Surface nets
+//
+// A quick preview mesher for trying out density settings. Like dual
+// contouring it puts one vertex in every cell the surface passes through
+// and a quad across every crossed grid edge, but the vertex is simply the
+// average of the cell's edge crossings and its normal the gradient of the
+// cell's trilinear density there, so nothing outside the grid is sampled
+// and no system is solved. The surface comes out a little smoother and
+// less exact than marching cubes', with about as many triangles.
+//
+// Work goes a grid row at a time: the densities of four rows of nodes are
+// copied out of the grid once, their inside/outside bits combined into the
+// corner codes of a row of cells with plain byte loops the compiler
+// vectorises, and the codes stepped over 8 at a time until one is mixed.
+// Only those cells are looked at one by one. Unlike the noise's AVX2 paths
+// these need nothing past the SSE2 every x86-64 build has, so there are no
+// intrinsics and no choice made at run time.
+//
+//----------------------------------------------------------------------------
+
+#pragma once
+
+#include "comp308.hpp"
+#include "marchingCubes.hpp"
+
+class ThreadPool;
+struct SurfaceBlocks;
+
+// Meshes the grid of (ncellsX+1)*(ncellsY+1)*(ncellsZ+1) points, ordered and
+// with solid above minValue as for MarchingCubesIndexed, into mesh, wound as
+// marching cubes winds its triangles. Blocks of x slabs go to pool when
+// given, the result is the same either way. Cells in blocks surface marks
+// as holding none are not looked at.
+void SurfaceNets(int ncellsX, int ncellsY, int ncellsZ, float minValue, const comp308::vec4 * points,
+	MCMesh &mesh, ThreadPool * pool = nullptr, const SurfaceBlocks * surface = nullptr);
@@ -0,0 +1,178 @@
+//---------------------------------------------------------------------------
+//
+// Headless parameter sweep over the boids rule weights
+//
+//----------------------------------------------------------------------------
+
+#include <chrono>
+#include <cstdlib>
+#include <cmath>
+#include <fstream>  // file streams
+#include <iostream> // input/output streams
+#include <sstream>  // string streams
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "comp308.hpp"
+#include "school.hpp"
+#include "sweep.hpp"
+#include "threadPool.hpp"
+
+using namespace std;
+using namespace comp308;
+
+namespace {
+
+	// Each sweepable parameter and where it lives in a run
+	struct gridAxis {
+		const char *name;
+		vector<float> values;
+	};
+
+	void applyValue(SweepRun &run, const string &name, float value) {
+		if (name == "cohesion") run.params.cohesion = value;
+		else if (name == "separation") run.params.separation = value;
+		else if (name == "distance") run.params.separationDistance = value;
+		else if (name == "alignment") run.params.alignment = value;
+		else if (name == "bound") run.params.boundPush = value;
+		else if (name == "limit") run.params.velocityLimit = value;
+		else if (name == "fish") run.params.fishAmount = int(value);
+		else if (name == "steps") run.steps = int(value);
+		else if (name == "seeds") run.seed = unsigned(value);
+		else if (name == "blocked") run.params.blockedSeparation = value != 0;
+	}
+
+	void measure(const School &school, SweepRun &run) {
+		const vector<Fish> &fish = school.getFish();
+		vec3 centre;
+		vec3 heading;
+		float speed = 0;
+		for (const Fish &f : fish) {
+			centre += f.getPosition();
+			float s = length(f.getVelocity());
+			if (s > 0) heading += f.getVelocity() / s;
+			speed += s;
+		}
+		centre /= float(fish.size());
+
+		float spread = 0;
+		for (const Fish &f : fish) {
+			spread += length(f.getPosition() - centre);
+		}
+
+		run.cohesion = spread / fish.size();
+		run.polarization = length(heading) / fish.size();
+		run.speed = speed / fish.size();
+	}
+}
+
+vector<SweepRun> readSweepGrid(const string &filename) {
+	ifstream gridFile(filename);
+	if (!gridFile.is_open()) {
+		cerr << "Error reading " << filename << endl;
+		throw runtime_error("Error :: could not open file.");
+	}
+
+	vector<gridAxis> axes = {
+		{"cohesion", {}}, {"separation", {}}, {"distance", {}}, {"alignment", {}},
+		{"bound", {}}, {"limit", {}}, {"fish", {}}, {"steps", {}}, {"seeds", {}}, {"blocked", {}}
+	};
+
+	string line;
+	while (getline(gridFile, line)) {
+		istringstream gridLine(line.substr(0, line.find('#')));
+		string name;
+		if (!(gridLine >> name)) continue;
+
+		gridAxis *axis = nullptr;
+		for (gridAxis &a : axes) {
+			if (name == a.name) axis = &a;
+		}
+		if (!axis) throw runtime_error("Error :: unknown sweep parameter '" + name + "'.");
+
+		float value;
+		while (gridLine >> value) axis->values.push_back(value);
+		if (axis->values.empty()) throw runtime_error("Error :: no values for sweep parameter '" + name + "'.");
+		// the rules average over the other fish, so a school needs two
+		if (name == "fish") {
+			for (float v : axis->values) {
+				if (!(v >= 2)) {
+					ostringstream message;
+					message << "Error :: a school needs at least 2 fish, not " << v << ".";
+					throw runtime_error(message.str());
+				}
+			}
+		}
+	}
+
+	// cartesian product, the first axis varies slowest
+	vector<SweepRun> runs(1);
+	for (const gridAxis &axis : axes) {
+		if (axis.values.empty()) continue;
+		vector<SweepRun> expanded;
+		for (const SweepRun &run : runs) {
+			for (float value : axis.values) {
+				SweepRun r = run;
+				applyValue(r, axis.name, value);
+				expanded.push_back(r);
+			}
+		}
+		runs.swap(expanded);
+	}
+	return runs;
+}
+
+void runSweep(vector<SweepRun> &runs) {
+	// Runs share nothing, each worker owns its school and writes only its own result
+	ThreadPool::global().parallelFor(int(runs.size()), [&](int i) {
+		SweepRun &run = runs[i];
+		auto start = chrono::steady_clock::now();
+
+		School school(run.params, run.seed);
+		for (int s = 0; s < run.steps; ++s) {
+			school.moveAllFishToNewPositions();
+		}
+		measure(school, run);
+
+		run.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	});
+}
+
+void writeSweepCSV(const string &filename, const vector<SweepRun> &runs) {
+	ofstream file(filename);
+	if (!file.is_open()) {
+		cerr << "Error writing " << filename << endl;
+		throw runtime_error("Error :: could not open file.");
+	}
+	file << "cohesion,separation,distance,alignment,bound,limit,fish,steps,seed,blocked,"
+	     << "cohesion_metric,polarization,speed,seconds\n";
+	for (const SweepRun &r : runs) {
+		file << r.params.cohesion << "," << r.params.separation << "," << r.params.separationDistance << ","
+		     << r.params.alignment << "," << r.params.boundPush << "," << r.params.velocityLimit << ","
+		     << r.params.fishAmount << "," << r.steps << "," << r.seed << "," << r.params.blockedSeparation << ","
+		     << r.cohesion << "," << r.polarization << "," << r.speed << "," << r.seconds << "\n";
+	}
+}
+
+int sweepMain(const string &gridFile, const string &csvFile) {
+	try {
+		vector<SweepRun> runs = readSweepGrid(gridFile);
+		cout << "Sweeping " << runs.size() << " schools on " << ThreadPool::global().size() << " threads" << endl;
+
+		auto start = chrono::steady_clock::now();
+		runSweep(runs);
+		double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+		double fishSteps = 0;
+		for (const SweepRun &r : runs) fishSteps += double(r.params.fishAmount) * r.steps;
+		cout << "Finished in " << seconds << "s (" << runs.size() / seconds << " runs/s, "
+		     << fishSteps / seconds << " fish steps/s)" << endl;
+
+		writeSweepCSV(csvFile, runs);
+	} catch (const exception &e) {
+		cerr << e.what() << endl;
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
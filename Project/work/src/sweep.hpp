@@ -0,0 +1,53 @@
+//---------------------------------------------------------------------------
+//
+// Headless parameter sweep over the boids rule weights
+//
+// The grid file has one parameter per line followed by the values to try,
+// every combination is simulated as an independent school:
+//
+//   # comments and blank lines are ignored
+//   cohesion   500 1000 2000
+//   separation 25 50
+//   distance   1.5
+//   alignment  4 8 16
+//   bound      0.025 0.05
+//   limit      0.5
+//   fish       300
+//   steps      1000
+//   seeds      1 2 3
+//   blocked    0 1          # SchoolParams::blockedSeparation
+//
+// Parameters left out keep their SchoolParams default, steps defaults to
+// 1000 and seeds to a single run with seed 1.
+//
+//----------------------------------------------------------------------------
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "school.hpp"
+
+struct SweepRun {
+	SchoolParams params;
+	unsigned seed = 1;
+	int steps = 1000;
+
+	// results
+	float cohesion = 0;     // mean distance of a fish from the school centre
+	float polarization = 0; // length of the mean heading, 1 when all fish swim the same way
+	float speed = 0;        // mean fish speed
+	double seconds = 0;
+};
+
+// Expands the grid file into one run per parameter combination
+std::vector<SweepRun> readSweepGrid(const std::string &);
+
+// Simulates every run across the thread pool and fills in the results
+void runSweep(std::vector<SweepRun> &);
+
+void writeSweepCSV(const std::string &, const std::vector<SweepRun> &);
+
+// Entry point for --sweep, returns the process exit code
+int sweepMain(const std::string &gridFile, const std::string &csvFile);
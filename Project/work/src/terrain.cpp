@@ -10,84 +10,306 @@
 #include <sstream>  // string streams
 #include <string>
 #include <stdexcept>
+#include <algorithm>
+#include <utility>
 #include <vector>
+#include <chrono>
+#include <ctime>
+#include <future>
 
 #include "comp308.hpp"
+#include "marchingCubes.hpp"
+#include "meshCache.hpp"
+#include "simplify.hpp"
 #include "terrain.hpp"
+#include "threadPool.hpp"
 
 using namespace std;
 using namespace comp308;
 
-Terrain::Terrain() {
-	mcPoints = new vec4[(nX+1)*(nY+1)*(nZ+1)];
-	vec3 stepSize((MAXX-MINX)/nX, (MAXY-MINY)/nY, (MAXZ-MINZ)/nZ);
-	for(int i=0; i < nX+1; i++) {
-		for(int j=0; j < nY+1; j++) {
-			for(int k=0; k < nZ+1; k++) {
-				vec4 vert(MINX+i*stepSize.x, MINY+j*stepSize.y, MINZ+k*stepSize.z, 0);
-				vert.w = calculateDensity(vert);
-				mcPoints[i*(nY+1)*(nZ+1) + j*(nZ+1) + k] = vert;
-			}
+Terrain::Terrain() : Terrain(TerrainSettings()) {
+}
+
+namespace {
+	// Bump when the mesher, the normals or the density program change what they make
+	const unsigned meshVersion = 3;
+
+	// Hash of everything the baked mesh depends on
+	unsigned long long meshCacheKey(const TerrainSettings &settings, float minValue) {
+		CacheKey key;
+		key.add(meshVersion).add(settings.density.seed);
+		key.add(settings.nX).add(settings.nY).add(settings.nZ);
+		const float bounds[6] = { settings.minBound.x, settings.maxBound.x, settings.minBound.y, settings.maxBound.y,
+			settings.minBound.z, settings.maxBound.z };
+		key.add(bounds).add(minValue);
+		for (const Perlin::Octave &octave : settings.density.octaves) {
+			key.add(octave.frequency).add(octave.amplitude);
+		}
+		key.add(settings.density.wallOctave.frequency).add(settings.density.wallOctave.amplitude);
+		key.add(settings.density.walls).add(settings.density.simplex).add(settings.skipBlockCells).add(settings.simplifyError);
+		key.add(int(settings.mesher));
+		key.add(settings.density.expression.data(), settings.density.expression.size());
+		return key.value();
+	}
+}
+
+void checkTerrainSettings(const TerrainSettings &settings) {
+	if (settings.nX < 1 || settings.nY < 1 || settings.nZ < 1) {
+		throw runtime_error("Error :: terrain needs at least one cell on each axis.");
+	}
+	for (int a = 0; a < 3; a++) {
+		if (!(settings.minBound[a] < settings.maxBound[a])) throw runtime_error("Error :: terrain bounds are empty.");
+	}
+}
+
+Terrain::Terrain(const TerrainSettings &settings, bool mesh) : density(settings.density) {
+	checkTerrainSettings(settings);
+	nX = settings.nX;
+	nY = settings.nY;
+	nZ = settings.nZ;
+	minBound = settings.minBound;
+	maxBound = settings.maxBound;
+	adaptive = settings.adaptive;
+	octree = settings.octree;
+	simplifyError = settings.simplifyError;
+	mesher = settings.mesher;
+
+	// an adaptive mesh depends on where the camera is, so it is not cached
+	bool caching = mesh && !adaptive && !settings.meshCache.empty() && settings.density.seed != 0;
+	// also needed on a cache hit, sculpting has to know which nodes were sampled
+	if (settings.skipBlockCells > 0) {
+		const int first[3] = { 0, 0, 0 };
+		surface = density.surfaceBlocks(minBound, cellSize(), first, nX, nY, nZ,
+			settings.skipBlockCells, minValue);
+	}
+
+	unsigned long long key = caching ? meshCacheKey(settings, minValue) : 0;
+	if (caching && loadMeshCache(settings.meshCache, key)) {
+		return;
+	}
+
+	sampleDensity(settings.threads);
+	if (mesh && adaptive) {
+		uploadOctree(meshOctree(density, minBound, maxBound, minValue,
+			settings.viewpoint, octree, &ThreadPool::global()));
+	} else if (mesh) {
+		MCMesh built;
+		buildMesh(built);
+		if (caching) {
+			saveMeshCache(settings.meshCache, key, built.indices);
 		}
 	}
-	// Convert strut to geometry types
-	vector<vec3> geoPoints;
-	vector<triangle> geoTriangles;
-	//runs Marching Cubes
-	Triangles = MarchingCubesLinear(nX, nY, nZ, minValue, mcPoints, numOfTriangles);
-	for(int i = 0; i<numOfTriangles; ++i) {
-		geoPoints.push_back(Triangles[i].p[0]);
-		geoPoints.push_back(Triangles[i].p[1]);
-		geoPoints.push_back(Triangles[i].p[2]);
-		triangle t; 
-		t.v[0].p = geoPoints.size()-3;
-		t.v[1].p = geoPoints.size()-2;
-		t.v[2].p = geoPoints.size()-1;
-		geoTriangles.push_back(t);
-	}
-	g_geometry = new Geometry(geoPoints, geoTriangles);
 	//saveObj();
 }
 
-Terrain::Terrain(string filename) {
-	cout << filename << endl;
-	g_geometry = new Geometry(filename);
+// Fills mcPoints with the density at every grid point. Blocks that are
+// all rock or all water only get the noise free trend, which is enough to
+// tell rock from water there
+void Terrain::sampleDensity(unsigned threads) {
+	mcPoints = new vec4[(nX+1)*(nY+1)*(nZ+1)];
+	vec3 stepSize = cellSize();
+	const int first[3] = { 0, 0, 0 };
+	const SurfaceBlocks *blocks = skipBlocks();
+
+	if (threads == 0) {
+		density.sampleGrid(minBound, stepSize, first, nX, nY, nZ, mcPoints, &ThreadPool::global(), blocks);
+	} else {
+		ThreadPool pool(threads);
+		density.sampleGrid(minBound, stepSize, first, nX, nY, nZ, mcPoints, &pool, blocks);
+	}
 }
 
-float Terrain::calculateDensity(vec4 coords) {
-	Perlin p;
-	float density = -coords.y;
-	density += p.noise(coords.x, coords.y, coords.z) - 25.0003;
-	density += p.noise(coords.x*0.403, coords.y*0.403, coords.z*0.403)*2.5;  
-	density += p.noise(coords.x*0.196, coords.y*0.196, coords.z*0.196)*5.0;  
-	density += p.noise(coords.x*0.101, coords.y*0.101, coords.z*0.101)*10.0;
-	//density += p.noise(coords.x*0.05, coords.y*0.05, coords.z*0.05)*100.0;
-// 	if((coords.x+50)/40>-pi()/2 && (coords.x+50)/40 < pi()/2
-// 	  && (coords.z+50)/10>-pi()/2 && (coords.z+50)/10 < pi()/2
-// 	) {
-// 		density += cos((coords.x+50)/40)*7*cos((coords.z+50)/10)*5;
-// 	}
-	if(coords.z < -160 && coords.z > -210) {
-		density += -(coords.z + 160)+p.noise(coords.x*0.101, coords.y*0.101, coords.z*0.101)*10.0;
+void Terrain::buildMesh(MCMesh &mesh) {
+	if (mesher == Mesher::DualContouring) {
+		//vertices placed on the tangent planes of the real density, which
+		//the grid's differences would round off
+		DualContourSettings settings;
+		float h = 0.5f * cellSize().x;
+		settings.gradient = [this, h](vec3 p) { return density.gradient(p, h); };
+		DualContour(nX, nY, nZ, minValue, mcPoints, mesh, settings, &ThreadPool::global(), skipBlocks());
+	} else if (mesher == Mesher::SurfaceNets) {
+		//a vertex averaged from each crossed cell, for a quick look
+		SurfaceNets(nX, nY, nZ, minValue, mcPoints, mesh, &ThreadPool::global(), skipBlocks());
+	} else {
+		//runs Marching Cubes, sharing the vertex on every crossed grid edge, with
+		//normals from the density gradient on the grid
+		MarchingCubesIndexed(nX, nY, nZ, minValue, mcPoints, mesh, &ThreadPool::global(), skipBlocks());
 	}
-	if(coords.z > 160 && coords.z < 210) {
-		density += (coords.z - 160)+p.noise(coords.x*0.101, coords.y*0.101, coords.z*0.101)*10.0;
+	if (simplifyError > 0) {
+		SimplifySettings settings;
+		settings.maxError = simplifyError;
+		SimplifiedMesh simplified = simplifyMesh(mesh.vertices, mesh.indices, settings);
+		cout << "terrain simplified from " << mesh.indices.size() / 3 << " to " << simplified.indices.size() / 3
+		     << " triangles" << endl;
+		// points have moved off the grid, their normals come from the density
+		// gradient at the grid's own spacing as the mesher's do
+		float h = cellSize().x;
+		mesh.vertices = move(simplified.points);
+		mesh.indices = move(simplified.indices);
+		mesh.normals.resize(mesh.vertices.size());
+		ThreadPool::global().parallelFor(int(mesh.vertices.size()), [&](int i) {
+			vec3 g = density.gradient(mesh.vertices[i], h);
+			mesh.normals[i] = (length(g) > 0) ? -normalize(g) : vec3(0, 1, 0);
+		});
 	}
-	if(coords.x < -160 && coords.x > -210 && coords.z < 190 && coords.z > -190) {
-		density += -(coords.x + 160)+p.noise(coords.x*0.101, coords.y*0.101, coords.z*0.101)*10.0;
+	g_geometry = new Geometry(move(mesh.vertices), move(mesh.normals), mesh.indices);
+}
+
+void Terrain::uploadOctree(const OctreeMesh &mesh) {
+	vector<vec3> interleaved;
+	interleaved.reserve(2 * mesh.vertices.size());
+	for (size_t i = 0; i < mesh.vertices.size(); ++i) {
+		interleaved.push_back(mesh.vertices[i]);
+		interleaved.push_back(mesh.normals[i]);
+	}
+	delete g_geometry;
+	g_geometry = new Geometry(interleaved.data(), mesh.vertices.size(), mesh.indices.data(), mesh.indices.size());
+	meshViewpoint = mesh.viewpoint;
+}
+
+void Terrain::update(vec3 camera) {
+	if (!adaptive) return;
+	if (remesh.valid()) {
+		if (remesh.wait_for(chrono::seconds(0)) == future_status::ready) {
+			uploadOctree(remesh.get());
+		}
+		return;
+	}
+	if (length(camera - meshViewpoint) > octree.rebuildDistance) {
+		// the density field is never modified, and the destructor waits for this
+		remesh = async(launch::async, [this, camera] {
+			return meshOctree(density, minBound, maxBound, minValue,
+				camera, octree, &ThreadPool::global());
+		});
+	}
+}
+
+// The grid coordinates are worked out exactly as sampleDensity does, only
+// the densities come from the file
+bool Terrain::loadMeshCache(const string &directory, unsigned long long key) {
+	string path = meshCachePath(directory, key);
+	MeshCacheFile file(path, key);
+	if (!file.valid() || file.nodeCount() != size_t(nX+1)*(nY+1)*(nZ+1)) {
+		return false;
+	}
+
+	mcPoints = new vec4[file.nodeCount()];
+	vec3 base = minBound;
+	vec3 stepSize = cellSize();
+	const float *densities = file.densities();
+	for (int i = 0; i < nX+1; i++) {
+		for (int j = 0; j < nY+1; j++) {
+			for (int k = 0; k < nZ+1; k++) {
+				int n = i*(nY+1)*(nZ+1) + j*(nZ+1) + k;
+				mcPoints[n] = vec4(base.x+i*stepSize.x, base.y+j*stepSize.y, base.z+k*stepSize.z, densities[n]);
+			}
+		}
+	}
+
+	g_geometry = new Geometry(file.vertices(), file.vertexCount(), file.indices(), file.indexCount());
+	cached = true;
+	cout << "terrain mesh read from " << path << endl;
+	return true;
+}
+
+// A cache that cannot be written only costs the next launch its head start
+void Terrain::saveMeshCache(const string &directory, unsigned long long key, const vector<unsigned int> &indices) {
+	try {
+		writeMeshCache(directory, key, mcPoints, size_t(nX+1)*(nY+1)*(nZ+1),
+			g_geometry->getPoints(), g_geometry->getNormals(), indices);
+	} catch (const runtime_error &) {
+		cerr << "terrain mesh not cached" << endl;
 	}
-	if(coords.x > 160 && coords.x < 210 && coords.z < 190 && coords.z > -190) {
-		density += (coords.x - 160)+p.noise(coords.x*0.101, coords.y*0.101, coords.z*0.101)*10.0;
+}
+
+Terrain::Terrain(string filename, float simplify) : density(DensitySettings()) {
+	cout << filename << endl;
+	simplifyError = simplify;
+	if (simplifyError <= 0) {
+		g_geometry = new Geometry(filename);
+		return;
+	}
+	SimplifySettings settings;
+	settings.maxError = simplifyError;
+	SimplifiedMesh simplified = simplifyMesh(Geometry(filename, false), settings);
+	g_geometry = new Geometry(move(simplified.points), simplified.indices, NormalWeighting::Area);
+}
+
+Terrain::~Terrain() {
+	if (remesh.valid()) remesh.wait();
+	delete [] mcPoints;
+	delete g_geometry;
+	delete sculpted;
+}
+
+Mesher mesherNamed(const string &name) {
+	if (name == "marching") return Mesher::MarchingCubes;
+	if (name == "dual") return Mesher::DualContouring;
+	if (name == "nets") return Mesher::SurfaceNets;
+	throw runtime_error("Error :: no mesher called '" + name + "', it is marching, dual or nets.");
+}
+
+void readTerrainSettings(const string &filename, TerrainSettings &settings) {
+	ifstream settingsFile(filename);
+	if (!settingsFile.is_open()) {
+		cerr << "Error reading " << filename << endl;
+		throw runtime_error("Error :: could not open file.");
 	}
-	return density;
 
+	string line;
+	while (getline(settingsFile, line)) {
+		istringstream settingsLine(line.substr(0, line.find('#')));
+		string name;
+		if (!(settingsLine >> name)) continue;
+
+		vector<double> values;
+		string text;
+		if (name == "noise") {
+			if (!(settingsLine >> text) || (text != "perlin" && text != "simplex")) {
+				throw runtime_error("Error :: terrain noise is perlin or simplex.");
+			}
+			settings.density.simplex = text == "simplex";
+			continue;
+		}
+		if (name == "mesher") {
+			if (!(settingsLine >> text)) throw runtime_error("Error :: no name for terrain setting 'mesher'.");
+			settings.mesher = mesherNamed(text);
+			continue;
+		}
+		if (name == "cache" || name == "density") {
+			if (!(settingsLine >> text)) throw runtime_error("Error :: no path for terrain setting '" + name + "'.");
+			if (name == "cache") settings.meshCache = text;
+			else settings.density.expression = readDensitySource(text);
+			continue;
+		}
+		double value;
+		while (settingsLine >> value) values.push_back(value);
+		if (values.empty() || !settingsLine.eof()) {
+			throw runtime_error("Error :: bad values for terrain setting '" + name + "'.");
+		}
 
-	// Ball
-	//return coords.x*coords.x + coords.y*coords.y + coords.z*coords.z -50 - 0.0003;
-	// Random terrain
-	//return 2*sin(coords.x/4) + 0.1*sin(coords.x) + 0.1*sin(coords.x/3) + 0.1*sin(coords.x/3.5 + 15) + 0.2*sin(coords.z) + sin(coords.z/5)  -cos(coords.x/3.4 + coords.z/4.3) - coords.y - 5.003;
-	// Slope
-	//return coords.x*0.2-coords.y - 0.0003;
+		if (name == "cells" && (values.size() == 1 || values.size() == 3)) {
+			settings.nX = int(values[0]);
+			settings.nY = int(values[values.size() == 3 ? 1 : 0]);
+			settings.nZ = int(values[values.size() == 3 ? 2 : 0]);
+		} else if (name == "min" && values.size() == 3) {
+			settings.minBound = vec3(float(values[0]), float(values[1]), float(values[2]));
+		} else if (name == "max" && values.size() == 3) {
+			settings.maxBound = vec3(float(values[0]), float(values[1]), float(values[2]));
+		} else if (name == "seed" && values.size() == 1) {
+			settings.density.seed = unsigned(values[0]);
+		} else if (name == "skip" && values.size() == 1) {
+			settings.skipBlockCells = int(values[0]);
+		} else if (name == "threads" && values.size() == 1) {
+			settings.threads = unsigned(values[0]);
+		} else if (name == "simplify" && values.size() == 1) {
+			settings.simplifyError = float(values[0]);
+		} else if (name == "adaptive" && values.size() == 1) {
+			settings.adaptive = values[0] != 0;
+		} else {
+			throw runtime_error("Error :: bad terrain setting '" + name + "'.");
+		}
+	}
 }
 
 void Terrain::saveObj() {
@@ -97,5 +319,152 @@ void Terrain::saveObj() {
 void Terrain::renderTerrain() {
 	glShadeModel(GL_SMOOTH);
 	glColor3f(173.0f/255.0f,177.0f/255.0f,157.0f/255.0f);
-	g_geometry->renderGeometry();
+	if (sculpted) {
+		sculpted->render();
+	} else {
+		g_geometry->renderGeometry();
+	}
+}
+
+// Trilinear interpolation of the grid, clamped to its edges
+float Terrain::gridDensity(vec3 p) const {
+	const vec3 base = minBound;
+	const vec3 size = maxBound - minBound;
+	const int cells[3] = { nX, nY, nZ };
+	int c[3];
+	float f[3];
+	for (int a = 0; a < 3; a++) {
+		float u = max(0.0f, min(float(cells[a]), (p[a] - base[a]) / size[a] * cells[a]));
+		c[a] = min(int(u), cells[a] - 1);
+		f[a] = u - c[a];
+	}
+	auto at = [&](int i, int j, int k) { return mcPoints[i*(nY+1)*(nZ+1) + j*(nZ+1) + k].w; };
+	float value = 0;
+	for (int corner = 0; corner < 8; corner++) {
+		int dx = corner & 1, dy = (corner >> 1) & 1, dz = corner >> 2;
+		float weight = (dx ? f[0] : 1 - f[0]) * (dy ? f[1] : 1 - f[1]) * (dz ? f[2] : 1 - f[2]);
+		value += weight * at(c[0] + dx, c[1] + dy, c[2] + dz);
+	}
+	return value;
+}
+
+/*
+	Steps along the ray half a cell at a time from where it enters the
+	grid's box, then bisects the step where it goes from water into rock.
+*/
+bool Terrain::raycast(vec3 origin, vec3 direction, vec3 &hit) const {
+	if (!mcPoints || length(direction) == 0) return false;
+	direction = normalize(direction);
+
+	const vec3 low = minBound;
+	const vec3 high = maxBound;
+	float tNear = 0, tFar = 1e30f;
+	for (int a = 0; a < 3; a++) {
+		if (fabs(direction[a]) < 1e-8f) {
+			if (origin[a] < low[a] || origin[a] > high[a]) return false;
+			continue;
+		}
+		float t0 = (low[a] - origin[a]) / direction[a];
+		float t1 = (high[a] - origin[a]) / direction[a];
+		tNear = max(tNear, min(t0, t1));
+		tFar = min(tFar, max(t0, t1));
+	}
+	if (tNear > tFar) return false;
+
+	vec3 cell = cellSize();
+	float step = 0.5f * min(cell.x, min(cell.y, cell.z));
+	float before = tNear;
+	bool wasRock = gridDensity(origin + direction * tNear) > minValue;
+	while (before < tFar) {
+		float after = min(before + step, tFar);
+		bool rock = gridDensity(origin + direction * after) > minValue;
+		if (rock && !wasRock) {
+			for (int n = 0; n < 16; n++) {
+				float middle = 0.5f * (before + after);
+				if (gridDensity(origin + direction * middle) > minValue) after = middle;
+				else before = middle;
+			}
+			hit = origin + direction * after;
+			return true;
+		}
+		wasRock = rock;
+		before = after;
+	}
+	return false;
+}
+
+// Nodes of skipped blocks hold only the trend. Before a brush reaches them
+// their blocks are marked as holding surface, and the nodes that makes
+// sampleGrid sample are given their real density
+void Terrain::wakeBlocks(const int cellLo[3], const int cellHi[3]) {
+	const int size = surface.size;
+	const int nodes[3] = { nX, nY, nZ };
+	int from[3], to[3], nodeLo[3], nodeHi[3];
+	for (int a = 0; a < 3; a++) {
+		from[a] = cellLo[a] / size;
+		to[a] = (cellHi[a] - 1) / size;
+		nodeLo[a] = max(0, from[a] * size - 1);
+		nodeHi[a] = min(nodes[a], (to[a] + 1) * size + 1);
+	}
+
+	vector<int> trend;
+	for (int i = nodeLo[0]; i <= nodeHi[0]; i++)
+		for (int j = nodeLo[1]; j <= nodeHi[1]; j++)
+			for (int k = nodeLo[2]; k <= nodeHi[2]; k++)
+				if (!surface.sampled(i, j, k)) trend.push_back(i*(nY+1)*(nZ+1) + j*(nZ+1) + k);
+
+	for (int bx = from[0]; bx <= to[0]; bx++)
+		for (int by = from[1]; by <= to[1]; by++)
+			for (int bz = from[2]; bz <= to[2]; bz++)
+				surface.active[(bx*surface.countY + by)*surface.countZ + bz] = 1;
+
+	for (int n : trend) {
+		int i = n / ((nY+1)*(nZ+1)), j = (n / (nZ+1)) % (nY+1), k = n % (nZ+1);
+		if (surface.sampled(i, j, k)) mcPoints[n].w = density.at(vec3(mcPoints[n]));
+	}
+}
+
+bool Terrain::sculpt(vec3 centre, float radius, float amount) {
+	//the blocks are remeshed with marching cubes, which would not meet the
+	//rest of a mesh made another way
+	if (!mcPoints || adaptive || mesher != Mesher::MarchingCubes) return false;
+	const vec3 base = minBound;
+	const vec3 step = cellSize();
+	const int cells[3] = { nX, nY, nZ };
+
+	// grid nodes the brush reaches
+	int lo[3], hi[3];
+	for (int a = 0; a < 3; a++) {
+		lo[a] = max(0, int(ceil((centre[a] - radius - base[a]) / step[a])));
+		hi[a] = min(cells[a], int(floor((centre[a] + radius - base[a]) / step[a])));
+		if (lo[a] > hi[a]) return true;
+	}
+	// cells whose mesh can change, normals come from gradients one node
+	// further out than the nodes themselves
+	int cellLo[3], cellHi[3];
+	for (int a = 0; a < 3; a++) {
+		cellLo[a] = max(0, lo[a] - 2);
+		cellHi[a] = min(cells[a], hi[a] + 2);
+	}
+	if (skipBlocks()) wakeBlocks(cellLo, cellHi);
+
+	for (int i = lo[0]; i <= hi[0]; i++) {
+		for (int j = lo[1]; j <= hi[1]; j++) {
+			for (int k = lo[2]; k <= hi[2]; k++) {
+				vec4 &p = mcPoints[i*(nY+1)*(nZ+1) + j*(nZ+1) + k];
+				float d = length(vec3(p) - centre) / radius;
+				if (d < 1) p.w += amount * (1 - d*d) * (1 - d*d);
+			}
+		}
+	}
+
+	if (sculpted) {
+		sculpted->remesh(cellLo, cellHi, mcPoints, skipBlocks());
+	} else {
+		// the first stroke swaps the single mesh for blocks
+		sculpted = new SculptMesh(nX, nY, nZ, minValue, mcPoints, skipBlocks(), 16, &ThreadPool::global());
+		delete g_geometry;
+		g_geometry = nullptr;
+	}
+	return true;
 }
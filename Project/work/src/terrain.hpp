@@ -7,6 +7,7 @@
 #pragma once
 
 #include <cmath>
+#include <future>
 #include <iostream>
 #include <string>
 #include <vector>
@@ -14,15 +15,53 @@
 #include "comp308.hpp"
 #include "geometry.hpp"
 #include "marchingCubes.hpp"
-#include "perlin.hpp"
+#include "density.hpp"
+#include "dualContouring.hpp"
+#include "octreeMesher.hpp"
+#include "sculptMesh.hpp"
+#include "surfaceNets.hpp"
 
-//boundary values for Marching Cubes
-#define MINX -200.0
-#define MAXX 200.0
-#define MINY -200.0
-#define MAXY 200.0
-#define MINZ -200.0
-#define MAXZ 200.0
+// How the density grid is made into triangles
+enum class Mesher {
+	MarchingCubes,
+	DualContouring,		//one vertex a cell, keeps ridges sharp with fewer triangles
+	SurfaceNets,		//quick preview, a little smoother than marching cubes and faster
+};
+
+// The mesher named marching, dual or nets, throws for any other name
+Mesher mesherNamed(const std::string &);
+
+struct TerrainSettings {
+	//number of cells on each axis
+	int nX = 40;
+	int nY = 40;
+	int nZ = 40;
+	//corners of the box the grid spans. The walls of the density function
+	//stay where they are, a box past them only adds rock
+	comp308::vec3 minBound = comp308::vec3(-200);
+	comp308::vec3 maxBound = comp308::vec3(200);
+	//threads used for generation, 0 for one per core
+	unsigned threads = 0;
+	//cells along a side of the blocks checked for surface before sampling,
+	//0 samples every node
+	int skipBlockCells = 4;
+	//seed and noise layers of the density function
+	DensitySettings density;
+	//simplify the mesh by collapsing edges while the error stays under this
+	//many world units, 0 keeps every triangle. Not for adaptive meshes
+	float simplifyError = 0.0f;
+	//directory of baked meshes, empty for none. Only used with a fixed
+	//seed, a seed from the clock never makes the same terrain twice
+	std::string meshCache;
+	//mesh with an octree refined towards viewpoint instead of the uniform
+	//grid, and remesh as the camera moves (see update)
+	bool adaptive = false;
+	OctreeSettings octree;
+	comp308::vec3 viewpoint = comp308::vec3(0, 0, 170);
+	//mesher for the uniform grid. Only marching cubes terrains can be
+	//sculpted
+	Mesher mesher = Mesher::MarchingCubes;
+};
 
 class Terrain {
 private:
@@ -33,18 +72,91 @@ private:
 	int nX = 40;
 	int nY = 40;
 	int nZ = 40;
+	//box the grid spans
+	comp308::vec3 minBound = comp308::vec3(-200);
+	comp308::vec3 maxBound = comp308::vec3(200);
+	//density function, seeded once and shared by every sample
+	DensityField density;
 	//data points passed to Marching Cubes
-	comp308::vec4 * mcPoints;
-	//data returned by Marching Cubes
-	TRIANGLE * Triangles;
-	int numOfTriangles;
+	comp308::vec4 * mcPoints = nullptr;
+	//blocks of the grid that can hold surface, empty when every node is sampled
+	SurfaceBlocks surface;
+	//the mesh in blocks that are remeshed on their own, made by the first sculpt
+	SculptMesh *sculpted = nullptr;
+	bool cached = false;
+	float simplifyError = 0.0f;
+	Mesher mesher = Mesher::MarchingCubes;
+	//adaptive meshing, and the remesh running in the background if any
+	bool adaptive = false;
+	OctreeSettings octree;
+	comp308::vec3 meshViewpoint;
+	std::future<OctreeMesh> remesh;
 
-	float calculateDensity(vec4);
+	comp308::vec3 cellSize() const {
+		return comp308::vec3((maxBound.x-minBound.x)/nX, (maxBound.y-minBound.y)/nY, (maxBound.z-minBound.z)/nZ);
+	}
+	void sampleDensity(unsigned threads);
+	const SurfaceBlocks * skipBlocks() const { return surface.active.empty() ? nullptr : &surface; }
+	void wakeBlocks(const int cellLo[3], const int cellHi[3]);
+	float gridDensity(comp308::vec3) const;
+	void buildMesh(MCMesh &);
+	void uploadOctree(const OctreeMesh &);
+	bool loadMeshCache(const std::string &directory, unsigned long long key);
+	void saveMeshCache(const std::string &directory, unsigned long long key, const std::vector<unsigned int> &indices);
 	void saveObj();
 
 public:
 	Terrain();
-	Terrain(std::string);
+	// buildMesh false only fills the density grid, no OpenGL needed
+	Terrain(const TerrainSettings &, bool buildMesh = true);
+	// From an OBJ file, simplified as TerrainSettings::simplifyError if given
+	Terrain(std::string, float simplifyError = 0.0f);
+	Terrain(const Terrain &) = delete;
+	Terrain & operator=(const Terrain &) = delete;
+	~Terrain();
 
+	// Once a frame with the camera position. An adaptive terrain starts a
+	// remesh in the background once the camera has moved far enough, and
+	// swaps to it when it is done; otherwise does nothing.
+	void update(comp308::vec3 camera);
 	void renderTerrain();
-};
\ No newline at end of file
+
+	// Where a ray from origin first goes into rock, found on the density
+	// grid. False if it never does or there is no grid.
+	bool raycast(comp308::vec3 origin, comp308::vec3 direction, comp308::vec3 &hit) const;
+	// Adds amount to the density around centre, falling smoothly to nothing
+	// at radius: more than zero fills, less carves. Only the cells it reaches
+	// are meshed again and only their part of the buffers is uploaded. False
+	// for a terrain that cannot be sculpted: loaded from a file, adaptive or
+	// meshed other than by marching cubes.
+	bool sculpt(comp308::vec3 centre, float radius, float amount);
+	// The blocked mesh once sculpted, else nullptr
+	const SculptMesh * getSculptMesh() const { return sculpted; }
+
+	// Density grid passed to Marching Cubes, nullptr when loaded from a file.
+	// Points are ordered x, then y, then z with getCells()+1 points per axis.
+	const comp308::vec4 * getGridPoints() const { return mcPoints; }
+	int getCellsX() const { return nX; }
+	int getCellsY() const { return nY; }
+	int getCellsZ() const { return nZ; }
+	comp308::vec3 getMinBound() const { return minBound; }
+	comp308::vec3 getMaxBound() const { return maxBound; }
+	float getIsoValue() const { return minValue; }
+	// true when the mesh and grid were read from the mesh cache
+	bool fromCache() const { return cached; }
+	const DensityField & getDensity() const { return density; }
+	// Blocks of the grid that were sampled, empty when all were
+	const SurfaceBlocks & getSurfaceBlocks() const { return surface; }
+};
+
+// Throws if settings cannot make a terrain: fewer than one cell on an axis
+// or bounds with nothing between them
+void checkTerrainSettings(const TerrainSettings &);
+
+// Reads settings from a file of "name values" lines, # starts a comment:
+//   cells 64 | cells 64 32 64, min -200 -200 -200, max 200 200 200,
+//   seed 7, skip 4, threads 2, simplify 0.5, cache <directory>, adaptive 1,
+//   density <expression file>, noise perlin | simplex, mesher marching | dual | nets
+// Names not in the file keep the values settings had. Throws if the file
+// cannot be read or has a line it does not understand.
+void readTerrainSettings(const std::string &filename, TerrainSettings &settings);
\ No newline at end of file
@@ -0,0 +1,113 @@
+//---------------------------------------------------------------------------
+//
+// Fixed size worker thread pool
+//
+//----------------------------------------------------------------------------
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "threadPool.hpp"
+
+using namespace std;
+
+ThreadPool::ThreadPool(unsigned threads) {
+	if (threads == 0) threads = max(1u, thread::hardware_concurrency());
+	for (unsigned i = 1; i < threads; ++i) {
+		m_workers.emplace_back(&ThreadPool::workerLoop, this);
+	}
+}
+
+ThreadPool::~ThreadPool() {
+	{
+		lock_guard<mutex> lock(m_mutex);
+		m_stopping = true;
+	}
+	m_wake.notify_all();
+	for (thread &t : m_workers) t.join();
+}
+
+void ThreadPool::workerLoop() {
+	while (true) {
+		function<void()> task;
+		{
+			unique_lock<mutex> lock(m_mutex);
+			m_wake.wait(lock, [this] { return m_stopping || !m_tasks.empty(); });
+			if (m_tasks.empty()) return; // stopping and nothing left to do
+			task = move(m_tasks.front());
+			m_tasks.pop_front();
+		}
+		task();
+	}
+}
+
+void ThreadPool::submit(function<void()> task) {
+	if (m_workers.empty()) {
+		task();
+		return;
+	}
+	{
+		lock_guard<mutex> lock(m_mutex);
+		m_tasks.push_back(move(task));
+	}
+	m_wake.notify_one();
+}
+
+void ThreadPool::parallelFor(int count, const function<void(int)> &fn) {
+	if (count <= 0) return;
+
+	// Helpers may still be sitting in the queue after the loop is over (for
+	// example when a worker is the one calling parallelFor), so the shared
+	// state outlives this call and a late helper never touches fn.
+	struct loopState {
+		atomic<int> next{0};
+		int running = 0;
+		const function<void(int)> *fn = nullptr;
+		int count = 0;
+		mutex m;
+		condition_variable done;
+	};
+	shared_ptr<loopState> state = make_shared<loopState>();
+	state->fn = &fn;
+	state->count = count;
+
+	auto work = [](loopState &s) {
+		for (int i = s.next++; i < s.count; i = s.next++) {
+			(*s.fn)(i);
+		}
+	};
+
+	int helpers = min(int(m_workers.size()), count - 1);
+	for (int h = 0; h < helpers; ++h) {
+		submit([state, work] {
+			{
+				lock_guard<mutex> lock(state->m);
+				if (state->next >= state->count) return;
+				state->running++;
+			}
+			work(*state);
+			{
+				lock_guard<mutex> lock(state->m);
+				state->running--;
+			}
+			state->done.notify_all();
+		});
+	}
+
+	work(*state);
+
+	// Every index has been claimed, wait for helpers still running theirs
+	unique_lock<mutex> lock(state->m);
+	state->done.wait(lock, [&] { return state->running == 0; });
+}
+
+ThreadPool & ThreadPool::global() {
+	static ThreadPool pool;
+	return pool;
+}
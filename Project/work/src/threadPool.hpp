@@ -0,0 +1,50 @@
+//---------------------------------------------------------------------------
+//
+// Fixed size worker thread pool
+//
+// Used for the CPU heavy batch work (school parameter sweeps, terrain
+// generation). The calling thread always takes part in parallelFor so a
+// pool with zero workers still runs everything, just serially.
+//
+//----------------------------------------------------------------------------
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class ThreadPool {
+private:
+	std::vector<std::thread> m_workers;
+	std::deque<std::function<void()>> m_tasks;
+	std::mutex m_mutex;
+	std::condition_variable m_wake;
+	bool m_stopping = false;
+
+	void workerLoop();
+
+public:
+	// threads is the total number of threads that work on a parallelFor,
+	// including the caller. 0 means one per hardware thread.
+	explicit ThreadPool(unsigned threads = 0);
+	ThreadPool(const ThreadPool &) = delete;
+	ThreadPool & operator=(const ThreadPool &) = delete;
+	~ThreadPool();
+
+	unsigned size() const { return unsigned(m_workers.size()) + 1; }
+
+	// Queues a task for a worker thread and returns straight away
+	void submit(std::function<void()>);
+
+	// Calls fn(i) for every i in [0, count), handing out indices one at a
+	// time, and returns once all of them have finished
+	void parallelFor(int count, const std::function<void(int)> &fn);
+
+	// Shared pool sized to the machine
+	static ThreadPool & global();
+};